@@ -0,0 +1,102 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Projection.h"
+#include "Tiles.h"
+
+// ========================================================
+// Variance-driven adaptive sampling by tile. Two cheap
+//  passes estimate the per-sample luminance variance of
+//  every tile; tiles whose predicted error exceeds the
+//  target are re-rendered on their own through a
+//  sub-frustum (the tile's share of the off-axis
+//  imageRegion) and blended into the image weighted by
+//  sample count. Flat background tiles keep the samples of
+//  the initial passes.
+// ========================================================
+
+static float luminance(const float *rgb)
+{
+  return 0.2126f * rgb[0] + 0.7152f * rgb[1] + 0.0722f * rgb[2];
+}
+
+// imageRegion of one tile; the camera's other parameters stay the same,
+// and a frame of the tile's size renders exactly the tile's pixels
+static float4 tileImageRegion(
+    float4 region, const TileGrid &grid, uint32_t tile)
+{
+  uint32_t x0, y0, x1, y1;
+  grid.tileBounds(tile, x0, y0, x1, y1);
+  const float sx = (region.z - region.x) / grid.width;
+  const float sy = (region.w - region.y) / grid.height;
+  return float4(region.x + x0 * sx,
+      region.y + y0 * sy,
+      region.x + x1 * sx,
+      region.y + y1 * sy);
+}
+
+// Per-sample luminance variance of each tile from two independent RGBA
+// passes of 'spp' samples each: E[(a - b)^2] = 2 * variance / spp
+static void estimateTileVariance(const TileGrid &grid,
+    const float *a,
+    const float *b,
+    int spp,
+    std::vector<float> &variance)
+{
+  variance.resize(grid.numTiles());
+  parallelFor(grid.numTiles(), [&](size_t begin, size_t end) {
+    for (size_t tile = begin; tile < end; tile++) {
+      uint32_t x0, y0, x1, y1;
+      grid.tileBounds(uint32_t(tile), x0, y0, x1, y1);
+      double sum = 0.0;
+      for (uint32_t y = y0; y < y1; y++) {
+        const size_t row = size_t(y) * grid.width;
+        for (uint32_t x = x0; x < x1; x++) {
+          const float d = luminance(a + 4 * (row + x))
+              - luminance(b + 4 * (row + x));
+          sum += d * d;
+        }
+      }
+      const size_t n = size_t(x1 - x0) * (y1 - y0);
+      variance[tile] = n ? float(0.5 * spp * sum / n) : 0.f;
+    }
+  });
+}
+
+// Samples per pixel a tile needs so that its predicted RMSE,
+// sqrt(variance / n), drops to 'targetError'
+static int requiredSamples(float variance, float targetError)
+{
+  const float target2 = std::max(targetError * targetError, 1e-12f);
+  return int(std::min(std::ceil(variance / target2), 1e6f));
+}
+
+// Blend a tile-sized RGBA image of 'spp' samples into the full image,
+// where the tile already holds 'samples' samples per pixel
+static void accumulateTile(const TileGrid &grid,
+    uint32_t tile,
+    const float *tileColor,
+    float samples,
+    int spp,
+    float *color)
+{
+  uint32_t x0, y0, x1, y1;
+  grid.tileBounds(tile, x0, y0, x1, y1);
+  const float w = float(spp) / (samples + spp);
+  const uint32_t tileWidth = x1 - x0;
+  for (uint32_t y = y0; y < y1; y++) {
+    float *dst = color + 4 * (size_t(y) * grid.width + x0);
+    const float *src = tileColor + 4 * size_t(y - y0) * tileWidth;
+    for (uint32_t i = 0; i < 4 * tileWidth; i++)
+      dst[i] += w * (src[i] - dst[i]);
+  }
+}
@@ -0,0 +1,161 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// ========================================================
+// Small byte-oriented LZ77 codec in the spirit of LZ4: a
+//  stream of sequences, each a token byte (literal count
+//  << 4 | match length - 4), the literals, a 16-bit match
+//  offset and optional length extensions. The last
+//  sequence has literals only. Favors speed over ratio.
+// ========================================================
+
+static constexpr size_t lzMinMatch = 4;
+static constexpr size_t lzMaxOffset = 65535;
+
+// Upper bound of the compressed size of n bytes
+static size_t lzCompressBound(size_t n)
+{
+  return n + n / 255 + 16;
+}
+
+static uint32_t lzRead32(const uint8_t *p)
+{
+  uint32_t v;
+  std::memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static uint32_t lzHash(uint32_t v)
+{
+  return (v * 2654435761u) >> 20; // 12 bits
+}
+
+static uint8_t *lzWriteLength(uint8_t *op, size_t len)
+{
+  for (; len >= 255; len -= 255)
+    *op++ = 255;
+  *op++ = uint8_t(len);
+  return op;
+}
+
+static uint8_t *lzWriteSequence(uint8_t *op,
+    const uint8_t *literals,
+    size_t numLiterals,
+    size_t offset,
+    size_t matchLength)
+{
+  const size_t ml = matchLength ? matchLength - lzMinMatch : 0;
+  uint8_t *token = op++;
+  *token = uint8_t((numLiterals < 15 ? numLiterals : 15) << 4);
+  if (numLiterals >= 15)
+    op = lzWriteLength(op, numLiterals - 15);
+  std::memcpy(op, literals, numLiterals);
+  op += numLiterals;
+
+  if (matchLength) {
+    *op++ = uint8_t(offset & 0xff);
+    *op++ = uint8_t(offset >> 8);
+    *token |= uint8_t(ml < 15 ? ml : 15);
+    if (ml >= 15)
+      op = lzWriteLength(op, ml - 15);
+  }
+  return op;
+}
+
+// Compress n bytes from src into dst (at least lzCompressBound(n) bytes),
+// returns the compressed size
+static size_t lzCompress(const uint8_t *src, size_t n, uint8_t *dst)
+{
+  uint32_t table[1 << 12] = {};
+  uint8_t *op = dst;
+
+  // Leave a few literals at the end so matches never run past the input
+  const size_t matchLimit = n > 12 ? n - 5 : 0;
+
+  size_t ip = 0, anchor = 0;
+  while (ip + lzMinMatch <= matchLimit) {
+    const uint32_t h = lzHash(lzRead32(src + ip));
+    const size_t ref = table[h];
+    table[h] = uint32_t(ip);
+
+    if (ref < ip && ip - ref <= lzMaxOffset
+        && lzRead32(src + ref) == lzRead32(src + ip)) {
+      size_t len = lzMinMatch;
+      while (ip + len < matchLimit && src[ref + len] == src[ip + len])
+        len++;
+      op = lzWriteSequence(op, src + anchor, ip - anchor, ip - ref, len);
+      ip += len;
+      anchor = ip;
+    } else {
+      // Skip faster through incompressible data
+      ip += 1 + ((ip - anchor) >> 6);
+    }
+  }
+
+  op = lzWriteSequence(op, src + anchor, n - anchor, 0, 0);
+  return size_t(op - dst);
+}
+
+static bool lzReadLength(
+    const uint8_t *src, size_t n, size_t &ip, size_t &len)
+{
+  uint8_t b;
+  do {
+    if (ip >= n)
+      return false;
+    b = src[ip++];
+    len += b;
+  } while (b == 255);
+  return true;
+}
+
+// Decompress n bytes from src into dst of capacity dstSize, returns the
+// decompressed size or 0 on malformed input
+static size_t lzDecompress(
+    const uint8_t *src, size_t n, uint8_t *dst, size_t dstSize)
+{
+  size_t ip = 0, op = 0;
+  while (ip < n) {
+    const uint8_t token = src[ip++];
+
+    size_t numLiterals = token >> 4;
+    if (numLiterals == 15 && !lzReadLength(src, n, ip, numLiterals))
+      return 0;
+    if (numLiterals > n - ip || numLiterals > dstSize - op)
+      return 0;
+    std::memcpy(dst + op, src + ip, numLiterals);
+    ip += numLiterals;
+    op += numLiterals;
+
+    if (ip == n)
+      break; // last sequence
+
+    if (n - ip < 2)
+      return 0;
+    const size_t offset = src[ip] | (size_t(src[ip + 1]) << 8);
+    ip += 2;
+    if (offset == 0 || offset > op)
+      return 0;
+
+    size_t len = token & 15;
+    if (len == 15 && !lzReadLength(src, n, ip, len))
+      return 0;
+    len += lzMinMatch;
+    if (len > dstSize - op)
+      return 0;
+
+    // Byte copy: source and destination may overlap
+    const uint8_t *match = dst + op - offset;
+    for (size_t i = 0; i < len; i++)
+      dst[op + i] = match[i];
+    op += len;
+  }
+  return op;
+}
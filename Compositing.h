@@ -0,0 +1,185 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Simd.h"
+
+// ========================================================
+// Sort-last depth compositing of RGBA8 color + float depth
+//  layers. The inner loop is a per-pixel select, with
+//  explicit SSE2 and AVX2 versions (Simd.h).
+// ========================================================
+
+struct DepthLayer
+{
+  uint32_t *color{nullptr};
+  float *depth{nullptr};
+};
+
+#ifdef OFFAXIS_HOST_X86
+// SIMD versions of depthCompositeRange; return where the scalar remainder
+// starts. Ordered compares, so NaN depths keep dst like the scalar loop.
+static size_t depthCompositeSSE2(uint32_t *dstColor,
+    float *dstDepth,
+    const uint32_t *srcColor,
+    const float *srcDepth,
+    size_t begin,
+    size_t end)
+{
+  size_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    const __m128 sd = _mm_loadu_ps(srcDepth + i);
+    const __m128 dd = _mm_loadu_ps(dstDepth + i);
+    const __m128 nearer = _mm_cmplt_ps(sd, dd);
+    const __m128i mask = _mm_castps_si128(nearer);
+    const __m128i sc = _mm_loadu_si128((const __m128i *)(srcColor + i));
+    const __m128i dc = _mm_loadu_si128((const __m128i *)(dstColor + i));
+    _mm_storeu_si128((__m128i *)(dstColor + i),
+        _mm_or_si128(_mm_and_si128(mask, sc), _mm_andnot_si128(mask, dc)));
+    _mm_storeu_ps(dstDepth + i,
+        _mm_or_ps(_mm_and_ps(nearer, sd), _mm_andnot_ps(nearer, dd)));
+  }
+  return i;
+}
+
+OFFAXIS_TARGET_AVX2 static size_t depthCompositeAVX2(uint32_t *dstColor,
+    float *dstDepth,
+    const uint32_t *srcColor,
+    const float *srcDepth,
+    size_t begin,
+    size_t end)
+{
+  size_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    const __m256 sd = _mm256_loadu_ps(srcDepth + i);
+    const __m256 dd = _mm256_loadu_ps(dstDepth + i);
+    const __m256 nearer = _mm256_cmp_ps(sd, dd, _CMP_LT_OQ);
+    const __m256i sc = _mm256_loadu_si256((const __m256i *)(srcColor + i));
+    const __m256i dc = _mm256_loadu_si256((const __m256i *)(dstColor + i));
+    _mm256_storeu_si256((__m256i *)(dstColor + i),
+        _mm256_blendv_epi8(dc, sc, _mm256_castps_si256(nearer)));
+    _mm256_storeu_ps(dstDepth + i, _mm256_blendv_ps(dd, sd, nearer));
+  }
+  return i;
+}
+#endif
+
+// Composite src into dst over the pixel range [begin, end), keeping the
+// fragment closer to the camera (ties keep dst)
+static void depthCompositeRange(uint32_t *__restrict dstColor,
+    float *__restrict dstDepth,
+    const uint32_t *__restrict srcColor,
+    const float *__restrict srcDepth,
+    size_t begin,
+    size_t end)
+{
+  size_t i = begin;
+#ifdef OFFAXIS_HOST_X86
+  if (hostIsa() == HostIsa::AVX2)
+    i = depthCompositeAVX2(dstColor, dstDepth, srcColor, srcDepth, i, end);
+  else if (hostIsa() == HostIsa::SSE2)
+    i = depthCompositeSSE2(dstColor, dstDepth, srcColor, srcDepth, i, end);
+#endif
+  for (; i < end; i++) {
+    const bool nearer = srcDepth[i] < dstDepth[i];
+    dstColor[i] = nearer ? srcColor[i] : dstColor[i];
+    dstDepth[i] = nearer ? srcDepth[i] : dstDepth[i];
+  }
+}
+
+// Composite all layers into 'out', parallel over pixel blocks; blocks are
+// small enough that all layers' slices of a block stay in cache
+static void depthCompositeLayers(const std::vector<DepthLayer> &layers,
+    DepthLayer out,
+    size_t numPixels)
+{
+  if (layers.empty())
+    return;
+
+  const size_t blockSize = 4096;
+  const size_t numBlocks = (numPixels + blockSize - 1) / blockSize;
+
+  parallelFor(numBlocks, [&](size_t firstBlock, size_t lastBlock) {
+    for (size_t b = firstBlock; b < lastBlock; b++) {
+      const size_t begin = b * blockSize;
+      const size_t end = std::min(numPixels, begin + blockSize);
+      std::copy(layers[0].color + begin,
+          layers[0].color + end,
+          out.color + begin);
+      std::copy(layers[0].depth + begin,
+          layers[0].depth + end,
+          out.depth + begin);
+      for (size_t l = 1; l < layers.size(); l++) {
+        depthCompositeRange(out.color,
+            out.depth,
+            layers[l].color,
+            layers[l].depth,
+            begin,
+            end);
+      }
+    }
+  });
+}
+
+// ========================================================
+// Binary-swap schedule: P = 2^k ranks each start with a
+//  full layer; in round r, rank i pairs with i ^ (1 << r),
+//  keeps one half of the range both currently share and
+//  composites the partner's copy of that half into its
+//  own. After k rounds each rank owns 1/P of the final
+//  image. Ranks beyond the largest power of two are folded
+//  into rank - P first.
+// ========================================================
+
+static int binarySwapNumRanks(int numWorkers)
+{
+  int p = 1;
+  while (p * 2 <= numWorkers)
+    p *= 2;
+  return p;
+}
+
+static int binarySwapNumRounds(int numWorkers)
+{
+  int rounds = 0;
+  for (int p = binarySwapNumRanks(numWorkers); p > 1; p /= 2)
+    rounds++;
+  return rounds;
+}
+
+// Pixel range owned by 'rank' after the first 'rounds' rounds
+static void binarySwapRange(
+    int rank, int rounds, size_t numPixels, size_t &begin, size_t &end)
+{
+  begin = 0;
+  end = numPixels;
+  for (int r = 0; r < rounds; r++) {
+    const size_t mid = begin + (end - begin) / 2;
+    if (rank & (1 << r))
+      begin = mid;
+    else
+      end = mid;
+  }
+}
+
+// Round 'round' of binary swap, executed by 'rank' on shared layers
+static void binarySwapRound(const std::vector<DepthLayer> &layers,
+    int rank,
+    int round,
+    size_t numPixels)
+{
+  size_t begin, end;
+  binarySwapRange(rank, round + 1, numPixels, begin, end);
+  const DepthLayer &mine = layers[rank];
+  const DepthLayer &partner = layers[rank ^ (1 << round)];
+  depthCompositeRange(
+      mine.color, mine.depth, partner.color, partner.depth, begin, end);
+}
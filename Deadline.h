@@ -0,0 +1,183 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <thread>
+#include <vector>
+// ours
+#include "Timing.h"
+
+// ========================================================
+// Frame deadlines. Instead of blocking in anari::wait, the
+//  frame is polled with ANARI_NO_WAIT until it is ready or
+//  the deadline passed. A late frame is discarded
+//  (anariDiscardFrame), and then either re-rendered at a
+//  lower sample count or replaced by the previous image.
+// ========================================================
+
+enum class DeadlinePolicy
+{
+  Wait, // no deadline: block until the frame is ready
+  PreviousImage, // discard, show the last image that was ready in time
+  LowerQuality, // discard, re-render with fewer samples per pixel
+};
+
+static const char *deadlinePolicyName(DeadlinePolicy p)
+{
+  switch (p) {
+  case DeadlinePolicy::Wait:
+    return "wait";
+  case DeadlinePolicy::PreviousImage:
+    return "previous";
+  case DeadlinePolicy::LowerQuality:
+    return "lower";
+  default:
+    return "<invalid>";
+  }
+}
+
+static bool parseDeadlinePolicy(const char *name, DeadlinePolicy &p)
+{
+  for (int i = 0; i <= int(DeadlinePolicy::LowerQuality); i++) {
+    if (!std::strcmp(name, deadlinePolicyName(DeadlinePolicy(i)))) {
+      p = DeadlinePolicy(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Polls until the frame is ready or 'timer' passed deadlineMs; returns
+// whether the frame is ready
+static bool pollFrameUntil(anari::Device device,
+    anari::Frame frame,
+    const Timer &timer,
+    double deadlineMs,
+    double pollIntervalMs = 0.2)
+{
+  const auto interval = std::chrono::duration<double, std::milli>(
+      pollIntervalMs);
+  while (!anari::isReady(device, frame)) {
+    if (timer.elapsedMs() >= deadlineMs)
+      return false;
+    std::this_thread::sleep_for(interval);
+  }
+  return true;
+}
+
+// Asks the device to stop and waits until the frame can be reused;
+// returns how long that took
+static double discardFrame(anari::Device device, anari::Frame frame)
+{
+  Timer timer;
+  anari::discard(device, frame);
+  anari::wait(device, frame);
+  return timer.elapsedMs();
+}
+
+struct DeadlineFrame
+{
+  bool missed{false}; // not ready at the deadline
+  bool stale{false}; // the previous image was shown instead
+  double discardMs{0.0}; // anariDiscardFrame until the frame was idle
+  double presentMs{0.0}; // render start until an image was available
+  uint32_t level{0}; // quality level of the image shown
+};
+
+struct DeadlineRenderer
+{
+  anari::Device device{nullptr};
+  anari::Frame frame{nullptr};
+  anari::Renderer renderer{nullptr};
+  DeadlinePolicy policy{DeadlinePolicy::Wait};
+  double deadlineMs{16.0};
+
+  // Samples per pixel per quality level, best first
+  std::vector<int> levels = {32, 16, 8, 4, 1};
+  // In-time frames in a row before trying the next better level
+  int recoverAfter{10};
+
+  uint32_t level{0};
+  int inTime{0};
+  std::vector<uint32_t> image; // last image shown
+
+  void setLevel(uint32_t l)
+  {
+    level = l;
+    anari::setParameter(device, renderer, "pixelSamples", levels[l]);
+    anari::commitParameters(device, renderer);
+  }
+
+  // Renders the frame as currently set up, with the camera already
+  // committed; 'image' holds the result
+  DeadlineFrame renderFrame()
+  {
+    DeadlineFrame f;
+    Timer timer;
+    anari::render(device, frame);
+
+    bool ready = true;
+    if (policy == DeadlinePolicy::Wait) {
+      anari::wait(device, frame);
+      f.missed = timer.elapsedMs() > deadlineMs;
+    } else {
+      ready = pollFrameUntil(device, frame, timer, deadlineMs);
+      f.missed = !ready;
+    }
+    const double renderMs = timer.elapsedMs();
+
+    if (!ready) {
+      f.discardMs = discardFrame(device, frame);
+      if (policy == DeadlinePolicy::LowerQuality
+          && level + 1 < levels.size()) {
+        setLevel(level + 1);
+      }
+      if (policy == DeadlinePolicy::LowerQuality || image.empty()) {
+        // Nothing to fall back to: the re-issued frame is shown late
+        anari::render(device, frame);
+        anari::wait(device, frame);
+        ready = true;
+      } else
+        f.stale = true;
+    }
+
+    if (ready && !readImage())
+      f.stale = true;
+    f.presentMs = timer.elapsedMs();
+    f.level = level;
+
+    // Step back up after a run of frames that would also have made the
+    // deadline with the next better level's sample count
+    if (f.missed)
+      inTime = 0;
+    else if (policy == DeadlinePolicy::LowerQuality && level > 0) {
+      const double estimate =
+          renderMs * levels[level - 1] / double(levels[level]);
+      inTime = estimate < 0.9 * deadlineMs ? inTime + 1 : 0;
+      if (inTime >= recoverAfter) {
+        setLevel(level - 1);
+        inTime = 0;
+      }
+    }
+
+    return f;
+  }
+
+  // Keeps the previous image if the color channel can't be mapped
+  bool readImage()
+  {
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    const bool mapped = fb.data != nullptr;
+    if (mapped)
+      image.assign(fb.data, fb.data + size_t(fb.width) * fb.height);
+    anari::unmap(device, frame, "channel.color");
+    return mapped;
+  }
+};
@@ -0,0 +1,144 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+// ours
+#include "Parallel.h"
+
+// ========================================================
+// Edge-avoiding à-trous wavelet denoiser (Dammertz et al.
+//  2010) for RGBA float images. Each pass applies a 5x5
+//  B3-spline kernel with holes of 2^i pixels; weights are
+//  attenuated by color, depth, normal and albedo
+//  differences. Guides are optional: pass nullptr for the
+//  ones the device does not provide.
+// ========================================================
+
+struct DenoiseGuides
+{
+  const float *depth{nullptr}; // 1 float per pixel, inf for background
+  const float *normal{nullptr}; // 3 floats per pixel
+  const float *albedo{nullptr}; // 3 floats per pixel
+};
+
+// Pass k filters with a step of 2^k pixels; wider steps than 2^9 span
+// most of a display-sized image and only blur
+static const int maxDenoisePasses = 10;
+
+struct DenoiseParams
+{
+  int numPasses{5}; // at most maxDenoisePasses
+  float sigmaColor{0.6f}; // halved every pass
+  float sigmaDepth{0.05f}; // relative depth difference, per step
+  float normalPower{32.f};
+  float sigmaAlbedo{0.1f};
+};
+
+static void atrousPass(const DenoiseParams &params,
+    const DenoiseGuides &guides,
+    const float *in,
+    float *out,
+    uint32_t width,
+    uint32_t height,
+    int pass)
+{
+  static const float kernel[5] = {
+      1.f / 16.f, 1.f / 4.f, 3.f / 8.f, 1.f / 4.f, 1.f / 16.f};
+  const int step = 1 << pass;
+  const float sigmaColor = params.sigmaColor / float(1 << pass);
+  const float invColor = 1.f / (sigmaColor * sigmaColor);
+  const float invAlbedo = 1.f / (params.sigmaAlbedo * params.sigmaAlbedo);
+
+  parallelForRows(height, [&](unsigned y) {
+    for (uint32_t x = 0; x < width; x++) {
+      const size_t p = size_t(y) * width + x;
+      const float *cp = in + 4 * p;
+      const float zp = guides.depth ? guides.depth[p] : 0.f;
+
+      float sum[4] = {0.f, 0.f, 0.f, 0.f};
+      float wsum = 0.f;
+
+      for (int j = -2; j <= 2; j++) {
+        const int qy =
+            std::min(std::max(int(y) + j * step, 0), int(height) - 1);
+        for (int i = -2; i <= 2; i++) {
+          const int qx =
+              std::min(std::max(int(x) + i * step, 0), int(width) - 1);
+          const size_t q = size_t(qy) * width + qx;
+          const float *cq = in + 4 * q;
+
+          float w = kernel[i + 2] * kernel[j + 2];
+
+          const float dr = cp[0] - cq[0];
+          const float dg = cp[1] - cq[1];
+          const float db = cp[2] - cq[2];
+          w *= std::exp(-(dr * dr + dg * dg + db * db) * invColor);
+
+          if (guides.depth && zp != guides.depth[q]) {
+            // Background (inf) next to geometry gets zero weight
+            const float dz = std::fabs(zp - guides.depth[q]);
+            const float scale =
+                params.sigmaDepth * step * std::max(std::fabs(zp), 1e-3f);
+            const float e = dz / scale;
+            w *= std::isfinite(e) ? std::exp(-e) : 0.f;
+          }
+          if (guides.normal) {
+            const float *np = guides.normal + 3 * p;
+            const float *nq = guides.normal + 3 * q;
+            const float d = np[0] * nq[0] + np[1] * nq[1] + np[2] * nq[2];
+            w *= std::pow(std::max(d, 0.f), params.normalPower);
+          }
+          if (guides.albedo) {
+            const float *ap = guides.albedo + 3 * p;
+            const float *aq = guides.albedo + 3 * q;
+            const float da0 = ap[0] - aq[0];
+            const float da1 = ap[1] - aq[1];
+            const float da2 = ap[2] - aq[2];
+            w *= std::exp(-(da0 * da0 + da1 * da1 + da2 * da2) * invAlbedo);
+          }
+
+          for (int c = 0; c < 4; c++)
+            sum[c] += w * cq[c];
+          wsum += w;
+        }
+      }
+
+      // The center tap always has weight > 0 unless normals degenerate
+      const float inv = wsum > 0.f ? 1.f / wsum : 0.f;
+      for (int c = 0; c < 4; c++)
+        out[4 * p + c] = wsum > 0.f ? sum[c] * inv : cp[c];
+    }
+  });
+}
+
+// Denoise an RGBA float image into 'out' (both width * height * 4 floats)
+static void denoise(const DenoiseParams &params,
+    const DenoiseGuides &guides,
+    const float *color,
+    float *out,
+    uint32_t width,
+    uint32_t height)
+{
+  const size_t n = size_t(width) * height * 4;
+  const int numPasses = std::min(params.numPasses, maxDenoisePasses);
+  if (numPasses <= 0) {
+    std::copy(color, color + n, out);
+    return;
+  }
+
+  std::vector<float> scratch(n);
+  const float *src = color;
+  for (int pass = 0; pass < numPasses; pass++) {
+    // Ping-pong so that the last pass writes to 'out'
+    const bool toOut = (numPasses - 1 - pass) % 2 == 0;
+    float *dst = toOut ? out : scratch.data();
+    atrousPass(params, guides, src, dst, width, height, pass);
+    src = dst;
+  }
+}
@@ -0,0 +1,157 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <list>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Projection.h"
+#include "TemporalAccumulation.h"
+
+// ========================================================
+// Cache of rendered images keyed by the quantized outputs
+//  of offaxisStereoCamera. Eye motion below the
+//  quantization steps maps to the same key, so the cached
+//  image is reused instead of rendering again. Entries are
+//  kept in LRU order so a viewer swaying between nearby
+//  positions keeps hitting.
+// ========================================================
+
+struct CameraQuantization
+{
+  float position{0.005f}; // eye position, world units
+  float angle{0.001f}; // fovy, radians
+  float region{0.002f}; // imageRegion, fraction of the image
+  float direction{0.001f}; // dir/up components
+};
+
+struct CameraKey
+{
+  int32_t q[15];
+
+  bool operator==(const CameraKey &other) const
+  {
+    return std::equal(q, q + 15, other.q);
+  }
+};
+
+static CameraKey quantizeCamera(const CameraQuantization &steps,
+    float3 eye,
+    float3 dir,
+    float3 up,
+    float fovy,
+    float aspect,
+    float4 imageRegion)
+{
+  auto quantize = [](float v, float step) {
+    return int32_t(std::floor(v / step + 0.5f));
+  };
+  CameraKey key;
+  key.q[0] = quantize(eye.x, steps.position);
+  key.q[1] = quantize(eye.y, steps.position);
+  key.q[2] = quantize(eye.z, steps.position);
+  key.q[3] = quantize(dir.x, steps.direction);
+  key.q[4] = quantize(dir.y, steps.direction);
+  key.q[5] = quantize(dir.z, steps.direction);
+  key.q[6] = quantize(up.x, steps.direction);
+  key.q[7] = quantize(up.y, steps.direction);
+  key.q[8] = quantize(up.z, steps.direction);
+  key.q[9] = quantize(fovy, steps.angle);
+  key.q[10] = quantize(std::log(aspect), steps.angle);
+  key.q[11] = quantize(imageRegion.x, steps.region);
+  key.q[12] = quantize(imageRegion.y, steps.region);
+  key.q[13] = quantize(imageRegion.z, steps.region);
+  key.q[14] = quantize(imageRegion.w, steps.region);
+  return key;
+}
+
+struct CachedFrame
+{
+  CameraKey key;
+  float3 eye;
+  mat4 proj, view; // for warping
+  std::vector<uint32_t> color;
+  std::vector<float> depth; // empty if not available
+};
+
+struct FrameCache
+{
+  explicit FrameCache(size_t capacity = 4)
+      : capacity(std::max<size_t>(1, capacity))
+  {}
+
+  // Entry for key, moved to the front; nullptr on a miss
+  const CachedFrame *find(const CameraKey &key)
+  {
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->key == key) {
+        entries.splice(entries.begin(), entries, it);
+        return &entries.front();
+      }
+    }
+    return nullptr;
+  }
+
+  // Slot for a new entry, recycling the least recently used one
+  CachedFrame &insert(const CameraKey &key)
+  {
+    if (entries.size() >= capacity)
+      entries.splice(entries.begin(), entries, std::prev(entries.end()));
+    else
+      entries.emplace_front();
+    entries.front().key = key;
+    return entries.front();
+  }
+
+  size_t capacity;
+  std::list<CachedFrame> entries;
+};
+
+// Cheap warp of a cached image to a nearby eye: each pixel of the new view
+// takes the cached depth at the same pixel as an estimate of its own depth,
+// is moved into the cached view with the cached matrices and takes the
+// nearest cached color there
+static void warpCachedFrame(const CachedFrame &cached,
+    uint2 size,
+    float3 eye,
+    mat4 proj,
+    mat4 view,
+    uint32_t *out)
+{
+  float3 corners[3];
+  farPlaneCorners(proj, view, corners);
+  const float3 dx = (corners[1] - corners[0]) / float(size.x);
+  const float3 dy = (corners[2] - corners[0]) / float(size.y);
+  const mat4 cachedViewProj = mul(cached.proj, cached.view);
+
+  parallelForRows(size.y, [&](unsigned y) {
+    for (uint32_t x = 0; x < size.x; x++) {
+      const size_t p = size_t(y) * size.x + x;
+      const float t = cached.depth[p];
+      const float3 far = corners[0] + dx * (x + 0.5f) + dy * (y + 0.5f);
+      const float3 dir = normalize(far - eye);
+      const float3 P = eye + dir * (std::isfinite(t) ? t : 1e3f);
+
+      // Points behind the cached eye would project mirrored; they keep
+      // the cached pixel unwarped
+      const float4 clip = mul(cachedViewProj, float4(P, 1.f));
+      if (!(clip.w > 1e-6f)) {
+        out[p] = cached.color[p];
+        continue;
+      }
+
+      // Clamp before converting, NaN goes to 0
+      const float qx = (clip.x / clip.w * 0.5f + 0.5f) * size.x;
+      const float qy = (clip.y / clip.w * 0.5f + 0.5f) * size.y;
+      const float cx = std::max(0.f, std::min(qx, float(size.x - 1)));
+      const float cy = std::max(0.f, std::min(qy, float(size.y - 1)));
+      out[p] = cached.color[size_t(cy) * size.x + uint32_t(cx)];
+    }
+  });
+}
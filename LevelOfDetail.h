@@ -0,0 +1,270 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+// ours
+#include "Projection.h"
+#include "Scene.h"
+
+// ========================================================
+// View-dependent level of detail for sphere clouds. An
+//  octree over the sphere centers stores, per node, a
+//  proxy sphere standing in for all spheres below it.
+//  Per frame, a cut through the tree is selected from the
+//  tracked eye: nodes outside the off-axis frustum are
+//  culled, nodes whose projection onto the screen is
+//  smaller than a few pixels are drawn as their proxy, and
+//  everything else is refined down to the original
+//  spheres.
+// ========================================================
+
+struct LodNode
+{
+  float3 center; // bounding sphere of the spheres below
+  float radius{0.f};
+  uint32_t begin{0}, end{0}; // range in LodTree::spheres
+  uint32_t firstChild{0}, numChildren{0}; // children are contiguous
+  // Proxy: volume preserving sphere at the centroid
+  float3 proxyPosition;
+  float proxyRadius{0.f};
+  float proxyAttribute{0.f};
+};
+
+struct LodTree
+{
+  SphereData spheres; // reordered so every node covers a range
+  std::vector<LodNode> nodes; // root first
+};
+
+struct LodParams
+{
+  float pixelThreshold{2.f}; // proxy below this projected diameter
+  bool cull{true};
+};
+
+struct LodStats
+{
+  size_t visitedNodes{0};
+  size_t culledNodes{0};
+  size_t proxies{0};
+  size_t spheres{0}; // original spheres in the cut
+};
+
+static void computeLodNode(const LodTree &tree, LodNode &node)
+{
+  const auto &P = tree.spheres.positions;
+  const float r = tree.spheres.radius;
+  const float n = float(node.end - node.begin);
+
+  float3 centroid(0.f, 0.f, 0.f);
+  float attribute = 0.f;
+  float3 lower(P[node.begin]), upper(P[node.begin]);
+  for (uint32_t i = node.begin; i < node.end; i++) {
+    centroid += P[i];
+    attribute += tree.spheres.distances[i];
+    lower = min(lower, P[i]);
+    upper = max(upper, P[i]);
+  }
+  centroid /= n;
+
+  node.center = (lower + upper) * 0.5f;
+  node.radius = 0.f;
+  for (uint32_t i = node.begin; i < node.end; i++)
+    node.radius = std::max(node.radius, length(P[i] - node.center));
+  node.radius += r;
+
+  node.proxyPosition = centroid;
+  node.proxyRadius = std::min(r * std::cbrt(n), node.radius);
+  node.proxyAttribute = attribute / n;
+}
+
+static LodTree buildLodTree(
+    const SphereData &input, uint32_t leafSize = 32, int maxDepth = 16)
+{
+  const uint32_t numSpheres = uint32_t(input.positions.size());
+  std::vector<uint32_t> order(numSpheres);
+  std::iota(order.begin(), order.end(), 0);
+
+  LodTree tree;
+  tree.spheres.radius = input.radius;
+  tree.spheres.positions = input.positions;
+  tree.spheres.distances = input.distances;
+  if (numSpheres == 0)
+    return tree;
+
+  struct Task
+  {
+    uint32_t node;
+    int depth;
+  };
+  std::vector<Task> stack;
+  std::vector<uint32_t> scratch;
+
+  tree.nodes.emplace_back();
+  tree.nodes[0].begin = 0;
+  tree.nodes[0].end = numSpheres;
+  computeLodNode(tree, tree.nodes[0]);
+  stack.push_back({0, 0});
+
+  const auto &P = input.positions;
+
+  while (!stack.empty()) {
+    const Task task = stack.back();
+    stack.pop_back();
+    LodNode node = tree.nodes[task.node];
+    if (node.end - node.begin <= leafSize || task.depth >= maxDepth)
+      continue;
+
+    // Partition the node's spheres into octants around its center
+    const float3 c = node.center;
+    auto octant = [&](uint32_t i) {
+      return (P[i].x > c.x ? 1 : 0) | (P[i].y > c.y ? 2 : 0)
+          | (P[i].z > c.z ? 4 : 0);
+    };
+    uint32_t offsets[9] = {0};
+    for (uint32_t i = node.begin; i < node.end; i++)
+      offsets[octant(order[i]) + 1]++;
+    for (int o = 0; o < 8; o++)
+      offsets[o + 1] += offsets[o];
+    scratch.resize(node.end - node.begin);
+    for (uint32_t i = node.begin; i < node.end; i++)
+      scratch[offsets[octant(order[i])]++] = order[i];
+    std::copy(scratch.begin(), scratch.end(), order.begin() + node.begin);
+
+    // Reorder the sphere data to match
+    for (uint32_t i = node.begin; i < node.end; i++) {
+      tree.spheres.positions[i] = P[order[i]];
+      tree.spheres.distances[i] = input.distances[order[i]];
+    }
+
+    node.firstChild = uint32_t(tree.nodes.size());
+    uint32_t begin = node.begin;
+    while (begin < node.end) {
+      const int o = octant(order[begin]);
+      uint32_t end = begin;
+      while (end < node.end && octant(order[end]) == o)
+        end++;
+      LodNode child;
+      child.begin = begin;
+      child.end = end;
+      computeLodNode(tree, child);
+      tree.nodes.push_back(child);
+      begin = end;
+    }
+    node.numChildren = uint32_t(tree.nodes.size()) - node.firstChild;
+    tree.nodes[task.node] = node;
+
+    // All spheres in one octant (duplicates): stop splitting
+    if (node.numChildren == 1) {
+      tree.nodes[task.node].numChildren = 0;
+      tree.nodes.pop_back();
+      continue;
+    }
+
+    for (uint32_t i = 0; i < node.numChildren; i++)
+      stack.push_back({node.firstChild + i, task.depth + 1});
+  }
+
+  tree.spheres.indices.resize(numSpheres);
+  std::iota(tree.spheres.indices.begin(), tree.spheres.indices.end(), 0);
+  return tree;
+}
+
+// Select the cut for 'eye' looking at the screen (LL, LR, UR) rendered at
+// 'imageWidth' pixels across; proxies and original spheres go to 'out'
+static LodStats selectLod(const LodTree &tree,
+    const LodParams &params,
+    float3 LL,
+    float3 LR,
+    float3 UR,
+    float3 eye,
+    uint32_t imageWidth,
+    SphereData &out)
+{
+  LodStats stats;
+  out.positions.clear();
+  out.distances.clear();
+  out.indices.clear();
+  out.radii.clear();
+  out.radius = tree.spheres.radius;
+  if (tree.nodes.empty())
+    return stats;
+
+  const float width = length(LR - LL);
+  const float3 X = (LR - LL) / width;
+  const float3 Y = normalize(UR - LR);
+  const float3 Z = cross(X, Y);
+  const float dist = dot(eye - LL, Z);
+  const float pixelsPerUnit = imageWidth / width;
+
+  // Side planes of the off-axis frustum, normals pointing inwards
+  const float3 UL = LL + (UR - LR);
+  const float3 corners[4] = {LL, LR, UR, UL};
+  const float3 screenCenter = (LL + UR) * 0.5f;
+  float3 planes[4];
+  for (int i = 0; i < 4; i++) {
+    float3 n = normalize(cross(corners[i] - eye, corners[(i + 1) % 4] - eye));
+    planes[i] = dot(n, screenCenter - eye) < 0.f ? -n : n;
+  }
+
+  auto emitProxy = [&](const LodNode &node) {
+    out.positions.push_back(node.proxyPosition);
+    out.distances.push_back(node.proxyAttribute);
+    out.radii.push_back(node.proxyRadius);
+    stats.proxies++;
+  };
+  auto emitSpheres = [&](const LodNode &node) {
+    out.positions.insert(out.positions.end(),
+        tree.spheres.positions.begin() + node.begin,
+        tree.spheres.positions.begin() + node.end);
+    out.distances.insert(out.distances.end(),
+        tree.spheres.distances.begin() + node.begin,
+        tree.spheres.distances.begin() + node.end);
+    out.radii.insert(out.radii.end(), node.end - node.begin, out.radius);
+    stats.spheres += node.end - node.begin;
+  };
+
+  std::vector<uint32_t> stack = {0};
+  while (!stack.empty()) {
+    const LodNode &node = tree.nodes[stack.back()];
+    stack.pop_back();
+    stats.visitedNodes++;
+
+    // Frustum culling, including everything behind the eye
+    const float depth = dot(eye - node.center, Z);
+    bool outside = depth < -node.radius;
+    for (int i = 0; params.cull && !outside && i < 4; i++)
+      outside = dot(planes[i], node.center - eye) < -node.radius;
+    if (params.cull && outside) {
+      stats.culledNodes++;
+      continue;
+    }
+
+    // Projected diameter on the screen, in pixels
+    const bool close = depth <= node.radius;
+    const float size =
+        close ? 1e30f : 2.f * node.radius * dist / depth * pixelsPerUnit;
+
+    if (size < params.pixelThreshold)
+      emitProxy(node);
+    else if (node.numChildren == 0)
+      emitSpheres(node);
+    else {
+      for (uint32_t i = 0; i < node.numChildren; i++)
+        stack.push_back(node.firstChild + i);
+    }
+  }
+
+  if (stats.proxies == 0)
+    out.radii.clear(); // all spheres have the original radius
+  out.indices.resize(out.positions.size());
+  std::iota(out.indices.begin(), out.indices.end(), 0);
+  return stats;
+}
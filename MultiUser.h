@@ -0,0 +1,164 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <vector>
+// ours
+#include "OffaxisProjection.h"
+#include "Projection.h"
+#include "Stereo.h"
+
+// ========================================================
+// Several tracked users in a CAVE with shutter
+//  multiplexing: per display cycle, every wall shows both
+//  eye views of every user, i.e. a cycle renders
+//  walls x users x 2 views. Views are numbered wall-major,
+//  (wall * numUsers + user) * 2 + eye, eye 0 is the left.
+// ========================================================
+
+struct CaveWall
+{
+  const char *name;
+  float3 LL, LR, UR;
+};
+
+// Walls of a cube with edge length 'size' spanning [0, size]^3, all facing
+// inwards; the front wall is the screen used by the other tools
+static std::vector<CaveWall> caveWalls(float size, uint32_t numWalls)
+{
+  const float s = size;
+  const CaveWall all[] = {
+      {"front", float3(0, 0, 0), float3(s, 0, 0), float3(s, s, 0)},
+      {"left", float3(0, 0, s), float3(0, 0, 0), float3(0, s, 0)},
+      {"right", float3(s, 0, 0), float3(s, 0, s), float3(s, s, s)},
+      {"floor", float3(0, 0, s), float3(s, 0, s), float3(s, 0, 0)},
+      {"ceiling", float3(0, s, 0), float3(s, s, 0), float3(s, s, s)},
+  };
+  const uint32_t n = numWalls < 5 ? numWalls : 5;
+  return std::vector<CaveWall>(all, all + n);
+}
+
+struct MultiUserViews
+{
+  uint32_t numWalls{0};
+  uint32_t numUsers{0};
+  std::vector<float> eyes; // per user: left xyz, right xyz
+  std::vector<offaxis::PerspectiveSolution> cameras; // per view
+
+  size_t numViews() const
+  {
+    return size_t(numWalls) * numUsers * 2;
+  }
+
+  size_t viewIndex(uint32_t wall, uint32_t user, uint32_t eye) const
+  {
+    return (size_t(wall) * numUsers + user) * 2 + eye;
+  }
+
+  uint32_t userOf(size_t view) const
+  {
+    return uint32_t(view / 2 % numUsers);
+  }
+
+  float3 eyeOf(size_t view) const
+  {
+    const float *e = &eyes[3 * (view % (2 * size_t(numUsers)))];
+    return float3(e[0], e[1], e[2]);
+  }
+};
+
+// Eyes of all users from their head positions, then the cameras of all
+// views with one batched solve per wall. The eye positions do not depend on
+// the wall; heads are assumed to face the front wall.
+static void updateMultiUserViews(const std::vector<CaveWall> &walls,
+    const float3 *heads,
+    uint32_t numUsers,
+    float ipd,
+    MultiUserViews &views)
+{
+  views.numWalls = uint32_t(walls.size());
+  views.numUsers = numUsers;
+  views.eyes.resize(6 * size_t(numUsers));
+  views.cameras.resize(views.numViews());
+
+  for (uint32_t u = 0; u < numUsers; u++) {
+    float3 left, right;
+    stereoEyes(walls[0].LL, walls[0].LR, heads[u], ipd, left, right);
+    std::memcpy(&views.eyes[6 * u], &left, sizeof(left));
+    std::memcpy(&views.eyes[6 * u + 3], &right, sizeof(right));
+  }
+
+  for (uint32_t w = 0; w < views.numWalls; w++) {
+    const CaveWall &wall = walls[w];
+    const offaxis::ProjectionScreen screen = {
+        {wall.LL.x, wall.LL.y, wall.LL.z},
+        {wall.LR.x, wall.LR.y, wall.LR.z},
+        {wall.UR.x, wall.UR.y, wall.UR.z}};
+    offaxis::solvePerspectiveBatch(screen,
+        views.eyes.data(),
+        2 * size_t(numUsers),
+        &views.cameras[views.viewIndex(w, 0, 0)]);
+  }
+}
+
+// ========================================================
+// Order in which the views of a cycle are rendered
+// ========================================================
+
+enum class ViewSchedule
+{
+  Serial, // render and wait for one view at a time
+  WallMajor, // all views in flight, in view order
+  UserMajor, // all views in flight, user by user; the first user rotates
+};
+
+static const char *viewScheduleName(ViewSchedule s)
+{
+  switch (s) {
+  case ViewSchedule::Serial:
+    return "serial";
+  case ViewSchedule::WallMajor:
+    return "wall-major";
+  case ViewSchedule::UserMajor:
+    return "user-major";
+  default:
+    return "<invalid>";
+  }
+}
+
+static bool parseViewSchedule(const char *name, ViewSchedule &s)
+{
+  for (int i = 0; i <= int(ViewSchedule::UserMajor); i++) {
+    if (!std::strcmp(name, viewScheduleName(ViewSchedule(i)))) {
+      s = ViewSchedule(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+static void viewOrder(const MultiUserViews &views,
+    ViewSchedule s,
+    uint32_t cycle,
+    std::vector<uint32_t> &order)
+{
+  order.clear();
+  if (s != ViewSchedule::UserMajor) {
+    for (size_t v = 0; v < views.numViews(); v++)
+      order.push_back(uint32_t(v));
+    return;
+  }
+  // Users finish one after the other; rotating the first one each cycle
+  // spreads the latency evenly
+  for (uint32_t i = 0; i < views.numUsers; i++) {
+    const uint32_t u = (cycle + i) % views.numUsers;
+    for (uint32_t w = 0; w < views.numWalls; w++) {
+      order.push_back(uint32_t(views.viewIndex(w, u, 0)));
+      order.push_back(uint32_t(views.viewIndex(w, u, 1)));
+    }
+  }
+}
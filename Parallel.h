@@ -0,0 +1,70 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstddef>
+#include <cstdlib>
+#include <thread>
+#include <vector>
+
+// ========================================================
+// Minimal fork/join helpers for the host-side image
+//  stages. Work is split into one contiguous range per
+//  thread so inner loops stay simple enough for the
+//  compiler to vectorize.
+// ========================================================
+
+// Number of worker threads; OFFAXIS_NUM_THREADS overrides the default
+inline unsigned numThreads()
+{
+  static const unsigned n = [] {
+    if (const char *env = std::getenv("OFFAXIS_NUM_THREADS")) {
+      const int v = std::atoi(env);
+      if (v > 0)
+        return unsigned(v);
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+  }();
+  return n;
+}
+
+// Calls func(begin, end) on disjoint sub-ranges of [0, n)
+template <typename Func>
+inline void parallelFor(size_t n, Func &&func, size_t minRangeSize = 1)
+{
+  const size_t maxRanges =
+      std::max<size_t>(1, n / std::max<size_t>(1, minRangeSize));
+  const size_t numRanges = std::min<size_t>(numThreads(), maxRanges);
+
+  if (numRanges <= 1) {
+    if (n > 0)
+      func(size_t(0), n);
+    return;
+  }
+
+  std::vector<std::thread> threads;
+  threads.reserve(numRanges - 1);
+  for (size_t r = 1; r < numRanges; r++) {
+    const size_t begin = n * r / numRanges;
+    const size_t end = n * (r + 1) / numRanges;
+    threads.emplace_back([&func, begin, end] { func(begin, end); });
+  }
+
+  func(size_t(0), n / numRanges);
+
+  for (auto &t : threads)
+    t.join();
+}
+
+// Calls func(y) for every row y in [0, height)
+template <typename Func>
+inline void parallelForRows(unsigned height, Func &&func)
+{
+  parallelFor(height, [&](size_t begin, size_t end) {
+    for (size_t y = begin; y < end; y++)
+      func(unsigned(y));
+  });
+}
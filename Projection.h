@@ -137,6 +137,15 @@ static void offaxisStereoCamera(float3 LL,
   imageRegionOUT.w = top < bottom ? (bottom + top) / newHeight : 1.f;
 }
 
+// Area of the symmetric frustum relative to the visible imageRegion, i.e.,
+// how many more rays a device would trace if it ignored the region
+static float frustumEnlargement(float4 imageRegion)
+{
+  const float area = (imageRegion.z - imageRegion.x)
+      * (imageRegion.w - imageRegion.y);
+  return area > 0.f ? 1.f / area : 0.f;
+}
+
 static void offaxisStereoCameraFromTransform(mat4 projInv,
     mat4 viewInv,
     float3 &eyeOUT,
@@ -0,0 +1,358 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <numeric>
+#include <random>
+#include <vector>
+// ours
+#include "math-helpers.h"
+
+using namespace anari::math;
+
+// ========================================================
+// Sphere positions and attributes of the test scene, kept
+//  on the host so they can be partitioned before upload
+// ========================================================
+struct SphereData
+{
+  std::vector<float3> positions;
+  std::vector<float> distances; // used as color map coordinate
+  std::vector<uint32_t> indices;
+  std::vector<float> radii; // per sphere, 'radius' is used if empty
+  float radius{.015f};
+};
+
+static SphereData generateSpheres(
+    const float3 &pos, uint32_t numSpheres = 10000)
+{
+  std::mt19937 rng;
+  rng.seed(0);
+  std::normal_distribution<float> vert_dist(0.f, 0.25f);
+
+  SphereData spheres;
+  spheres.positions.resize(numSpheres);
+  spheres.distances.resize(numSpheres);
+  spheres.indices.resize(numSpheres);
+
+  for (uint32_t i = 0; i < numSpheres; i++) {
+    auto &p = spheres.positions[i];
+    const auto a = p[0] = vert_dist(rng);
+    const auto b = p[1] = vert_dist(rng);
+    const auto c = p[2] = vert_dist(rng);
+    spheres.distances[i] = std::sqrt(a * a + b * b + c * c); // roughly 0-1
+    // translate
+    p += pos;
+  }
+
+  std::iota(spheres.indices.begin(), spheres.indices.end(), 0);
+  std::shuffle(spheres.indices.begin(), spheres.indices.end(), rng);
+
+  return spheres;
+}
+
+// Contiguous range of spheres for part 'part' out of 'numParts'
+static SphereData partitionSpheres(
+    const SphereData &spheres, uint32_t part, uint32_t numParts)
+{
+  const size_t n = spheres.positions.size();
+  const uint32_t begin = uint32_t(n * part / numParts);
+  const uint32_t end = uint32_t(n * (part + 1) / numParts);
+
+  SphereData result;
+  result.radius = spheres.radius;
+  result.positions.assign(
+      spheres.positions.begin() + begin, spheres.positions.begin() + end);
+  result.distances.assign(
+      spheres.distances.begin() + begin, spheres.distances.begin() + end);
+  for (uint32_t index : spheres.indices) {
+    if (index >= begin && index < end)
+      result.indices.push_back(index - begin);
+  }
+  return result;
+}
+
+// ========================================================
+// upload spheres into a sphere geometry, replacing any
+//  previous arrays; the caller commits the geometry
+// ========================================================
+static void setSphereArrays(
+    anari::Device device, anari::Geometry geometry, const SphereData &spheres)
+{
+  const uint32_t numSpheres = uint32_t(spheres.positions.size());
+  const float radius = spheres.radius;
+
+  // Create + fill position and color arrays //
+
+  auto indicesArray = anari::newArray1D(device, ANARI_UINT32, numSpheres);
+  auto positionsArray =
+      anari::newArray1D(device, ANARI_FLOAT32_VEC3, numSpheres);
+  auto distanceArray = anari::newArray1D(device, ANARI_FLOAT32, numSpheres);
+  {
+    auto *positions = anari::map<float3>(device, positionsArray);
+    auto *distances = anari::map<float>(device, distanceArray);
+    std::copy(
+        spheres.positions.begin(), spheres.positions.end(), positions);
+    std::copy(
+        spheres.distances.begin(), spheres.distances.end(), distances);
+    anari::unmap(device, positionsArray);
+    anari::unmap(device, distanceArray);
+
+    auto *indices = anari::map<uint32_t>(device, indicesArray);
+    std::copy(spheres.indices.begin(), spheres.indices.end(), indices);
+    anari::unmap(device, indicesArray);
+  }
+
+  // Parameterize geometry //
+
+  anari::setAndReleaseParameter(
+      device, geometry, "primitive.index", indicesArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.position", positionsArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.attribute0", distanceArray);
+  anari::setParameter(device, geometry, "radius", radius);
+
+  if (!spheres.radii.empty()) {
+    auto radiusArray = anari::newArray1D(device, ANARI_FLOAT32, numSpheres);
+    auto *radii = anari::map<float>(device, radiusArray);
+    std::copy(spheres.radii.begin(), spheres.radii.end(), radii);
+    anari::unmap(device, radiusArray);
+    anari::setAndReleaseParameter(
+        device, geometry, "vertex.radius", radiusArray);
+  } else {
+    anari::unsetParameter(device, geometry, "vertex.radius");
+  }
+}
+
+// ========================================================
+// color mapped material of the test scene
+// ========================================================
+static anari::Material newSphereMaterial(anari::Device device)
+{
+  // Create color map texture //
+
+  auto texelArray = anari::newArray1D(device, ANARI_FLOAT32_VEC3, 2);
+  {
+    auto *texels = anari::map<float3>(device, texelArray);
+    texels[0][0] = 1.f;
+    texels[0][1] = 0.f;
+    texels[0][2] = 0.f;
+    texels[1][0] = 0.f;
+    texels[1][1] = 1.f;
+    texels[1][2] = 0.f;
+    anari::unmap(device, texelArray);
+  }
+
+  auto texture = anari::newObject<anari::Sampler>(device, "image1D");
+  anari::setAndReleaseParameter(device, texture, "image", texelArray);
+  anari::setParameter(device, texture, "filter", "linear");
+  anari::commitParameters(device, texture);
+
+  // Create and parameterize material //
+
+  auto material = anari::newObject<anari::Material>(device, "matte");
+  anari::setAndReleaseParameter(device, material, "color", texture);
+  anari::commitParameters(device, material);
+
+  return material;
+}
+
+// ========================================================
+// surface of the test scene's material around a
+//  committed geometry (consumed)
+// ========================================================
+static anari::Surface newGeometrySurface(
+    anari::Device device, anari::Geometry geometry)
+{
+  auto surface = anari::newObject<anari::Surface>(device);
+  anari::setAndReleaseParameter(device, surface, "geometry", geometry);
+  anari::setAndReleaseParameter(
+      device, surface, "material", newSphereMaterial(device));
+  anari::commitParameters(device, surface);
+  return surface;
+}
+
+// ========================================================
+// upload spheres and build the test scene's surface;
+//  optionally also returns (retained) the sphere geometry
+//  so its arrays can be replaced later on
+// ========================================================
+static anari::Surface newSphereSurface(anari::Device device,
+    const SphereData &spheres,
+    anari::Geometry *geometryOUT = nullptr)
+{
+  // Create and parameterize geometry //
+
+  auto geometry = anari::newObject<anari::Geometry>(device, "sphere");
+  setSphereArrays(device, geometry, spheres);
+  anari::commitParameters(device, geometry);
+  if (geometryOUT) {
+    anari::retain(device, geometry);
+    *geometryOUT = geometry;
+  }
+
+  return newGeometrySurface(device, geometry);
+}
+
+// ========================================================
+// build a world from a single surface (consumed)
+// ========================================================
+static anari::World newSurfaceWorld(
+    anari::Device device, anari::Surface surface)
+{
+  // Create and parameterize world //
+
+  auto world = anari::newObject<anari::World>(device);
+#if 1
+  {
+    auto surfaceArray = anari::newArray1D(device, ANARI_SURFACE, 1);
+    auto *s = anari::map<anari::Surface>(device, surfaceArray);
+    s[0] = surface;
+    anari::unmap(device, surfaceArray);
+    anari::setAndReleaseParameter(device, world, "surface", surfaceArray);
+  }
+#else
+  anari::setAndReleaseParameter(
+      device, world, "surface", anari::newArray1D(device, &surface));
+#endif
+  anari::release(device, surface);
+  anari::commitParameters(device, world);
+
+  return world;
+}
+
+// ========================================================
+// build the test scene's world from its spheres
+// ========================================================
+static anari::World newSphereWorld(
+    anari::Device device, const SphereData &spheres)
+{
+  return newSurfaceWorld(device, newSphereSurface(device, spheres));
+}
+
+// ========================================================
+// Instanced variant for scaling tests: one sphere group
+//  placed many times through "transform" instances, so
+//  the effective primitive count grows without growing
+//  the uploaded geometry
+// ========================================================
+
+// Uniform scale around 'pivot' followed by a translation to 'target'
+static mat4 instanceTransform(float3 pivot, float scale, float3 target)
+{
+  return mat4(float4(scale, 0.f, 0.f, 0.f),
+      float4(0.f, scale, 0.f, 0.f),
+      float4(0.f, 0.f, scale, 0.f),
+      float4(target - pivot * scale, 1.f));
+}
+
+// n x n x n copies of a sphere cluster centered at 'pivot', shrunk to fit
+// a cube of edge length 'extent' that extends from 'center' away from the
+// viewer (-z), so all copies stay behind the screen plane
+static std::vector<mat4> instanceGrid(
+    float3 pivot, float3 center, float extent, uint32_t n)
+{
+  std::vector<mat4> transforms;
+  transforms.reserve(size_t(n) * n * n);
+  const float spacing = extent / n;
+  // The clusters have a standard deviation of 0.25, i.e., +/- 0.75 covers
+  // nearly all of their spheres
+  const float scale = spacing / 1.5f;
+  for (uint32_t z = 0; z < n; z++) {
+    for (uint32_t y = 0; y < n; y++) {
+      for (uint32_t x = 0; x < n; x++) {
+        const float3 target = center
+            + float3((x + 0.5f) * spacing - 0.5f * extent,
+                (y + 0.5f) * spacing - 0.5f * extent,
+                -(z + 0.5f) * spacing);
+        transforms.push_back(instanceTransform(pivot, scale, target));
+      }
+    }
+  }
+  return transforms;
+}
+
+// The same spheres with all transforms applied, for comparing against
+// instancing at equal primitive count. Sphere indices are 32 bit, so the
+// result is empty if it would hold more than UINT32_MAX spheres.
+static SphereData flattenInstances(
+    const SphereData &spheres, const std::vector<mat4> &transforms)
+{
+  const size_t n = spheres.positions.size();
+  SphereData result;
+  if (transforms.empty() || n > UINT32_MAX / transforms.size())
+    return result;
+  result.radius = spheres.radius * transforms[0].x.x; // uniform scale
+  result.positions.resize(n * transforms.size());
+  result.distances.resize(n * transforms.size());
+  result.indices.resize(n * transforms.size());
+  for (size_t t = 0; t < transforms.size(); t++) {
+    const mat4 &m = transforms[t];
+    for (size_t i = 0; i < n; i++) {
+      const float4 p = mul(m, float4(spheres.positions[i], 1.f));
+      result.positions[t * n + i] = float3(p.x, p.y, p.z);
+      result.distances[t * n + i] = spheres.distances[i];
+      result.indices[t * n + i] = uint32_t(t * n + spheres.indices[i]);
+    }
+  }
+  return result;
+}
+
+static anari::World newInstancedSphereWorld(anari::Device device,
+    const SphereData &spheres,
+    const std::vector<mat4> &transforms)
+{
+  auto surface = newSphereSurface(device, spheres);
+
+  auto group = anari::newObject<anari::Group>(device);
+  {
+    auto surfaceArray = anari::newArray1D(device, ANARI_SURFACE, 1);
+    auto *s = anari::map<anari::Surface>(device, surfaceArray);
+    s[0] = surface;
+    anari::unmap(device, surfaceArray);
+    anari::setAndReleaseParameter(device, group, "surface", surfaceArray);
+  }
+  anari::release(device, surface);
+  anari::commitParameters(device, group);
+
+  const size_t numInstances = transforms.size();
+  std::vector<anari::Instance> instances(numInstances);
+  for (size_t i = 0; i < numInstances; i++) {
+    instances[i] = anari::newObject<anari::Instance>(device, "transform");
+    anari::setParameter(device, instances[i], "group", group);
+    anari::setParameter(device, instances[i], "transform", transforms[i]);
+    anari::commitParameters(device, instances[i]);
+  }
+  anari::release(device, group);
+
+  auto world = anari::newObject<anari::World>(device);
+  {
+    auto instanceArray =
+        anari::newArray1D(device, ANARI_INSTANCE, numInstances);
+    auto *dst = anari::map<anari::Instance>(device, instanceArray);
+    std::copy(instances.begin(), instances.end(), dst);
+    anari::unmap(device, instanceArray);
+    anari::setAndReleaseParameter(device, world, "instance", instanceArray);
+  }
+  for (auto instance : instances)
+    anari::release(device, instance);
+  anari::commitParameters(device, world);
+
+  return world;
+}
+
+// ========================================================
+// generate our test scene
+// ========================================================
+static anari::World generateScene(anari::Device device, const float3 &pos)
+{
+  return newSphereWorld(device, generateSpheres(pos));
+}
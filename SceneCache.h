@@ -0,0 +1,481 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define OFFAXIS_SSE2 1
+#endif
+// ours
+#include "Parallel.h"
+#include "Scene.h"
+
+// ========================================================
+// Scene cache: the test scene's spheres on disk, so large
+//  scenes need not be regenerated. Binary file layout
+//  (little endian):
+//
+//   char magic[4] "OXSC", u32 version (1),
+//   u32 encoding (0 = float32, 1 = quantized16),
+//   u32 blockSize, u64 numSpheres, f32 radius,
+//
+//   float32:     f32 position[3 * n], f32 attribute[n],
+//                u32 index[n]
+//   quantized16: QuantizedBlock block[numBlocks],
+//                u16 position[3 * n], u16 attribute[n]
+//
+//  Quantized spheres are stored one per primitive, along
+//  a Morton curve, so that every block of blockSize
+//  spheres is spatially compact. The order of primitives
+//  does not change the image, so they are rendered with
+//  identity indices and none are stored (8 instead of 20
+//  bytes per sphere). Every block has its own bounding
+//  box, positions are 16-bit fixed point within it; same
+//  for the attribute.
+// ========================================================
+
+enum class SceneEncoding : uint32_t
+{
+  Float32 = 0,
+  Quantized16 = 1,
+};
+
+struct QuantizedBlock
+{
+  float3 origin;
+  float3 step; // extent / 65535 per axis
+  float attributeMin{0.f};
+  float attributeStep{0.f};
+};
+
+struct QuantizedSpheres
+{
+  uint32_t blockSize{4096};
+  std::vector<QuantizedBlock> blocks;
+  std::vector<uint16_t> positions; // xyz interleaved
+  std::vector<uint16_t> attributes;
+  float radius{.015f};
+
+  size_t size() const
+  {
+    return attributes.size();
+  }
+};
+
+static uint16_t quantize16(float value, float origin, float step)
+{
+  if (step <= 0.f)
+    return 0;
+  const float q = std::round((value - origin) / step);
+  return uint16_t(std::min(std::max(q, 0.f), 65535.f));
+}
+
+// Quantize spheres order[0..n) into one block
+static void quantizeBlock(const SphereData &spheres,
+    const uint32_t *order,
+    size_t n,
+    QuantizedBlock &block,
+    uint16_t *positions,
+    uint16_t *attributes)
+{
+  if (n == 0)
+    return;
+
+  float3 lower(spheres.positions[order[0]]), upper(lower);
+  float attrLower = spheres.distances[order[0]];
+  float attrUpper = attrLower;
+  for (size_t i = 0; i < n; i++) {
+    lower = min(lower, spheres.positions[order[i]]);
+    upper = max(upper, spheres.positions[order[i]]);
+    attrLower = std::min(attrLower, spheres.distances[order[i]]);
+    attrUpper = std::max(attrUpper, spheres.distances[order[i]]);
+  }
+
+  block.origin = lower;
+  block.step = (upper - lower) / 65535.f;
+  block.attributeMin = attrLower;
+  block.attributeStep = (attrUpper - attrLower) / 65535.f;
+
+  for (size_t i = 0; i < n; i++) {
+    const float3 p = spheres.positions[order[i]];
+    for (int c = 0; c < 3; c++)
+      positions[3 * i + c] = quantize16(p[c], block.origin[c], block.step[c]);
+    attributes[i] = quantize16(
+        spheres.distances[order[i]], block.attributeMin, block.attributeStep);
+  }
+}
+
+// Spreads the low 10 bits of v to every third bit
+static uint32_t mortonSpread(uint32_t v)
+{
+  v &= 0x3ff;
+  v = (v | (v << 16)) & 0x030000ff;
+  v = (v | (v << 8)) & 0x0300f00f;
+  v = (v | (v << 4)) & 0x030c30c3;
+  v = (v | (v << 2)) & 0x09249249;
+  return v;
+}
+
+// The vertices of all primitives (primitive.index, or all vertices if
+// there is none), sorted along a Morton curve over their bounds with 10
+// bits per axis
+static std::vector<uint32_t> spatialOrder(const SphereData &spheres)
+{
+  const bool indexed = !spheres.indices.empty();
+  const size_t n = indexed ? spheres.indices.size() : spheres.positions.size();
+  std::vector<uint32_t> order(n);
+  if (n == 0)
+    return order;
+
+  auto vertex = [&](size_t i) {
+    return indexed ? spheres.indices[i] : uint32_t(i);
+  };
+
+  float3 lower(spheres.positions[vertex(0)]), upper(lower);
+  for (size_t i = 0; i < n; i++) {
+    lower = min(lower, spheres.positions[vertex(i)]);
+    upper = max(upper, spheres.positions[vertex(i)]);
+  }
+  const float3 extent = upper - lower;
+
+  // Code in the upper, primitive in the lower half of the key
+  std::vector<uint64_t> keys(n);
+  parallelFor(n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const float3 p = spheres.positions[vertex(i)];
+      uint32_t code = 0;
+      for (int c = 0; c < 3; c++) {
+        const float t =
+            extent[c] > 0.f ? (p[c] - lower[c]) / extent[c] * 1024.f : 0.f;
+        const float cell = std::max(0.f, std::min(t, 1023.f)); // NaN -> 0
+        code |= mortonSpread(uint32_t(cell)) << c;
+      }
+      keys[i] = (uint64_t(code) << 32) | i;
+    }
+  });
+  std::sort(keys.begin(), keys.end());
+
+  for (size_t i = 0; i < n; i++)
+    order[i] = vertex(uint32_t(keys[i]));
+  return order;
+}
+
+// primitive.index of 'spheres' after storing their vertices in 'order',
+// which must be a permutation of the vertices
+static std::vector<uint32_t> reorderedIndices(
+    const SphereData &spheres, const std::vector<uint32_t> &order)
+{
+  std::vector<uint32_t> slot(spheres.positions.size());
+  for (size_t i = 0; i < order.size(); i++)
+    slot[order[i]] = uint32_t(i);
+  if (spheres.indices.empty())
+    return slot;
+
+  std::vector<uint32_t> indices(spheres.indices.size());
+  for (size_t i = 0; i < indices.size(); i++)
+    indices[i] = slot[spheres.indices[i]];
+  return indices;
+}
+
+static QuantizedSpheres quantizeSpheres(
+    const SphereData &spheres, uint32_t blockSize = 4096)
+{
+  QuantizedSpheres result;
+  result.blockSize = std::max(1u, blockSize);
+  result.radius = spheres.radius;
+
+  const std::vector<uint32_t> order = spatialOrder(spheres);
+  const size_t n = order.size();
+  const size_t numBlocks = (n + result.blockSize - 1) / result.blockSize;
+  result.blocks.resize(numBlocks);
+  result.positions.resize(3 * n);
+  result.attributes.resize(n);
+
+  parallelFor(numBlocks, [&](size_t firstBlock, size_t lastBlock) {
+    for (size_t b = firstBlock; b < lastBlock; b++) {
+      const size_t begin = b * result.blockSize;
+      const size_t end = std::min(n, begin + result.blockSize);
+      quantizeBlock(spheres,
+          order.data() + begin,
+          end - begin,
+          result.blocks[b],
+          result.positions.data() + 3 * begin,
+          result.attributes.data() + begin);
+    }
+  });
+
+  return result;
+}
+
+// ========================================================
+// Decoding, straight into (mapped) float arrays. The SSE2
+//  path converts four spheres per step: their twelve
+//  interleaved coordinates fill three registers whose
+//  lanes cycle through x, y, z, so the per-axis origin and
+//  step are three fixed lane patterns and no shuffles are
+//  needed.
+// ========================================================
+
+static void decodeQuantizedBlockScalar(const QuantizedBlock &block,
+    const uint16_t *q,
+    const uint16_t *qa,
+    size_t n,
+    float *positions,
+    float *attributes)
+{
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < 3; c++)
+      positions[3 * i + c] = block.origin[c] + q[3 * i + c] * block.step[c];
+    attributes[i] = block.attributeMin + qa[i] * block.attributeStep;
+  }
+}
+
+static void decodeQuantizedBlock(const QuantizedBlock &block,
+    const uint16_t *q,
+    const uint16_t *qa,
+    size_t n,
+    float *positions,
+    float *attributes)
+{
+#if OFFAXIS_SSE2
+  const float3 o = block.origin;
+  const float3 s = block.step;
+  const __m128 o0 = _mm_setr_ps(o.x, o.y, o.z, o.x);
+  const __m128 o1 = _mm_setr_ps(o.y, o.z, o.x, o.y);
+  const __m128 o2 = _mm_setr_ps(o.z, o.x, o.y, o.z);
+  const __m128 s0 = _mm_setr_ps(s.x, s.y, s.z, s.x);
+  const __m128 s1 = _mm_setr_ps(s.y, s.z, s.x, s.y);
+  const __m128 s2 = _mm_setr_ps(s.z, s.x, s.y, s.z);
+  const __m128i zero = _mm_setzero_si128();
+
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    const __m128i a = _mm_loadu_si128((const __m128i *)(q + 3 * i));
+    const __m128i b = _mm_loadl_epi64((const __m128i *)(q + 3 * i + 8));
+    const __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero));
+    const __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero));
+    const __m128 f2 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(b, zero));
+    float *dst = positions + 3 * i;
+    _mm_storeu_ps(dst, _mm_add_ps(o0, _mm_mul_ps(f0, s0)));
+    _mm_storeu_ps(dst + 4, _mm_add_ps(o1, _mm_mul_ps(f1, s1)));
+    _mm_storeu_ps(dst + 8, _mm_add_ps(o2, _mm_mul_ps(f2, s2)));
+  }
+  for (; i < n; i++) {
+    for (int c = 0; c < 3; c++)
+      positions[3 * i + c] = o[c] + q[3 * i + c] * s[c];
+  }
+
+  const __m128 oa = _mm_set1_ps(block.attributeMin);
+  const __m128 sa = _mm_set1_ps(block.attributeStep);
+  size_t j = 0;
+  for (; j + 8 <= n; j += 8) {
+    const __m128i a = _mm_loadu_si128((const __m128i *)(qa + j));
+    const __m128 f0 = _mm_cvtepi32_ps(_mm_unpacklo_epi16(a, zero));
+    const __m128 f1 = _mm_cvtepi32_ps(_mm_unpackhi_epi16(a, zero));
+    _mm_storeu_ps(attributes + j, _mm_add_ps(oa, _mm_mul_ps(f0, sa)));
+    _mm_storeu_ps(attributes + j + 4, _mm_add_ps(oa, _mm_mul_ps(f1, sa)));
+  }
+  for (; j < n; j++)
+    attributes[j] = block.attributeMin + qa[j] * block.attributeStep;
+#else
+  decodeQuantizedBlockScalar(block, q, qa, n, positions, attributes);
+#endif
+}
+
+// Decode all blocks in parallel
+static void decodeQuantizedSpheres(const QuantizedSpheres &spheres,
+    float3 *positions,
+    float *attributes,
+    bool simd = true)
+{
+  const size_t n = spheres.size();
+  const size_t bs = spheres.blockSize;
+  auto decode = simd ? decodeQuantizedBlock : decodeQuantizedBlockScalar;
+  parallelFor(spheres.blocks.size(), [&](size_t firstBlock, size_t lastBlock) {
+    for (size_t b = firstBlock; b < lastBlock; b++) {
+      const size_t begin = b * bs;
+      const size_t count = std::min(n, begin + bs) - begin;
+      decode(spheres.blocks[b],
+          spheres.positions.data() + 3 * begin,
+          spheres.attributes.data() + begin,
+          count,
+          (float *)(positions + begin),
+          attributes + begin);
+    }
+  });
+}
+
+// ========================================================
+// File I/O
+// ========================================================
+
+struct SceneCache
+{
+  SceneEncoding encoding{SceneEncoding::Float32};
+  SphereData spheres; // float32
+  QuantizedSpheres quantized; // quantized16
+
+  size_t size() const
+  {
+    return encoding == SceneEncoding::Quantized16 ? quantized.size()
+                                                  : spheres.positions.size();
+  }
+};
+
+static bool saveSceneCache(const char *fileName, const SceneCache &cache)
+{
+  FILE *fp = fopen(fileName, "wb");
+  if (!fp)
+    return false;
+
+  const bool quantized = cache.encoding == SceneEncoding::Quantized16;
+  const uint32_t header[3] = {
+      1, uint32_t(cache.encoding), quantized ? cache.quantized.blockSize : 0};
+  const uint64_t n = cache.size();
+  const float radius =
+      quantized ? cache.quantized.radius : cache.spheres.radius;
+  bool ok = fwrite("OXSC", 1, 4, fp) == 4
+      && fwrite(header, sizeof(uint32_t), 3, fp) == 3
+      && fwrite(&n, sizeof(n), 1, fp) == 1
+      && fwrite(&radius, sizeof(radius), 1, fp) == 1;
+
+  if (ok && quantized) {
+    const auto &q = cache.quantized;
+    ok = fwrite(q.blocks.data(), sizeof(QuantizedBlock), q.blocks.size(), fp)
+            == q.blocks.size()
+        && fwrite(q.positions.data(), sizeof(uint16_t), 3 * n, fp) == 3 * n
+        && fwrite(q.attributes.data(), sizeof(uint16_t), n, fp) == n;
+  } else if (ok) {
+    const auto &s = cache.spheres;
+    ok = s.distances.size() == n && s.indices.size() == n
+        && fwrite(s.positions.data(), sizeof(float3), n, fp) == n
+        && fwrite(s.distances.data(), sizeof(float), n, fp) == n
+        && fwrite(s.indices.data(), sizeof(uint32_t), n, fp) == n;
+  }
+
+  fclose(fp);
+  return ok;
+}
+
+// True if all indices address one of n spheres
+static bool indicesInRange(const std::vector<uint32_t> &indices, uint64_t n)
+{
+  return std::all_of(
+      indices.begin(), indices.end(), [&](uint32_t i) { return i < n; });
+}
+
+static bool loadSceneCache(const char *fileName, SceneCache &cache)
+{
+  FILE *fp = fopen(fileName, "rb");
+  if (!fp)
+    return false;
+  char magic[4];
+  uint32_t header[3];
+  uint64_t n = 0;
+  float radius = 0.f;
+  bool ok = fread(magic, 1, 4, fp) == 4 && std::equal(magic, magic + 4, "OXSC")
+      && fread(header, sizeof(uint32_t), 3, fp) == 3 && header[0] == 1
+      && fread(&n, sizeof(n), 1, fp) == 1
+      && fread(&radius, sizeof(radius), 1, fp) == 1;
+
+  // The spheres must fill the rest of the file exactly, check before
+  // allocating; n is bounded first so the expected size can't overflow
+  const long headerBytes = 4 + sizeof(header) + sizeof(n) + sizeof(radius);
+  long fileSize = -1;
+  if (ok && fseek(fp, 0, SEEK_END) == 0)
+    fileSize = ftell(fp);
+  ok = ok && fileSize >= headerBytes && n <= UINT32_MAX
+      && fseek(fp, headerBytes, SEEK_SET) == 0;
+  const uint64_t payload = ok ? uint64_t(fileSize - headerBytes) : 0;
+
+  if (ok && header[1] == uint32_t(SceneEncoding::Quantized16)) {
+    cache.encoding = SceneEncoding::Quantized16;
+    auto &q = cache.quantized;
+    q.blockSize = std::max(1u, header[2]);
+    q.radius = radius;
+    const uint64_t numBlocks = (n + q.blockSize - 1) / q.blockSize;
+    ok = payload
+        == numBlocks * sizeof(QuantizedBlock) + n * 4 * sizeof(uint16_t);
+    if (ok) {
+      q.blocks.resize(numBlocks);
+      q.positions.resize(3 * n);
+      q.attributes.resize(n);
+    }
+    ok = ok
+        && fread(q.blocks.data(), sizeof(QuantizedBlock), q.blocks.size(), fp)
+            == q.blocks.size()
+        && fread(q.positions.data(), sizeof(uint16_t), 3 * n, fp) == 3 * n
+        && fread(q.attributes.data(), sizeof(uint16_t), n, fp) == n;
+  } else if (ok && header[1] == uint32_t(SceneEncoding::Float32)) {
+    cache.encoding = SceneEncoding::Float32;
+    auto &s = cache.spheres;
+    s.radius = radius;
+    ok = payload == n * (sizeof(float3) + sizeof(float) + sizeof(uint32_t));
+    if (ok) {
+      s.positions.resize(n);
+      s.distances.resize(n);
+      s.indices.resize(n);
+    }
+    ok = ok && fread(s.positions.data(), sizeof(float3), n, fp) == n
+        && fread(s.distances.data(), sizeof(float), n, fp) == n
+        && fread(s.indices.data(), sizeof(uint32_t), n, fp) == n
+        && indicesInRange(s.indices, n);
+  } else {
+    ok = false;
+  }
+
+  fclose(fp);
+  return ok;
+}
+
+// ========================================================
+// build the test scene's world from a cache; quantized
+//  spheres are decoded directly into the mapped arrays
+// ========================================================
+static anari::World newCachedSphereWorld(
+    anari::Device device, const SceneCache &cache)
+{
+  if (cache.encoding == SceneEncoding::Float32)
+    return newSphereWorld(device, cache.spheres);
+
+  const auto &q = cache.quantized;
+  const uint32_t numSpheres = uint32_t(q.size());
+
+  auto indicesArray = anari::newArray1D(device, ANARI_UINT32, numSpheres);
+  auto positionsArray =
+      anari::newArray1D(device, ANARI_FLOAT32_VEC3, numSpheres);
+  auto distanceArray = anari::newArray1D(device, ANARI_FLOAT32, numSpheres);
+  {
+    auto *positions = anari::map<float3>(device, positionsArray);
+    auto *distances = anari::map<float>(device, distanceArray);
+    decodeQuantizedSpheres(q, positions, distances);
+    anari::unmap(device, positionsArray);
+    anari::unmap(device, distanceArray);
+
+    auto *indices = anari::map<uint32_t>(device, indicesArray);
+    std::iota(indices, indices + numSpheres, 0u);
+    anari::unmap(device, indicesArray);
+  }
+
+  auto geometry = anari::newObject<anari::Geometry>(device, "sphere");
+  anari::setAndReleaseParameter(
+      device, geometry, "primitive.index", indicesArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.position", positionsArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.attribute0", distanceArray);
+  anari::setParameter(device, geometry, "radius", q.radius);
+  anari::commitParameters(device, geometry);
+
+  return newSurfaceWorld(device, newGeometrySurface(device, geometry));
+}
@@ -0,0 +1,487 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// posix
+#include <fcntl.h>
+#include <sys/types.h>
+#include <unistd.h>
+// std
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+// ours
+#include "Codec.h"
+#include "Parallel.h"
+#include "Scene.h"
+#include "SceneCache.h"
+
+// ========================================================
+// Chunked scene files for time series of sphere data.
+//  Every time step is split into chunks of chunkSize
+//  spheres that are compressed independently (Codec.h),
+//  so they can be read and decompressed in parallel
+//  straight into the mapped arrays, with only one chunk
+//  per thread in flight. File layout (little endian):
+//
+//   char magic[4] "OXCK", u32 version (1),
+//   u32 encoding (SceneEncoding), u32 chunkSize,
+//   u64 numSpheres (per step), f32 radius,
+//   u8 chunks[...],
+//   u32 primitiveIndex[numSpheres],
+//   ChunkIndexEntry index[numSteps * numChunks],
+//   u32 numSteps, u64 indexOffset, char magic[4] "OXCK"
+//
+//  indexOffset is where primitiveIndex starts. Spheres of
+//  all steps are stored along the Morton curve of the
+//  first step (SceneCache.h), which also fixes the stored
+//  primitive.index; later steps must share the first
+//  step's primitive.index. Before
+//  compression, a float32 chunk holds f32 position[3 * k]
+//  and f32 attribute[k] split into byte planes (all first
+//  bytes, then all second bytes, ...), which exposes the
+//  redundancy in the exponents to the LZ matcher. A
+//  quantized16 chunk holds a QuantizedBlock followed by
+//  u16 position[3 * k], u16 attribute[k] in byte planes.
+// ========================================================
+
+static const char chunkMagic[4] = {'O', 'X', 'C', 'K'};
+
+// Readers allocate a few raw chunks per thread, and sphere indices are
+// 32 bit
+static const uint32_t maxChunkSize = 1u << 22;
+static const uint64_t maxChunkedSpheres = UINT32_MAX;
+
+struct ChunkIndexEntry
+{
+  uint64_t offset{0};
+  uint32_t compressedSize{0};
+  uint32_t rawSize{0};
+};
+
+// Byte planes of n words of wordSize bytes
+static void shuffleBytes(
+    const uint8_t *src, size_t n, size_t wordSize, uint8_t *dst)
+{
+  for (size_t i = 0; i < n; i++) {
+    for (size_t b = 0; b < wordSize; b++)
+      dst[b * n + i] = src[i * wordSize + b];
+  }
+}
+
+static void unshuffleBytes(
+    const uint8_t *src, size_t n, size_t wordSize, uint8_t *dst)
+{
+  for (size_t b = 0; b < wordSize; b++) {
+    const uint8_t *plane = src + b * n;
+    for (size_t i = 0; i < n; i++)
+      dst[i * wordSize + b] = plane[i];
+  }
+}
+
+static size_t chunkRawSize(SceneEncoding encoding, size_t numSpheres)
+{
+  return encoding == SceneEncoding::Quantized16
+      ? sizeof(QuantizedBlock) + 4 * sizeof(uint16_t) * numSpheres
+      : 4 * sizeof(float) * numSpheres;
+}
+
+// ========================================================
+// Writer: one step at a time, compressing chunks in
+//  parallel batches
+// ========================================================
+struct ChunkedSceneWriter
+{
+  ~ChunkedSceneWriter()
+  {
+    close();
+  }
+
+  bool open(const char *fileName,
+      SceneEncoding encoding,
+      uint32_t chunkSize,
+      uint64_t numSpheres,
+      float radius)
+  {
+    close();
+    if (numSpheres > maxChunkedSpheres)
+      return false;
+    file = fopen(fileName, "wb");
+    if (!file)
+      return false;
+    this->encoding = encoding;
+    this->chunkSize = std::min(std::max(1u, chunkSize), maxChunkSize);
+    this->numSpheres = numSpheres;
+    index.clear();
+    order.clear();
+    primitiveIndices.clear();
+    numSteps = 0;
+
+    const uint32_t header[3] = {1, uint32_t(encoding), this->chunkSize};
+    offset = 4 + sizeof(header) + sizeof(numSpheres) + sizeof(radius);
+    return fwrite(chunkMagic, 1, 4, file) == 4
+        && fwrite(header, sizeof(uint32_t), 3, file) == 3
+        && fwrite(&numSpheres, sizeof(numSpheres), 1, file) == 1
+        && fwrite(&radius, sizeof(radius), 1, file) == 1;
+  }
+
+  size_t numChunks() const
+  {
+    return size_t((numSpheres + chunkSize - 1) / chunkSize);
+  }
+
+  // Appends a time step; 'spheres' must have numSpheres primitives
+  bool writeStep(const SphereData &spheres)
+  {
+    if (!file || spheres.positions.size() != numSpheres)
+      return false;
+    if (numSteps == 0) {
+      order = spatialOrder(spheres);
+      primitiveIndices = reorderedIndices(spheres, order);
+    }
+    if (order.size() != numSpheres || primitiveIndices.size() != numSpheres)
+      return false;
+
+    const size_t maxRaw = chunkRawSize(encoding, chunkSize);
+    const size_t stride = lzCompressBound(maxRaw);
+    const size_t batchSize = size_t(numThreads()) * 4;
+    std::vector<uint8_t> compressed(batchSize * stride);
+    std::vector<ChunkIndexEntry> entries(batchSize);
+
+    for (size_t first = 0; first < numChunks(); first += batchSize) {
+      const size_t count = std::min(batchSize, numChunks() - first);
+      parallelFor(count, [&](size_t begin, size_t end) {
+        std::vector<uint8_t> raw(maxRaw), scratch(maxRaw);
+        for (size_t i = begin; i < end; i++) {
+          const size_t chunk = first + i;
+          const size_t s0 = chunk * chunkSize;
+          const size_t k = std::min<size_t>(chunkSize, numSpheres - s0);
+          const size_t rawSize =
+              packChunk(spheres, order.data() + s0, k, raw.data(), scratch);
+          entries[i].rawSize = uint32_t(rawSize);
+          entries[i].compressedSize = uint32_t(
+              lzCompress(raw.data(), rawSize, compressed.data() + i * stride));
+        }
+      });
+
+      for (size_t i = 0; i < count; i++) {
+        entries[i].offset = offset;
+        if (fwrite(compressed.data() + i * stride,
+                1,
+                entries[i].compressedSize,
+                file)
+            != entries[i].compressedSize)
+          return false;
+        offset += entries[i].compressedSize;
+        index.push_back(entries[i]);
+      }
+    }
+
+    numSteps++;
+    return true;
+  }
+
+  // Writes the index and footer; 'offset' is the file size afterwards
+  bool close()
+  {
+    if (!file)
+      return false;
+    const uint64_t indexOffset = offset;
+    primitiveIndices.resize(numSpheres);
+    bool ok = fwrite(primitiveIndices.data(),
+                  sizeof(uint32_t),
+                  primitiveIndices.size(),
+                  file)
+            == primitiveIndices.size()
+        && fwrite(index.data(), sizeof(ChunkIndexEntry), index.size(), file)
+            == index.size()
+        && fwrite(&numSteps, sizeof(numSteps), 1, file) == 1
+        && fwrite(&indexOffset, sizeof(indexOffset), 1, file) == 1
+        && fwrite(chunkMagic, 1, 4, file) == 4;
+    offset += primitiveIndices.size() * sizeof(uint32_t)
+        + index.size() * sizeof(ChunkIndexEntry) + 16;
+    ok = fclose(file) == 0 && ok;
+    file = nullptr;
+    return ok;
+  }
+
+  // Raw chunk of spheres order[0..k) in byte planes, returns its size
+  size_t packChunk(const SphereData &spheres,
+      const uint32_t *order,
+      size_t k,
+      uint8_t *raw,
+      std::vector<uint8_t> &scratch) const
+  {
+    if (encoding == SceneEncoding::Quantized16) {
+      auto *q = (uint16_t *)scratch.data();
+      QuantizedBlock block;
+      quantizeBlock(spheres, order, k, block, q, q + 3 * k);
+      std::memcpy(raw, &block, sizeof(block));
+      shuffleBytes(
+          scratch.data(), 4 * k, sizeof(uint16_t), raw + sizeof(block));
+    } else {
+      auto *f = (float *)scratch.data();
+      for (size_t i = 0; i < k; i++) {
+        std::memcpy(f + 3 * i, &spheres.positions[order[i]], sizeof(float3));
+        f[3 * k + i] = spheres.distances[order[i]];
+      }
+      shuffleBytes(scratch.data(), 4 * k, sizeof(float), raw);
+    }
+    return chunkRawSize(encoding, k);
+  }
+
+  FILE *file{nullptr};
+  SceneEncoding encoding{SceneEncoding::Float32};
+  uint32_t chunkSize{65536};
+  uint64_t numSpheres{0};
+  uint32_t numSteps{0};
+  uint64_t offset{0};
+  std::vector<ChunkIndexEntry> index;
+  std::vector<uint32_t> order; // stored sphere order, from the first step
+  std::vector<uint32_t> primitiveIndices;
+};
+
+// ========================================================
+// Reader: header and index are read on open, chunks are
+//  read on demand with pread from the worker threads
+// ========================================================
+struct ChunkedSceneReader
+{
+  ~ChunkedSceneReader()
+  {
+    close();
+  }
+
+  bool open(const char *fileName)
+  {
+    close();
+    fd = ::open(fileName, O_RDONLY);
+    if (fd < 0)
+      return false;
+
+    char magic[4];
+    uint32_t header[3];
+    uint8_t footer[16];
+    const off_t fileSize = lseek(fd, 0, SEEK_END);
+    bool ok = fileSize >= off_t(44) && readAt(magic, 4, 0)
+        && std::equal(magic, magic + 4, chunkMagic)
+        && readAt(header, sizeof(header), 4) && header[0] == 1
+        && readAt(&numSpheres, sizeof(numSpheres), 16)
+        && readAt(&radius, sizeof(radius), 24)
+        && readAt(footer, sizeof(footer), uint64_t(fileSize) - 16)
+        && std::equal(footer + 12, footer + 16, chunkMagic);
+    if (!ok) {
+      close();
+      return false;
+    }
+
+    encoding = SceneEncoding(header[1]);
+    chunkSize = header[2];
+    std::memcpy(&numSteps, footer, sizeof(numSteps));
+    std::memcpy(&indicesOffset, footer + 4, sizeof(indicesOffset));
+
+    // primitive.index and the chunk index must fill the space between
+    // indexOffset and the footer exactly; checked before allocating, with
+    // each term bounded first so nothing overflows
+    const uint64_t trailerEnd = uint64_t(fileSize) - 16;
+    ok = (encoding == SceneEncoding::Float32
+             || encoding == SceneEncoding::Quantized16)
+        && chunkSize >= 1 && chunkSize <= maxChunkSize
+        && numSpheres <= maxChunkedSpheres && indicesOffset >= 28
+        && indicesOffset <= trailerEnd
+        && numSpheres * sizeof(uint32_t) <= trailerEnd - indicesOffset;
+    const uint64_t indexBytes =
+        ok ? trailerEnd - indicesOffset - numSpheres * sizeof(uint32_t) : 0;
+    ok = ok
+        && indexBytes
+            == uint64_t(numSteps) * numChunks() * sizeof(ChunkIndexEntry);
+    if (ok) {
+      index.resize(size_t(numSteps) * numChunks());
+      ok = readAt(index.data(),
+          index.size() * sizeof(ChunkIndexEntry),
+          indicesOffset + numSpheres * sizeof(uint32_t));
+    }
+    if (!ok)
+      close();
+    return ok;
+  }
+
+  void close()
+  {
+    if (fd >= 0)
+      ::close(fd);
+    fd = -1;
+  }
+
+  size_t numChunks() const
+  {
+    return size_t((numSpheres + chunkSize - 1) / chunkSize);
+  }
+
+  bool readAt(void *dst, size_t size, uint64_t offset) const
+  {
+    auto *p = (uint8_t *)dst;
+    while (size > 0) {
+      const ssize_t n = pread(fd, p, size, off_t(offset));
+      if (n <= 0)
+        return false;
+      p += n;
+      size -= size_t(n);
+      offset += uint64_t(n);
+    }
+    return true;
+  }
+
+  // Reads primitive.index (numSpheres entries), false if out of range
+  bool readIndices(uint32_t *indices) const
+  {
+    return fd >= 0
+        && readAt(indices, numSpheres * sizeof(uint32_t), indicesOffset)
+        && std::all_of(indices, indices + numSpheres, [&](uint32_t i) {
+             return i < numSpheres;
+           });
+  }
+
+  // Total compressed and raw bytes of a step
+  void stepBytes(uint32_t step, uint64_t &compressed, uint64_t &raw) const
+  {
+    compressed = raw = 0;
+    for (size_t c = 0; c < numChunks(); c++) {
+      compressed += index[step * numChunks() + c].compressedSize;
+      raw += index[step * numChunks() + c].rawSize;
+    }
+  }
+
+  // Reads, decompresses and decodes one step into positions/attributes
+  // (numSpheres each), in parallel over chunks
+  bool readStep(uint32_t step, float3 *positions, float *attributes) const
+  {
+    if (fd < 0 || step >= numSteps)
+      return false;
+
+    const size_t maxRaw = chunkRawSize(encoding, chunkSize);
+    std::vector<uint8_t> ok(numChunks(), 1);
+    parallelFor(numChunks(), [&](size_t begin, size_t end) {
+      std::vector<uint8_t> compressed(lzCompressBound(maxRaw));
+      std::vector<uint8_t> raw(maxRaw), scratch(maxRaw);
+      for (size_t c = begin; c < end; c++) {
+        const ChunkIndexEntry &e = index[step * numChunks() + c];
+        const size_t s0 = c * chunkSize;
+        const size_t k = std::min<size_t>(chunkSize, numSpheres - s0);
+        if (e.rawSize != chunkRawSize(encoding, k)
+            || e.compressedSize > compressed.size()
+            || !readAt(compressed.data(), e.compressedSize, e.offset)
+            || lzDecompress(
+                   compressed.data(), e.compressedSize, raw.data(), maxRaw)
+                != e.rawSize) {
+          ok[c] = 0;
+          continue;
+        }
+        unpackChunk(raw.data(), k, scratch, positions + s0, attributes + s0);
+      }
+    });
+
+    return std::all_of(ok.begin(), ok.end(), [](uint8_t v) { return v != 0; });
+  }
+
+  void unpackChunk(const uint8_t *raw,
+      size_t k,
+      std::vector<uint8_t> &scratch,
+      float3 *positions,
+      float *attributes) const
+  {
+    if (encoding == SceneEncoding::Quantized16) {
+      QuantizedBlock block;
+      std::memcpy(&block, raw, sizeof(block));
+      unshuffleBytes(
+          raw + sizeof(block), 4 * k, sizeof(uint16_t), scratch.data());
+      const auto *q = (const uint16_t *)scratch.data();
+      decodeQuantizedBlock(
+          block, q, q + 3 * k, k, (float *)positions, attributes);
+    } else {
+      // Positions and attributes are contiguous word ranges of the chunk
+      unshuffleBytes(raw, 4 * k, sizeof(float), scratch.data());
+      std::memcpy(positions, scratch.data(), k * sizeof(float3));
+      std::memcpy(
+          attributes, scratch.data() + k * sizeof(float3), k * sizeof(float));
+    }
+  }
+
+  int fd{-1};
+  SceneEncoding encoding{SceneEncoding::Float32};
+  uint32_t chunkSize{0};
+  uint64_t numSpheres{0};
+  float radius{.015f};
+  uint32_t numSteps{0};
+  uint64_t indicesOffset{0};
+  std::vector<ChunkIndexEntry> index; // step major
+};
+
+// ========================================================
+// upload a step into a sphere geometry, replacing any
+//  previous arrays; the caller commits the geometry
+// ========================================================
+static bool setChunkedSphereArrays(anari::Device device,
+    anari::Geometry geometry,
+    const ChunkedSceneReader &reader,
+    uint32_t step)
+{
+  // open() rejects files with more than UINT32_MAX spheres
+  const uint32_t numSpheres = uint32_t(reader.numSpheres);
+
+  auto indicesArray = anari::newArray1D(device, ANARI_UINT32, numSpheres);
+  auto positionsArray =
+      anari::newArray1D(device, ANARI_FLOAT32_VEC3, numSpheres);
+  auto distanceArray = anari::newArray1D(device, ANARI_FLOAT32, numSpheres);
+
+  auto *positions = anari::map<float3>(device, positionsArray);
+  auto *distances = anari::map<float>(device, distanceArray);
+  const bool ok = reader.readStep(step, positions, distances);
+  anari::unmap(device, positionsArray);
+  anari::unmap(device, distanceArray);
+
+  auto *indices = anari::map<uint32_t>(device, indicesArray);
+  const bool indicesOk = reader.readIndices(indices);
+  if (!indicesOk)
+    std::fill(indices, indices + numSpheres, 0u);
+  anari::unmap(device, indicesArray);
+
+  anari::setAndReleaseParameter(
+      device, geometry, "primitive.index", indicesArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.position", positionsArray);
+  anari::setAndReleaseParameter(
+      device, geometry, "vertex.attribute0", distanceArray);
+  anari::setParameter(device, geometry, "radius", reader.radius);
+  return ok && indicesOk;
+}
+
+// ========================================================
+// build the test scene's world from a step of a chunked
+//  file; also returns (retained) the sphere geometry so
+//  later steps can be loaded into it. Returns nullptr if
+//  the step can't be read.
+// ========================================================
+static anari::World newChunkedSphereWorld(anari::Device device,
+    const ChunkedSceneReader &reader,
+    uint32_t step,
+    anari::Geometry *geometryOUT = nullptr)
+{
+  auto geometry = anari::newObject<anari::Geometry>(device, "sphere");
+  if (!setChunkedSphereArrays(device, geometry, reader, step)) {
+    anari::release(device, geometry);
+    return nullptr;
+  }
+  anari::commitParameters(device, geometry);
+  if (geometryOUT) {
+    anari::retain(device, geometry);
+    *geometryOUT = geometry;
+  }
+
+  return newSurfaceWorld(device, newGeometrySurface(device, geometry));
+}
@@ -0,0 +1,415 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// posix
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <unistd.h>
+// std
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Scene.h"
+
+// ========================================================
+// Application-owned scene arrays for very large scenes.
+//  Sphere data is generated straight into page-aligned
+//  mappings, optionally backed by transparent or explicit
+//  (hugetlbfs) huge pages, and handed to the device
+//  without a copy. The first write to every page happens
+//  on worker threads pinned to the NUMA nodes, so pages
+//  are placed on the node of the thread that fills them.
+// ========================================================
+
+enum class PageMode
+{
+  Base, // base pages only (THP disabled for the mapping)
+  Transparent, // madvise(MADV_HUGEPAGE)
+  Explicit, // MAP_HUGETLB, needs reserved pages (vm.nr_hugepages)
+};
+
+static const char *pageModeName(PageMode mode)
+{
+  switch (mode) {
+  case PageMode::Transparent:
+    return "thp";
+  case PageMode::Explicit:
+    return "hugetlb";
+  default:
+    return "base";
+  }
+}
+
+static bool parsePageMode(const char *name, PageMode &mode)
+{
+  if (!std::strcmp(name, "base"))
+    mode = PageMode::Base;
+  else if (!std::strcmp(name, "thp"))
+    mode = PageMode::Transparent;
+  else if (!std::strcmp(name, "hugetlb"))
+    mode = PageMode::Explicit;
+  else
+    return false;
+  return true;
+}
+
+// Page faults of the whole process so far, including device threads
+struct PageFaults
+{
+  long minor{0};
+  long major{0};
+};
+
+static PageFaults pageFaults()
+{
+  PageFaults result;
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) == 0) {
+    result.minor = usage.ru_minflt;
+    result.major = usage.ru_majflt;
+  }
+  return result;
+}
+
+// ========================================================
+// Page-aligned anonymous mappings
+// ========================================================
+
+struct SceneBuffer
+{
+  void *data{nullptr};
+  size_t bytes{0};
+  void *mapping{nullptr}; // what to munmap
+  size_t mappedBytes{0};
+  PageMode mode{PageMode::Base}; // what was actually used
+};
+
+static constexpr size_t hugePageSize = size_t(2) << 20;
+
+static size_t roundUp(size_t value, size_t alignment)
+{
+  return (value + alignment - 1) / alignment * alignment;
+}
+
+static void freeSceneBuffer(SceneBuffer *buffer)
+{
+  if (!buffer)
+    return;
+  if (buffer->mapping)
+    munmap(buffer->mapping, buffer->mappedBytes);
+  delete buffer;
+}
+
+// Reserves address space only; pages are faulted in on first touch.
+// Falls back to transparent huge pages if no explicit ones are reserved.
+static SceneBuffer *allocateSceneBuffer(size_t bytes, PageMode mode)
+{
+  auto *buffer = new SceneBuffer;
+  buffer->bytes = bytes;
+  buffer->mode = mode;
+  const int prot = PROT_READ | PROT_WRITE;
+  const int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+
+#ifdef MAP_HUGETLB
+  if (mode == PageMode::Explicit) {
+    buffer->mappedBytes = roundUp(std::max<size_t>(bytes, 1), hugePageSize);
+    void *p = mmap(
+        nullptr, buffer->mappedBytes, prot, flags | MAP_HUGETLB, -1, 0);
+    if (p != MAP_FAILED) {
+      buffer->mapping = buffer->data = p;
+      return buffer;
+    }
+    fprintf(stderr,
+        "MAP_HUGETLB failed for %zu bytes (reserve pages with "
+        "vm.nr_hugepages), falling back to thp\n",
+        buffer->mappedBytes);
+  }
+#endif
+  if (mode == PageMode::Explicit)
+    buffer->mode = mode = PageMode::Transparent;
+
+  // Over-allocate so the data can start on a huge page boundary
+  buffer->mappedBytes = roundUp(bytes, hugePageSize) + hugePageSize;
+  void *p = mmap(nullptr, buffer->mappedBytes, prot, flags, -1, 0);
+  if (p == MAP_FAILED) {
+    delete buffer;
+    return nullptr;
+  }
+  buffer->mapping = p;
+  buffer->data = (void *)roundUp(size_t(p), hugePageSize);
+
+#if defined(MADV_HUGEPAGE) && defined(MADV_NOHUGEPAGE)
+  const int advice =
+      mode == PageMode::Transparent ? MADV_HUGEPAGE : MADV_NOHUGEPAGE;
+  if (madvise(buffer->mapping, buffer->mappedBytes, advice) != 0
+      && mode == PageMode::Transparent) {
+    fprintf(stderr, "madvise(MADV_HUGEPAGE) failed, using base pages\n");
+    buffer->mode = PageMode::Base;
+  }
+#else
+  buffer->mode = PageMode::Base;
+#endif
+
+  return buffer;
+}
+
+// ANARI deleter for arrays shared from a SceneBuffer
+static void sceneBufferDeleter(const void *userPtr, const void *)
+{
+  freeSceneBuffer((SceneBuffer *)userPtr);
+}
+
+// ========================================================
+// NUMA nodes from sysfs, and a parallelFor whose workers
+//  are pinned to them (no libnuma dependency)
+// ========================================================
+
+// Parses lists like "0-3,8-11"
+static std::vector<int> parseCpuList(const char *list)
+{
+  std::vector<int> result;
+  const char *s = list;
+  while (*s) {
+    char *end = nullptr;
+    const long first = std::strtol(s, &end, 10);
+    if (end == s)
+      break;
+    long last = first;
+    s = end;
+    if (*s == '-') {
+      last = std::strtol(s + 1, &end, 10);
+      s = end;
+    }
+    for (long i = first; i <= last; i++)
+      result.push_back(int(i));
+    while (*s == ',' || *s == '\n' || *s == ' ')
+      s++;
+  }
+  return result;
+}
+
+static std::string readLine(const char *fileName)
+{
+  std::string result;
+  if (FILE *fp = fopen(fileName, "r")) {
+    char line[4096];
+    if (fgets(line, sizeof(line), fp))
+      result = line;
+    fclose(fp);
+  }
+  return result;
+}
+
+// CPUs of every NUMA node; a single node with all CPUs if unknown
+static const std::vector<std::vector<int>> &numaNodes()
+{
+  static const std::vector<std::vector<int>> nodes = [] {
+    std::vector<std::vector<int>> result;
+    const std::string online = readLine("/sys/devices/system/node/online");
+    for (int node : parseCpuList(online.c_str())) {
+      char fileName[128];
+      snprintf(fileName,
+          sizeof(fileName),
+          "/sys/devices/system/node/node%d/cpulist",
+          node);
+      std::vector<int> cpus = parseCpuList(readLine(fileName).c_str());
+      if (!cpus.empty())
+        result.push_back(cpus);
+    }
+    if (result.empty()) {
+      result.emplace_back();
+      for (unsigned i = 0; i < std::thread::hardware_concurrency(); i++)
+        result[0].push_back(int(i));
+    }
+    return result;
+  }();
+  return nodes;
+}
+
+// Restricts the calling thread to the given CPUs
+static bool pinCurrentThread(const std::vector<int> &cpus)
+{
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (int cpu : cpus) {
+    if (cpu < CPU_SETSIZE)
+      CPU_SET(cpu, &set);
+  }
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpus;
+  return false;
+#endif
+}
+
+// Like parallelFor, but range r of R runs on a thread pinned to node
+// r * numNodes / R, so consecutive ranges share a node
+template <typename Func>
+inline void parallelForPinned(size_t n, Func &&func, size_t minRangeSize = 1)
+{
+  const auto &nodes = numaNodes();
+  const size_t maxRanges =
+      std::max<size_t>(1, n / std::max<size_t>(1, minRangeSize));
+  const size_t numRanges = std::min<size_t>(numThreads(), maxRanges);
+
+  std::vector<std::thread> threads;
+  threads.reserve(numRanges);
+  for (size_t r = 0; r < numRanges; r++) {
+    const size_t begin = n * r / numRanges;
+    const size_t end = n * (r + 1) / numRanges;
+    const auto &cpus = nodes[r * nodes.size() / numRanges];
+    threads.emplace_back([&func, &cpus, begin, end] {
+      pinCurrentThread(cpus);
+      func(begin, end);
+    });
+  }
+
+  for (auto &t : threads)
+    t.join();
+}
+
+// ========================================================
+// The test scene's spheres, generated into SceneBuffers
+// ========================================================
+
+struct SceneArrays
+{
+  SceneBuffer *positions{nullptr}; // float3
+  SceneBuffer *distances{nullptr}; // float
+  SceneBuffer *indices{nullptr}; // uint32_t
+  size_t numSpheres{0};
+  float radius{.015f};
+};
+
+static void freeSceneArrays(SceneArrays &arrays)
+{
+  freeSceneBuffer(arrays.positions);
+  freeSceneBuffer(arrays.distances);
+  freeSceneBuffer(arrays.indices);
+  arrays = SceneArrays();
+}
+
+// Same distribution as generateSpheres(), but filled in blocks with their
+// own seeds so the result does not depend on the thread count. Indices are
+// not shuffled: at this size, that would be a serial pass over all pages.
+static void fillSphereBlocks(const float3 &pos,
+    size_t numSpheres,
+    size_t firstBlock,
+    size_t lastBlock,
+    float3 *positions,
+    float *distances,
+    uint32_t *indices)
+{
+  constexpr size_t blockSize = size_t(1) << 16;
+  std::normal_distribution<float> vert_dist(0.f, 0.25f);
+  for (size_t b = firstBlock; b < lastBlock; b++) {
+    std::mt19937 rng;
+    rng.seed(uint32_t(b));
+    const size_t end = std::min(numSpheres, (b + 1) * blockSize);
+    for (size_t i = b * blockSize; i < end; i++) {
+      const float x = vert_dist(rng);
+      const float y = vert_dist(rng);
+      const float z = vert_dist(rng);
+      positions[i] = float3(x, y, z) + pos;
+      distances[i] = std::sqrt(x * x + y * y + z * z);
+      indices[i] = uint32_t(i);
+    }
+  }
+}
+
+static size_t numSphereBlocks(size_t numSpheres)
+{
+  return (numSpheres + (size_t(1) << 16) - 1) >> 16;
+}
+
+// Sphere indices are 32 bit
+static const size_t maxSceneSpheres = UINT32_MAX;
+
+// First touch happens in fillSphereBlocks, on NUMA-pinned workers if
+// 'pinned', otherwise on unpinned ones; false for more than
+// maxSceneSpheres spheres or if the allocation fails
+static bool generateSceneArrays(const float3 &pos,
+    size_t numSpheres,
+    PageMode mode,
+    bool pinned,
+    SceneArrays &arrays)
+{
+  if (numSpheres > maxSceneSpheres)
+    return false;
+
+  arrays.numSpheres = numSpheres;
+  arrays.positions = allocateSceneBuffer(numSpheres * sizeof(float3), mode);
+  arrays.distances = allocateSceneBuffer(numSpheres * sizeof(float), mode);
+  arrays.indices = allocateSceneBuffer(numSpheres * sizeof(uint32_t), mode);
+  if (!arrays.positions || !arrays.distances || !arrays.indices) {
+    freeSceneArrays(arrays);
+    return false;
+  }
+
+  auto *positions = (float3 *)arrays.positions->data;
+  auto *distances = (float *)arrays.distances->data;
+  auto *indices = (uint32_t *)arrays.indices->data;
+  auto fill = [&](size_t begin, size_t end) {
+    fillSphereBlocks(
+        pos, numSpheres, begin, end, positions, distances, indices);
+  };
+  if (pinned)
+    parallelForPinned(numSphereBlocks(numSpheres), fill);
+  else
+    parallelFor(numSphereBlocks(numSpheres), fill);
+  return true;
+}
+
+// Shares the arrays with the device, which frees them through
+// sceneBufferDeleter once it no longer needs them; 'arrays' is consumed
+static anari::World newSharedSphereWorld(
+    anari::Device device, SceneArrays &arrays)
+{
+  auto share = [&](anari::Geometry geometry,
+                   const char *name,
+                   auto *data,
+                   SceneBuffer *buffer) {
+    anari::setAndReleaseParameter(device,
+        geometry,
+        name,
+        anari::newArray1D(device,
+            data,
+            sceneBufferDeleter,
+            buffer,
+            uint64_t(arrays.numSpheres)));
+  };
+
+  auto geometry = anari::newObject<anari::Geometry>(device, "sphere");
+  share(geometry,
+      "primitive.index",
+      (const uint32_t *)arrays.indices->data,
+      arrays.indices);
+  share(geometry,
+      "vertex.position",
+      (const float3 *)arrays.positions->data,
+      arrays.positions);
+  share(geometry,
+      "vertex.attribute0",
+      (const float *)arrays.distances->data,
+      arrays.distances);
+  anari::setParameter(device, geometry, "radius", arrays.radius);
+  anari::commitParameters(device, geometry);
+  arrays = SceneArrays();
+
+  return newSurfaceWorld(device, newGeometrySurface(device, geometry));
+}
@@ -0,0 +1,139 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+// ours
+#include "Projection.h"
+
+// ========================================================
+// Screens made of planar rectangular facets, e.g. to
+//  approximate a cylindrical wall. Each facet is an
+//  LL/LR/UR rectangle as used by offaxisStereoCamera and
+//  covers a pixel rectangle of the stitched output image.
+// ========================================================
+
+struct ScreenFacet
+{
+  float3 LL, LR, UR;
+  uint32_t x0, y0, width, height; // pixel rect in the stitched image
+};
+
+struct FacetScreen
+{
+  std::vector<ScreenFacet> facets;
+  uint2 imageSize{0, 0};
+};
+
+// Vertical cylinder segment around 'center' (at the bottom of the screen),
+// spanning 'arc' radians symmetrically around -Z, split into numFacets
+// columns. The stitched image is the unrolled cylinder, with square pixels
+// at imageHeight rows.
+static FacetScreen cylindricalScreen(float3 center,
+    float radius,
+    float arc,
+    float height,
+    uint32_t numFacets,
+    uint32_t imageHeight)
+{
+  FacetScreen screen;
+  const float arcLength = radius * arc;
+  screen.imageSize.x = uint32_t(std::round(imageHeight * arcLength / height));
+  screen.imageSize.y = imageHeight;
+
+  auto pointAt = [&](float angle, float y) {
+    return float3(center.x + radius * std::sin(angle),
+        center.y + y,
+        center.z - radius * std::cos(angle));
+  };
+
+  for (uint32_t i = 0; i < numFacets; i++) {
+    const float a0 = -0.5f * arc + arc * i / numFacets;
+    const float a1 = -0.5f * arc + arc * (i + 1) / numFacets;
+    ScreenFacet f;
+    f.LL = pointAt(a0, 0.f);
+    f.LR = pointAt(a1, 0.f);
+    f.UR = pointAt(a1, height);
+    f.x0 = screen.imageSize.x * i / numFacets;
+    f.width = screen.imageSize.x * (i + 1) / numFacets - f.x0;
+    f.y0 = 0;
+    f.height = imageHeight;
+    screen.facets.push_back(f);
+  }
+  return screen;
+}
+
+// Text file: "width height" of the stitched image, then one facet per line
+// as "LLx LLy LLz LRx LRy LRz URx URy URz x0 y0 width height"
+static bool loadFacetScreen(const char *fileName, FacetScreen &screen)
+{
+  FILE *fp = fopen(fileName, "r");
+  if (!fp)
+    return false;
+
+  screen = FacetScreen{};
+  bool ok =
+      fscanf(fp, "%u %u", &screen.imageSize.x, &screen.imageSize.y) == 2;
+
+  ScreenFacet f;
+  while (ok
+      && fscanf(fp,
+             "%f %f %f %f %f %f %f %f %f %u %u %u %u",
+             &f.LL.x,
+             &f.LL.y,
+             &f.LL.z,
+             &f.LR.x,
+             &f.LR.y,
+             &f.LR.z,
+             &f.UR.x,
+             &f.UR.y,
+             &f.UR.z,
+             &f.x0,
+             &f.y0,
+             &f.width,
+             &f.height)
+          == 13) {
+    ok = f.width > 0 && f.height > 0
+        && f.x0 + f.width <= screen.imageSize.x
+        && f.y0 + f.height <= screen.imageSize.y;
+    screen.facets.push_back(f);
+  }
+
+  fclose(fp);
+  return ok && !screen.facets.empty();
+}
+
+// Largest distance between a cylinder and its facets (the sagitta of the
+// chord), i.e. how far geometry on the facets is off the true surface
+static float cylindricalFacetError(float radius, float arc, uint32_t numFacets)
+{
+  return radius * (1.f - std::cos(0.5f * arc / numFacets));
+}
+
+// ========================================================
+// Strategy 2 cameras for all facets of a screen
+// ========================================================
+
+struct FacetCamera
+{
+  float3 dir, up;
+  float fovy, aspect;
+  float4 imageRegion;
+};
+
+static void facetCameras(
+    const FacetScreen &screen, float3 eye, std::vector<FacetCamera> &cameras)
+{
+  cameras.resize(screen.facets.size());
+  for (size_t i = 0; i < screen.facets.size(); i++) {
+    const ScreenFacet &f = screen.facets[i];
+    FacetCamera &c = cameras[i];
+    offaxisStereoCamera(
+        f.LL, f.LR, f.UR, eye, c.dir, c.up, c.fovy, c.aspect, c.imageRegion);
+  }
+}
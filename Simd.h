@@ -0,0 +1,76 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdlib>
+#include <cstring>
+
+// ========================================================
+// Runtime ISA selection for the explicit SIMD paths of the
+//  host-side image stages. AVX2 kernels are compiled with
+//  a target attribute, so the build needs no ISA flags;
+//  SSE2 is part of x86-64. OFFAXIS_HOST_ISA=baseline|sse2
+//  caps the selection, e.g. to compare against the scalar
+//  loops.
+// ========================================================
+
+#if (defined(__GNUC__) || defined(__clang__)) && defined(__x86_64__)
+#define OFFAXIS_HOST_X86 1
+#include <immintrin.h>
+// Without FMA, so the kernels round like the scalar loops
+#define OFFAXIS_TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+enum class HostIsa
+{
+  Baseline, // scalar C++
+  SSE2,
+  AVX2,
+  Count,
+};
+
+inline const char *hostIsaName(HostIsa isa)
+{
+  static const char *names[] = {"baseline", "sse2", "avx2"};
+  return isa < HostIsa::Count ? names[int(isa)] : "<invalid>";
+}
+
+inline bool hostIsaSupported(HostIsa isa)
+{
+#ifdef OFFAXIS_HOST_X86
+  __builtin_cpu_init();
+  switch (isa) {
+  case HostIsa::Baseline:
+  case HostIsa::SSE2:
+    return true;
+  case HostIsa::AVX2:
+    return __builtin_cpu_supports("avx2");
+  default:
+    return false;
+  }
+#else
+  return isa == HostIsa::Baseline;
+#endif
+}
+
+// Best supported ISA, at most the one named by OFFAXIS_HOST_ISA
+inline HostIsa hostIsa()
+{
+  static const HostIsa isa = [] {
+    int limit = int(HostIsa::Count) - 1;
+    if (const char *env = std::getenv("OFFAXIS_HOST_ISA")) {
+      for (int i = 0; i < int(HostIsa::Count); i++) {
+        if (!std::strcmp(env, hostIsaName(HostIsa(i))))
+          limit = i;
+      }
+    }
+    for (int i = limit; i > 0; i--) {
+      if (hostIsaSupported(HostIsa(i)))
+        return HostIsa(i);
+    }
+    return HostIsa::Baseline;
+  }();
+  return isa;
+}
@@ -0,0 +1,169 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstring>
+// ours
+#include "Parallel.h"
+#include "Projection.h"
+
+// ========================================================
+// Packing of left/right eye RGBA8 images into the layouts
+//  expected by stereo displays. Each eye is rendered at
+//  exactly the resolution it occupies in the packed image
+//  (see stereoEyeSize), so packing reads the mapped frame
+//  buffers once and never resamples.
+// ========================================================
+
+enum class StereoFormat
+{
+  SideBySide,
+  TopBottom,
+  RowInterleaved,
+  ColumnInterleaved,
+  Anaglyph,
+};
+
+static const char *stereoFormatName(StereoFormat f)
+{
+  switch (f) {
+  case StereoFormat::SideBySide:
+    return "sbs";
+  case StereoFormat::TopBottom:
+    return "tb";
+  case StereoFormat::RowInterleaved:
+    return "rows";
+  case StereoFormat::ColumnInterleaved:
+    return "columns";
+  case StereoFormat::Anaglyph:
+    return "anaglyph";
+  }
+  return "unknown";
+}
+
+static bool parseStereoFormat(const char *name, StereoFormat &f)
+{
+  for (int i = 0; i <= int(StereoFormat::Anaglyph); i++) {
+    if (!std::strcmp(name, stereoFormatName(StereoFormat(i)))) {
+      f = StereoFormat(i);
+      return true;
+    }
+  }
+  return false;
+}
+
+// Resolution to render each eye at for a packed image of outSize
+static uint2 stereoEyeSize(StereoFormat f, uint2 outSize)
+{
+  switch (f) {
+  case StereoFormat::SideBySide:
+  case StereoFormat::ColumnInterleaved:
+    return uint2(outSize.x / 2, outSize.y);
+  case StereoFormat::TopBottom:
+  case StereoFormat::RowInterleaved:
+    return uint2(outSize.x, outSize.y / 2);
+  case StereoFormat::Anaglyph:
+    return outSize;
+  }
+  return outSize;
+}
+
+// Packed image size for eyes rendered at eyeSize
+static uint2 stereoPackedSize(StereoFormat f, uint2 eyeSize)
+{
+  switch (f) {
+  case StereoFormat::SideBySide:
+  case StereoFormat::ColumnInterleaved:
+    return uint2(eyeSize.x * 2, eyeSize.y);
+  case StereoFormat::TopBottom:
+  case StereoFormat::RowInterleaved:
+    return uint2(eyeSize.x, eyeSize.y * 2);
+  case StereoFormat::Anaglyph:
+    return eyeSize;
+  }
+  return eyeSize;
+}
+
+// Eye positions for a tracked head: offset by half the interpupillary
+// distance along the screen's horizontal axis
+static void stereoEyes(float3 LL,
+    float3 LR,
+    float3 head,
+    float ipd,
+    float3 &leftOUT,
+    float3 &rightOUT)
+{
+  const float3 X = normalize(LR - LL);
+  leftOUT = head - X * (0.5f * ipd);
+  rightOUT = head + X * (0.5f * ipd);
+}
+
+// Pack one output row; rows are in ANARI order (row 0 at the bottom)
+static void packStereoRow(StereoFormat f,
+    const uint32_t *__restrict left,
+    const uint32_t *__restrict right,
+    uint2 eyeSize,
+    uint32_t *__restrict out,
+    uint32_t y)
+{
+  const uint32_t w = eyeSize.x, h = eyeSize.y;
+
+  switch (f) {
+  case StereoFormat::SideBySide: {
+    uint32_t *dst = out + size_t(y) * 2 * w;
+    std::memcpy(dst, left + size_t(y) * w, w * sizeof(uint32_t));
+    std::memcpy(dst + w, right + size_t(y) * w, w * sizeof(uint32_t));
+    break;
+  }
+  case StereoFormat::TopBottom: {
+    // Left eye in the top half, i.e. the upper rows
+    const uint32_t *src = y < h ? right + size_t(y) * w
+                                : left + size_t(y - h) * w;
+    std::memcpy(out + size_t(y) * w, src, w * sizeof(uint32_t));
+    break;
+  }
+  case StereoFormat::RowInterleaved: {
+    // Even rows (counted from the top) show the left eye
+    const uint32_t *src = ((2 * h - 1 - y) & 1) ? right : left;
+    std::memcpy(out + size_t(y) * w,
+        src + size_t(y / 2) * w,
+        w * sizeof(uint32_t));
+    break;
+  }
+  case StereoFormat::ColumnInterleaved: {
+    const uint32_t *l = left + size_t(y) * w;
+    const uint32_t *r = right + size_t(y) * w;
+    uint32_t *dst = out + size_t(y) * 2 * w;
+    for (uint32_t x = 0; x < w; x++) {
+      dst[2 * x] = l[x];
+      dst[2 * x + 1] = r[x];
+    }
+    break;
+  }
+  case StereoFormat::Anaglyph: {
+    // Red-cyan: red from the left eye, green/blue/alpha from the right
+    const uint32_t *l = left + size_t(y) * w;
+    const uint32_t *r = right + size_t(y) * w;
+    uint32_t *dst = out + size_t(y) * w;
+    for (uint32_t x = 0; x < w; x++)
+      dst[x] = (l[x] & 0x000000ffu) | (r[x] & 0xffffff00u);
+    break;
+  }
+  }
+}
+
+// Pack both eyes into out (stereoPackedSize(f, eyeSize) pixels), parallel
+// over output rows
+static void packStereo(StereoFormat f,
+    const uint32_t *left,
+    const uint32_t *right,
+    uint2 eyeSize,
+    uint32_t *out)
+{
+  const uint2 outSize = stereoPackedSize(f, eyeSize);
+  parallelForRows(outSize.y,
+      [&](unsigned y) { packStereoRow(f, left, right, eyeSize, out, y); });
+}
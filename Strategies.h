@@ -0,0 +1,124 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// ours
+#include "Projection.h"
+
+// ========================================================
+// Camera setup for the three strategies, split into
+//  object creation and per-frame parameter updates so
+//  render loops can reuse their camera objects
+// ========================================================
+
+static void setPerspectiveCameraParameters(anari::Device device,
+    anari::Camera camera,
+    float3 eye,
+    float3 dir,
+    float3 up,
+    float fovy,
+    float aspect,
+    float4 imgRegion)
+{
+  anari::setParameter(device, camera, "position", eye);
+  anari::setParameter(device, camera, "direction", dir);
+  anari::setParameter(device, camera, "up", up);
+  anari::setParameter(device, camera, "fovy", fovy);
+  anari::setParameter(device, camera, "aspect", aspect);
+  anari::setParameter(
+      device, camera, "imageRegion", ANARI_FLOAT32_BOX2, &imgRegion);
+
+  anari::commitParameters(device, camera);
+}
+
+// Strategy 1 (requires ANARI_VSNRAY_CAMERA_MATRIX)
+static void setMatrixCameraParameters(
+    anari::Device device, anari::Camera camera, mat4 proj, mat4 view)
+{
+  anari::setParameter(device, camera, "proj", proj);
+  anari::setParameter(device, camera, "view", view);
+
+  anari::commitParameters(device, camera);
+}
+
+// Strategy 2
+static void setFixedFrameCameraParameters(anari::Device device,
+    anari::Camera camera,
+    float3 LL,
+    float3 LR,
+    float3 UR,
+    float3 eye)
+{
+  float3 dir, up;
+  float fovy, aspect;
+  float4 imgRegion;
+  offaxisStereoCamera(LL, LR, UR, eye, dir, up, fovy, aspect, imgRegion);
+
+  setPerspectiveCameraParameters(
+      device, camera, eye, dir, up, fovy, aspect, imgRegion);
+}
+
+// Strategy 3
+static void setMatrixFrameCameraParameters(
+    anari::Device device, anari::Camera camera, mat4 proj, mat4 view)
+{
+  float3 eye, dir, up;
+  float fovy, aspect;
+  float4 imgRegion;
+  offaxisStereoCameraFromTransform(
+      inverse(proj), inverse(view), eye, dir, up, fovy, aspect, imgRegion);
+
+  setPerspectiveCameraParameters(
+      device, camera, eye, dir, up, fovy, aspect, imgRegion);
+}
+
+enum class Strategy
+{
+  MatrixCamExtension = 1,
+  FixedFrame = 2,
+  MatricesToPerspective = 3,
+};
+
+static const char *strategyName(Strategy s)
+{
+  switch (s) {
+  case Strategy::MatrixCamExtension:
+    return "Strategy 1 (matrix camera)";
+  case Strategy::FixedFrame:
+    return "Strategy 2 (perspective, fixed frame)";
+  case Strategy::MatricesToPerspective:
+    return "Strategy 3 (perspective, from matrices)";
+  }
+  return "unknown";
+}
+
+static anari::Camera newStrategyCamera(anari::Device device, Strategy s)
+{
+  return anari::newObject<anari::Camera>(
+      device, s == Strategy::MatrixCamExtension ? "matrix" : "perspective");
+}
+
+// Compute and commit the camera for the given strategy and screen/eye
+static void setStrategyCameraParameters(anari::Device device,
+    anari::Camera camera,
+    Strategy s,
+    float3 LL,
+    float3 LR,
+    float3 UR,
+    float3 eye)
+{
+  if (s == Strategy::FixedFrame) {
+    setFixedFrameCameraParameters(device, camera, LL, LR, UR, eye);
+    return;
+  }
+
+  mat4 proj, view;
+  offaxisStereoTransform(LL, LR, UR, eye, proj, view);
+  if (s == Strategy::MatrixCamExtension)
+    setMatrixCameraParameters(device, camera, proj, view);
+  else
+    setMatrixFrameCameraParameters(device, camera, proj, view);
+}
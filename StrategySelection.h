@@ -0,0 +1,145 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+// ours
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// ========================================================
+// Runtime selection of the cheapest correct strategy.
+//  Supported strategies are probed via device extensions,
+//  each renders a short calibration run under a moving
+//  eye, and its image at the rest position is compared
+//  against Strategy 2, which every device supporting the
+//  perspective camera renders correctly. The fastest
+//  strategy with an equivalent image wins.
+// ========================================================
+
+struct StrategyCalibration
+{
+  Strategy strategy;
+  bool supported{false};
+  bool equivalent{false};
+  double rmse{0.0}; // vs Strategy 2, 8-bit units
+  Stats frameTime; // camera update + render + wait
+};
+
+struct StrategySelection
+{
+  Strategy selected{Strategy::FixedFrame};
+  std::vector<StrategyCalibration> calibrations;
+};
+
+// Calibrate all supported strategies on 'frame' (which must have a
+// UFIXED8 color channel, world and renderer set). The frame's camera is
+// left unset; callers create their own camera for the selected strategy.
+// 'tolerance' is the largest RMSE (8-bit units) still considered equal,
+// which must allow for sampling noise between two renders
+static StrategySelection selectStrategy(anari::Library library,
+    const char *deviceSubtype,
+    anari::Device device,
+    anari::Frame frame,
+    float3 LL,
+    float3 LR,
+    float3 UR,
+    float3 eye,
+    int numFrames = 10,
+    double tolerance = 2.0)
+{
+  StrategySelection selection;
+
+  const Strategy order[] = {Strategy::FixedFrame,
+      Strategy::MatrixCamExtension,
+      Strategy::MatricesToPerspective};
+
+  std::vector<uint32_t> reference;
+
+  for (Strategy s : order) {
+    StrategyCalibration c;
+    c.strategy = s;
+    c.supported = s != Strategy::MatrixCamExtension
+        || deviceHasExtension(
+            library, deviceSubtype, "ANARI_VSNRAY_CAMERA_MATRIX");
+    if (!c.supported) {
+      selection.calibrations.push_back(c);
+      continue;
+    }
+
+    auto camera = newStrategyCamera(device, s);
+    anari::setParameter(device, frame, "camera", camera);
+    anari::commitParameters(device, frame);
+
+    // Image at the rest position, also warms up the device
+    setStrategyCameraParameters(device, camera, s, LL, LR, UR, eye);
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    const size_t numPixels = size_t(fb.width) * fb.height;
+    if (reference.empty()) {
+      reference.assign(fb.data, fb.data + numPixels);
+      c.equivalent = true;
+    } else if (reference.size() == numPixels) {
+      c.rmse = rmseRGBA8(reference.data(), fb.data, numPixels);
+      c.equivalent = c.rmse <= tolerance;
+    }
+    anari::unmap(device, frame, "channel.color");
+
+    // Timed run, including the per-frame camera math and commits
+    for (int i = 0; i < numFrames; i++) {
+      const float t = i * 0.05f;
+      const float3 e =
+          eye + float3(0.2f * std::sin(t), 0.1f * std::cos(0.7f * t), 0.f);
+      Timer timer;
+      setStrategyCameraParameters(device, camera, s, LL, LR, UR, e);
+      anari::render(device, frame);
+      anari::wait(device, frame);
+      c.frameTime.add(timer.elapsedMs());
+    }
+
+    anari::unsetParameter(device, frame, "camera");
+    anari::commitParameters(device, frame);
+    anari::release(device, camera);
+
+    selection.calibrations.push_back(c);
+  }
+
+  double best = -1.0;
+  for (const auto &c : selection.calibrations) {
+    if (!c.supported || !c.equivalent)
+      continue;
+    if (best < 0.0 || c.frameTime.mean() < best) {
+      best = c.frameTime.mean();
+      selection.selected = c.strategy;
+    }
+  }
+
+  return selection;
+}
+
+static void printStrategySelection(const StrategySelection &selection)
+{
+  printf("strategy calibration:\n");
+  for (const auto &c : selection.calibrations) {
+    if (!c.supported) {
+      printf("  %-40s not supported by the device\n", strategyName(c.strategy));
+      continue;
+    }
+    printf("  %-40s %8.2fms/frame  RMSE %6.3f  %s\n",
+        strategyName(c.strategy),
+        c.frameTime.mean(),
+        c.rmse,
+        c.equivalent ? "ok" : "image differs, rejected");
+  }
+  printf("  => selected %s\n", strategyName(selection.selected));
+}
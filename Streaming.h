@@ -0,0 +1,210 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+// ours
+#include "Codec.h"
+#include "Parallel.h"
+#include "Tiles.h"
+
+// ========================================================
+// Tile-based delta encoding of RGBA8 framebuffers for
+//  streaming to thin clients. Only tiles that changed
+//  since the previous frame are sent; each is XORed with
+//  its previous contents (so unchanged pixels become zero
+//  bytes) and LZ-compressed. Message layout:
+//
+//   u32 magic 'OXFB', u32 frameID, u32 width, u32 height,
+//   u32 tileSize, u32 numTiles,
+//   numTiles x { u32 tileIndex, u32 size, u8 data[size] }
+// ========================================================
+
+static constexpr uint32_t streamMagic = 0x4246584f; // "OXFB"
+
+// Indices of all tiles whose pixels differ between cur and prev
+static std::vector<uint32_t> findChangedTiles(
+    const TileGrid &grid, const uint32_t *cur, const uint32_t *prev)
+{
+  std::vector<uint8_t> changed(grid.numTiles(), 0);
+  parallelFor(grid.numTiles(), [&](size_t begin, size_t end) {
+    for (size_t t = begin; t < end; t++) {
+      uint32_t x0, y0, x1, y1;
+      grid.tileBounds(uint32_t(t), x0, y0, x1, y1);
+      const size_t rowBytes = (x1 - x0) * sizeof(uint32_t);
+      for (uint32_t y = y0; y < y1 && !changed[t]; y++) {
+        const size_t offset = size_t(y) * grid.width + x0;
+        changed[t] = std::memcmp(cur + offset, prev + offset, rowBytes) != 0;
+      }
+    }
+  });
+
+  std::vector<uint32_t> result;
+  for (uint32_t t = 0; t < grid.numTiles(); t++) {
+    if (changed[t])
+      result.push_back(t);
+  }
+  return result;
+}
+
+static void streamPut32(std::vector<uint8_t> &out, uint32_t v)
+{
+  const uint8_t b[4] = {
+      uint8_t(v), uint8_t(v >> 8), uint8_t(v >> 16), uint8_t(v >> 24)};
+  out.insert(out.end(), b, b + 4);
+}
+
+static uint32_t streamGet32(const uint8_t *p)
+{
+  return p[0] | (p[1] << 8) | (p[2] << 16) | (uint32_t(p[3]) << 24);
+}
+
+// Gather a tile's pixels XORed with the previous frame into scratch
+static size_t gatherTileDelta(const TileGrid &grid,
+    uint32_t tile,
+    const uint32_t *cur,
+    const uint32_t *prev,
+    uint32_t *scratch)
+{
+  uint32_t x0, y0, x1, y1;
+  grid.tileBounds(tile, x0, y0, x1, y1);
+  size_t n = 0;
+  for (uint32_t y = y0; y < y1; y++) {
+    const uint32_t *c = cur + size_t(y) * grid.width;
+    const uint32_t *p = prev + size_t(y) * grid.width;
+    for (uint32_t x = x0; x < x1; x++)
+      scratch[n++] = c[x] ^ p[x];
+  }
+  return n;
+}
+
+// Encode the delta from prev to cur into a message, compressing tiles in
+// parallel; returns the number of tiles sent
+static uint32_t encodeFrameDelta(const TileGrid &grid,
+    uint32_t frameID,
+    const uint32_t *cur,
+    const uint32_t *prev,
+    std::vector<uint8_t> &out)
+{
+  const auto tiles = findChangedTiles(grid, cur, prev);
+  const size_t maxTileBytes =
+      size_t(grid.tileSize) * grid.tileSize * sizeof(uint32_t);
+  const size_t stride = lzCompressBound(maxTileBytes);
+
+  std::vector<uint8_t> compressed(tiles.size() * stride);
+  std::vector<size_t> sizes(tiles.size());
+
+  parallelFor(tiles.size(), [&](size_t begin, size_t end) {
+    std::vector<uint32_t> scratch(size_t(grid.tileSize) * grid.tileSize);
+    for (size_t i = begin; i < end; i++) {
+      const size_t n =
+          gatherTileDelta(grid, tiles[i], cur, prev, scratch.data());
+      sizes[i] = lzCompress((const uint8_t *)scratch.data(),
+          n * sizeof(uint32_t),
+          compressed.data() + i * stride);
+    }
+  });
+
+  out.clear();
+  streamPut32(out, streamMagic);
+  streamPut32(out, frameID);
+  streamPut32(out, grid.width);
+  streamPut32(out, grid.height);
+  streamPut32(out, grid.tileSize);
+  streamPut32(out, uint32_t(tiles.size()));
+  for (size_t i = 0; i < tiles.size(); i++) {
+    streamPut32(out, tiles[i]);
+    streamPut32(out, uint32_t(sizes[i]));
+    const uint8_t *data = compressed.data() + i * stride;
+    out.insert(out.end(), data, data + sizes[i]);
+  }
+  return uint32_t(tiles.size());
+}
+
+// Apply a message to the client-side framebuffer fb (width x height);
+// returns false on malformed or mismatching messages, leaving fb unchanged
+static bool decodeFrameDelta(const uint8_t *msg,
+    size_t size,
+    uint32_t *fb,
+    uint32_t width,
+    uint32_t height,
+    uint32_t &frameID)
+{
+  if (size < 24 || streamGet32(msg) != streamMagic)
+    return false;
+  frameID = streamGet32(msg + 4);
+  if (streamGet32(msg + 8) != width || streamGet32(msg + 12) != height)
+    return false;
+  const uint32_t tileSize = streamGet32(msg + 16);
+  const uint32_t numTiles = streamGet32(msg + 20);
+  // Bound everything sized from the header before allocating
+  if (tileSize == 0 || tileSize > std::max(width, height))
+    return false;
+
+  TileGrid grid(width, height, tileSize);
+  if (numTiles > grid.numTiles() || numTiles > (size - 24) / 8)
+    return false;
+
+  // Locate the tiles first, then decode them in parallel; every tile may
+  // appear only once, so the tiles' deltas never exceed one frame
+  std::vector<uint32_t> tiles(numTiles);
+  std::vector<size_t> offsets(numTiles);
+  std::vector<size_t> sizes(numTiles);
+  std::vector<size_t> firstPixel(numTiles + 1, 0);
+  std::vector<uint8_t> seen(grid.numTiles(), 0);
+  size_t pos = 24;
+  for (uint32_t i = 0; i < numTiles; i++) {
+    if (size - pos < 8)
+      return false;
+    tiles[i] = streamGet32(msg + pos);
+    sizes[i] = streamGet32(msg + pos + 4);
+    offsets[i] = pos + 8;
+    pos += 8;
+    if (tiles[i] >= grid.numTiles() || seen[tiles[i]]
+        || sizes[i] > size - pos)
+      return false;
+    seen[tiles[i]] = 1;
+    pos += sizes[i];
+
+    uint32_t x0, y0, x1, y1;
+    grid.tileBounds(tiles[i], x0, y0, x1, y1);
+    firstPixel[i + 1] = firstPixel[i] + size_t(x1 - x0) * (y1 - y0);
+  }
+
+  // Decompress all deltas before touching fb: a bad tile must not leave
+  // the client framebuffer half-updated, or every later delta is off
+  std::vector<uint32_t> deltas(firstPixel[numTiles]);
+  std::vector<uint8_t> ok(numTiles, 1);
+  parallelFor(numTiles, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const size_t expected =
+          (firstPixel[i + 1] - firstPixel[i]) * sizeof(uint32_t);
+      const size_t n = lzDecompress(msg + offsets[i],
+          sizes[i],
+          (uint8_t *)(deltas.data() + firstPixel[i]),
+          expected);
+      ok[i] = n == expected;
+    }
+  });
+  if (!std::all_of(ok.begin(), ok.end(), [](uint8_t v) { return v != 0; }))
+    return false;
+
+  parallelFor(numTiles, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      uint32_t x0, y0, x1, y1;
+      grid.tileBounds(tiles[i], x0, y0, x1, y1);
+      const uint32_t *delta = deltas.data() + firstPixel[i];
+      for (uint32_t y = y0; y < y1; y++) {
+        uint32_t *row = fb + size_t(y) * width;
+        for (uint32_t x = x0; x < x1; x++)
+          row[x] ^= *delta++;
+      }
+    }
+  });
+  return true;
+}
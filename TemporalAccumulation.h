@@ -0,0 +1,164 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Projection.h"
+
+// ========================================================
+// Temporal accumulation for a moving tracked eye. Each
+//  pixel of the new frame is reconstructed in world space
+//  from its depth (distance along the primary ray) and the
+//  current off-axis matrices, projected into the previous
+//  frame with the previous matrices, and blended with the
+//  history found there. History whose depth disagrees with
+//  the reprojected point (disocclusion) is discarded.
+// ========================================================
+
+struct TemporalParams
+{
+  float maxHistory{32.f}; // cap on accumulated frames per pixel
+  float depthTolerance{0.02f}; // relative
+};
+
+struct TemporalHistory
+{
+  uint2 size{0, 0};
+  std::vector<float> color; // RGBA
+  std::vector<float> depth;
+  std::vector<float> count;
+  mat4 proj, view;
+  float3 eye;
+  bool valid{false};
+};
+
+// Points on the far plane of the frustum for the lower left, lower right
+// and upper left image corners; far plane points are affine in pixel
+// coordinates, so primary rays can be interpolated from these
+static void farPlaneCorners(mat4 proj, mat4 view, float3 corners[3])
+{
+  const mat4 projInv = inverse(proj);
+  const mat4 viewInv = inverse(view);
+  corners[0] = unprojectNDC(projInv, viewInv, float3(-1.f, -1.f, 1.f));
+  corners[1] = unprojectNDC(projInv, viewInv, float3(1.f, -1.f, 1.f));
+  corners[2] = unprojectNDC(projInv, viewInv, float3(-1.f, 1.f, 1.f));
+}
+
+// Blend the new frame (color RGBA, depth) into the history and write the
+// accumulated image to 'out'; returns the fraction of pixels whose history
+// was rejected
+static float temporalAccumulate(TemporalHistory &history,
+    const TemporalParams &params,
+    const float *color,
+    const float *depth,
+    uint2 size,
+    float3 eye,
+    mat4 proj,
+    mat4 view,
+    float *out)
+{
+  const size_t numPixels = size_t(size.x) * size.y;
+  const bool hasHistory = history.valid && history.size.x == size.x
+      && history.size.y == size.y;
+
+  std::vector<float> newDepth(depth, depth + numPixels);
+  std::vector<float> newCount(numPixels);
+
+  float3 corners[3];
+  farPlaneCorners(proj, view, corners);
+  const float3 dx = (corners[1] - corners[0]) / float(size.x);
+  const float3 dy = (corners[2] - corners[0]) / float(size.y);
+  const mat4 prevViewProj = mul(history.proj, history.view);
+
+  std::vector<size_t> rejectedPerRow(size.y, 0);
+
+  parallelForRows(size.y, [&](unsigned y) {
+    for (uint32_t x = 0; x < size.x; x++) {
+      const size_t p = size_t(y) * size.x + x;
+      const float *c = color + 4 * p;
+      const float t = depth[p];
+
+      float hist[4] = {0.f, 0.f, 0.f, 0.f};
+      float histCount = 0.f;
+
+      if (hasHistory) {
+        // World position of this pixel; background goes "far away"
+        const float3 far = corners[0] + dx * (x + 0.5f) + dy * (y + 0.5f);
+        const float3 dir = normalize(far - eye);
+        const bool background = !std::isfinite(t);
+        const float3 P = eye + dir * (background ? 1e3f : t);
+
+        // Into the previous frame
+        const float4 clip = mul(prevViewProj, float4(P, 1.f));
+        const float px = (clip.x / clip.w * 0.5f + 0.5f) * size.x - 0.5f;
+        const float py = (clip.y / clip.w * 0.5f + 0.5f) * size.y - 0.5f;
+        const float expected = length(P - history.eye);
+
+        const int x0 = int(std::floor(px));
+        const int y0 = int(std::floor(py));
+        const float fx = px - x0;
+        const float fy = py - y0;
+
+        float wsum = 0.f;
+        for (int j = 0; j < 2; j++) {
+          for (int i = 0; i < 2; i++) {
+            const int qx = x0 + i, qy = y0 + j;
+            if (clip.w <= 0.f || qx < 0 || qy < 0 || qx >= int(size.x)
+                || qy >= int(size.y))
+              continue;
+            const size_t q = size_t(qy) * size.x + qx;
+            const float hd = history.depth[q];
+            const bool match = background
+                ? !std::isfinite(hd)
+                : std::fabs(hd - expected)
+                    <= params.depthTolerance * expected;
+            if (!match)
+              continue;
+            const float w = (i ? fx : 1.f - fx) * (j ? fy : 1.f - fy);
+            for (int k = 0; k < 4; k++)
+              hist[k] += w * history.color[4 * q + k];
+            histCount = std::max(histCount, history.count[q]);
+            wsum += w;
+          }
+        }
+
+        if (wsum > 1e-3f) {
+          for (int k = 0; k < 4; k++)
+            hist[k] /= wsum;
+        } else {
+          histCount = 0.f;
+        }
+      }
+
+      if (histCount == 0.f)
+        rejectedPerRow[y]++;
+
+      const float n = std::min(histCount + 1.f, params.maxHistory);
+      const float alpha = 1.f / n;
+      for (int k = 0; k < 4; k++)
+        out[4 * p + k] = hist[k] + alpha * (c[k] - hist[k]);
+      newCount[p] = n;
+    }
+  });
+
+  history.size = size;
+  history.color.assign(out, out + 4 * numPixels);
+  history.depth.swap(newDepth);
+  history.count.swap(newCount);
+  history.proj = proj;
+  history.view = view;
+  history.eye = eye;
+  history.valid = true;
+
+  size_t rejected = 0;
+  for (size_t r : rejectedPerRow)
+    rejected += r;
+  return numPixels ? float(rejected) / numPixels : 0.f;
+}
@@ -0,0 +1,44 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cstdint>
+
+// ========================================================
+// Regular grid of square tiles over an image; edge tiles
+//  are clipped to the image bounds
+// ========================================================
+
+struct TileGrid
+{
+  TileGrid(uint32_t w, uint32_t h, uint32_t ts)
+      : width(w),
+        height(h),
+        tileSize(ts),
+        numTilesX((w + ts - 1) / ts),
+        numTilesY((h + ts - 1) / ts)
+  {}
+
+  uint32_t numTiles() const
+  {
+    return numTilesX * numTilesY;
+  }
+
+  void tileBounds(uint32_t tile,
+      uint32_t &x0,
+      uint32_t &y0,
+      uint32_t &x1,
+      uint32_t &y1) const
+  {
+    x0 = (tile % numTilesX) * tileSize;
+    y0 = (tile / numTilesX) * tileSize;
+    x1 = std::min(width, x0 + tileSize);
+    y1 = std::min(height, y0 + tileSize);
+  }
+
+  uint32_t width, height, tileSize;
+  uint32_t numTilesX, numTilesY;
+};
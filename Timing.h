@@ -0,0 +1,102 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+// ========================================================
+// Wall-clock timer and sample statistics used by the
+//  benchmark tools
+// ========================================================
+struct Timer
+{
+  using Clock = std::chrono::steady_clock;
+
+  Timer()
+  {
+    reset();
+  }
+
+  void reset()
+  {
+    start = Clock::now();
+  }
+
+  double elapsedMs() const
+  {
+    return std::chrono::duration<double, std::milli>(Clock::now() - start)
+        .count();
+  }
+
+  Clock::time_point start;
+};
+
+struct Stats
+{
+  void add(double v)
+  {
+    samples.push_back(v);
+  }
+
+  size_t count() const
+  {
+    return samples.size();
+  }
+
+  double sum() const
+  {
+    double s = 0.0;
+    for (double v : samples)
+      s += v;
+    return s;
+  }
+
+  double mean() const
+  {
+    return samples.empty() ? 0.0 : sum() / samples.size();
+  }
+
+  double min() const
+  {
+    return samples.empty() ? 0.0
+                           : *std::min_element(samples.begin(), samples.end());
+  }
+
+  double max() const
+  {
+    return samples.empty() ? 0.0
+                           : *std::max_element(samples.begin(), samples.end());
+  }
+
+  // p in [0,1]
+  double percentile(double p) const
+  {
+    if (samples.empty())
+      return 0.0;
+    std::vector<double> sorted(samples);
+    std::sort(sorted.begin(), sorted.end());
+    size_t i = size_t(p * (sorted.size() - 1) + 0.5);
+    return sorted[std::min(i, sorted.size() - 1)];
+  }
+
+  void print(const char *name, const char *unit = "ms") const
+  {
+    printf("%-24s avg %10.4f%s  min %10.4f%s  p95 %10.4f%s  max %10.4f%s\n",
+        name,
+        mean(),
+        unit,
+        min(),
+        unit,
+        percentile(0.95),
+        unit,
+        max(),
+        unit);
+  }
+
+  std::vector<double> samples;
+};
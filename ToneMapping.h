@@ -0,0 +1,297 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+// ours
+#include "Parallel.h"
+#include "Simd.h"
+
+// ========================================================
+// Host-side exposure, tone mapping and sRGB encoding of
+//  ANARI_FLOAT32_VEC4 color channels into RGBA8. sRGB
+//  encoding comes in three variants: exact (pow), table
+//  lookup and a sqrt-based polynomial. The latter two
+//  have an explicit AVX2 path (Simd.h) that gives the
+//  same bytes as the scalar loop.
+// ========================================================
+
+enum class ToneMapOperator
+{
+  None, // clamp only
+  Reinhard,
+  Aces, // Narkowicz' fit of the ACES filmic curve
+};
+
+enum class SrgbEncode
+{
+  Exact,
+  Lut,
+  Polynomial,
+};
+
+struct ToneMapParams
+{
+  float exposure{1.f};
+  ToneMapOperator op{ToneMapOperator::None};
+  SrgbEncode encode{SrgbEncode::Polynomial};
+};
+
+static const char *toneMapOperatorName(ToneMapOperator op)
+{
+  switch (op) {
+  case ToneMapOperator::None:
+    return "none";
+  case ToneMapOperator::Reinhard:
+    return "reinhard";
+  case ToneMapOperator::Aces:
+    return "aces";
+  }
+  return "unknown";
+}
+
+static const char *srgbEncodeName(SrgbEncode e)
+{
+  switch (e) {
+  case SrgbEncode::Exact:
+    return "exact";
+  case SrgbEncode::Lut:
+    return "lut";
+  case SrgbEncode::Polynomial:
+    return "polynomial";
+  }
+  return "unknown";
+}
+
+// Linear [0,1] -> sRGB [0,1]
+static float srgbEncodeExact(float x)
+{
+  return x <= 0.0031308f ? 12.92f * x
+                         : 1.055f * std::pow(x, 1.f / 2.4f) - 0.055f;
+}
+
+// Approximation of x^(1/2.4) by a combination of nested square roots
+static float srgbEncodePolynomial(float x)
+{
+  const float s1 = std::sqrt(x);
+  const float s2 = std::sqrt(s1);
+  const float s3 = std::sqrt(s2);
+  const float curve =
+      0.662002687f * s1 + 0.684122060f * s2 - 0.323583601f * s3
+      - 0.0225411470f * x;
+  const float lin = 12.92f * x;
+  return x <= 0.0031308f ? lin : curve;
+}
+
+static constexpr int srgbLutSize = 4096;
+
+// Padded by three bytes, so 32-bit gathers can read the last entries
+static const uint8_t *srgbLut()
+{
+  static const struct Lut
+  {
+    Lut()
+    {
+      for (int i = 0; i < srgbLutSize; i++) {
+        const float x = float(i) / (srgbLutSize - 1);
+        values[i] = uint8_t(srgbEncodeExact(x) * 255.f + 0.5f);
+      }
+    }
+    uint8_t values[srgbLutSize + 3] = {};
+  } lut;
+  return lut.values;
+}
+
+// Beyond this all operators saturate; keeps Inf out of the operators
+static constexpr float maxExposedValue = 65504.f;
+
+static float toneMap(ToneMapOperator op, float x)
+{
+  switch (op) {
+  case ToneMapOperator::Reinhard:
+    return x / (1.f + x);
+  case ToneMapOperator::Aces:
+    return (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+  case ToneMapOperator::None:
+    break;
+  }
+  return x;
+}
+
+// Clamps to [0, hi]; NaN maps to 0
+static float clampNaNSafe(float x, float hi)
+{
+  return std::max(0.f, std::min(x, hi));
+}
+
+static float saturate(float x)
+{
+  return clampNaNSafe(x, 1.f);
+}
+
+#ifdef OFFAXIS_HOST_X86
+// Clamps to [0, hi]; NaN maps to 0 (maxps returns its second operand
+// for NaN)
+OFFAXIS_TARGET_AVX2 static inline __m256 clampNaNSafeAVX2(__m256 x, __m256 hi)
+{
+  return _mm256_min_ps(_mm256_max_ps(x, _mm256_setzero_ps()), hi);
+}
+
+// Two RGBA pixels per iteration, with the same operations in the same order
+// as the scalar loop; returns where the scalar remainder starts
+template <ToneMapOperator OP, SrgbEncode ENCODE>
+OFFAXIS_TARGET_AVX2 static uint32_t toneMapRowAVX2(
+    const float *in, uint32_t *out, uint32_t width, float exposure)
+{
+  const int *lut = (const int *)srgbLut();
+  const __m256 one = _mm256_set1_ps(1.f);
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 scale = _mm256_set1_ps(255.f);
+  const __m256 maxValue = _mm256_set1_ps(maxExposedValue);
+  const __m256 e = _mm256_set1_ps(exposure);
+  const __m256i alphaLanes = _mm256_setr_epi32(0, 0, 0, -1, 0, 0, 0, -1);
+
+  uint32_t x = 0;
+  for (; x + 2 <= width; x += 2) {
+    const __m256 raw = _mm256_loadu_ps(in + 4 * x);
+
+    __m256 v = clampNaNSafeAVX2(_mm256_mul_ps(raw, e), maxValue);
+    if (OP == ToneMapOperator::Reinhard)
+      v = _mm256_div_ps(v, _mm256_add_ps(one, v));
+    else if (OP == ToneMapOperator::Aces) {
+      const __m256 n = _mm256_mul_ps(v,
+          _mm256_add_ps(
+              _mm256_mul_ps(_mm256_set1_ps(2.51f), v), _mm256_set1_ps(0.03f)));
+      const __m256 d = _mm256_add_ps(
+          _mm256_mul_ps(v,
+              _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(2.43f), v),
+                  _mm256_set1_ps(0.59f))),
+          _mm256_set1_ps(0.14f));
+      v = _mm256_div_ps(n, d);
+    }
+    v = clampNaNSafeAVX2(v, one);
+
+    __m256i color;
+    if (ENCODE == SrgbEncode::Lut) {
+      const __m256 i = _mm256_add_ps(
+          _mm256_mul_ps(v, _mm256_set1_ps(float(srgbLutSize - 1))), half);
+      color = _mm256_and_si256(
+          _mm256_i32gather_epi32(lut, _mm256_cvttps_epi32(i), 1),
+          _mm256_set1_epi32(0xff));
+    } else {
+      const __m256 s1 = _mm256_sqrt_ps(v);
+      const __m256 s2 = _mm256_sqrt_ps(s1);
+      const __m256 s3 = _mm256_sqrt_ps(s2);
+      __m256 curve = _mm256_mul_ps(_mm256_set1_ps(0.662002687f), s1);
+      curve = _mm256_add_ps(
+          curve, _mm256_mul_ps(_mm256_set1_ps(0.684122060f), s2));
+      curve = _mm256_sub_ps(
+          curve, _mm256_mul_ps(_mm256_set1_ps(0.323583601f), s3));
+      curve = _mm256_sub_ps(
+          curve, _mm256_mul_ps(_mm256_set1_ps(0.0225411470f), v));
+      const __m256 lin = _mm256_mul_ps(_mm256_set1_ps(12.92f), v);
+      const __m256 isLinear =
+          _mm256_cmp_ps(v, _mm256_set1_ps(0.0031308f), _CMP_LE_OQ);
+      const __m256 srgb = clampNaNSafeAVX2(
+          _mm256_blendv_ps(curve, lin, isLinear), one);
+      color = _mm256_cvttps_epi32(
+          _mm256_add_ps(_mm256_mul_ps(srgb, scale), half));
+    }
+
+    const __m256i alpha = _mm256_cvttps_epi32(_mm256_add_ps(
+        _mm256_mul_ps(clampNaNSafeAVX2(raw, one), scale), half));
+    const __m256i rgba = _mm256_blendv_epi8(color, alpha, alphaLanes);
+
+    // 8 x u32 -> 8 x u8, i.e. two RGBA8 pixels
+    const __m128i words = _mm_packus_epi32(
+        _mm256_castsi256_si128(rgba), _mm256_extracti128_si256(rgba, 1));
+    _mm_storel_epi64(
+        (__m128i *)(out + x), _mm_packus_epi16(words, words));
+  }
+  return x;
+}
+#endif
+
+// Tone map one row of RGBA float pixels into RGBA8
+template <ToneMapOperator OP, SrgbEncode ENCODE>
+static void toneMapRow(const float *__restrict in,
+    uint32_t *__restrict out,
+    uint32_t width,
+    float exposure)
+{
+  const uint8_t *lut = srgbLut();
+  uint32_t x = 0;
+#ifdef OFFAXIS_HOST_X86
+  if (ENCODE != SrgbEncode::Exact && hostIsa() == HostIsa::AVX2)
+    x = toneMapRowAVX2<OP, ENCODE>(in, out, width, exposure);
+#endif
+  for (; x < width; x++) {
+    uint32_t result = 0;
+    for (int c = 0; c < 3; c++) {
+      const float e = clampNaNSafe(in[4 * x + c] * exposure, maxExposedValue);
+      const float v = saturate(toneMap(OP, e));
+      uint32_t byte;
+      if (ENCODE == SrgbEncode::Lut)
+        byte = lut[int(v * (srgbLutSize - 1) + 0.5f)];
+      else if (ENCODE == SrgbEncode::Exact)
+        byte = uint32_t(srgbEncodeExact(v) * 255.f + 0.5f);
+      else
+        byte = uint32_t(saturate(srgbEncodePolynomial(v)) * 255.f + 0.5f);
+      result |= byte << (8 * c);
+    }
+    const uint32_t alpha = uint32_t(saturate(in[4 * x + 3]) * 255.f + 0.5f);
+    out[x] = result | (alpha << 24);
+  }
+}
+
+template <ToneMapOperator OP>
+static void toneMapRowDispatch(SrgbEncode encode,
+    const float *in,
+    uint32_t *out,
+    uint32_t width,
+    float exposure)
+{
+  switch (encode) {
+  case SrgbEncode::Exact:
+    toneMapRow<OP, SrgbEncode::Exact>(in, out, width, exposure);
+    break;
+  case SrgbEncode::Lut:
+    toneMapRow<OP, SrgbEncode::Lut>(in, out, width, exposure);
+    break;
+  case SrgbEncode::Polynomial:
+    toneMapRow<OP, SrgbEncode::Polynomial>(in, out, width, exposure);
+    break;
+  }
+}
+
+// Tone map a width x height RGBA float image, parallel over rows
+static void toneMapImage(const ToneMapParams &params,
+    const float *in,
+    uint32_t *out,
+    uint32_t width,
+    uint32_t height)
+{
+  parallelForRows(height, [&](unsigned y) {
+    const float *src = in + size_t(y) * width * 4;
+    uint32_t *dst = out + size_t(y) * width;
+    switch (params.op) {
+    case ToneMapOperator::None:
+      toneMapRowDispatch<ToneMapOperator::None>(
+          params.encode, src, dst, width, params.exposure);
+      break;
+    case ToneMapOperator::Reinhard:
+      toneMapRowDispatch<ToneMapOperator::Reinhard>(
+          params.encode, src, dst, width, params.exposure);
+      break;
+    case ToneMapOperator::Aces:
+      toneMapRowDispatch<ToneMapOperator::Aces>(
+          params.encode, src, dst, width, params.exposure);
+      break;
+    }
+  });
+}
@@ -0,0 +1,323 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+#include <vector>
+// ours
+#include "Projection.h"
+
+// ========================================================
+// Recorded head tracker data. Trace files are plain text,
+//  one sample per line: "time x y z" with time in seconds
+//  and the head position in screen/CAVE coordinates.
+// ========================================================
+
+struct TrackerSample
+{
+  double time{0.0};
+  float3 position;
+};
+
+static bool loadTrackerTrace(
+    const char *fileName, std::vector<TrackerSample> &samples)
+{
+  FILE *fp = fopen(fileName, "r");
+  if (!fp)
+    return false;
+  samples.clear();
+  TrackerSample s;
+  while (fscanf(fp,
+             "%lf %f %f %f",
+             &s.time,
+             &s.position.x,
+             &s.position.y,
+             &s.position.z)
+      == 4) {
+    samples.push_back(s);
+  }
+  fclose(fp);
+  return !samples.empty();
+}
+
+static bool saveTrackerTrace(
+    const char *fileName, const std::vector<TrackerSample> &samples)
+{
+  FILE *fp = fopen(fileName, "w");
+  if (!fp)
+    return false;
+  for (const auto &s : samples) {
+    fprintf(fp,
+        "%.6f %.6f %.6f %.6f\n",
+        s.time,
+        s.position.x,
+        s.position.y,
+        s.position.z);
+  }
+  fclose(fp);
+  return true;
+}
+
+// Synthetic trace of a viewer who mostly stands still (sensor noise and
+// slow sway) and occasionally moves to a new spot around 'rest'
+static std::vector<TrackerSample> syntheticTrackerTrace(float3 rest,
+    size_t numSamples,
+    double rate = 60.0,
+    unsigned seed = 0)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> noise(0.f, 0.0005f);
+  std::uniform_real_distribution<float> offset(-0.3f, 0.3f);
+  std::uniform_int_distribution<int> holdFrames(60, 240);
+
+  std::vector<TrackerSample> samples(numSamples);
+  float3 from = rest, to = rest;
+  int hold = holdFrames(rng), moveFrames = 0, moveLength = 1;
+
+  for (size_t i = 0; i < numSamples; i++) {
+    if (moveFrames == 0 && --hold <= 0) {
+      // Start moving to a new spot over half a second
+      from = to;
+      to = rest + float3(offset(rng), 0.2f * offset(rng), 0.5f * offset(rng));
+      moveLength = moveFrames = int(rate * 0.5);
+      hold = holdFrames(rng);
+    }
+
+    float3 p = to;
+    if (moveFrames > 0) {
+      const float t = 1.f - float(moveFrames--) / moveLength;
+      const float s = t * t * (3.f - 2.f * t);
+      p = from + (to - from) * s;
+    }
+
+    const float sway = 0.002f * std::sin(float(i) / rate * 1.3f);
+    samples[i].time = i / rate;
+    samples[i].position =
+        p + float3(sway + noise(rng), noise(rng), noise(rng));
+  }
+  return samples;
+}
+
+// ========================================================
+// Rigid-body tracked screens (handheld tablets, fish-tank
+//  displays). Trace lines are "time x y z qx qy qz qw":
+//  the screen center and its orientation as a unit
+//  quaternion. In the rest orientation the screen's X axis
+//  points right, Y up, and the screen faces +Z.
+// ========================================================
+
+struct ScreenPose
+{
+  float3 position; // screen center
+  float4 orientation{0.f, 0.f, 0.f, 1.f}; // (x, y, z, w)
+};
+
+struct ScreenPoseSample
+{
+  double time{0.0};
+  ScreenPose pose;
+};
+
+static float4 quaternionFromAxisAngle(float3 axis, float angle)
+{
+  const float s = std::sin(0.5f * angle);
+  const float3 a = normalize(axis) * s;
+  return float4(a.x, a.y, a.z, std::cos(0.5f * angle));
+}
+
+static float4 quaternionMultiply(float4 a, float4 b)
+{
+  return float4(a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+      a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+      a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+      a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z);
+}
+
+static float3 quaternionRotate(float4 q, float3 v)
+{
+  const float3 u(q.x, q.y, q.z);
+  const float3 t = 2.f * cross(u, v);
+  return v + q.w * t + cross(u, t);
+}
+
+// Corners of a screen of physical size 'size' at 'pose', as used by
+// offaxisStereoCamera and offaxisStereoTransform
+static void screenCorners(const ScreenPose &pose,
+    float2 size,
+    float3 &LLOUT,
+    float3 &LROUT,
+    float3 &UROUT)
+{
+  const float3 X = quaternionRotate(pose.orientation, float3(1.f, 0.f, 0.f));
+  const float3 Y = quaternionRotate(pose.orientation, float3(0.f, 1.f, 0.f));
+  LLOUT = pose.position - X * (0.5f * size.x) - Y * (0.5f * size.y);
+  LROUT = LLOUT + X * size.x;
+  UROUT = LROUT + Y * size.y;
+}
+
+static bool loadScreenPoseTrace(
+    const char *fileName, std::vector<ScreenPoseSample> &samples)
+{
+  FILE *fp = fopen(fileName, "r");
+  if (!fp)
+    return false;
+  samples.clear();
+  ScreenPoseSample s;
+  float3 &p = s.pose.position;
+  float4 &q = s.pose.orientation;
+  while (fscanf(fp,
+             "%lf %f %f %f %f %f %f %f",
+             &s.time,
+             &p.x,
+             &p.y,
+             &p.z,
+             &q.x,
+             &q.y,
+             &q.z,
+             &q.w)
+      == 8) {
+    // Trackers do not always deliver exactly unit quaternions
+    const float len = length(q);
+    if (len > 0.f)
+      q = q / len;
+    samples.push_back(s);
+  }
+  fclose(fp);
+  return !samples.empty();
+}
+
+static bool saveScreenPoseTrace(
+    const char *fileName, const std::vector<ScreenPoseSample> &samples)
+{
+  FILE *fp = fopen(fileName, "w");
+  if (!fp)
+    return false;
+  for (const auto &s : samples) {
+    const float3 &p = s.pose.position;
+    const float4 &q = s.pose.orientation;
+    fprintf(fp,
+        "%.6f %.6f %.6f %.6f %.6f %.6f %.6f %.6f\n",
+        s.time,
+        p.x,
+        p.y,
+        p.z,
+        q.x,
+        q.y,
+        q.z,
+        q.w);
+  }
+  fclose(fp);
+  return true;
+}
+
+// Synthetic trace of a handheld screen around 'rest': hand tremor, slow
+// drift of a few centimeters and tilting by up to about ten degrees
+static std::vector<ScreenPoseSample> syntheticScreenPoseTrace(
+    ScreenPose rest, size_t numSamples, double rate = 60.0, unsigned seed = 1)
+{
+  std::mt19937 rng(seed);
+  std::normal_distribution<float> tremor(0.f, 0.001f);
+  std::normal_distribution<float> angleTremor(0.f, 0.002f);
+
+  std::vector<ScreenPoseSample> samples(numSamples);
+  for (size_t i = 0; i < numSamples; i++) {
+    const float t = float(i / rate);
+    const float3 drift(0.05f * std::sin(0.4f * t),
+        0.03f * std::sin(0.3f * t + 1.f),
+        0.04f * std::sin(0.25f * t + 2.f));
+    const float yaw = 0.17f * std::sin(0.35f * t) + angleTremor(rng);
+    const float pitch = 0.12f * std::sin(0.5f * t + 0.5f) + angleTremor(rng);
+    const float roll = 0.05f * std::sin(0.2f * t) + angleTremor(rng);
+
+    float4 q = quaternionFromAxisAngle(float3(0.f, 1.f, 0.f), yaw);
+    q = quaternionMultiply(
+        q, quaternionFromAxisAngle(float3(1.f, 0.f, 0.f), pitch));
+    q = quaternionMultiply(
+        q, quaternionFromAxisAngle(float3(0.f, 0.f, 1.f), roll));
+
+    samples[i].time = i / rate;
+    samples[i].pose.position = rest.position + drift
+        + float3(tremor(rng), tremor(rng), tremor(rng));
+    samples[i].pose.orientation = quaternionMultiply(rest.orientation, q);
+  }
+  return samples;
+}
+
+// ========================================================
+// Sampling traces by time (traces are sorted by time):
+//  linear interpolation between the samples around it,
+//  normalized for orientations. Replays longer than the
+//  trace loop over it.
+// ========================================================
+
+template <typename SAMPLE>
+static double traceLoopTime(const std::vector<SAMPLE> &trace, double time)
+{
+  const double duration = trace.back().time - trace.front().time;
+  if (!(duration > 0.0))
+    return trace.front().time;
+  return trace.front().time + std::fmod(std::max(0.0, time), duration);
+}
+
+// Sample i at or before 'time' and the weight of sample i + 1; the weight
+// is 0 at the ends of the trace
+template <typename SAMPLE>
+static size_t traceSegment(
+    const std::vector<SAMPLE> &trace, double time, float &weightOUT)
+{
+  weightOUT = 0.f;
+  auto it = std::upper_bound(trace.begin(),
+      trace.end(),
+      time,
+      [](double t, const SAMPLE &s) { return t < s.time; });
+  if (it == trace.begin())
+    return 0;
+  const size_t i = size_t(it - trace.begin()) - 1;
+  if (it != trace.end()) {
+    const double dt = trace[i + 1].time - trace[i].time;
+    weightOUT = dt > 0.0 ? float((time - trace[i].time) / dt) : 0.f;
+  }
+  return i;
+}
+
+// Head position 'time' seconds into the trace
+static float3 trackerPositionAt(
+    const std::vector<TrackerSample> &trace, double time)
+{
+  if (trace.empty())
+    return float3(0.f);
+  float w = 0.f;
+  const size_t i = traceSegment(trace, traceLoopTime(trace, time), w);
+  if (w == 0.f)
+    return trace[i].position;
+  return trace[i].position + (trace[i + 1].position - trace[i].position) * w;
+}
+
+// Screen pose 'time' seconds into the trace
+static ScreenPose screenPoseAt(
+    const std::vector<ScreenPoseSample> &trace, double time)
+{
+  if (trace.empty())
+    return ScreenPose();
+  float w = 0.f;
+  const size_t i = traceSegment(trace, traceLoopTime(trace, time), w);
+  if (w == 0.f)
+    return trace[i].pose;
+
+  const ScreenPose &a = trace[i].pose;
+  const ScreenPose &b = trace[i + 1].pose;
+  float4 qb = b.orientation;
+  if (dot(a.orientation, qb) < 0.f)
+    qb = -qb; // shorter arc
+  const float4 q = a.orientation + (qb - a.orientation) * w;
+
+  ScreenPose result;
+  result.position = a.position + (b.position - a.position) * w;
+  result.orientation = q / length(q);
+  return result;
+}
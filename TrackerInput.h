@@ -0,0 +1,322 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// posix
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <type_traits>
+#include <vector>
+// ours
+#include "Tracker.h"
+
+// ========================================================
+// Seqlock mailbox: one writer publishes values, any number
+//  of readers copy the latest one. Neither side takes a
+//  lock or waits for the other. The sequence number is odd
+//  while a write is in progress; readers retry when it was
+//  odd or changed during their copy. The value is kept in
+//  relaxed atomic words, so the racing copy is well
+//  defined.
+// ========================================================
+
+template <typename T>
+struct SeqlockMailbox
+{
+  static_assert(std::is_trivially_copyable<T>::value,
+      "mailbox values are copied word by word");
+  static constexpr size_t numWords = (sizeof(T) + 7) / 8;
+
+  void publish(const T &v)
+  {
+    uint64_t w[numWords] = {};
+    std::memcpy(w, &v, sizeof(T));
+    const uint64_t s = seq.load(std::memory_order_relaxed);
+    seq.store(s + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (size_t i = 0; i < numWords; i++)
+      words[i].store(w[i], std::memory_order_relaxed);
+    seq.store(s + 2, std::memory_order_release);
+  }
+
+  // False if nothing was published yet, or if writes kept interfering for
+  // maxAttempts tries (a writer never stalls a reader for longer)
+  bool tryRead(T &v, int maxAttempts = 16) const
+  {
+    for (int a = 0; a < maxAttempts; a++) {
+      const uint64_t s0 = seq.load(std::memory_order_acquire);
+      if (s0 & 1)
+        continue;
+      uint64_t w[numWords];
+      for (size_t i = 0; i < numWords; i++)
+        w[i] = words[i].load(std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (seq.load(std::memory_order_relaxed) != s0)
+        continue;
+      if (s0 == 0)
+        return false;
+      std::memcpy(&v, w, sizeof(T));
+      return true;
+    }
+    return false;
+  }
+
+  // Number of values published so far
+  uint64_t version() const
+  {
+    return seq.load(std::memory_order_acquire) / 2;
+  }
+
+  alignas(64) std::atomic<uint64_t> seq{0};
+  std::atomic<uint64_t> words[numWords]{};
+};
+
+// Ring of the N most recent values from one writer, each slot a mailbox
+// that also records which value it holds, so readers can tell when a slot
+// was overwritten while they were walking the ring
+template <typename T, size_t N>
+struct SeqlockRing
+{
+  struct Entry
+  {
+    uint64_t index;
+    T value;
+  };
+
+  void push(const T &v)
+  {
+    const uint64_t i = count.load(std::memory_order_relaxed);
+    slots[i % N].publish(Entry{i, v});
+    count.store(i + 1, std::memory_order_release);
+  }
+
+  // Up to maxCount of the most recent values, oldest first
+  size_t recent(T *out, size_t maxCount) const
+  {
+    const uint64_t c = count.load(std::memory_order_acquire);
+    const size_t n = size_t(std::min<uint64_t>({maxCount, c, N}));
+    size_t m = 0;
+    for (; m < n; m++) {
+      const uint64_t i = c - 1 - m;
+      Entry e;
+      if (!slots[i % N].tryRead(e) || e.index != i)
+        break;
+      out[n - 1 - m] = e.value;
+    }
+    std::copy(out + n - m, out + n, out);
+    return m;
+  }
+
+  alignas(64) std::atomic<uint64_t> count{0};
+  SeqlockMailbox<Entry> slots[N];
+};
+
+// ========================================================
+// Background tracker ingestion. A thread reads head
+//  positions from a local UDP socket (one "time x y z"
+//  text line per datagram, as in trace files) or replays a
+//  recorded trace, and publishes them with the arrival
+//  time on trackerClock(). The render thread only ever
+//  reads the mailbox and the history ring, so it never
+//  blocks on tracker I/O.
+// ========================================================
+
+static double trackerClock()
+{
+  using Clock = std::chrono::steady_clock;
+  return std::chrono::duration<double>(Clock::now().time_since_epoch())
+      .count();
+}
+
+// Position extrapolated to 'time' from a least-squares linear fit of the
+// recent samples (oldest first), at most maxAhead seconds past the last one
+static float3 predictPosition(const TrackerSample *samples,
+    size_t n,
+    double time,
+    double maxAhead = 0.05)
+{
+  if (n == 0)
+    return float3(0.f);
+  if (n == 1)
+    return samples[0].position;
+
+  const double t0 = samples[n - 1].time;
+  double mt = 0.0;
+  float3 mp(0.f);
+  for (size_t i = 0; i < n; i++) {
+    mt += samples[i].time - t0;
+    mp += samples[i].position;
+  }
+  mt /= n;
+  mp /= float(n);
+
+  double stt = 0.0;
+  float3 stp(0.f);
+  for (size_t i = 0; i < n; i++) {
+    const double dt = samples[i].time - t0 - mt;
+    stt += dt * dt;
+    stp += (samples[i].position - mp) * float(dt);
+  }
+  if (stt <= 0.0)
+    return samples[n - 1].position;
+
+  const float3 velocity = stp / float(stt);
+  const double ahead = std::min(time - t0, maxAhead);
+  return mp + velocity * float(ahead - mt);
+}
+
+struct TrackerReceiver
+{
+  static constexpr size_t historySize = 64;
+
+  ~TrackerReceiver()
+  {
+    stop();
+  }
+
+  // Receive on 127.0.0.1:port; with port 0 the system picks a free port,
+  // see boundPort
+  bool listenUdp(uint16_t port)
+  {
+    stop();
+    fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (fd < 0)
+      return false;
+
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(port);
+    socklen_t len = sizeof(addr);
+    // Wake up regularly to notice stop()
+    timeval timeout = {0, 50000};
+    if (bind(fd, (sockaddr *)&addr, sizeof(addr)) != 0
+        || getsockname(fd, (sockaddr *)&addr, &len) != 0
+        || setsockopt(
+               fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout))
+            != 0) {
+      close(fd);
+      fd = -1;
+      return false;
+    }
+    boundPort = ntohs(addr.sin_port);
+
+    running = true;
+    thread = std::thread([this] { receiveLoop(); });
+    return true;
+  }
+
+  // Publish the samples of a recorded trace at their recorded pace, scaled
+  // by 'speed'; false if there are no samples or 'speed' is not positive
+  bool replay(std::vector<TrackerSample> samples, double speed, bool loop)
+  {
+    stop();
+    if (samples.empty() || !(speed > 0.0))
+      return false;
+    running = true;
+    thread = std::thread([this, samples, speed, loop] {
+      replayLoop(samples, speed, loop);
+    });
+    return true;
+  }
+
+  void stop()
+  {
+    running = false;
+    if (thread.joinable())
+      thread.join();
+    if (fd >= 0)
+      close(fd);
+    fd = -1;
+  }
+
+  // Falls back to the newest complete history entry when the mailbox is
+  // being written, e.g. because the writer was preempted mid-publish
+  bool latest(TrackerSample &s) const
+  {
+    return mailbox.tryRead(s) || history.recent(&s, 1) == 1;
+  }
+
+  size_t recent(TrackerSample *out, size_t maxCount) const
+  {
+    return history.recent(out, maxCount);
+  }
+
+  uint64_t numReceived() const
+  {
+    return mailbox.version();
+  }
+
+  SeqlockMailbox<TrackerSample> mailbox;
+  SeqlockRing<TrackerSample, historySize> history;
+  std::atomic<uint64_t> numMalformed{0};
+  uint16_t boundPort{0};
+
+ private:
+  void publish(float3 position)
+  {
+    TrackerSample s;
+    s.time = trackerClock();
+    s.position = position;
+    mailbox.publish(s);
+    history.push(s);
+  }
+
+  void receiveLoop()
+  {
+    char buf[256];
+    while (running) {
+      const ssize_t n = recv(fd, buf, sizeof(buf) - 1, 0);
+      if (n <= 0)
+        continue; // timeout, check 'running'
+      buf[n] = '\0';
+      double time = 0.0;
+      float3 p;
+      if (sscanf(buf, "%lf %f %f %f", &time, &p.x, &p.y, &p.z) == 4)
+        publish(p);
+      else
+        numMalformed++;
+    }
+  }
+
+  void replayLoop(
+      const std::vector<TrackerSample> &samples, double speed, bool loop)
+  {
+    using Clock = std::chrono::steady_clock;
+    // A loop takes at least a millisecond, so a trace of a single sample
+    // (or with equal times) does not publish flat out
+    const double period = std::max(
+        (samples.back().time - samples.front().time) / speed, 1e-3);
+    auto start = Clock::now();
+    do {
+      for (const auto &s : samples) {
+        if (!running)
+          return;
+        const double t = (s.time - samples.front().time) / speed;
+        std::this_thread::sleep_until(
+            start + std::chrono::duration<double>(t));
+        publish(s.position);
+      }
+      start += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(period));
+      if (loop)
+        std::this_thread::sleep_until(start);
+    } while (loop && running);
+  }
+
+  std::thread thread;
+  std::atomic<bool> running{false};
+  int fd{-1};
+};
@@ -0,0 +1,328 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Simd.h"
+
+// ========================================================
+// Per-projector warp and edge blend. A warp map stores,
+//  for every projector pixel, the source position in the
+//  rendered image (in source pixels) and a blend weight.
+//  Binary file layout (little endian):
+//
+//   char magic[4] "OXWM", u32 version (1),
+//   u32 width, u32 height        (projector resolution)
+//   u32 srcWidth, u32 srcHeight  (rendered image size)
+//   f32 u[width * height], f32 v[width * height],
+//   f32 blend[width * height]
+// ========================================================
+
+// Largest projector image a map file may describe, and the source image
+// must be at least 2x2 for bilinear sampling and addressable with 32 bits
+static const uint64_t maxWarpPixels = uint64_t(1) << 26;
+
+static bool isValidWarpSize(
+    uint32_t width, uint32_t height, uint32_t srcWidth, uint32_t srcHeight)
+{
+  return uint64_t(width) * height <= maxWarpPixels && srcWidth >= 2
+      && srcHeight >= 2 && uint64_t(srcWidth) * srcHeight <= UINT32_MAX;
+}
+
+struct WarpMap
+{
+  uint32_t width{0}, height{0};
+  uint32_t srcWidth{0}, srcHeight{0};
+  std::vector<float> u, v, blend;
+};
+
+static bool saveWarpMap(const char *fileName, const WarpMap &map)
+{
+  FILE *fp = fopen(fileName, "wb");
+  if (!fp)
+    return false;
+  const uint32_t header[5] = {
+      1, map.width, map.height, map.srcWidth, map.srcHeight};
+  const size_t n = size_t(map.width) * map.height;
+  bool ok = fwrite("OXWM", 1, 4, fp) == 4
+      && fwrite(header, sizeof(uint32_t), 5, fp) == 5
+      && fwrite(map.u.data(), sizeof(float), n, fp) == n
+      && fwrite(map.v.data(), sizeof(float), n, fp) == n
+      && fwrite(map.blend.data(), sizeof(float), n, fp) == n;
+  fclose(fp);
+  return ok;
+}
+
+static bool loadWarpMap(const char *fileName, WarpMap &map)
+{
+  FILE *fp = fopen(fileName, "rb");
+  if (!fp)
+    return false;
+  char magic[4];
+  uint32_t header[5] = {};
+  bool ok = fread(magic, 1, 4, fp) == 4 && std::equal(magic, magic + 4, "OXWM")
+      && fread(header, sizeof(uint32_t), 5, fp) == 5 && header[0] == 1
+      && isValidWarpSize(header[1], header[2], header[3], header[4]);
+
+  // The three planes must fill the rest of the file exactly
+  long fileSize = -1;
+  if (ok && fseek(fp, 0, SEEK_END) == 0)
+    fileSize = ftell(fp);
+  const uint64_t headerBytes = 4 + 5 * sizeof(uint32_t);
+  const uint64_t planeBytes = uint64_t(header[1]) * header[2] * sizeof(float);
+  ok = ok && fileSize >= 0 && uint64_t(fileSize) - headerBytes == 3 * planeBytes
+      && fseek(fp, long(headerBytes), SEEK_SET) == 0;
+
+  if (ok) {
+    map.width = header[1];
+    map.height = header[2];
+    map.srcWidth = header[3];
+    map.srcHeight = header[4];
+    const size_t n = size_t(map.width) * map.height;
+    map.u.resize(n);
+    map.v.resize(n);
+    map.blend.resize(n);
+    ok = fread(map.u.data(), sizeof(float), n, fp) == n
+        && fread(map.v.data(), sizeof(float), n, fp) == n
+        && fread(map.blend.data(), sizeof(float), n, fp) == n;
+  }
+  fclose(fp);
+  return ok;
+}
+
+// ========================================================
+// Precomputed sampling table: per projector pixel the
+//  offset of the top-left source texel and four bilinear
+//  weights with the blend factor folded in. Samples
+//  outside the source get zero weights, so the inner
+//  loop is branch-free.
+// ========================================================
+
+struct WarpTable
+{
+  uint32_t width{0}, height{0};
+  uint32_t srcWidth{0}, srcHeight{0};
+  std::vector<uint32_t> offset;
+  std::vector<float> w00, w10, w01, w11;
+};
+
+static WarpTable buildWarpTable(const WarpMap &map)
+{
+  WarpTable t;
+  t.width = map.width;
+  t.height = map.height;
+  t.srcWidth = map.srcWidth;
+  t.srcHeight = map.srcHeight;
+  const size_t n = size_t(map.width) * map.height;
+  t.offset.resize(n);
+  t.w00.resize(n);
+  t.w10.resize(n);
+  t.w01.resize(n);
+  t.w11.resize(n);
+
+  const float maxX = float(map.srcWidth) - 1.f;
+  const float maxY = float(map.srcHeight) - 1.f;
+
+  parallelFor(n, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      // Texel centers are at integer + 0.5
+      const float x = map.u[i] - 0.5f;
+      const float y = map.v[i] - 0.5f;
+      const bool inside = x >= -0.5f && y >= -0.5f && x <= maxX + 0.5f
+          && y <= maxY + 0.5f && map.srcWidth > 1 && map.srcHeight > 1;
+
+      // Clamps map NaN to 0 (NaN positions are never inside), so the
+      // conversions below are always defined
+      const float cx = std::max(0.f, std::min(x, maxX));
+      const float cy = std::max(0.f, std::min(y, maxY));
+      const uint32_t x0 = std::min(uint32_t(cx), map.srcWidth - 2);
+      const uint32_t y0 = std::min(uint32_t(cy), map.srcHeight - 2);
+      const float fx = cx - x0;
+      const float fy = cy - y0;
+      const float b =
+          inside ? std::max(0.f, std::min(map.blend[i], 1.f)) : 0.f;
+
+      t.offset[i] = inside ? y0 * map.srcWidth + x0 : 0;
+      t.w00[i] = b * (1.f - fx) * (1.f - fy);
+      t.w10[i] = b * fx * (1.f - fy);
+      t.w01[i] = b * (1.f - fx) * fy;
+      t.w11[i] = b * fx * fy;
+    }
+  });
+  return t;
+}
+
+#ifdef OFFAXIS_HOST_X86
+// One 8-bit channel of 8 RGBA8 pixels as float
+OFFAXIS_TARGET_AVX2 static inline __m256 warpChannelAVX2(
+    __m256i texels, __m128i shift)
+{
+  return _mm256_cvtepi32_ps(_mm256_and_si256(
+      _mm256_srl_epi32(texels, shift), _mm256_set1_epi32(0xff)));
+}
+
+// AVX2 version of warpRow: four gathers fetch the 2x2 texels of 8 pixels,
+// which are weighted per channel in float like the scalar loop; returns
+// where the scalar remainder starts
+OFFAXIS_TARGET_AVX2 static uint32_t warpRowAVX2(uint32_t width,
+    uint32_t stride,
+    const uint32_t *offset,
+    const float *w00,
+    const float *w10,
+    const float *w01,
+    const float *w11,
+    const uint32_t *src,
+    uint32_t *out)
+{
+  const int *base = (const int *)src;
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 maxValue = _mm256_set1_ps(255.f);
+  const __m256i one = _mm256_set1_epi32(1);
+  const __m256i down = _mm256_set1_epi32(int(stride));
+
+  uint32_t x = 0;
+  for (; x + 8 <= width; x += 8) {
+    const __m256i o00 = _mm256_loadu_si256((const __m256i *)(offset + x));
+    const __m256i o01 = _mm256_add_epi32(o00, down);
+    const __m256i c00 = _mm256_i32gather_epi32(base, o00, 4);
+    const __m256i c10 =
+        _mm256_i32gather_epi32(base, _mm256_add_epi32(o00, one), 4);
+    const __m256i c01 = _mm256_i32gather_epi32(base, o01, 4);
+    const __m256i c11 =
+        _mm256_i32gather_epi32(base, _mm256_add_epi32(o01, one), 4);
+    const __m256 a = _mm256_loadu_ps(w00 + x);
+    const __m256 b = _mm256_loadu_ps(w10 + x);
+    const __m256 c = _mm256_loadu_ps(w01 + x);
+    const __m256 d = _mm256_loadu_ps(w11 + x);
+
+    __m256i result = _mm256_setzero_si256();
+    for (int shift = 0; shift < 32; shift += 8) {
+      const __m128i s = _mm_cvtsi32_si128(shift);
+      __m256 v = _mm256_mul_ps(a, warpChannelAVX2(c00, s));
+      v = _mm256_add_ps(v, _mm256_mul_ps(b, warpChannelAVX2(c10, s)));
+      v = _mm256_add_ps(v, _mm256_mul_ps(c, warpChannelAVX2(c01, s)));
+      v = _mm256_add_ps(v, _mm256_mul_ps(d, warpChannelAVX2(c11, s)));
+      v = _mm256_min_ps(_mm256_add_ps(v, half), maxValue);
+      result = _mm256_or_si256(result,
+          _mm256_sll_epi32(_mm256_cvttps_epi32(v), s));
+    }
+    _mm256_storeu_si256((__m256i *)(out + x), result);
+  }
+  return x;
+}
+#endif
+
+// Warp + blend one row of RGBA8 pixels
+static void warpRow(const WarpTable &t,
+    const uint32_t *__restrict src,
+    uint32_t *__restrict dst,
+    uint32_t y)
+{
+  const size_t rowBegin = size_t(y) * t.width;
+  const uint32_t *offset = t.offset.data() + rowBegin;
+  const float *w00 = t.w00.data() + rowBegin;
+  const float *w10 = t.w10.data() + rowBegin;
+  const float *w01 = t.w01.data() + rowBegin;
+  const float *w11 = t.w11.data() + rowBegin;
+  uint32_t *out = dst + rowBegin;
+  const uint32_t stride = t.srcWidth;
+
+  uint32_t x = 0;
+#ifdef OFFAXIS_HOST_X86
+  // Gathers take signed 32-bit indices
+  const bool gatherable =
+      uint64_t(t.srcWidth) * t.srcHeight <= uint64_t(INT32_MAX);
+  if (hostIsa() == HostIsa::AVX2 && gatherable)
+    x = warpRowAVX2(t.width, stride, offset, w00, w10, w01, w11, src, out);
+#endif
+  for (; x < t.width; x++) {
+    const uint32_t *p = src + offset[x];
+    const uint32_t c00 = p[0], c10 = p[1];
+    const uint32_t c01 = p[stride], c11 = p[stride + 1];
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift < 32; shift += 8) {
+      const float v = w00[x] * float((c00 >> shift) & 0xff)
+          + w10[x] * float((c10 >> shift) & 0xff)
+          + w01[x] * float((c01 >> shift) & 0xff)
+          + w11[x] * float((c11 >> shift) & 0xff);
+      result |= uint32_t(std::min(v + 0.5f, 255.f)) << shift;
+    }
+    out[x] = result;
+  }
+}
+
+// Warp + blend the whole projector image, parallel over rows
+static void warpAndBlend(
+    const WarpTable &t, const uint32_t *src, uint32_t *dst)
+{
+  // The 2x2 footprint does not fit a smaller source
+  if (t.srcWidth < 2 || t.srcHeight < 2) {
+    std::fill(dst, dst + size_t(t.width) * t.height, 0u);
+    return;
+  }
+  parallelForRows(t.height, [&](unsigned y) { warpRow(t, src, dst, y); });
+}
+
+// ========================================================
+// Demo maps: numProjectors side by side, overlapping by
+//  the given fraction, with a mild keystone per projector
+//  and smoothstep ramps in the overlap regions
+// ========================================================
+
+static WarpMap demoWarpMap(uint32_t projector,
+    uint32_t numProjectors,
+    float overlap,
+    uint32_t width,
+    uint32_t height,
+    uint32_t srcWidth,
+    uint32_t srcHeight)
+{
+  WarpMap map;
+  map.width = width;
+  map.height = height;
+  map.srcWidth = srcWidth;
+  map.srcHeight = srcHeight;
+  const size_t n = size_t(width) * height;
+  map.u.resize(n);
+  map.v.resize(n);
+  map.blend.resize(n);
+
+  // Width of one projector in normalized source coordinates
+  const float segment = 1.f / (numProjectors - (numProjectors - 1) * overlap);
+  const float start = projector * segment * (1.f - overlap);
+  const float ramp = overlap * segment;
+
+  auto smoothstep = [](float e0, float e1, float x) {
+    const float t = std::min(std::max((x - e0) / (e1 - e0), 0.f), 1.f);
+    return t * t * (3.f - 2.f * t);
+  };
+
+  for (uint32_t y = 0; y < height; y++) {
+    for (uint32_t x = 0; x < width; x++) {
+      const float s = (x + 0.5f) / width;
+      const float t = (y + 0.5f) / height;
+      const float keystone = 0.04f * (t - 0.5f) * (s - 0.5f);
+      const float u = start + (s + keystone) * segment;
+
+      float b = 1.f;
+      if (projector > 0 && ramp > 0.f)
+        b *= smoothstep(start, start + ramp, u);
+      if (projector + 1 < numProjectors && ramp > 0.f)
+        b *= 1.f - smoothstep(start + segment - ramp, start + segment, u);
+
+      const size_t i = size_t(y) * width + x;
+      map.u[i] = u * srcWidth;
+      map.v[i] = t * srcHeight;
+      map.blend[i] = b;
+    }
+  }
+  return map;
+}
@@ -0,0 +1,52 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+// ========================================================
+// query anari extensions (ANARI_VSNRAY_CAMERA_MATRIX)
+// ========================================================
+static bool deviceHasExtension(anari::Library library,
+    const std::string &deviceSubtype,
+    const std::string &extName)
+{
+  const char **extensions =
+      anariGetDeviceExtensions(library, deviceSubtype.c_str());
+
+  for (; *extensions; extensions++) {
+    if (*extensions == extName)
+      return true;
+  }
+  return false;
+}
+
+// ========================================================
+// Log ANARI errors
+// ========================================================
+static void statusFunc(const void * /*userData*/,
+    ANARIDevice /*device*/,
+    ANARIObject source,
+    ANARIDataType /*sourceType*/,
+    ANARIStatusSeverity severity,
+    ANARIStatusCode /*code*/,
+    const char *message)
+{
+  if (severity == ANARI_SEVERITY_FATAL_ERROR) {
+    fprintf(stderr, "[FATAL][%p] %s\n", source, message);
+    std::exit(1);
+  } else if (severity == ANARI_SEVERITY_ERROR) {
+    fprintf(stderr, "[ERROR][%p] %s\n", source, message);
+  } else if (severity == ANARI_SEVERITY_WARNING) {
+    fprintf(stderr, "[WARN ][%p] %s\n", source, message);
+  } else if (severity == ANARI_SEVERITY_PERFORMANCE_WARNING) {
+    fprintf(stderr, "[PERF ][%p] %s\n", source, message);
+  }
+  // Ignore INFO/DEBUG messages
+}
@@ -0,0 +1,88 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include <anari/anari.h>
+// std
+#include <cstddef>
+#include <cstdint>
+
+namespace offaxis {
+
+// Minimal data type helpers for the types the sample app passes through the
+// API; unknown types report size 0 so callers can flag them
+
+inline bool isObjectType(ANARIDataType type)
+{
+  switch (type) {
+  case ANARI_DEVICE:
+  case ANARI_OBJECT:
+  case ANARI_ARRAY:
+  case ANARI_ARRAY1D:
+  case ANARI_ARRAY2D:
+  case ANARI_ARRAY3D:
+  case ANARI_CAMERA:
+  case ANARI_FRAME:
+  case ANARI_GEOMETRY:
+  case ANARI_GROUP:
+  case ANARI_INSTANCE:
+  case ANARI_LIGHT:
+  case ANARI_MATERIAL:
+  case ANARI_RENDERER:
+  case ANARI_SAMPLER:
+  case ANARI_SPATIAL_FIELD:
+  case ANARI_SURFACE:
+  case ANARI_VOLUME:
+  case ANARI_WORLD:
+    return true;
+  default:
+    return false;
+  }
+}
+
+inline size_t sizeOfDataType(ANARIDataType type)
+{
+  if (isObjectType(type))
+    return sizeof(ANARIObject);
+
+  switch (type) {
+  case ANARI_UINT8:
+    return 1;
+  case ANARI_UINT16:
+    return 2;
+  case ANARI_UINT16_VEC3:
+    return 6;
+  case ANARI_BOOL:
+  case ANARI_DATA_TYPE:
+  case ANARI_INT32:
+  case ANARI_UINT32:
+  case ANARI_FLOAT32:
+  case ANARI_UFIXED8_VEC4:
+  case ANARI_UFIXED8_RGBA_SRGB:
+    return 4;
+  case ANARI_INT64:
+  case ANARI_UINT64:
+  case ANARI_FLOAT64:
+  case ANARI_INT32_VEC2:
+  case ANARI_UINT32_VEC2:
+  case ANARI_FLOAT32_VEC2:
+    return 8;
+  case ANARI_FLOAT32_VEC3:
+    return 12;
+  case ANARI_FLOAT32_VEC4:
+  case ANARI_FLOAT32_BOX2:
+    return 16;
+  case ANARI_FLOAT32_MAT3x4:
+    return 48;
+  case ANARI_FLOAT32_MAT4:
+    return 64;
+  case ANARI_VOID_POINTER:
+    return sizeof(void *);
+  default:
+    return 0;
+  }
+}
+
+} // namespace offaxis
@@ -0,0 +1,342 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#include "LayerDevice.h"
+// std
+#include <cstring>
+
+namespace offaxis {
+
+LayerDevice::LayerDevice(ANARILibrary library) : anari::DeviceImpl(library) {}
+
+LayerDevice::~LayerDevice()
+{
+  if (m_wrapped)
+    anariRelease(m_wrapped, m_wrapped);
+}
+
+bool LayerDevice::isDevice(ANARIObject o) const
+{
+  return o == (ANARIObject)this_device();
+}
+
+ANARIObject LayerDevice::wrapped(ANARIObject o) const
+{
+  return isDevice(o) ? (ANARIObject)m_wrapped : o;
+}
+
+bool LayerDevice::setDeviceParameter(
+    const char *name, ANARIDataType type, const void *mem)
+{
+  if (!std::strcmp(name, "wrappedDevice") && type == ANARI_DEVICE) {
+    ANARIDevice d = *(const ANARIDevice *)mem;
+    if (d)
+      anariRetain(d, d);
+    if (m_wrapped)
+      anariRelease(m_wrapped, m_wrapped);
+    m_wrapped = d;
+    return true;
+  }
+  return false;
+}
+
+void LayerDevice::commitDeviceParameters() {}
+
+// Data Arrays ////////////////////////////////////////////////////////////////
+
+ANARIArray1D LayerDevice::newArray1D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1)
+{
+  return anariNewArray1D(
+      m_wrapped, appMemory, deleter, userdata, type, numItems1);
+}
+
+ANARIArray2D LayerDevice::newArray2D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2)
+{
+  return anariNewArray2D(
+      m_wrapped, appMemory, deleter, userdata, type, numItems1, numItems2);
+}
+
+ANARIArray3D LayerDevice::newArray3D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2,
+    uint64_t numItems3)
+{
+  return anariNewArray3D(m_wrapped,
+      appMemory,
+      deleter,
+      userdata,
+      type,
+      numItems1,
+      numItems2,
+      numItems3);
+}
+
+void *LayerDevice::mapArray(ANARIArray a)
+{
+  return anariMapArray(m_wrapped, a);
+}
+
+void LayerDevice::unmapArray(ANARIArray a)
+{
+  anariUnmapArray(m_wrapped, a);
+}
+
+// Renderable Objects /////////////////////////////////////////////////////////
+
+ANARILight LayerDevice::newLight(const char *type)
+{
+  return anariNewLight(m_wrapped, type);
+}
+
+ANARICamera LayerDevice::newCamera(const char *type)
+{
+  return anariNewCamera(m_wrapped, type);
+}
+
+ANARIGeometry LayerDevice::newGeometry(const char *type)
+{
+  return anariNewGeometry(m_wrapped, type);
+}
+
+ANARISpatialField LayerDevice::newSpatialField(const char *type)
+{
+  return anariNewSpatialField(m_wrapped, type);
+}
+
+ANARISurface LayerDevice::newSurface()
+{
+  return anariNewSurface(m_wrapped);
+}
+
+ANARIVolume LayerDevice::newVolume(const char *type)
+{
+  return anariNewVolume(m_wrapped, type);
+}
+
+// Surface Meta-Data //////////////////////////////////////////////////////////
+
+ANARIMaterial LayerDevice::newMaterial(const char *material_type)
+{
+  return anariNewMaterial(m_wrapped, material_type);
+}
+
+ANARISampler LayerDevice::newSampler(const char *type)
+{
+  return anariNewSampler(m_wrapped, type);
+}
+
+// Instancing /////////////////////////////////////////////////////////////////
+
+ANARIGroup LayerDevice::newGroup()
+{
+  return anariNewGroup(m_wrapped);
+}
+
+ANARIInstance LayerDevice::newInstance(const char *type)
+{
+  return anariNewInstance(m_wrapped, type);
+}
+
+// Top-level Worlds ///////////////////////////////////////////////////////////
+
+ANARIWorld LayerDevice::newWorld()
+{
+  return anariNewWorld(m_wrapped);
+}
+
+// Query functions ////////////////////////////////////////////////////////////
+
+const char **LayerDevice::getObjectSubtypes(ANARIDataType objectType)
+{
+  return anariGetObjectSubtypes(m_wrapped, objectType);
+}
+
+const void *LayerDevice::getObjectInfo(ANARIDataType objectType,
+    const char *objectSubtype,
+    const char *infoName,
+    ANARIDataType infoType)
+{
+  return anariGetObjectInfo(
+      m_wrapped, objectType, objectSubtype, infoName, infoType);
+}
+
+const void *LayerDevice::getParameterInfo(ANARIDataType objectType,
+    const char *objectSubtype,
+    const char *parameterName,
+    ANARIDataType parameterType,
+    const char *infoName,
+    ANARIDataType infoType)
+{
+  return anariGetParameterInfo(m_wrapped,
+      objectType,
+      objectSubtype,
+      parameterName,
+      parameterType,
+      infoName,
+      infoType);
+}
+
+// Object + Parameter Lifetime Management /////////////////////////////////////
+
+int LayerDevice::getProperty(ANARIObject object,
+    const char *name,
+    ANARIDataType type,
+    void *mem,
+    uint64_t size,
+    ANARIWaitMask mask)
+{
+  return anariGetProperty(
+      m_wrapped, wrapped(object), name, type, mem, size, mask);
+}
+
+void LayerDevice::setParameter(
+    ANARIObject object, const char *name, ANARIDataType type, const void *mem)
+{
+  if (isDevice(object) && setDeviceParameter(name, type, mem))
+    return;
+  if (m_wrapped)
+    anariSetParameter(m_wrapped, wrapped(object), name, type, mem);
+}
+
+void LayerDevice::unsetParameter(ANARIObject object, const char *name)
+{
+  anariUnsetParameter(m_wrapped, wrapped(object), name);
+}
+
+void LayerDevice::unsetAllParameters(ANARIObject object)
+{
+  anariUnsetAllParameters(m_wrapped, wrapped(object));
+}
+
+void *LayerDevice::mapParameterArray1D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t *elementStride)
+{
+  return anariMapParameterArray1D(
+      m_wrapped, wrapped(object), name, dataType, numElements1, elementStride);
+}
+
+void *LayerDevice::mapParameterArray2D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t *elementStride)
+{
+  return anariMapParameterArray2D(m_wrapped,
+      wrapped(object),
+      name,
+      dataType,
+      numElements1,
+      numElements2,
+      elementStride);
+}
+
+void *LayerDevice::mapParameterArray3D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t numElements3,
+    uint64_t *elementStride)
+{
+  return anariMapParameterArray3D(m_wrapped,
+      wrapped(object),
+      name,
+      dataType,
+      numElements1,
+      numElements2,
+      numElements3,
+      elementStride);
+}
+
+void LayerDevice::unmapParameterArray(ANARIObject object, const char *name)
+{
+  anariUnmapParameterArray(m_wrapped, wrapped(object), name);
+}
+
+void LayerDevice::commitParameters(ANARIObject object)
+{
+  if (isDevice(object))
+    commitDeviceParameters();
+  if (m_wrapped)
+    anariCommitParameters(m_wrapped, wrapped(object));
+}
+
+void LayerDevice::release(ANARIObject object)
+{
+  if (isDevice(object)) {
+    if (--m_refCount == 0)
+      delete this;
+    return;
+  }
+  anariRelease(m_wrapped, object);
+}
+
+void LayerDevice::retain(ANARIObject object)
+{
+  if (isDevice(object)) {
+    m_refCount++;
+    return;
+  }
+  anariRetain(m_wrapped, object);
+}
+
+// FrameBuffer Manipulation ///////////////////////////////////////////////////
+
+ANARIFrame LayerDevice::newFrame()
+{
+  return anariNewFrame(m_wrapped);
+}
+
+const void *LayerDevice::frameBufferMap(ANARIFrame fb,
+    const char *channel,
+    uint32_t *width,
+    uint32_t *height,
+    ANARIDataType *pixelType)
+{
+  return anariMapFrame(m_wrapped, fb, channel, width, height, pixelType);
+}
+
+void LayerDevice::frameBufferUnmap(ANARIFrame fb, const char *channel)
+{
+  anariUnmapFrame(m_wrapped, fb, channel);
+}
+
+// Frame Rendering ////////////////////////////////////////////////////////////
+
+ANARIRenderer LayerDevice::newRenderer(const char *type)
+{
+  return anariNewRenderer(m_wrapped, type);
+}
+
+void LayerDevice::renderFrame(ANARIFrame frame)
+{
+  anariRenderFrame(m_wrapped, frame);
+}
+
+int LayerDevice::frameReady(ANARIFrame frame, ANARIWaitMask mask)
+{
+  return anariFrameReady(m_wrapped, frame, mask);
+}
+
+void LayerDevice::discardFrame(ANARIFrame frame)
+{
+  anariDiscardFrame(m_wrapped, frame);
+}
+
+} // namespace offaxis
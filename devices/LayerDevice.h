@@ -0,0 +1,168 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include <anari/backend/DeviceImpl.h>
+
+namespace offaxis {
+
+// ========================================================
+// Pass-through device forwarding every call to another
+//  ANARI device. The wrapped device is set the same way as
+//  for the SDK's debug layer:
+//
+//   anariSetParameter(layer, layer, "wrappedDevice",
+//       ANARI_DEVICE, &wrapped);
+//   anariCommitParameters(layer, layer);
+//
+//  Object handles are the wrapped device's handles; layers
+//  override individual calls to observe or translate them.
+// ========================================================
+struct LayerDevice : public anari::DeviceImpl
+{
+  LayerDevice(ANARILibrary library);
+  ~LayerDevice() override;
+
+  // Data Arrays //////////////////////////////////////////////////////////////
+
+  ANARIArray1D newArray1D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1) override;
+
+  ANARIArray2D newArray2D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2) override;
+
+  ANARIArray3D newArray3D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2,
+      uint64_t numItems3) override;
+
+  void *mapArray(ANARIArray) override;
+  void unmapArray(ANARIArray) override;
+
+  // Renderable Objects ///////////////////////////////////////////////////////
+
+  ANARILight newLight(const char *type) override;
+  ANARICamera newCamera(const char *type) override;
+  ANARIGeometry newGeometry(const char *type) override;
+  ANARISpatialField newSpatialField(const char *type) override;
+  ANARISurface newSurface() override;
+  ANARIVolume newVolume(const char *type) override;
+
+  // Surface Meta-Data ////////////////////////////////////////////////////////
+
+  ANARIMaterial newMaterial(const char *material_type) override;
+  ANARISampler newSampler(const char *type) override;
+
+  // Instancing ///////////////////////////////////////////////////////////////
+
+  ANARIGroup newGroup() override;
+  ANARIInstance newInstance(const char *type) override;
+
+  // Top-level Worlds /////////////////////////////////////////////////////////
+
+  ANARIWorld newWorld() override;
+
+  // Query functions //////////////////////////////////////////////////////////
+
+  const char **getObjectSubtypes(ANARIDataType objectType) override;
+  const void *getObjectInfo(ANARIDataType objectType,
+      const char *objectSubtype,
+      const char *infoName,
+      ANARIDataType infoType) override;
+  const void *getParameterInfo(ANARIDataType objectType,
+      const char *objectSubtype,
+      const char *parameterName,
+      ANARIDataType parameterType,
+      const char *infoName,
+      ANARIDataType infoType) override;
+
+  // Object + Parameter Lifetime Management ///////////////////////////////////
+
+  int getProperty(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      void *mem,
+      uint64_t size,
+      ANARIWaitMask mask) override;
+
+  void setParameter(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      const void *mem) override;
+  void unsetParameter(ANARIObject object, const char *name) override;
+  void unsetAllParameters(ANARIObject object) override;
+
+  void *mapParameterArray1D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t *elementStride) override;
+  void *mapParameterArray2D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t *elementStride) override;
+  void *mapParameterArray3D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t numElements3,
+      uint64_t *elementStride) override;
+  void unmapParameterArray(ANARIObject object, const char *name) override;
+
+  void commitParameters(ANARIObject object) override;
+  void release(ANARIObject object) override;
+  void retain(ANARIObject object) override;
+
+  // FrameBuffer Manipulation /////////////////////////////////////////////////
+
+  ANARIFrame newFrame() override;
+
+  const void *frameBufferMap(ANARIFrame fb,
+      const char *channel,
+      uint32_t *width,
+      uint32_t *height,
+      ANARIDataType *pixelType) override;
+
+  void frameBufferUnmap(ANARIFrame fb, const char *channel) override;
+
+  // Frame Rendering //////////////////////////////////////////////////////////
+
+  ANARIRenderer newRenderer(const char *type) override;
+
+  void renderFrame(ANARIFrame) override;
+  int frameReady(ANARIFrame, ANARIWaitMask) override;
+  void discardFrame(ANARIFrame) override;
+
+ protected:
+  // Device parameters not meant for the wrapped device; return true if the
+  // parameter was consumed by the layer
+  virtual bool setDeviceParameter(
+      const char *name, ANARIDataType type, const void *mem);
+  virtual void commitDeviceParameters();
+
+  bool isDevice(ANARIObject o) const;
+  // Translate the layer's device handle to the wrapped one
+  ANARIObject wrapped(ANARIObject o) const;
+
+  ANARIDevice m_wrapped{nullptr};
+
+ private:
+  int m_refCount{1};
+};
+
+} // namespace offaxis
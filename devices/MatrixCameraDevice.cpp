@@ -0,0 +1,230 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#include "MatrixCameraDevice.h"
+// std
+#include <cstring>
+// ours
+#include "Projection.h"
+
+namespace offaxis {
+
+static const float identity[16] = {
+    1.f, 0.f, 0.f, 0.f, //
+    0.f, 1.f, 0.f, 0.f, //
+    0.f, 0.f, 1.f, 0.f, //
+    0.f, 0.f, 0.f, 1.f, //
+};
+
+MatrixCameraDevice::MatrixCameraDevice(ANARILibrary library)
+    : LayerDevice(library)
+{}
+
+MatrixCameraDevice::MatrixCamera *MatrixCameraDevice::matrixCamera(
+    ANARIObject o)
+{
+  auto it = m_cameras.find(o);
+  return it != m_cameras.end() ? &it->second : nullptr;
+}
+
+void MatrixCameraDevice::translate(ANARICamera camera, MatrixCamera &mc)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  mat4 proj, view;
+  std::memcpy(&proj, mc.proj, sizeof(proj));
+  std::memcpy(&view, mc.view, sizeof(view));
+
+  float3 eye, dir, up;
+  float fovy, aspect;
+  float4 imgRegion;
+  offaxisStereoCameraFromTransform(
+      inverse(proj), inverse(view), eye, dir, up, fovy, aspect, imgRegion);
+
+  anariSetParameter(m_wrapped, camera, "position", ANARI_FLOAT32_VEC3, &eye);
+  anariSetParameter(m_wrapped, camera, "direction", ANARI_FLOAT32_VEC3, &dir);
+  anariSetParameter(m_wrapped, camera, "up", ANARI_FLOAT32_VEC3, &up);
+  anariSetParameter(m_wrapped, camera, "fovy", ANARI_FLOAT32, &fovy);
+  anariSetParameter(m_wrapped, camera, "aspect", ANARI_FLOAT32, &aspect);
+  anariSetParameter(
+      m_wrapped, camera, "imageRegion", ANARI_FLOAT32_BOX2, &imgRegion);
+
+  std::memcpy(mc.committedProj, mc.proj, sizeof(mc.proj));
+  std::memcpy(mc.committedView, mc.view, sizeof(mc.view));
+  mc.translated = true;
+
+  m_translations++;
+  m_translateNs += std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now() - start)
+                       .count();
+}
+
+// Renderable Objects /////////////////////////////////////////////////////////
+
+ANARICamera MatrixCameraDevice::newCamera(const char *type)
+{
+  if (!type || std::strcmp(type, "matrix"))
+    return LayerDevice::newCamera(type);
+
+  ANARICamera camera = LayerDevice::newCamera("perspective");
+  if (camera) {
+    MatrixCamera &mc = m_cameras[camera];
+    mc = MatrixCamera();
+    std::memcpy(mc.proj, identity, sizeof(identity));
+    std::memcpy(mc.view, identity, sizeof(identity));
+  }
+  return camera;
+}
+
+// Query functions ////////////////////////////////////////////////////////////
+
+const char **MatrixCameraDevice::getObjectSubtypes(ANARIDataType objectType)
+{
+  const char **subtypes = LayerDevice::getObjectSubtypes(objectType);
+  if (objectType != ANARI_CAMERA)
+    return subtypes;
+
+  m_cameraSubtypes.clear();
+  bool hasMatrix = false;
+  for (; subtypes && *subtypes; subtypes++) {
+    hasMatrix = hasMatrix || !std::strcmp(*subtypes, "matrix");
+    m_cameraSubtypes.push_back(*subtypes);
+  }
+  if (!hasMatrix)
+    m_cameraSubtypes.push_back("matrix");
+  m_cameraSubtypes.push_back(nullptr);
+  return m_cameraSubtypes.data();
+}
+
+// Object + Parameter Lifetime Management /////////////////////////////////////
+
+int MatrixCameraDevice::getProperty(ANARIObject object,
+    const char *name,
+    ANARIDataType type,
+    void *mem,
+    uint64_t size,
+    ANARIWaitMask mask)
+{
+  if (isDevice(object) && type == ANARI_UINT64 && size >= sizeof(uint64_t)) {
+    const uint64_t *value = nullptr;
+    if (!std::strcmp(name, "matrix.translations"))
+      value = &m_translations;
+    else if (!std::strcmp(name, "matrix.cacheHits"))
+      value = &m_cacheHits;
+    else if (!std::strcmp(name, "matrix.translateNs"))
+      value = &m_translateNs;
+    if (value) {
+      std::memcpy(mem, value, sizeof(uint64_t));
+      return 1;
+    }
+  }
+
+  if (isDevice(object) && type == ANARI_STRING_LIST
+      && size >= sizeof(const char **) && !std::strcmp(name, "extension")) {
+    const char **extensions = nullptr;
+    if (!LayerDevice::getProperty(
+            object, name, type, &extensions, sizeof(extensions), mask))
+      extensions = nullptr;
+
+    m_extensions.clear();
+    bool hasMatrix = false;
+    for (; extensions && *extensions; extensions++) {
+      hasMatrix = hasMatrix
+          || !std::strcmp(*extensions, "ANARI_VSNRAY_CAMERA_MATRIX");
+      m_extensions.push_back(*extensions);
+    }
+    if (!hasMatrix)
+      m_extensions.push_back("ANARI_VSNRAY_CAMERA_MATRIX");
+    m_extensions.push_back(nullptr);
+
+    const char **result = m_extensions.data();
+    std::memcpy(mem, &result, sizeof(result));
+    return 1;
+  }
+
+  return LayerDevice::getProperty(object, name, type, mem, size, mask);
+}
+
+void MatrixCameraDevice::setParameter(
+    ANARIObject object, const char *name, ANARIDataType type, const void *mem)
+{
+  if (auto *mc = matrixCamera(object)) {
+    if (type == ANARI_FLOAT32_MAT4 && !std::strcmp(name, "proj")) {
+      std::memcpy(mc->proj, mem, sizeof(mc->proj));
+      return;
+    } else if (type == ANARI_FLOAT32_MAT4 && !std::strcmp(name, "view")) {
+      std::memcpy(mc->view, mem, sizeof(mc->view));
+      return;
+    }
+    mc->dirty = true;
+  }
+  LayerDevice::setParameter(object, name, type, mem);
+}
+
+void MatrixCameraDevice::unsetParameter(ANARIObject object, const char *name)
+{
+  if (auto *mc = matrixCamera(object)) {
+    if (!std::strcmp(name, "proj")) {
+      std::memcpy(mc->proj, identity, sizeof(identity));
+      return;
+    } else if (!std::strcmp(name, "view")) {
+      std::memcpy(mc->view, identity, sizeof(identity));
+      return;
+    }
+    mc->dirty = true;
+  }
+  LayerDevice::unsetParameter(object, name);
+}
+
+void MatrixCameraDevice::unsetAllParameters(ANARIObject object)
+{
+  if (auto *mc = matrixCamera(object)) {
+    std::memcpy(mc->proj, identity, sizeof(identity));
+    std::memcpy(mc->view, identity, sizeof(identity));
+    mc->translated = false;
+    mc->dirty = true;
+  }
+  LayerDevice::unsetAllParameters(object);
+}
+
+void MatrixCameraDevice::commitParameters(ANARIObject object)
+{
+  if (auto *mc = matrixCamera(object)) {
+    const bool unchanged = mc->translated
+        && !std::memcmp(mc->proj, mc->committedProj, sizeof(mc->proj))
+        && !std::memcmp(mc->view, mc->committedView, sizeof(mc->view));
+    if (unchanged) {
+      m_cacheHits++;
+      // Nothing changed at all, spare the wrapped device the commit
+      if (!mc->dirty)
+        return;
+    } else {
+      translate((ANARICamera)object, *mc);
+    }
+    mc->dirty = false;
+  }
+  LayerDevice::commitParameters(object);
+}
+
+void MatrixCameraDevice::release(ANARIObject object)
+{
+  if (isDevice(object)) {
+    LayerDevice::release(object); // may delete this
+    return;
+  }
+
+  if (auto *mc = matrixCamera(object)) {
+    if (--mc->refCount == 0)
+      m_cameras.erase(object);
+  }
+  LayerDevice::release(object);
+}
+
+void MatrixCameraDevice::retain(ANARIObject object)
+{
+  if (auto *mc = matrixCamera(object))
+    mc->refCount++;
+  LayerDevice::retain(object);
+}
+
+} // namespace offaxis
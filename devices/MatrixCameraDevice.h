@@ -0,0 +1,87 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <chrono>
+#include <unordered_map>
+#include <vector>
+// ours
+#include "LayerDevice.h"
+
+namespace offaxis {
+
+// ========================================================
+// Layer that provides the "matrix" camera (Strategy 1) on
+//  any device: the camera's "proj" and "view" parameters
+//  are kept by the layer, and on commit turned into a
+//  "perspective" camera with imageRegion on the wrapped
+//  device (Strategy 3). The translation is skipped when
+//  the matrices did not change since the last commit.
+//  Device parameters:
+//
+//   "wrappedDevice" ANARI_DEVICE  device to forward to
+//
+//  The device's "extension" property is the wrapped
+//  device's list plus ANARI_VSNRAY_CAMERA_MATRIX.
+//  Device properties (ANARI_UINT64), for measuring the
+//  layer's overhead:
+//
+//   "matrix.translations"  commits that translated
+//   "matrix.cacheHits"     commits with unchanged matrices
+//   "matrix.translateNs"   time spent translating
+// ========================================================
+struct MatrixCameraDevice : public LayerDevice
+{
+  MatrixCameraDevice(ANARILibrary library);
+
+  ANARICamera newCamera(const char *type) override;
+
+  const char **getObjectSubtypes(ANARIDataType objectType) override;
+
+  int getProperty(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      void *mem,
+      uint64_t size,
+      ANARIWaitMask mask) override;
+
+  void setParameter(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      const void *mem) override;
+  void unsetParameter(ANARIObject object, const char *name) override;
+  void unsetAllParameters(ANARIObject object) override;
+
+  void commitParameters(ANARIObject object) override;
+  void release(ANARIObject object) override;
+  void retain(ANARIObject object) override;
+
+ private:
+  struct MatrixCamera
+  {
+    float proj[16];
+    float view[16];
+    // Matrices the wrapped perspective camera was last set up from
+    float committedProj[16];
+    float committedView[16];
+    bool translated{false};
+    // Other parameters were forwarded since the last commit
+    bool dirty{true};
+    int refCount{1};
+  };
+
+  MatrixCamera *matrixCamera(ANARIObject o);
+  void translate(ANARICamera camera, MatrixCamera &mc);
+
+  std::unordered_map<ANARIObject, MatrixCamera> m_cameras;
+  std::vector<const char *> m_cameraSubtypes;
+  std::vector<const char *> m_extensions;
+
+  uint64_t m_translations{0};
+  uint64_t m_cacheHits{0};
+  uint64_t m_translateNs{0};
+};
+
+} // namespace offaxis
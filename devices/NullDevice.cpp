@@ -0,0 +1,708 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#include "NullDevice.h"
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <thread>
+// ours
+#include "DataTypes.h"
+
+namespace offaxis {
+
+const char **query_extensions();
+
+// NullObject definitions /////////////////////////////////////////////////////
+
+NullObject::~NullObject() = default;
+
+const NullObject::Param *NullObject::param(const std::string &name) const
+{
+  auto it = params.find(name);
+  return it != params.end() ? &it->second : nullptr;
+}
+
+template <typename T>
+static bool getParam(const NullObject &o, const std::string &name, T &value)
+{
+  auto *p = o.param(name);
+  if (!p || p->data.size() != sizeof(T))
+    return false;
+  std::memcpy(&value, p->data.data(), sizeof(T));
+  return true;
+}
+
+// NullArray definitions //////////////////////////////////////////////////////
+
+NullArray::NullArray(ANARIDataType arrayType,
+    const void *appMem,
+    ANARIMemoryDeleter del,
+    const void *delPtr,
+    ANARIDataType elType,
+    uint64_t n1,
+    uint64_t n2,
+    uint64_t n3)
+    : NullObject(arrayType, ""),
+      elementType(elType),
+      appMemory(appMem),
+      deleter(del),
+      deleterPtr(delPtr)
+{
+  numItems[0] = n1;
+  numItems[1] = n2;
+  numItems[2] = n3;
+  if (!appMemory)
+    storage.resize(n1 * n2 * n3 * sizeOfDataType(elType));
+}
+
+NullArray::~NullArray()
+{
+  if (appMemory && deleter)
+    deleter(deleterPtr, appMemory);
+}
+
+void *NullArray::data()
+{
+  return appMemory ? const_cast<void *>(appMemory) : storage.data();
+}
+
+// NullDevice definitions /////////////////////////////////////////////////////
+
+NullDevice::NullDevice(ANARILibrary library) : anari::DeviceImpl(library) {}
+
+template <typename T>
+T NullDevice::newHandle(ANARIDataType type, const char *subtype)
+{
+  m_numObjects++;
+  return (T) new NullObject(type, subtype);
+}
+
+NullObject *NullDevice::object(ANARIObject o) const
+{
+  if (!o || o == (ANARIObject)this_device())
+    return nullptr;
+  return (NullObject *)o;
+}
+
+void NullDevice::reportStatus(ANARIObject source,
+    ANARIDataType sourceType,
+    ANARIStatusSeverity severity,
+    ANARIStatusCode code,
+    const char *message) const
+{
+  auto cb = defaultStatusCallback();
+  if (cb)
+    cb(defaultStatusCallbackUserPtr(),
+        this_device(),
+        source,
+        sourceType,
+        severity,
+        code,
+        message);
+}
+
+void NullDevice::releaseObject(NullObject *o)
+{
+  if (!o || --o->refCount > 0)
+    return;
+
+  for (auto &p : o->params) {
+    if (isObjectType(p.second.type)) {
+      ANARIObject child = nullptr;
+      std::memcpy(&child, p.second.data.data(), sizeof(child));
+      releaseObject(object(child));
+    }
+  }
+
+  if (o->type == ANARI_ARRAY1D || o->type == ANARI_ARRAY2D
+      || o->type == ANARI_ARRAY3D) {
+    auto *a = (NullArray *)o;
+    for (auto h : a->retained)
+      releaseObject(object(h));
+  }
+
+  delete o;
+}
+
+// Data Arrays ////////////////////////////////////////////////////////////////
+
+ANARIArray1D NullDevice::newArray1D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1)
+{
+  m_numObjects++;
+  return (ANARIArray1D) new NullArray(
+      ANARI_ARRAY1D, appMemory, deleter, userdata, type, numItems1, 1, 1);
+}
+
+ANARIArray2D NullDevice::newArray2D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2)
+{
+  m_numObjects++;
+  return (ANARIArray2D) new NullArray(ANARI_ARRAY2D,
+      appMemory,
+      deleter,
+      userdata,
+      type,
+      numItems1,
+      numItems2,
+      1);
+}
+
+ANARIArray3D NullDevice::newArray3D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2,
+    uint64_t numItems3)
+{
+  m_numObjects++;
+  return (ANARIArray3D) new NullArray(ANARI_ARRAY3D,
+      appMemory,
+      deleter,
+      userdata,
+      type,
+      numItems1,
+      numItems2,
+      numItems3);
+}
+
+void *NullDevice::mapArray(ANARIArray a)
+{
+  return ((NullArray *)a)->data();
+}
+
+void NullDevice::unmapArray(ANARIArray a)
+{
+  auto *array = (NullArray *)a;
+  if (!isObjectType(array->elementType))
+    return;
+
+  // Arrays of objects keep their elements alive, like a real device would
+  std::vector<ANARIObject> previous;
+  previous.swap(array->retained);
+
+  const auto *handles = (const ANARIObject *)array->data();
+  const uint64_t n =
+      array->numItems[0] * array->numItems[1] * array->numItems[2];
+  for (uint64_t i = 0; i < n; i++) {
+    if (auto *o = object(handles[i])) {
+      o->refCount++;
+      array->retained.push_back(handles[i]);
+    }
+  }
+
+  for (auto h : previous)
+    releaseObject(object(h));
+}
+
+// Renderable Objects /////////////////////////////////////////////////////////
+
+ANARILight NullDevice::newLight(const char *type)
+{
+  return newHandle<ANARILight>(ANARI_LIGHT, type);
+}
+
+ANARICamera NullDevice::newCamera(const char *type)
+{
+  return newHandle<ANARICamera>(ANARI_CAMERA, type);
+}
+
+ANARIGeometry NullDevice::newGeometry(const char *type)
+{
+  return newHandle<ANARIGeometry>(ANARI_GEOMETRY, type);
+}
+
+ANARISpatialField NullDevice::newSpatialField(const char *type)
+{
+  return newHandle<ANARISpatialField>(ANARI_SPATIAL_FIELD, type);
+}
+
+ANARISurface NullDevice::newSurface()
+{
+  return newHandle<ANARISurface>(ANARI_SURFACE, "");
+}
+
+ANARIVolume NullDevice::newVolume(const char *type)
+{
+  return newHandle<ANARIVolume>(ANARI_VOLUME, type);
+}
+
+// Surface Meta-Data //////////////////////////////////////////////////////////
+
+ANARIMaterial NullDevice::newMaterial(const char *material_type)
+{
+  return newHandle<ANARIMaterial>(ANARI_MATERIAL, material_type);
+}
+
+ANARISampler NullDevice::newSampler(const char *type)
+{
+  return newHandle<ANARISampler>(ANARI_SAMPLER, type);
+}
+
+// Instancing /////////////////////////////////////////////////////////////////
+
+ANARIGroup NullDevice::newGroup()
+{
+  return newHandle<ANARIGroup>(ANARI_GROUP, "");
+}
+
+ANARIInstance NullDevice::newInstance(const char *type)
+{
+  return newHandle<ANARIInstance>(ANARI_INSTANCE, type);
+}
+
+// Top-level Worlds ///////////////////////////////////////////////////////////
+
+ANARIWorld NullDevice::newWorld()
+{
+  return newHandle<ANARIWorld>(ANARI_WORLD, "");
+}
+
+// Query functions ////////////////////////////////////////////////////////////
+
+const char **NullDevice::getObjectSubtypes(ANARIDataType objectType)
+{
+  static const char *cameras[] = {"perspective", "matrix", nullptr};
+  static const char *geometries[] = {"sphere", nullptr};
+  static const char *lights[] = {"directional", nullptr};
+  static const char *materials[] = {"matte", nullptr};
+  static const char *samplers[] = {"image1D", nullptr};
+  static const char *renderers[] = {"default", nullptr};
+  static const char *none[] = {nullptr};
+
+  switch (objectType) {
+  case ANARI_CAMERA:
+    return cameras;
+  case ANARI_GEOMETRY:
+    return geometries;
+  case ANARI_LIGHT:
+    return lights;
+  case ANARI_MATERIAL:
+    return materials;
+  case ANARI_SAMPLER:
+    return samplers;
+  case ANARI_RENDERER:
+    return renderers;
+  default:
+    return none;
+  }
+}
+
+const void *NullDevice::getObjectInfo(ANARIDataType,
+    const char *,
+    const char *,
+    ANARIDataType)
+{
+  return nullptr;
+}
+
+const void *NullDevice::getParameterInfo(ANARIDataType,
+    const char *,
+    const char *,
+    ANARIDataType,
+    const char *,
+    ANARIDataType)
+{
+  return nullptr;
+}
+
+// Object + Parameter Lifetime Management /////////////////////////////////////
+
+int NullDevice::getProperty(ANARIObject o,
+    const char *name,
+    ANARIDataType type,
+    void *mem,
+    uint64_t size,
+    ANARIWaitMask)
+{
+  const std::string prop = name;
+  auto *obj = object(o);
+
+  if (!obj) {
+    if (prop == "extension" && type == ANARI_STRING_LIST
+        && size >= sizeof(const char **)) {
+      const char **exts = query_extensions();
+      std::memcpy(mem, &exts, sizeof(exts));
+      return 1;
+    } else if (prop == "null.numObjects" && type == ANARI_UINT64
+        && size >= sizeof(uint64_t)) {
+      std::memcpy(mem, &m_numObjects, sizeof(uint64_t));
+      return 1;
+    } else if (prop == "null.numCommits" && type == ANARI_UINT64
+        && size >= sizeof(uint64_t)) {
+      std::memcpy(mem, &m_numCommits, sizeof(uint64_t));
+      return 1;
+    }
+    return 0;
+  }
+
+  if (obj->type == ANARI_FRAME && prop == "duration" && type == ANARI_FLOAT32
+      && size >= sizeof(float)) {
+    std::memcpy(mem, &((NullFrame *)obj)->duration, sizeof(float));
+    return 1;
+  }
+
+  return 0;
+}
+
+void NullDevice::setParameter(
+    ANARIObject o, const char *name, ANARIDataType type, const void *mem)
+{
+  auto *obj = object(o);
+  if (!obj)
+    return; // device parameters (statusCallback etc.) are not needed here
+
+  NullObject::Param p;
+  p.type = type;
+
+  if (type == ANARI_STRING) {
+    p.str = (const char *)mem;
+  } else {
+    const size_t size = sizeOfDataType(type);
+    if (size == 0) {
+      reportStatus(o,
+          obj->type,
+          ANARI_SEVERITY_WARNING,
+          ANARI_STATUS_INVALID_ARGUMENT,
+          "null device: ignoring parameter of unsupported type");
+      return;
+    }
+    p.data.resize(size);
+    std::memcpy(p.data.data(), mem, size);
+  }
+
+  if (isObjectType(type)) {
+    if (auto *child = object(*(const ANARIObject *)mem))
+      child->refCount++;
+  }
+
+  unsetParameter(o, name);
+  obj->params[name] = std::move(p);
+}
+
+void NullDevice::unsetParameter(ANARIObject o, const char *name)
+{
+  auto *obj = object(o);
+  if (!obj)
+    return;
+
+  auto it = obj->params.find(name);
+  if (it == obj->params.end())
+    return;
+
+  if (isObjectType(it->second.type)) {
+    ANARIObject child = nullptr;
+    std::memcpy(&child, it->second.data.data(), sizeof(child));
+    releaseObject(object(child));
+  }
+
+  obj->params.erase(it);
+}
+
+void NullDevice::unsetAllParameters(ANARIObject o)
+{
+  auto *obj = object(o);
+  if (!obj)
+    return;
+
+  while (!obj->params.empty()) {
+    const std::string name = obj->params.begin()->first;
+    unsetParameter(o, name.c_str());
+  }
+}
+
+void *NullDevice::mapParameterArray1D(ANARIObject o,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t *elementStride)
+{
+  return mapParameterArray3D(
+      o, name, dataType, numElements1, 1, 1, elementStride);
+}
+
+void *NullDevice::mapParameterArray2D(ANARIObject o,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t *elementStride)
+{
+  return mapParameterArray3D(
+      o, name, dataType, numElements1, numElements2, 1, elementStride);
+}
+
+void *NullDevice::mapParameterArray3D(ANARIObject o,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t numElements3,
+    uint64_t *elementStride)
+{
+  const ANARIDataType arrayType = numElements3 > 1 ? ANARI_ARRAY3D
+      : numElements2 > 1                           ? ANARI_ARRAY2D
+                                                   : ANARI_ARRAY1D;
+  m_numObjects++;
+  auto *array = new NullArray(arrayType,
+      nullptr,
+      nullptr,
+      nullptr,
+      dataType,
+      numElements1,
+      numElements2,
+      numElements3);
+
+  ANARIObject handle = (ANARIObject)array;
+  setParameter(o, name, arrayType, &handle);
+
+  // setParameter ignores the device and types it can't store; only hand out
+  //  the mapping if the parameter actually took its reference
+  auto *obj = object(o);
+  ANARIArray stored = nullptr;
+  const bool owned =
+      obj && getParam(*obj, name, stored) && stored == (ANARIArray)array;
+  void *data = owned ? array->data() : nullptr;
+  releaseObject(array); // now owned by the parameter
+
+  if (elementStride)
+    *elementStride = data ? sizeOfDataType(dataType) : 0;
+  return data;
+}
+
+void NullDevice::unmapParameterArray(ANARIObject o, const char *name)
+{
+  auto *obj = object(o);
+  if (!obj)
+    return;
+
+  ANARIArray array = nullptr;
+  if (getParam(*obj, name, array))
+    unmapArray(array);
+}
+
+void NullDevice::commitParameters(ANARIObject o)
+{
+  m_numCommits++;
+
+  auto *obj = object(o);
+  if (!obj)
+    return;
+
+  obj->commitCount++;
+
+  if (obj->type == ANARI_FRAME) {
+    auto &frame = *(NullFrame *)obj;
+    uint32_t size[2] = {0, 0};
+    getParam(*obj, "size", size);
+    frame.width = size[0];
+    frame.height = size[1];
+
+    frame.colorType = ANARI_UNKNOWN;
+    frame.depthType = ANARI_UNKNOWN;
+    getParam(*obj, "channel.color", frame.colorType);
+    getParam(*obj, "channel.depth", frame.depthType);
+
+    int32_t animate = 0;
+    getParam(*obj, "null.animate", animate);
+    frame.animate = animate != 0;
+
+    frame.sampleTime = 0.f;
+    frame.jitter = 0.f;
+    getParam(*obj, "null.sampleTime", frame.sampleTime);
+    getParam(*obj, "null.jitter", frame.jitter);
+    frame.sampleTime = std::max(0.f, frame.sampleTime); // NaN -> 0
+    frame.jitter = std::max(0.f, std::min(frame.jitter, 1.f));
+
+    const size_t numPixels = size_t(frame.width) * frame.height;
+    frame.color.resize(numPixels * sizeOfDataType(frame.colorType));
+    frame.depth.resize(frame.depthType == ANARI_FLOAT32 ? numPixels : 0);
+    frame.patternKey = ~0ull;
+  }
+}
+
+void NullDevice::release(ANARIObject o)
+{
+  if (o == (ANARIObject)this_device()) {
+    if (--m_refCount == 0)
+      delete this;
+    return;
+  }
+  releaseObject(object(o));
+}
+
+void NullDevice::retain(ANARIObject o)
+{
+  if (o == (ANARIObject)this_device())
+    m_refCount++;
+  else if (auto *obj = object(o))
+    obj->refCount++;
+}
+
+// FrameBuffer Manipulation ///////////////////////////////////////////////////
+
+ANARIFrame NullDevice::newFrame()
+{
+  m_numObjects++;
+  return (ANARIFrame) new NullFrame;
+}
+
+const void *NullDevice::frameBufferMap(ANARIFrame fb,
+    const char *channel,
+    uint32_t *width,
+    uint32_t *height,
+    ANARIDataType *pixelType)
+{
+  auto &frame = *(NullFrame *)fb;
+  const std::string name = channel;
+
+  // Mapping waits for the frame, like on a real device
+  std::this_thread::sleep_until(frame.readyAt);
+
+  *width = frame.width;
+  *height = frame.height;
+
+  if (name == "channel.color" && !frame.color.empty()) {
+    *pixelType = frame.colorType;
+    return frame.color.data();
+  } else if (name == "channel.depth" && !frame.depth.empty()) {
+    *pixelType = ANARI_FLOAT32;
+    return frame.depth.data();
+  }
+
+  *width = 0;
+  *height = 0;
+  *pixelType = ANARI_UNKNOWN;
+  return nullptr;
+}
+
+void NullDevice::frameBufferUnmap(ANARIFrame, const char *) {}
+
+// Frame Rendering ////////////////////////////////////////////////////////////
+
+ANARIRenderer NullDevice::newRenderer(const char *type)
+{
+  return newHandle<ANARIRenderer>(ANARI_RENDERER, type);
+}
+
+// Regenerate the synthetic image only if its inputs changed, so a static
+// camera costs (almost) nothing per frame
+void NullDevice::updateFrame(NullFrame &frame)
+{
+  float bg[4] = {0.f, 0.f, 0.f, 1.f};
+  ANARIObject renderer = nullptr;
+  if (getParam(frame, "renderer", renderer) && object(renderer))
+    getParam(*object(renderer), "background", bg);
+
+  uint64_t key = 1469598103934665603ull; // FNV-1a
+  auto hash = [&](const void *data, size_t size) {
+    for (size_t i = 0; i < size; i++) {
+      key ^= ((const uint8_t *)data)[i];
+      key *= 1099511628211ull;
+    }
+  };
+  hash(bg, sizeof(bg));
+
+  ANARIObject camera = nullptr;
+  if (frame.animate && getParam(frame, "camera", camera) && object(camera)) {
+    for (auto &p : object(camera)->params)
+      hash(p.second.data.data(), p.second.data.size());
+  }
+
+  if (key == frame.patternKey)
+    return;
+  frame.patternKey = key;
+
+  // Checkerboard, offset by the camera hash so camera motion shows up
+  const uint32_t cell = 32;
+  const uint32_t offX = frame.animate ? uint32_t(key % cell) : 0;
+  const uint32_t offY = frame.animate ? uint32_t((key >> 8) % cell) : 0;
+  const float inf = std::numeric_limits<float>::infinity();
+
+  for (uint32_t y = 0; y < frame.height; y++) {
+    for (uint32_t x = 0; x < frame.width; x++) {
+      const bool fg = (((x + offX) / cell) + ((y + offY) / cell)) & 1;
+      const float s = fg ? 2.f : 1.f;
+      const float r = std::min(bg[0] * s, 1.f);
+      const float g = std::min(bg[1] * s, 1.f);
+      const float b = std::min(bg[2] * s, 1.f);
+      const size_t i = size_t(y) * frame.width + x;
+
+      if (frame.colorType == ANARI_FLOAT32_VEC4) {
+        float *px = (float *)frame.color.data() + i * 4;
+        px[0] = r;
+        px[1] = g;
+        px[2] = b;
+        px[3] = bg[3];
+      } else if (!frame.color.empty()) {
+        uint8_t *px = frame.color.data() + i * 4;
+        px[0] = uint8_t(r * 255.f);
+        px[1] = uint8_t(g * 255.f);
+        px[2] = uint8_t(b * 255.f);
+        px[3] = uint8_t(bg[3] * 255.f);
+      }
+
+      if (!frame.depth.empty())
+        frame.depth[i] = fg ? 1.f : inf;
+    }
+  }
+}
+
+void NullDevice::renderFrame(ANARIFrame f)
+{
+  auto start = std::chrono::steady_clock::now();
+
+  auto &frame = *(NullFrame *)f;
+  updateFrame(frame);
+  frame.frameID++;
+  m_numFrames++;
+
+  // Simulated render time, proportional to the renderer's sample count
+  float simulatedMs = 0.f;
+  if (frame.sampleTime > 0.f) {
+    int32_t spp = 1;
+    ANARIObject renderer = nullptr;
+    if (getParam(frame, "renderer", renderer) && object(renderer))
+      getParam(*object(renderer), "pixelSamples", spp);
+    simulatedMs = frame.sampleTime * std::max(1, spp);
+    if (frame.jitter > 0.f) {
+      std::uniform_real_distribution<float> u(-frame.jitter, frame.jitter);
+      simulatedMs *= 1.f + u(frame.rng);
+    }
+  }
+
+  const auto now = std::chrono::steady_clock::now();
+  frame.readyAt = now
+      + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+          std::chrono::duration<float, std::milli>(simulatedMs));
+  frame.duration =
+      std::chrono::duration<float>(now - start).count() + simulatedMs * 1e-3f;
+}
+
+int NullDevice::frameReady(ANARIFrame f, ANARIWaitMask mask)
+{
+  auto &frame = *(NullFrame *)f;
+  if (mask == ANARI_WAIT)
+    std::this_thread::sleep_until(frame.readyAt);
+  return std::chrono::steady_clock::now() >= frame.readyAt;
+}
+
+void NullDevice::discardFrame(ANARIFrame f)
+{
+  auto &frame = *(NullFrame *)f;
+  frame.readyAt = std::min(frame.readyAt, std::chrono::steady_clock::now());
+}
+
+} // namespace offaxis
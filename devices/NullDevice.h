@@ -0,0 +1,239 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari
+#include <anari/backend/DeviceImpl.h>
+// std
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace offaxis {
+
+// ========================================================
+// Null device: accepts every object the sample app uses,
+//  keeps parameters around, but "renders" instantly into a
+//  synthetic framebuffer. Used to measure the host-side
+//  overhead of the pipeline in isolation. The frame
+//  parameters null.sampleTime (ms per pixel sample) and
+//  null.jitter (relative random variation) make frames
+//  complete that much later, so polling, waiting and
+//  discarding can be exercised too.
+// ========================================================
+
+struct NullObject
+{
+  struct Param
+  {
+    ANARIDataType type{ANARI_UNKNOWN};
+    std::vector<uint8_t> data;
+    std::string str;
+  };
+
+  NullObject(ANARIDataType t, const char *s) : type(t), subtype(s ? s : "") {}
+  virtual ~NullObject();
+
+  const Param *param(const std::string &name) const;
+
+  ANARIDataType type{ANARI_UNKNOWN};
+  std::string subtype;
+  int refCount{1};
+  uint64_t commitCount{0};
+  std::map<std::string, Param> params;
+};
+
+struct NullArray : public NullObject
+{
+  NullArray(ANARIDataType arrayType,
+      const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *deleterPtr,
+      ANARIDataType elementType,
+      uint64_t n1,
+      uint64_t n2,
+      uint64_t n3);
+  ~NullArray() override;
+
+  void *data();
+
+  ANARIDataType elementType{ANARI_UNKNOWN};
+  uint64_t numItems[3]{1, 1, 1};
+  const void *appMemory{nullptr};
+  ANARIMemoryDeleter deleter{nullptr};
+  const void *deleterPtr{nullptr};
+  std::vector<uint8_t> storage;
+  std::vector<ANARIObject> retained; // object handles held by the array
+};
+
+struct NullFrame : public NullObject
+{
+  NullFrame() : NullObject(ANARI_FRAME, "") {}
+
+  uint32_t width{0};
+  uint32_t height{0};
+  ANARIDataType colorType{ANARI_UNKNOWN};
+  ANARIDataType depthType{ANARI_UNKNOWN};
+  std::vector<uint8_t> color;
+  std::vector<float> depth;
+  uint64_t frameID{0};
+  uint64_t patternKey{~0ull};
+  bool animate{false}; // "null.animate": pattern follows the camera
+  float sampleTime{0.f}; // "null.sampleTime": ms per pixel sample
+  float jitter{0.f}; // "null.jitter": in [0, 1]
+  std::minstd_rand rng;
+  std::chrono::steady_clock::time_point readyAt;
+  float duration{0.f};
+};
+
+struct NullDevice : public anari::DeviceImpl
+{
+  NullDevice(ANARILibrary library);
+  ~NullDevice() override = default;
+
+  // Data Arrays //////////////////////////////////////////////////////////////
+
+  ANARIArray1D newArray1D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1) override;
+
+  ANARIArray2D newArray2D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2) override;
+
+  ANARIArray3D newArray3D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2,
+      uint64_t numItems3) override;
+
+  void *mapArray(ANARIArray) override;
+  void unmapArray(ANARIArray) override;
+
+  // Renderable Objects ///////////////////////////////////////////////////////
+
+  ANARILight newLight(const char *type) override;
+  ANARICamera newCamera(const char *type) override;
+  ANARIGeometry newGeometry(const char *type) override;
+  ANARISpatialField newSpatialField(const char *type) override;
+  ANARISurface newSurface() override;
+  ANARIVolume newVolume(const char *type) override;
+
+  // Surface Meta-Data ////////////////////////////////////////////////////////
+
+  ANARIMaterial newMaterial(const char *material_type) override;
+  ANARISampler newSampler(const char *type) override;
+
+  // Instancing ///////////////////////////////////////////////////////////////
+
+  ANARIGroup newGroup() override;
+  ANARIInstance newInstance(const char *type) override;
+
+  // Top-level Worlds /////////////////////////////////////////////////////////
+
+  ANARIWorld newWorld() override;
+
+  // Query functions //////////////////////////////////////////////////////////
+
+  const char **getObjectSubtypes(ANARIDataType objectType) override;
+  const void *getObjectInfo(ANARIDataType objectType,
+      const char *objectSubtype,
+      const char *infoName,
+      ANARIDataType infoType) override;
+  const void *getParameterInfo(ANARIDataType objectType,
+      const char *objectSubtype,
+      const char *parameterName,
+      ANARIDataType parameterType,
+      const char *infoName,
+      ANARIDataType infoType) override;
+
+  // Object + Parameter Lifetime Management ///////////////////////////////////
+
+  int getProperty(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      void *mem,
+      uint64_t size,
+      ANARIWaitMask mask) override;
+
+  void setParameter(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      const void *mem) override;
+  void unsetParameter(ANARIObject object, const char *name) override;
+  void unsetAllParameters(ANARIObject object) override;
+
+  void *mapParameterArray1D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t *elementStride) override;
+  void *mapParameterArray2D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t *elementStride) override;
+  void *mapParameterArray3D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t numElements3,
+      uint64_t *elementStride) override;
+  void unmapParameterArray(ANARIObject object, const char *name) override;
+
+  void commitParameters(ANARIObject object) override;
+  void release(ANARIObject object) override;
+  void retain(ANARIObject object) override;
+
+  // FrameBuffer Manipulation /////////////////////////////////////////////////
+
+  ANARIFrame newFrame() override;
+
+  const void *frameBufferMap(ANARIFrame fb,
+      const char *channel,
+      uint32_t *width,
+      uint32_t *height,
+      ANARIDataType *pixelType) override;
+
+  void frameBufferUnmap(ANARIFrame fb, const char *channel) override;
+
+  // Frame Rendering //////////////////////////////////////////////////////////
+
+  ANARIRenderer newRenderer(const char *type) override;
+
+  void renderFrame(ANARIFrame) override;
+  int frameReady(ANARIFrame, ANARIWaitMask) override;
+  void discardFrame(ANARIFrame) override;
+
+ private:
+  template <typename T>
+  T newHandle(ANARIDataType type, const char *subtype);
+  NullObject *object(ANARIObject o) const;
+  void reportStatus(ANARIObject source,
+      ANARIDataType sourceType,
+      ANARIStatusSeverity severity,
+      ANARIStatusCode code,
+      const char *message) const;
+  void releaseObject(NullObject *o);
+  void updateFrame(NullFrame &frame);
+
+  int m_refCount{1};
+  uint64_t m_numObjects{0};
+  uint64_t m_numCommits{0};
+  uint64_t m_numFrames{0};
+};
+
+} // namespace offaxis
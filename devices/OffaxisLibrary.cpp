@@ -0,0 +1,107 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// anari
+#include <anari/backend/LibraryImpl.h>
+// std
+#include <cstring>
+// ours
+#include "MatrixCameraDevice.h"
+#include "NullDevice.h"
+#include "TraceDevice.h"
+
+#ifdef _WIN32
+#define OFFAXIS_LIBRARY_INTERFACE __declspec(dllexport)
+#else
+#define OFFAXIS_LIBRARY_INTERFACE __attribute__((visibility("default")))
+#endif
+
+namespace offaxis {
+
+// Extensions of the null device; the layer devices report their wrapped
+//  device's extensions through the device's "extension" property
+const char **query_extensions()
+{
+  static const char *extensions[] = {
+      "ANARI_KHR_GEOMETRY_SPHERE",
+      "ANARI_KHR_CAMERA_PERSPECTIVE",
+      "ANARI_KHR_LIGHT_DIRECTIONAL",
+      "ANARI_KHR_MATERIAL_MATTE",
+      "ANARI_KHR_FRAME_CHANNEL_DEPTH",
+      "ANARI_VSNRAY_CAMERA_MATRIX",
+      nullptr,
+  };
+  return extensions;
+}
+
+// ========================================================
+// ANARI library providing the in-tree devices:
+//  "null" (alias "default"): instant rendering, see
+//  NullDevice.h
+//  "trace": records all calls, see TraceDevice.h
+//  "matrix": "matrix" camera on any device, see
+//  MatrixCameraDevice.h
+// ========================================================
+struct OffaxisLibrary : public anari::LibraryImpl
+{
+  OffaxisLibrary(
+      void *lib, ANARIStatusCallback defaultStatusCB, const void *statusCBPtr);
+
+  ANARIDevice newDevice(const char *subtype) override;
+  const char **getDeviceExtensions(const char *deviceType) override;
+  const char **getDeviceSubtypes() override;
+};
+
+// Definitions ////////////////////////////////////////////////////////////////
+
+OffaxisLibrary::OffaxisLibrary(
+    void *lib, ANARIStatusCallback defaultStatusCB, const void *statusCBPtr)
+    : anari::LibraryImpl(lib, defaultStatusCB, statusCBPtr)
+{}
+
+ANARIDevice OffaxisLibrary::newDevice(const char *subtype)
+{
+  if (!subtype || !std::strcmp(subtype, "default")
+      || !std::strcmp(subtype, "null"))
+    return (ANARIDevice) new NullDevice(this_library());
+  else if (!std::strcmp(subtype, "trace"))
+    return (ANARIDevice) new TraceDevice(this_library());
+  else if (!std::strcmp(subtype, "matrix"))
+    return (ANARIDevice) new MatrixCameraDevice(this_library());
+  return nullptr;
+}
+
+const char **OffaxisLibrary::getDeviceExtensions(const char *deviceType)
+{
+  // The wrapped device is only known once the layer is created, so without
+  //  one the layers can only promise what they add themselves
+  static const char *traceExtensions[] = {nullptr};
+  static const char *matrixExtensions[] = {
+      "ANARI_VSNRAY_CAMERA_MATRIX", nullptr};
+
+  if (!deviceType || !std::strcmp(deviceType, "default")
+      || !std::strcmp(deviceType, "null"))
+    return query_extensions();
+  else if (!std::strcmp(deviceType, "trace"))
+    return traceExtensions;
+  else if (!std::strcmp(deviceType, "matrix"))
+    return matrixExtensions;
+  return nullptr;
+}
+
+const char **OffaxisLibrary::getDeviceSubtypes()
+{
+  static const char *subtypes[] = {
+      "default", "null", "trace", "matrix", nullptr};
+  return subtypes;
+}
+
+} // namespace offaxis
+
+// Define library entrypoint //////////////////////////////////////////////////
+
+extern "C" OFFAXIS_LIBRARY_INTERFACE ANARI_DEFINE_LIBRARY_ENTRYPOINT(
+    offaxis, handle, scb, scbPtr)
+{
+  return (ANARILibrary) new offaxis::OffaxisLibrary(handle, scb, scbPtr);
+}
@@ -0,0 +1,557 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#include "TraceDevice.h"
+// std
+#include <cstdio>
+#include <cstring>
+#include <vector>
+// ours
+#include "DataTypes.h"
+
+namespace offaxis {
+
+using trace::Op;
+
+TraceDevice::TraceDevice(ANARILibrary library) : LayerDevice(library) {}
+
+TraceDevice::~TraceDevice()
+{
+  m_writer.close();
+}
+
+bool TraceDevice::setDeviceParameter(
+    const char *name, ANARIDataType type, const void *mem)
+{
+  if (!std::strcmp(name, "traceFile") && type == ANARI_STRING) {
+    m_fileName = (const char *)mem;
+    m_writer.close();
+    return true;
+  }
+  return LayerDevice::setDeviceParameter(name, type, mem);
+}
+
+uint64_t TraceDevice::nanoseconds(Clock::time_point start)
+{
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      Clock::now() - start)
+      .count();
+}
+
+trace::Writer &TraceDevice::out(Op op, uint64_t durationNs)
+{
+  if (!m_writer.isOpen() && !m_writer.open(m_fileName))
+    fprintf(stderr, "[trace] could not open '%s'\n", m_fileName.c_str());
+  m_writer.begin(op, durationNs);
+  return m_writer;
+}
+
+uint64_t TraceDevice::id(ANARIObject o) const
+{
+  if (!o)
+    return 0;
+  if (isDevice(o) || o == (ANARIObject)m_wrapped)
+    return 1;
+  auto it = m_objects.find(o);
+  return it != m_objects.end() ? it->second.id : 0;
+}
+
+uint64_t TraceDevice::newId(ANARIObject o)
+{
+  // Handles may be recycled by the wrapped device, ids never are
+  TracedObject &traced = m_objects[o];
+  traced = TracedObject();
+  traced.id = m_nextId++;
+  return traced.id;
+}
+
+void TraceDevice::forget(ANARIObject o)
+{
+  auto it = m_objects.find(o);
+  if (it == m_objects.end() || --it->second.refCount > 0)
+    return;
+
+  m_objects.erase(it);
+  m_arrays.erase(o);
+  for (auto pa = m_paramArrays.begin(); pa != m_paramArrays.end();) {
+    if (pa->first.first == o)
+      pa = m_paramArrays.erase(pa);
+    else
+      ++pa;
+  }
+}
+
+void TraceDevice::recordNewObject(ANARIObject o,
+    ANARIDataType type,
+    const char *subtype,
+    Clock::time_point start)
+{
+  auto &w = out(Op::NewObject, nanoseconds(start));
+  w.varint(newId(o));
+  w.varint(type);
+  w.string(subtype);
+}
+
+std::vector<uint8_t> TraceDevice::arrayContents(
+    const ArrayInfo &info, const void *data) const
+{
+  std::vector<uint8_t> contents;
+  if (!data)
+    return contents;
+
+  if (!isObjectType(info.elementType)) {
+    const auto *bytes = (const uint8_t *)data;
+    contents.assign(
+        bytes, bytes + info.numItems * sizeOfDataType(info.elementType));
+    return contents;
+  }
+
+  // Object arrays are stored as 64-bit ids
+  contents.resize(info.numItems * sizeof(uint64_t));
+  const auto *handles = (const ANARIObject *)data;
+  for (uint64_t i = 0; i < info.numItems; i++) {
+    const uint64_t objectId = id(handles[i]);
+    std::memcpy(contents.data() + i * sizeof(uint64_t),
+        &objectId,
+        sizeof(uint64_t));
+  }
+  return contents;
+}
+
+void TraceDevice::recordNewArray(ANARIObject a,
+    int dims,
+    const void *appMemory,
+    ANARIDataType type,
+    uint64_t n1,
+    uint64_t n2,
+    uint64_t n3,
+    Clock::time_point start)
+{
+  ArrayInfo info;
+  info.elementType = type;
+  info.numItems = n1 * n2 * n3;
+  m_arrays[a] = info;
+
+  auto &w = out(Op::NewArray, nanoseconds(start));
+  w.varint(newId(a));
+  w.varint(dims);
+  w.varint(type);
+  w.varint(n1);
+  w.varint(n2);
+  w.varint(n3);
+  w.u8(appMemory ? 1 : 0);
+  if (appMemory) {
+    auto contents = arrayContents(info, appMemory);
+    w.data(contents.data(), contents.size());
+  }
+}
+
+// Data Arrays ////////////////////////////////////////////////////////////////
+
+ANARIArray1D TraceDevice::newArray1D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1)
+{
+  auto start = Clock::now();
+  auto a = LayerDevice::newArray1D(
+      appMemory, deleter, userdata, type, numItems1);
+  recordNewArray(a, 1, appMemory, type, numItems1, 1, 1, start);
+  return a;
+}
+
+ANARIArray2D TraceDevice::newArray2D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2)
+{
+  auto start = Clock::now();
+  auto a = LayerDevice::newArray2D(
+      appMemory, deleter, userdata, type, numItems1, numItems2);
+  recordNewArray(a, 2, appMemory, type, numItems1, numItems2, 1, start);
+  return a;
+}
+
+ANARIArray3D TraceDevice::newArray3D(const void *appMemory,
+    ANARIMemoryDeleter deleter,
+    const void *userdata,
+    ANARIDataType type,
+    uint64_t numItems1,
+    uint64_t numItems2,
+    uint64_t numItems3)
+{
+  auto start = Clock::now();
+  auto a = LayerDevice::newArray3D(
+      appMemory, deleter, userdata, type, numItems1, numItems2, numItems3);
+  recordNewArray(
+      a, 3, appMemory, type, numItems1, numItems2, numItems3, start);
+  return a;
+}
+
+void *TraceDevice::mapArray(ANARIArray a)
+{
+  auto start = Clock::now();
+  void *ptr = LayerDevice::mapArray(a);
+  m_arrays[a].mapped = ptr;
+  out(Op::MapArray, nanoseconds(start)).varint(id(a));
+  return ptr;
+}
+
+void TraceDevice::unmapArray(ANARIArray a)
+{
+  // Contents are only guaranteed valid until the unmap, so capture them
+  // first and emit the record (with the call's duration) afterwards
+  auto &info = m_arrays[a];
+  auto contents = arrayContents(info, info.mapped);
+  info.mapped = nullptr;
+
+  auto start = Clock::now();
+  LayerDevice::unmapArray(a);
+  auto &w = out(Op::UnmapArray, nanoseconds(start));
+  w.varint(id(a));
+  w.data(contents.data(), contents.size());
+}
+
+// Objects ////////////////////////////////////////////////////////////////////
+
+#define TRACE_NEW_OBJECT(TYPE, call, dataType, subtype)                        \
+  auto start = Clock::now();                                                   \
+  TYPE o = call;                                                               \
+  recordNewObject(o, dataType, subtype, start);                                \
+  return o;
+
+ANARILight TraceDevice::newLight(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARILight, LayerDevice::newLight(type), ANARI_LIGHT, type);
+}
+
+ANARICamera TraceDevice::newCamera(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARICamera, LayerDevice::newCamera(type), ANARI_CAMERA, type);
+}
+
+ANARIGeometry TraceDevice::newGeometry(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARIGeometry, LayerDevice::newGeometry(type), ANARI_GEOMETRY, type);
+}
+
+ANARISpatialField TraceDevice::newSpatialField(const char *type)
+{
+  TRACE_NEW_OBJECT(ANARISpatialField,
+      LayerDevice::newSpatialField(type),
+      ANARI_SPATIAL_FIELD,
+      type);
+}
+
+ANARISurface TraceDevice::newSurface()
+{
+  TRACE_NEW_OBJECT(
+      ANARISurface, LayerDevice::newSurface(), ANARI_SURFACE, nullptr);
+}
+
+ANARIVolume TraceDevice::newVolume(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARIVolume, LayerDevice::newVolume(type), ANARI_VOLUME, type);
+}
+
+ANARIMaterial TraceDevice::newMaterial(const char *material_type)
+{
+  TRACE_NEW_OBJECT(ANARIMaterial,
+      LayerDevice::newMaterial(material_type),
+      ANARI_MATERIAL,
+      material_type);
+}
+
+ANARISampler TraceDevice::newSampler(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARISampler, LayerDevice::newSampler(type), ANARI_SAMPLER, type);
+}
+
+ANARIGroup TraceDevice::newGroup()
+{
+  TRACE_NEW_OBJECT(ANARIGroup, LayerDevice::newGroup(), ANARI_GROUP, nullptr);
+}
+
+ANARIInstance TraceDevice::newInstance(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARIInstance, LayerDevice::newInstance(type), ANARI_INSTANCE, type);
+}
+
+ANARIWorld TraceDevice::newWorld()
+{
+  TRACE_NEW_OBJECT(ANARIWorld, LayerDevice::newWorld(), ANARI_WORLD, nullptr);
+}
+
+ANARIRenderer TraceDevice::newRenderer(const char *type)
+{
+  TRACE_NEW_OBJECT(
+      ANARIRenderer, LayerDevice::newRenderer(type), ANARI_RENDERER, type);
+}
+
+ANARIFrame TraceDevice::newFrame()
+{
+  TRACE_NEW_OBJECT(ANARIFrame, LayerDevice::newFrame(), ANARI_FRAME, nullptr);
+}
+
+#undef TRACE_NEW_OBJECT
+
+// Object + Parameter Lifetime Management /////////////////////////////////////
+
+int TraceDevice::getProperty(ANARIObject object,
+    const char *name,
+    ANARIDataType type,
+    void *mem,
+    uint64_t size,
+    ANARIWaitMask mask)
+{
+  auto start = Clock::now();
+  int result = LayerDevice::getProperty(object, name, type, mem, size, mask);
+  auto &w = out(Op::GetProperty, nanoseconds(start));
+  w.varint(id(object));
+  w.string(name);
+  w.varint(type);
+  w.varint(size);
+  w.varint(mask);
+  return result;
+}
+
+void TraceDevice::setParameter(
+    ANARIObject object, const char *name, ANARIDataType type, const void *mem)
+{
+  if (isDevice(object) && setDeviceParameter(name, type, mem))
+    return;
+
+  const size_t size = sizeOfDataType(type);
+  if (type != ANARI_STRING && size == 0) {
+    // Not representable in the trace (e.g. callbacks), forward only
+    LayerDevice::setParameter(object, name, type, mem);
+    return;
+  }
+
+  auto start = Clock::now();
+  LayerDevice::setParameter(object, name, type, mem);
+  auto &w = out(Op::SetParameter, nanoseconds(start));
+  w.varint(id(object));
+  w.string(name);
+  w.varint(type);
+  if (type == ANARI_STRING)
+    w.string((const char *)mem);
+  else if (isObjectType(type))
+    w.varint(id(*(const ANARIObject *)mem));
+  else
+    w.data(mem, size);
+}
+
+void TraceDevice::unsetParameter(ANARIObject object, const char *name)
+{
+  auto start = Clock::now();
+  LayerDevice::unsetParameter(object, name);
+  auto &w = out(Op::UnsetParameter, nanoseconds(start));
+  w.varint(id(object));
+  w.string(name);
+}
+
+void TraceDevice::unsetAllParameters(ANARIObject object)
+{
+  auto start = Clock::now();
+  LayerDevice::unsetAllParameters(object);
+  out(Op::UnsetAllParameters, nanoseconds(start)).varint(id(object));
+}
+
+void TraceDevice::recordMapParameterArray(ANARIObject object,
+    const char *name,
+    ANARIDataType type,
+    uint64_t n1,
+    uint64_t n2,
+    uint64_t n3,
+    void *mapped,
+    Clock::time_point start)
+{
+  const int dims = n3 > 1 ? 3 : (n2 > 1 ? 2 : 1);
+
+  ArrayInfo info;
+  info.elementType = type;
+  info.numItems = n1 * n2 * n3;
+  info.mapped = mapped;
+  m_paramArrays[{object, name}] = info;
+
+  auto &w = out(Op::MapParameterArray, nanoseconds(start));
+  w.varint(id(object));
+  w.string(name);
+  w.varint(type);
+  w.varint(dims);
+  w.varint(n1);
+  w.varint(n2);
+  w.varint(n3);
+}
+
+void *TraceDevice::mapParameterArray1D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t *elementStride)
+{
+  auto start = Clock::now();
+  void *ptr = LayerDevice::mapParameterArray1D(
+      object, name, dataType, numElements1, elementStride);
+  recordMapParameterArray(
+      object, name, dataType, numElements1, 1, 1, ptr, start);
+  return ptr;
+}
+
+void *TraceDevice::mapParameterArray2D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t *elementStride)
+{
+  auto start = Clock::now();
+  void *ptr = LayerDevice::mapParameterArray2D(
+      object, name, dataType, numElements1, numElements2, elementStride);
+  recordMapParameterArray(
+      object, name, dataType, numElements1, numElements2, 1, ptr, start);
+  return ptr;
+}
+
+void *TraceDevice::mapParameterArray3D(ANARIObject object,
+    const char *name,
+    ANARIDataType dataType,
+    uint64_t numElements1,
+    uint64_t numElements2,
+    uint64_t numElements3,
+    uint64_t *elementStride)
+{
+  auto start = Clock::now();
+  void *ptr = LayerDevice::mapParameterArray3D(object,
+      name,
+      dataType,
+      numElements1,
+      numElements2,
+      numElements3,
+      elementStride);
+  recordMapParameterArray(object,
+      name,
+      dataType,
+      numElements1,
+      numElements2,
+      numElements3,
+      ptr,
+      start);
+  return ptr;
+}
+
+void TraceDevice::unmapParameterArray(ANARIObject object, const char *name)
+{
+  auto it = m_paramArrays.find({object, name});
+  std::vector<uint8_t> contents;
+  if (it != m_paramArrays.end()) {
+    contents = arrayContents(it->second, it->second.mapped);
+    m_paramArrays.erase(it);
+  }
+
+  auto start = Clock::now();
+  LayerDevice::unmapParameterArray(object, name);
+  auto &w = out(Op::UnmapParameterArray, nanoseconds(start));
+  w.varint(id(object));
+  w.string(name);
+  w.data(contents.data(), contents.size());
+}
+
+void TraceDevice::commitParameters(ANARIObject object)
+{
+  auto start = Clock::now();
+  LayerDevice::commitParameters(object);
+  out(Op::CommitParameters, nanoseconds(start)).varint(id(object));
+}
+
+void TraceDevice::release(ANARIObject object)
+{
+  if (isDevice(object)) {
+    LayerDevice::release(object); // may delete this
+    return;
+  }
+
+  auto start = Clock::now();
+  LayerDevice::release(object);
+  out(Op::Release, nanoseconds(start)).varint(id(object));
+  forget(object);
+}
+
+void TraceDevice::retain(ANARIObject object)
+{
+  if (isDevice(object)) {
+    LayerDevice::retain(object);
+    return;
+  }
+
+  auto start = Clock::now();
+  LayerDevice::retain(object);
+  out(Op::Retain, nanoseconds(start)).varint(id(object));
+
+  auto it = m_objects.find(object);
+  if (it != m_objects.end())
+    it->second.refCount++;
+}
+
+// Frames /////////////////////////////////////////////////////////////////////
+
+const void *TraceDevice::frameBufferMap(ANARIFrame fb,
+    const char *channel,
+    uint32_t *width,
+    uint32_t *height,
+    ANARIDataType *pixelType)
+{
+  auto start = Clock::now();
+  const void *ptr =
+      LayerDevice::frameBufferMap(fb, channel, width, height, pixelType);
+  auto &w = out(Op::MapFrame, nanoseconds(start));
+  w.varint(id(fb));
+  w.string(channel);
+  return ptr;
+}
+
+void TraceDevice::frameBufferUnmap(ANARIFrame fb, const char *channel)
+{
+  auto start = Clock::now();
+  LayerDevice::frameBufferUnmap(fb, channel);
+  auto &w = out(Op::UnmapFrame, nanoseconds(start));
+  w.varint(id(fb));
+  w.string(channel);
+}
+
+void TraceDevice::renderFrame(ANARIFrame frame)
+{
+  auto start = Clock::now();
+  LayerDevice::renderFrame(frame);
+  out(Op::RenderFrame, nanoseconds(start)).varint(id(frame));
+  m_writer.flush(); // keep the trace usable if the app dies mid-frame
+}
+
+int TraceDevice::frameReady(ANARIFrame frame, ANARIWaitMask mask)
+{
+  auto start = Clock::now();
+  int ready = LayerDevice::frameReady(frame, mask);
+  auto &w = out(Op::FrameReady, nanoseconds(start));
+  w.varint(id(frame));
+  w.varint(mask);
+  return ready;
+}
+
+void TraceDevice::discardFrame(ANARIFrame frame)
+{
+  auto start = Clock::now();
+  LayerDevice::discardFrame(frame);
+  out(Op::DiscardFrame, nanoseconds(start)).varint(id(frame));
+}
+
+} // namespace offaxis
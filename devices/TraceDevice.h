@@ -0,0 +1,187 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <chrono>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+// ours
+#include "LayerDevice.h"
+#include "TraceFormat.h"
+
+namespace offaxis {
+
+// ========================================================
+// Layer that records every call (including array contents)
+//  into a binary trace (see TraceFormat.h) before passing
+//  it on to the wrapped device. Device parameters:
+//
+//   "wrappedDevice" ANARI_DEVICE  device to forward to
+//   "traceFile"     ANARI_STRING  output, default
+//                                 "offaxis.trace"
+// ========================================================
+struct TraceDevice : public LayerDevice
+{
+  TraceDevice(ANARILibrary library);
+  ~TraceDevice() override;
+
+  // Data Arrays //////////////////////////////////////////////////////////////
+
+  ANARIArray1D newArray1D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1) override;
+
+  ANARIArray2D newArray2D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2) override;
+
+  ANARIArray3D newArray3D(const void *appMemory,
+      ANARIMemoryDeleter deleter,
+      const void *userdata,
+      ANARIDataType,
+      uint64_t numItems1,
+      uint64_t numItems2,
+      uint64_t numItems3) override;
+
+  void *mapArray(ANARIArray) override;
+  void unmapArray(ANARIArray) override;
+
+  // Objects //////////////////////////////////////////////////////////////////
+
+  ANARILight newLight(const char *type) override;
+  ANARICamera newCamera(const char *type) override;
+  ANARIGeometry newGeometry(const char *type) override;
+  ANARISpatialField newSpatialField(const char *type) override;
+  ANARISurface newSurface() override;
+  ANARIVolume newVolume(const char *type) override;
+  ANARIMaterial newMaterial(const char *material_type) override;
+  ANARISampler newSampler(const char *type) override;
+  ANARIGroup newGroup() override;
+  ANARIInstance newInstance(const char *type) override;
+  ANARIWorld newWorld() override;
+  ANARIRenderer newRenderer(const char *type) override;
+  ANARIFrame newFrame() override;
+
+  // Object + Parameter Lifetime Management ///////////////////////////////////
+
+  int getProperty(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      void *mem,
+      uint64_t size,
+      ANARIWaitMask mask) override;
+
+  void setParameter(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      const void *mem) override;
+  void unsetParameter(ANARIObject object, const char *name) override;
+  void unsetAllParameters(ANARIObject object) override;
+
+  void *mapParameterArray1D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t *elementStride) override;
+  void *mapParameterArray2D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t *elementStride) override;
+  void *mapParameterArray3D(ANARIObject object,
+      const char *name,
+      ANARIDataType dataType,
+      uint64_t numElements1,
+      uint64_t numElements2,
+      uint64_t numElements3,
+      uint64_t *elementStride) override;
+  void unmapParameterArray(ANARIObject object, const char *name) override;
+
+  void commitParameters(ANARIObject object) override;
+  void release(ANARIObject object) override;
+  void retain(ANARIObject object) override;
+
+  // Frames ///////////////////////////////////////////////////////////////////
+
+  const void *frameBufferMap(ANARIFrame fb,
+      const char *channel,
+      uint32_t *width,
+      uint32_t *height,
+      ANARIDataType *pixelType) override;
+  void frameBufferUnmap(ANARIFrame fb, const char *channel) override;
+
+  void renderFrame(ANARIFrame) override;
+  int frameReady(ANARIFrame, ANARIWaitMask) override;
+  void discardFrame(ANARIFrame) override;
+
+ protected:
+  bool setDeviceParameter(
+      const char *name, ANARIDataType type, const void *mem) override;
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct ArrayInfo
+  {
+    ANARIDataType elementType{ANARI_UNKNOWN};
+    uint64_t numItems{0};
+    void *mapped{nullptr};
+  };
+
+  struct TracedObject
+  {
+    uint64_t id{0};
+    // Public references held by the application; at zero the handle is
+    //  dead and may be recycled by the wrapped device
+    uint64_t refCount{1};
+  };
+
+  static uint64_t nanoseconds(Clock::time_point start);
+
+  trace::Writer &out(trace::Op op, uint64_t durationNs);
+  uint64_t id(ANARIObject o) const;
+  uint64_t newId(ANARIObject o);
+  void forget(ANARIObject o);
+  void recordNewObject(ANARIObject o,
+      ANARIDataType type,
+      const char *subtype,
+      Clock::time_point start);
+  void recordNewArray(ANARIObject a,
+      int dims,
+      const void *appMemory,
+      ANARIDataType type,
+      uint64_t n1,
+      uint64_t n2,
+      uint64_t n3,
+      Clock::time_point start);
+  void recordMapParameterArray(ANARIObject object,
+      const char *name,
+      ANARIDataType type,
+      uint64_t n1,
+      uint64_t n2,
+      uint64_t n3,
+      void *mapped,
+      Clock::time_point start);
+  std::vector<uint8_t> arrayContents(
+      const ArrayInfo &info, const void *data) const;
+
+  trace::Writer m_writer;
+  std::string m_fileName{"offaxis.trace"};
+  std::unordered_map<ANARIObject, TracedObject> m_objects;
+  uint64_t m_nextId{2};
+  std::unordered_map<ANARIObject, ArrayInfo> m_arrays;
+  std::map<std::pair<ANARIObject, std::string>, ArrayInfo> m_paramArrays;
+};
+
+} // namespace offaxis
@@ -0,0 +1,253 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace offaxis {
+namespace trace {
+
+// ========================================================
+// Binary ANARI call trace, written by the "trace" layer
+//  device and consumed by the replay-trace tool.
+//
+//  file   := "OXTR" u32:version record*
+//  record := u8:op varint:durationNs payload
+//
+//  Objects are referred to by ids assigned in creation
+//  order (0 = null, 1 = the device). Integers are LEB128
+//  varints, strings are varint:length + bytes, raw data
+//  (parameter values, array contents) is varint:size +
+//  bytes. Object handles inside arrays or parameters are
+//  stored as ids. The duration is the time the call took
+//  on the recorded device.
+// ========================================================
+
+static const char magic[4] = {'O', 'X', 'T', 'R'};
+static const uint32_t version = 1;
+
+enum class Op : uint8_t
+{
+  NewArray = 1, // id, dims, elementType, n1, n2, n3, u8:hasData, [data]
+  MapArray, // id
+  UnmapArray, // id, data
+  NewObject, // id, objectType, subtype
+  SetParameter, // id, name, type, value (id | string | data)
+  UnsetParameter, // id, name
+  UnsetAllParameters, // id
+  MapParameterArray, // id, name, elementType, dims, n1, n2, n3
+  UnmapParameterArray, // id, name, data
+  CommitParameters, // id
+  Release, // id
+  Retain, // id
+  RenderFrame, // id
+  FrameReady, // id, waitMask
+  DiscardFrame, // id
+  MapFrame, // id, channel
+  UnmapFrame, // id, channel
+  GetProperty, // id, name, type, size, waitMask
+  Count
+};
+
+inline const char *opName(Op op)
+{
+  static const char *names[] = {"<invalid>",
+      "newArray",
+      "mapArray",
+      "unmapArray",
+      "newObject",
+      "setParameter",
+      "unsetParameter",
+      "unsetAllParameters",
+      "mapParameterArray",
+      "unmapParameterArray",
+      "commitParameters",
+      "release",
+      "retain",
+      "renderFrame",
+      "frameReady",
+      "discardFrame",
+      "mapFrame",
+      "unmapFrame",
+      "getProperty"};
+  return op < Op::Count ? names[size_t(op)] : names[0];
+}
+
+struct Writer
+{
+  ~Writer()
+  {
+    close();
+  }
+
+  bool open(const std::string &fileName)
+  {
+    close();
+    file = std::fopen(fileName.c_str(), "wb");
+    if (!file)
+      return false;
+    bytes(magic, sizeof(magic));
+    for (int i = 0; i < 4; i++)
+      u8(uint8_t(version >> (8 * i)));
+    return true;
+  }
+
+  bool isOpen() const
+  {
+    return file != nullptr;
+  }
+
+  void close()
+  {
+    flush();
+    if (file)
+      std::fclose(file);
+    file = nullptr;
+  }
+
+  void flush()
+  {
+    if (file && !buffer.empty())
+      std::fwrite(buffer.data(), 1, buffer.size(), file);
+    buffer.clear();
+  }
+
+  void begin(Op op, uint64_t durationNs)
+  {
+    u8(uint8_t(op));
+    varint(durationNs);
+  }
+
+  void u8(uint8_t v)
+  {
+    buffer.push_back(v);
+  }
+
+  void varint(uint64_t v)
+  {
+    while (v >= 0x80) {
+      buffer.push_back(uint8_t(v) | 0x80);
+      v >>= 7;
+    }
+    buffer.push_back(uint8_t(v));
+  }
+
+  void bytes(const void *data, size_t size)
+  {
+    const auto *b = (const uint8_t *)data;
+    buffer.insert(buffer.end(), b, b + size);
+    if (buffer.size() > (1u << 20))
+      flush();
+  }
+
+  void string(const char *str)
+  {
+    const size_t len = str ? std::char_traits<char>::length(str) : 0;
+    varint(len);
+    bytes(str, len);
+  }
+
+  void data(const void *data, size_t size)
+  {
+    varint(size);
+    bytes(data, size);
+  }
+
+  FILE *file{nullptr};
+  std::vector<uint8_t> buffer;
+};
+
+struct Reader
+{
+  bool open(const std::string &fileName)
+  {
+    FILE *file = std::fopen(fileName.c_str(), "rb");
+    if (!file)
+      return false;
+    const long size =
+        std::fseek(file, 0, SEEK_END) == 0 ? std::ftell(file) : -1;
+    if (size < 0 || std::fseek(file, 0, SEEK_SET) != 0) {
+      std::fclose(file);
+      return false;
+    }
+    contents.resize(size_t(size));
+    const size_t n = std::fread(contents.data(), 1, contents.size(), file);
+    std::fclose(file);
+    pos = 0;
+
+    if (n != contents.size() || n < 8)
+      return false;
+    for (int i = 0; i < 4; i++) {
+      if (contents[i] != uint8_t(magic[i]))
+        return false;
+    }
+    pos = 4;
+    uint32_t v = 0;
+    for (int i = 0; i < 4; i++)
+      v |= uint32_t(u8()) << (8 * i);
+    return v == version;
+  }
+
+  bool atEnd() const
+  {
+    return pos >= contents.size() || failed;
+  }
+
+  uint8_t u8()
+  {
+    if (pos >= contents.size()) {
+      failed = true;
+      return 0;
+    }
+    return contents[pos++];
+  }
+
+  uint64_t varint()
+  {
+    uint64_t v = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      const uint8_t b = u8();
+      v |= uint64_t(b & 0x7f) << shift;
+      if (!(b & 0x80))
+        break;
+    }
+    return v;
+  }
+
+  const uint8_t *bytes(size_t size)
+  {
+    if (pos + size > contents.size()) {
+      failed = true;
+      return nullptr;
+    }
+    const uint8_t *p = contents.data() + pos;
+    pos += size;
+    return p;
+  }
+
+  std::string string()
+  {
+    const size_t len = varint();
+    const auto *p = bytes(len);
+    return p ? std::string((const char *)p, len) : std::string();
+  }
+
+  // Returns a pointer into the trace, valid as long as the reader
+  const uint8_t *data(size_t &size)
+  {
+    size = varint();
+    return bytes(size);
+  }
+
+  std::vector<uint8_t> contents;
+  size_t pos{0};
+  bool failed{false};
+};
+
+} // namespace trace
+} // namespace offaxis
@@ -5,165 +5,21 @@
 #define ANARI_EXTENSION_UTILITY_IMPL
 #include <anari/anari_cpp.hpp>
 // std
-#include <algorithm>
 #include <array>
 #include <cstdio>
 #include <iostream>
-#include <numeric>
-#include <random>
 // stb_image
 #define STB_IMAGE_WRITE_IMPLEMENTATION
 #include "stb_image_write.h"
 // ours
+#include "Scene.h"
+#include "Strategies.h"
+#include "StrategySelection.h"
+#include "anari-helpers.h"
 #include "math-helpers.h"
 
 #include "Projection.h"
 
-// ========================================================
-// generate our test scene
-// ========================================================
-anari::World generateScene(anari::Device device, const float3 &pos)
-{
-  const uint32_t numSpheres = 10000;
-  const float radius = .015f;
-
-  std::mt19937 rng;
-  rng.seed(0);
-  std::normal_distribution<float> vert_dist(0.f, 0.25f);
-
-  // Create + fill position and color arrays with randomized values //
-
-  auto indicesArray = anari::newArray1D(device, ANARI_UINT32, numSpheres);
-  auto positionsArray =
-      anari::newArray1D(device, ANARI_FLOAT32_VEC3, numSpheres);
-  auto distanceArray = anari::newArray1D(device, ANARI_FLOAT32, numSpheres);
-  {
-    auto *positions = anari::map<float3>(device, positionsArray);
-    auto *distances = anari::map<float>(device, distanceArray);
-    for (uint32_t i = 0; i < numSpheres; i++) {
-      const auto a = positions[i][0] = vert_dist(rng);
-      const auto b = positions[i][1] = vert_dist(rng);
-      const auto c = positions[i][2] = vert_dist(rng);
-      distances[i] = std::sqrt(a * a + b * b + c * c); // will be roughly 0-1
-      // translate
-      positions[i] += pos;
-    }
-    anari::unmap(device, positionsArray);
-    anari::unmap(device, distanceArray);
-
-    auto *indicesBegin = anari::map<uint32_t>(device, indicesArray);
-    auto *indicesEnd = indicesBegin + numSpheres;
-    std::iota(indicesBegin, indicesEnd, 0);
-    std::shuffle(indicesBegin, indicesEnd, rng);
-    anari::unmap(device, indicesArray);
-  }
-
-  // Create and parameterize geometry //
-
-  auto geometry = anari::newObject<anari::Geometry>(device, "sphere");
-  anari::setAndReleaseParameter(
-      device, geometry, "primitive.index", indicesArray);
-  anari::setAndReleaseParameter(
-      device, geometry, "vertex.position", positionsArray);
-  anari::setAndReleaseParameter(
-      device, geometry, "vertex.attribute0", distanceArray);
-  anari::setParameter(device, geometry, "radius", radius);
-  anari::commitParameters(device, geometry);
-
-  // Create color map texture //
-
-  auto texelArray = anari::newArray1D(device, ANARI_FLOAT32_VEC3, 2);
-  {
-    auto *texels = anari::map<float3>(device, texelArray);
-    texels[0][0] = 1.f;
-    texels[0][1] = 0.f;
-    texels[0][2] = 0.f;
-    texels[1][0] = 0.f;
-    texels[1][1] = 1.f;
-    texels[1][2] = 0.f;
-    anari::unmap(device, texelArray);
-  }
-
-  auto texture = anari::newObject<anari::Sampler>(device, "image1D");
-  anari::setAndReleaseParameter(device, texture, "image", texelArray);
-  anari::setParameter(device, texture, "filter", "linear");
-  anari::commitParameters(device, texture);
-
-  // Create and parameterize material //
-
-  auto material = anari::newObject<anari::Material>(device, "matte");
-  anari::setAndReleaseParameter(device, material, "color", texture);
-  anari::commitParameters(device, material);
-
-  // Create and parameterize surface //
-
-  auto surface = anari::newObject<anari::Surface>(device);
-  anari::setAndReleaseParameter(device, surface, "geometry", geometry);
-  anari::setAndReleaseParameter(device, surface, "material", material);
-  anari::commitParameters(device, surface);
-
-  // Create and parameterize world //
-
-  auto world = anari::newObject<anari::World>(device);
-#if 1
-  {
-    auto surfaceArray = anari::newArray1D(device, ANARI_SURFACE, 1);
-    auto *s = anari::map<anari::Surface>(device, surfaceArray);
-    s[0] = surface;
-    anari::unmap(device, surfaceArray);
-    anari::setAndReleaseParameter(device, world, "surface", surfaceArray);
-  }
-#else
-  anari::setAndReleaseParameter(
-      device, world, "surface", anari::newArray1D(device, &surface));
-#endif
-  anari::release(device, surface);
-  anari::commitParameters(device, world);
-
-  return world;
-}
-
-// ========================================================
-// query anari extensions (ANARI_VSNRAY_CAMERA_MATRIX)
-// ========================================================
-static bool deviceHasExtension(anari::Library library,
-    const std::string &deviceSubtype,
-    const std::string &extName)
-{
-  const char **extensions =
-      anariGetDeviceExtensions(library, deviceSubtype.c_str());
-
-  for (; *extensions; extensions++) {
-    if (*extensions == extName)
-      return true;
-  }
-  return false;
-}
-
-// ========================================================
-// Log ANARI errors
-// ========================================================
-static void statusFunc(const void * /*userData*/,
-    ANARIDevice /*device*/,
-    ANARIObject source,
-    ANARIDataType /*sourceType*/,
-    ANARIStatusSeverity severity,
-    ANARIStatusCode /*code*/,
-    const char *message)
-{
-  if (severity == ANARI_SEVERITY_FATAL_ERROR) {
-    fprintf(stderr, "[FATAL][%p] %s\n", source, message);
-    std::exit(1);
-  } else if (severity == ANARI_SEVERITY_ERROR) {
-    fprintf(stderr, "[ERROR][%p] %s\n", source, message);
-  } else if (severity == ANARI_SEVERITY_WARNING) {
-    fprintf(stderr, "[WARN ][%p] %s\n", source, message);
-  } else if (severity == ANARI_SEVERITY_PERFORMANCE_WARNING) {
-    fprintf(stderr, "[PERF ][%p] %s\n", source, message);
-  }
-  // Ignore INFO/DEBUG messages
-}
-
 // ========================================================
 // Function to render a given frame (renderer+world+cam)
 //  and produce an output image
@@ -200,12 +56,8 @@ static void renderMatricesWithMatrixCamExtension(
 {
   // Create camera //
 
-  auto camera = anari::newObject<anari::Camera>(device, "matrix");
-
-  anari::setParameter(device, camera, "proj", proj);
-  anari::setParameter(device, camera, "view", view);
-
-  anari::commitParameters(device, camera);
+  auto camera = newStrategyCamera(device, Strategy::MatrixCamExtension);
+  setMatrixCameraParameters(device, camera, proj, view);
 
   anari::setParameter(device, frame, "camera", camera);
   anari::commitParameters(device, frame);
@@ -225,24 +77,10 @@ static void renderFixedFrameWithPerspectiveCam(anari::Device device,
     float3 UR,
     float3 eye)
 {
-  float3 dir, up;
-  float fovy, aspect;
-  float4 imgRegion;
-  offaxisStereoCamera(LL, LR, UR, eye, dir, up, fovy, aspect, imgRegion);
-
   // Create camera //
 
-  auto camera = anari::newObject<anari::Camera>(device, "perspective");
-
-  anari::setParameter(device, camera, "position", eye);
-  anari::setParameter(device, camera, "direction", dir);
-  anari::setParameter(device, camera, "up", up);
-  anari::setParameter(device, camera, "fovy", fovy);
-  anari::setParameter(device, camera, "aspect", aspect);
-  anari::setParameter(
-      device, camera, "imageRegion", ANARI_FLOAT32_BOX2, &imgRegion);
-
-  anari::commitParameters(device, camera);
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device, camera, LL, LR, UR, eye);
 
   anari::setParameter(device, frame, "camera", camera);
   anari::commitParameters(device, frame);
@@ -258,25 +96,10 @@ static void renderFixedFrameWithPerspectiveCam(anari::Device device,
 static void renderMatricesWithPerspectiveCam(
     anari::Device device, anari::Frame frame, mat4 proj, mat4 view)
 {
-  float3 eye, dir, up;
-  float fovy, aspect;
-  float4 imgRegion;
-  offaxisStereoCameraFromTransform(
-      inverse(proj), inverse(view), eye, dir, up, fovy, aspect, imgRegion);
-
   // Create camera //
 
-  auto camera = anari::newObject<anari::Camera>(device, "perspective");
-
-  anari::setParameter(device, camera, "position", eye);
-  anari::setParameter(device, camera, "direction", dir);
-  anari::setParameter(device, camera, "up", up);
-  anari::setParameter(device, camera, "fovy", fovy);
-  anari::setParameter(device, camera, "aspect", aspect);
-  anari::setParameter(
-      device, camera, "imageRegion", ANARI_FLOAT32_BOX2, &imgRegion);
-
-  anari::commitParameters(device, camera);
+  auto camera = newStrategyCamera(device, Strategy::MatricesToPerspective);
+  setMatrixFrameCameraParameters(device, camera, proj, view);
 
   anari::setParameter(device, frame, "camera", camera);
   anari::commitParameters(device, frame);
@@ -286,13 +109,40 @@ static void renderMatricesWithPerspectiveCam(
   anari::release(device, camera);
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+  std::string traceFile;
+  bool autoSelect = false;
+  for (int i = 1; i < argc; i++) {
+    if (std::string(argv[i]) == "--trace" && i + 1 < argc)
+      traceFile = argv[++i];
+    else if (std::string(argv[i]) == "--auto")
+      autoSelect = true;
+    else {
+      fprintf(stderr, "Usage: %s [--trace file.trace] [--auto]\n", argv[0]);
+      return 1;
+    }
+  }
+
   // Setup ANARI device //
 
   auto library = anari::loadLibrary("environment", statusFunc);
   auto device = anari::newDevice(library, "default");
 
+  // Optionally record all ANARI calls via the in-tree trace layer, to be
+  // replayed on other devices with the replay-trace tool
+  anari::Library traceLibrary = nullptr;
+  if (!traceFile.empty()) {
+    traceLibrary = anari::loadLibrary("offaxis", statusFunc);
+    auto traceDevice = anari::newDevice(traceLibrary, "trace");
+    anari::setParameter(traceDevice, traceDevice, "wrappedDevice", device);
+    anari::setParameter(
+        traceDevice, traceDevice, "traceFile", traceFile.c_str());
+    anari::commitParameters(traceDevice, traceDevice);
+    anari::release(device, device); // now owned by the layer
+    device = traceDevice;
+  }
+
   anari::Extensions extensions =
       anari::extension::getInstanceExtensionStruct(device, device);
 
@@ -345,6 +195,21 @@ int main()
   float3 UR(3.f, 3.f, 0.f);
   float3 eye(1.5f, 1.68f, 1.5f);
 
+  // With --auto, calibrate the supported strategies and only render with
+  // the fastest one whose image matches Strategy 2
+  bool runFixedFrame = true;
+  bool runMatricesToPerspective = true;
+  if (autoSelect) {
+    auto selection =
+        selectStrategy(library, "default", device, frame, LL, LR, UR, eye);
+    printStrategySelection(selection);
+    hasMatrixCameraExt =
+        selection.selected == Strategy::MatrixCamExtension;
+    runFixedFrame = selection.selected == Strategy::FixedFrame;
+    runMatricesToPerspective =
+        selection.selected == Strategy::MatricesToPerspective;
+  }
+
   // Strategy 1: use matrices coming from the app, plus an extension that
   // unprojects rays in NDC back to world space
   // (the renderer has to support/implement this)
@@ -353,20 +218,20 @@ int main()
     mat4 proj, view;
     offaxisStereoTransform(LL, LR, UR, eye, proj, view);
     renderMatricesWithMatrixCamExtension(device, frame, proj, view);
-  } else {
+  } else if (!autoSelect) {
     std::cerr
         << "Extension ANARI_VSNRAY_CAMERA_MATRIX not found, skipping Strategy 1\n";
   }
 
   // Strategy 2: transform the input frame to a format any ANARI device supports
-  {
+  if (runFixedFrame) {
     std::cout << "Strategy 2 ...\n";
     renderFixedFrameWithPerspectiveCam(device, frame, LL, LR, UR, eye);
   }
 
   // Strategy 3: given the input matrices, first reconstruct the frustum,
   // then transform input frame as in Strategy 2
-  {
+  if (runMatricesToPerspective) {
     std::cout << "Strategy 3 ...\n";
     mat4 proj, view;
     offaxisStereoTransform(LL, LR, UR, eye, proj, view);
@@ -380,6 +245,8 @@ int main()
   anari::release(device, frame);
   anari::release(device, device);
 
+  if (traceLibrary)
+    anari::unloadLibrary(traceLibrary);
   anari::unloadLibrary(library);
 
   return 0;
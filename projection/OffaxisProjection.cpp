@@ -0,0 +1,236 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#include "OffaxisProjection.h"
+// std
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+// ours
+#include "ProjectionKernels.h"
+
+namespace offaxis {
+
+// ========================================================
+// Runtime dispatch
+// ========================================================
+
+struct ProjectionKernelTable
+{
+  decltype(&kernels::baseline::solvePerspectiveBatch) perspective;
+  decltype(&kernels::baseline::solveFrustumBatch) frustum;
+};
+
+// Paths that were built; see projection/CMakeLists.txt
+static const ProjectionKernelTable kernelTables[] = {
+    {kernels::baseline::solvePerspectiveBatch,
+        kernels::baseline::solveFrustumBatch},
+#ifdef OFFAXIS_HAVE_SSE42
+    {kernels::sse42::solvePerspectiveBatch, kernels::sse42::solveFrustumBatch},
+#else
+    {nullptr, nullptr},
+#endif
+#ifdef OFFAXIS_HAVE_AVX2
+    {kernels::avx2::solvePerspectiveBatch, kernels::avx2::solveFrustumBatch},
+#else
+    {nullptr, nullptr},
+#endif
+#ifdef OFFAXIS_HAVE_AVX512
+    {kernels::avx512::solvePerspectiveBatch,
+        kernels::avx512::solveFrustumBatch},
+#else
+    {nullptr, nullptr},
+#endif
+};
+
+static bool cpuSupports(ProjectionIsa isa)
+{
+#if (defined(__GNUC__) || defined(__clang__))                                  \
+    && (defined(__x86_64__) || defined(__i386__))
+  // CPUID, including whether the OS saves the wider registers
+  __builtin_cpu_init();
+  switch (isa) {
+  case ProjectionIsa::Baseline:
+    return true;
+  case ProjectionIsa::SSE42:
+    return __builtin_cpu_supports("sse4.2");
+  case ProjectionIsa::AVX2:
+    return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+  case ProjectionIsa::AVX512:
+    return __builtin_cpu_supports("avx512f")
+        && __builtin_cpu_supports("avx512vl")
+        && __builtin_cpu_supports("avx512dq");
+  default:
+    return false;
+  }
+#else
+  return isa == ProjectionIsa::Baseline;
+#endif
+}
+
+const char *projectionIsaName(ProjectionIsa isa)
+{
+  static const char *names[] = {"baseline", "sse4.2", "avx2", "avx512"};
+  return isa < ProjectionIsa::Count ? names[int(isa)] : "<invalid>";
+}
+
+bool projectionIsaAvailable(ProjectionIsa isa)
+{
+  return isa < ProjectionIsa::Count && kernelTables[int(isa)].perspective
+      && cpuSupports(isa);
+}
+
+// Best available path, or the one named by OFFAXIS_PROJECTION_ISA (or the
+// best available below it)
+static ProjectionIsa defaultIsa()
+{
+  int limit = int(ProjectionIsa::Count) - 1;
+  if (const char *env = std::getenv("OFFAXIS_PROJECTION_ISA")) {
+    for (int i = 0; i < int(ProjectionIsa::Count); i++) {
+      if (!std::strcmp(env, projectionIsaName(ProjectionIsa(i))))
+        limit = i;
+    }
+  }
+  for (int i = limit; i > 0; i--) {
+    if (projectionIsaAvailable(ProjectionIsa(i)))
+      return ProjectionIsa(i);
+  }
+  return ProjectionIsa::Baseline;
+}
+
+static std::atomic<int> &selectedIsa()
+{
+  static std::atomic<int> isa{int(defaultIsa())};
+  return isa;
+}
+
+ProjectionIsa projectionIsa()
+{
+  return ProjectionIsa(selectedIsa().load(std::memory_order_relaxed));
+}
+
+bool setProjectionIsa(ProjectionIsa isa)
+{
+  if (!projectionIsaAvailable(isa))
+    return false;
+  selectedIsa().store(int(isa), std::memory_order_relaxed);
+  return true;
+}
+
+void solvePerspectiveBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    PerspectiveSolution *out)
+{
+  kernelTables[int(projectionIsa())].perspective(screen, eyes, n, out);
+}
+
+void solveFrustumBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    FrustumSolution *out)
+{
+  kernelTables[int(projectionIsa())].frustum(screen, eyes, n, out);
+}
+
+// ========================================================
+// Scalar solvers, the same math as Projection.h
+// ========================================================
+
+struct ScreenCoordinates
+{
+  float X[3], Y[3], Z[3];
+  float left, right, bottom, top, dist;
+};
+
+static ScreenCoordinates screenCoordinates(
+    const ProjectionScreen &s, const float eye[3])
+{
+  ScreenCoordinates c;
+  float width = 0.f, height = 0.f;
+  for (int i = 0; i < 3; i++) {
+    c.X[i] = s.LR[i] - s.LL[i];
+    c.Y[i] = s.UR[i] - s.LR[i];
+    width += c.X[i] * c.X[i];
+    height += c.Y[i] * c.Y[i];
+  }
+  width = std::sqrt(width);
+  height = std::sqrt(height);
+  for (int i = 0; i < 3; i++) {
+    c.X[i] /= width;
+    c.Y[i] /= height;
+  }
+  c.Z[0] = c.X[1] * c.Y[2] - c.X[2] * c.Y[1];
+  c.Z[1] = c.X[2] * c.Y[0] - c.X[0] * c.Y[2];
+  c.Z[2] = c.X[0] * c.Y[1] - c.X[1] * c.Y[0];
+
+  c.left = c.bottom = c.dist = 0.f;
+  for (int i = 0; i < 3; i++) {
+    const float e = eye[i] - s.LL[i];
+    c.left += e * c.X[i];
+    c.bottom += e * c.Y[i];
+    c.dist += e * c.Z[i];
+  }
+  c.right = width - c.left;
+  c.top = height - c.bottom;
+  return c;
+}
+
+void solvePerspective(const ProjectionScreen &screen,
+    const float eye[3],
+    PerspectiveSolution &out)
+{
+  const ScreenCoordinates c = screenCoordinates(screen, eye);
+  for (int i = 0; i < 3; i++) {
+    out.dir[i] = -c.Z[i];
+    out.up[i] = c.Y[i];
+  }
+
+  const float newWidth = c.left < c.right ? 2 * c.right : 2 * c.left;
+  const float newHeight = c.bottom < c.top ? 2 * c.top : 2 * c.bottom;
+
+  out.fovy = 2 * std::atan(newHeight / (2 * c.dist));
+  out.aspect = newWidth / newHeight;
+
+  out.imageRegion[0] =
+      c.left < c.right ? (c.right - c.left) / newWidth : 0.f;
+  out.imageRegion[1] =
+      c.bottom < c.top ? (c.top - c.bottom) / newHeight : 0.f;
+  out.imageRegion[2] =
+      c.right < c.left ? (c.left + c.right) / newWidth : 1.f;
+  out.imageRegion[3] =
+      c.top < c.bottom ? (c.bottom + c.top) / newHeight : 1.f;
+}
+
+void solveFrustum(
+    const ProjectionScreen &screen, const float eye[3], FrustumSolution &out)
+{
+  const ScreenCoordinates c = screenCoordinates(screen, eye);
+
+  const float znear = 1e-3f, zfar = 1000.f; // not relevant to us here
+  const float left = -c.left * znear / c.dist;
+  const float right = c.right * znear / c.dist;
+  const float bottom = -c.bottom * znear / c.dist;
+  const float top = c.top * znear / c.dist;
+
+  std::memset(out.proj, 0, sizeof(out.proj));
+  out.proj[0] = (2.f * znear) / (right - left);
+  out.proj[5] = (2.f * znear) / (top - bottom);
+  out.proj[8] = (right + left) / (right - left);
+  out.proj[9] = (top + bottom) / (top - bottom);
+  out.proj[10] = -(zfar + znear) / (zfar - znear);
+  out.proj[11] = -1.f;
+  out.proj[14] = -(2.f * zfar * znear) / (zfar - znear);
+
+  for (int i = 0; i < 3; i++) {
+    out.view[i] = c.X[i];
+    out.view[4 + i] = c.Y[i];
+    out.view[8 + i] = c.Z[i];
+    out.view[12 + i] = -eye[i];
+  }
+  out.view[3] = out.view[7] = out.view[11] = 0.f;
+  out.view[15] = 1.f;
+}
+
+} // namespace offaxis
@@ -0,0 +1,87 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+
+namespace offaxis {
+
+// ========================================================
+// Compiled off-axis camera solvers. The math is the same
+//  as in Projection.h, but the batched solvers are built
+//  for several x86 ISA levels and the best one supported
+//  by the CPU is selected at runtime (CPUID), so a single
+//  binary runs at full speed on every node of a
+//  heterogeneous cluster. OFFAXIS_PROJECTION_ISA=<name>
+//  overrides the choice (clamped to what is available).
+//
+//  Matrices are column major, like anari::math::mat4.
+// ========================================================
+
+enum class ProjectionIsa
+{
+  Baseline, // whatever the compiler targets by default
+  SSE42,
+  AVX2, // + FMA
+  AVX512, // F, VL, DQ
+  Count
+};
+
+const char *projectionIsaName(ProjectionIsa isa);
+
+// Compiled in and supported by this CPU
+bool projectionIsaAvailable(ProjectionIsa isa);
+
+// Currently selected path for the batched solvers
+ProjectionIsa projectionIsa();
+
+// Select a path; returns false (and changes nothing) if unavailable
+bool setProjectionIsa(ProjectionIsa isa);
+
+struct ProjectionScreen
+{
+  float LL[3];
+  float LR[3];
+  float UR[3];
+};
+
+// Strategy 2: parameters of the "perspective" camera
+struct PerspectiveSolution
+{
+  float dir[3];
+  float up[3];
+  float fovy;
+  float aspect;
+  float imageRegion[4]; // lower x, lower y, upper x, upper y
+};
+
+// Strategies 1 and 3: OpenGL-style projection and view matrices
+struct FrustumSolution
+{
+  float proj[16];
+  float view[16];
+};
+
+// Scalar solvers for a single eye, exact (libm)
+void solvePerspective(const ProjectionScreen &screen,
+    const float eye[3],
+    PerspectiveSolution &out);
+
+void solveFrustum(
+    const ProjectionScreen &screen, const float eye[3], FrustumSolution &out);
+
+// Batched solvers for n eyes (xyz interleaved), dispatched to the selected
+// ISA; fovy uses a polynomial arctangent (max. error in fovy 3.7e-6 rad)
+void solvePerspectiveBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    PerspectiveSolution *out);
+
+void solveFrustumBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    FrustumSolution *out);
+
+} // namespace offaxis
@@ -0,0 +1,210 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Batched camera solvers; compiled once per ISA level with
+// -DOFFAXIS_ISA=<namespace> and the matching code generation flags. The
+// loops are written for the auto-vectorizer: eyes are processed in tiles
+// that are transposed to structure-of-arrays first, and all selects are
+// between values computed unconditionally.
+//
+// Only C library math and static helpers are used here: inline functions
+// from C++ headers have vague linkage, and the linker could pick an AVX-512
+// instantiation for the baseline path.
+
+#include "ProjectionKernels.h"
+// std
+#include <math.h>
+
+#ifndef OFFAXIS_ISA
+#error "OFFAXIS_ISA must name the kernel namespace"
+#endif
+
+namespace offaxis {
+namespace kernels {
+namespace OFFAXIS_ISA {
+
+static constexpr size_t tileSize = 64;
+
+static inline float minf(float a, float b)
+{
+  return a < b ? a : b;
+}
+
+static inline size_t tileCount(size_t n, size_t t0)
+{
+  return n - t0 < tileSize ? n - t0 : tileSize;
+}
+
+struct ScreenFrame
+{
+  float X[3], Y[3], Z[3];
+  float LL[3];
+  float width, height;
+};
+
+static ScreenFrame screenFrame(const ProjectionScreen &s)
+{
+  ScreenFrame f;
+  float w2 = 0.f, h2 = 0.f;
+  for (int c = 0; c < 3; c++) {
+    f.X[c] = s.LR[c] - s.LL[c];
+    f.Y[c] = s.UR[c] - s.LR[c];
+    f.LL[c] = s.LL[c];
+    w2 += f.X[c] * f.X[c];
+    h2 += f.Y[c] * f.Y[c];
+  }
+  f.width = sqrtf(w2);
+  f.height = sqrtf(h2);
+  for (int c = 0; c < 3; c++) {
+    f.X[c] /= f.width;
+    f.Y[c] /= f.height;
+  }
+  f.Z[0] = f.X[1] * f.Y[2] - f.X[2] * f.Y[1];
+  f.Z[1] = f.X[2] * f.Y[0] - f.X[0] * f.Y[2];
+  f.Z[2] = f.X[0] * f.Y[1] - f.X[1] * f.Y[0];
+  return f;
+}
+
+// Minimax polynomial on [0, 1], reflected for larger arguments
+static inline float atanApprox(float t)
+{
+  const float a = fabsf(t);
+  const float u = minf(a, 1.f / a);
+  const float u2 = u * u;
+  float p = -0.01172120f;
+  p = p * u2 + 0.05265332f;
+  p = p * u2 - 0.11643287f;
+  p = p * u2 + 0.19354346f;
+  p = p * u2 - 0.33262347f;
+  p = p * u2 + 0.99997726f;
+  p *= u;
+  const float r = a > 1.f ? 1.57079633f - p : p;
+  return copysignf(r, t);
+}
+
+// Eye position relative to the screen: offsets from the left and bottom
+// edges and distance, for eyes [0, m) of the tile
+static void screenCoordinates(const ScreenFrame &f,
+    const float *eyes,
+    size_t m,
+    float *left,
+    float *bottom,
+    float *dist)
+{
+  alignas(64) float ex[tileSize], ey[tileSize], ez[tileSize];
+  for (size_t i = 0; i < m; i++) {
+    ex[i] = eyes[3 * i] - f.LL[0];
+    ey[i] = eyes[3 * i + 1] - f.LL[1];
+    ez[i] = eyes[3 * i + 2] - f.LL[2];
+  }
+  for (size_t i = 0; i < m; i++) {
+    left[i] = ex[i] * f.X[0] + ey[i] * f.X[1] + ez[i] * f.X[2];
+    bottom[i] = ex[i] * f.Y[0] + ey[i] * f.Y[1] + ez[i] * f.Y[2];
+    dist[i] = ex[i] * f.Z[0] + ey[i] * f.Z[1] + ez[i] * f.Z[2];
+  }
+}
+
+void solvePerspectiveBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    PerspectiveSolution *out)
+{
+  const ScreenFrame f = screenFrame(screen);
+
+  for (size_t t0 = 0; t0 < n; t0 += tileSize) {
+    const size_t m = tileCount(n, t0);
+    alignas(64) float left[tileSize], bottom[tileSize], dist[tileSize];
+    screenCoordinates(f, eyes + 3 * t0, m, left, bottom, dist);
+
+    alignas(64) float fovy[tileSize], aspect[tileSize];
+    alignas(64) float r0[tileSize], r1[tileSize], r2[tileSize], r3[tileSize];
+    for (size_t i = 0; i < m; i++) {
+      const float l = left[i];
+      const float r = f.width - l;
+      const float b = bottom[i];
+      const float t = f.height - b;
+      const float newWidth = l < r ? 2.f * r : 2.f * l;
+      const float newHeight = b < t ? 2.f * t : 2.f * b;
+      const float invWidth = 1.f / newWidth;
+      const float invHeight = 1.f / newHeight;
+
+      fovy[i] = 2.f * atanApprox(newHeight / (2.f * dist[i]));
+      aspect[i] = newWidth * invHeight;
+
+      r0[i] = l < r ? (r - l) * invWidth : 0.f;
+      r1[i] = b < t ? (t - b) * invHeight : 0.f;
+      r2[i] = r < l ? (l + r) * invWidth : 1.f;
+      r3[i] = t < b ? (b + t) * invHeight : 1.f;
+    }
+
+    for (size_t i = 0; i < m; i++) {
+      PerspectiveSolution &s = out[t0 + i];
+      for (int c = 0; c < 3; c++) {
+        s.dir[c] = -f.Z[c];
+        s.up[c] = f.Y[c];
+      }
+      s.fovy = fovy[i];
+      s.aspect = aspect[i];
+      s.imageRegion[0] = r0[i];
+      s.imageRegion[1] = r1[i];
+      s.imageRegion[2] = r2[i];
+      s.imageRegion[3] = r3[i];
+    }
+  }
+}
+
+void solveFrustumBatch(const ProjectionScreen &screen,
+    const float *eyes,
+    size_t n,
+    FrustumSolution *out)
+{
+  const ScreenFrame f = screenFrame(screen);
+  const float znear = 1e-3f, zfar = 1000.f;
+
+  for (size_t t0 = 0; t0 < n; t0 += tileSize) {
+    const size_t m = tileCount(n, t0);
+    alignas(64) float left[tileSize], bottom[tileSize], dist[tileSize];
+    screenCoordinates(f, eyes + 3 * t0, m, left, bottom, dist);
+
+    alignas(64) float p00[tileSize], p11[tileSize];
+    alignas(64) float p20[tileSize], p21[tileSize];
+    for (size_t i = 0; i < m; i++) {
+      const float s = znear / dist[i];
+      const float l = -left[i] * s;
+      const float r = (f.width - left[i]) * s;
+      const float b = -bottom[i] * s;
+      const float t = (f.height - bottom[i]) * s;
+      p00[i] = 2.f * znear / (r - l);
+      p11[i] = 2.f * znear / (t - b);
+      p20[i] = (r + l) / (r - l);
+      p21[i] = (t + b) / (t - b);
+    }
+
+    for (size_t i = 0; i < m; i++) {
+      FrustumSolution &s = out[t0 + i];
+      for (int j = 0; j < 16; j++)
+        s.proj[j] = 0.f;
+      s.proj[0] = p00[i];
+      s.proj[5] = p11[i];
+      s.proj[8] = p20[i];
+      s.proj[9] = p21[i];
+      s.proj[10] = -(zfar + znear) / (zfar - znear);
+      s.proj[11] = -1.f;
+      s.proj[14] = -(2.f * zfar * znear) / (zfar - znear);
+
+      const float *eye = eyes + 3 * (t0 + i);
+      for (int c = 0; c < 3; c++) {
+        s.view[c] = f.X[c];
+        s.view[4 + c] = f.Y[c];
+        s.view[8 + c] = f.Z[c];
+        s.view[12 + c] = -eye[c];
+      }
+      s.view[3] = s.view[7] = s.view[11] = 0.f;
+      s.view[15] = 1.f;
+    }
+  }
+}
+
+} // namespace OFFAXIS_ISA
+} // namespace kernels
+} // namespace offaxis
@@ -0,0 +1,39 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// std
+#include <cstddef>
+// ours
+#include "OffaxisProjection.h"
+
+namespace offaxis {
+namespace kernels {
+
+// ========================================================
+// ProjectionKernels.cpp is compiled once per ISA level,
+//  each time into its own namespace (OFFAXIS_ISA)
+// ========================================================
+
+#define OFFAXIS_DECLARE_PROJECTION_KERNELS(isa)                                \
+  namespace isa {                                                              \
+  void solvePerspectiveBatch(const ProjectionScreen &screen,                   \
+      const float *eyes,                                                       \
+      size_t n,                                                                \
+      PerspectiveSolution *out);                                               \
+  void solveFrustumBatch(const ProjectionScreen &screen,                       \
+      const float *eyes,                                                       \
+      size_t n,                                                                \
+      FrustumSolution *out);                                                   \
+  }
+
+OFFAXIS_DECLARE_PROJECTION_KERNELS(baseline)
+OFFAXIS_DECLARE_PROJECTION_KERNELS(sse42)
+OFFAXIS_DECLARE_PROJECTION_KERNELS(avx2)
+OFFAXIS_DECLARE_PROJECTION_KERNELS(avx512)
+
+#undef OFFAXIS_DECLARE_PROJECTION_KERNELS
+
+} // namespace kernels
+} // namespace offaxis
@@ -0,0 +1,82 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+#pragma once
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+// ours
+#include "Scene.h"
+#include "anari-helpers.h"
+
+// ========================================================
+// Setup shared by the tools: library and device, the
+//  sample's light and renderer, and comparing images
+// ========================================================
+
+// Loads 'libraryName' and creates its default device; prints an error and
+// returns nullptr if the library can't be loaded
+static anari::Device newToolDevice(
+    const std::string &libraryName, anari::Library &library)
+{
+  library = anari::loadLibrary(libraryName.c_str(), statusFunc);
+  if (!library) {
+    fprintf(stderr, "could not load ANARI library '%s'\n", libraryName.c_str());
+    return nullptr;
+  }
+  return anari::newDevice(library, "default");
+}
+
+// Adds the sample's directional light to 'world' and commits it
+static void addSampleLight(anari::Device device, anari::World world)
+{
+  auto light = anari::newObject<anari::Light>(device, "directional");
+  anari::setParameterArray1D(device, world, "light", &light, 1);
+  anari::release(device, light);
+  anari::commitParameters(device, world);
+}
+
+// The sample's sphere cluster and light, as rendered by main.cpp
+static anari::World newSampleWorld(anari::Device device)
+{
+  auto world = generateScene(device, float3(1.5f, 1.5f, 0.f));
+  addSampleLight(device, world);
+  return world;
+}
+
+static anari::Renderer newSampleRenderer(anari::Device device, int spp = 32)
+{
+  auto renderer = anari::newObject<anari::Renderer>(device, "default");
+  const float4 backgroundColor = {0.1f, 0.1f, 0.1f, 1.f};
+  anari::setParameter(device, renderer, "background", backgroundColor);
+  anari::setParameter(device, renderer, "pixelSamples", spp);
+  anari::commitParameters(device, renderer);
+  return renderer;
+}
+
+// RMSE of the RGB channels of two RGBA8 images, in 8-bit units
+static double rmseRGBA8(const uint32_t *a, const uint32_t *b, size_t n)
+{
+  double sum = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    for (int c = 0; c < 3; c++) {
+      const double d =
+          double((a[i] >> (8 * c)) & 0xff) - double((b[i] >> (8 * c)) & 0xff);
+      sum += d * d;
+    }
+  }
+  return n ? std::sqrt(sum / (3.0 * n)) : 0.0;
+}
+
+static double rmseRGBA8(
+    const std::vector<uint32_t> &a, const std::vector<uint32_t> &b)
+{
+  return rmseRGBA8(a.data(), b.data(), std::min(a.size(), b.size()));
+}
@@ -0,0 +1,359 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Adaptive sampling by tile (AdaptiveSampling.h): two low sample count
+// passes estimate per-tile variance, then only the tiles that are too noisy
+// are re-rendered through sub-frustum cameras (the tile's share of the
+// Strategy 2 imageRegion) and accumulated. The target error defaults to the
+// predicted error of uniform sampling at --uniform-spp; both images are
+// compared against a --reference-spp render:
+//
+//   adaptive-sampling [--tile 50] [--pass-spp 4] [--uniform-spp 32]
+//                     [--max-spp 512] [--target e] [--batch 16]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "AdaptiveSampling.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "ToneMapping.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+static anari::Frame newFrame(anari::Device device,
+    uint2 size,
+    anari::World world,
+    anari::Renderer renderer,
+    anari::Camera camera)
+{
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", size);
+  anari::setParameter(device, frame, "channel.color", ANARI_FLOAT32_VEC4);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+  return frame;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t tileSize = 50;
+  int passSpp = 4;
+  int uniformSpp = 32;
+  int maxSpp = 512;
+  int referenceSpp = 256;
+  float targetError = 0.f;
+  size_t batchSize = 16;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--tile") && i + 1 < argc)
+      tileSize = std::max(8, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--pass-spp") && i + 1 < argc)
+      passSpp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--uniform-spp") && i + 1 < argc)
+      uniformSpp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--max-spp") && i + 1 < argc)
+      maxSpp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--reference-spp") && i + 1 < argc)
+      referenceSpp = std::max(0, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--target") && i + 1 < argc)
+      targetError = std::max(0.f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--batch") && i + 1 < argc)
+      batchSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--tile n] [--pass-spp n] [--uniform-spp n] "
+          "[--max-spp n] [--reference-spp n] [--target e] [--batch n] "
+          "[--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  // Renderers are created per sample count as tiles ask for them
+  std::map<int, anari::Renderer> renderers;
+  auto rendererFor = [&](int spp) {
+    auto it = renderers.find(spp);
+    if (it == renderers.end())
+      it = renderers.emplace(spp, newSampleRenderer(device, spp)).first;
+    return it->second;
+  };
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  float3 dir, up;
+  float fovy, aspect;
+  float4 region;
+  offaxisStereoCamera(LL, LR, UR, eye, dir, up, fovy, aspect, region);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device, camera, LL, LR, UR, eye);
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+  const TileGrid grid(imageSize.x, imageSize.y, tileSize);
+
+  auto frame =
+      newFrame(device, imageSize, world, rendererFor(passSpp), camera);
+
+  auto renderFull = [&](int spp, std::vector<float> &color) {
+    anari::setParameter(device, frame, "renderer", rendererFor(spp));
+    anari::commitParameters(device, frame);
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    auto fb = anari::map<float4>(device, frame, "channel.color");
+    const float *data = (const float *)fb.data;
+    color.assign(data, data + 4 * numPixels);
+    anari::unmap(device, frame, "channel.color");
+  };
+
+  // Uniform sampling //
+
+  std::vector<float> uniform;
+  renderFull(uniformSpp, uniform); // warm up
+  Timer timer;
+  renderFull(uniformSpp, uniform);
+  const double uniformMs = timer.elapsedMs();
+
+  // Adaptive sampling: two passes, variance, refine noisy tiles //
+
+  std::vector<float> accumulated, second;
+  std::vector<float> variance;
+  std::vector<float> tileSamples(grid.numTiles(), 2.f * passSpp);
+  Stats passes, estimate, tileRender, accumulate;
+
+  timer.reset();
+  renderFull(passSpp, accumulated);
+  renderFull(passSpp, second);
+  passes.add(timer.elapsedMs());
+
+  timer.reset();
+  estimateTileVariance(
+      grid, accumulated.data(), second.data(), passSpp, variance);
+  for (size_t i = 0; i < accumulated.size(); i++)
+    accumulated[i] = 0.5f * (accumulated[i] + second[i]);
+  estimate.add(timer.elapsedMs());
+
+  double meanVariance = 0.0;
+  for (uint32_t tile = 0; tile < grid.numTiles(); tile++) {
+    uint32_t x0, y0, x1, y1;
+    grid.tileBounds(tile, x0, y0, x1, y1);
+    meanVariance += double(variance[tile]) * (x1 - x0) * (y1 - y0);
+  }
+  meanVariance /= double(numPixels);
+  if (meanVariance == 0.0) {
+    fprintf(stderr,
+        "warning: both passes are identical, the device does not seem to "
+        "reseed its samples per frame\n");
+  }
+  if (targetError == 0.f)
+    targetError = float(std::sqrt(meanVariance / uniformSpp));
+
+  // Additional samples per tile, rounded up to a power of two times
+  // passSpp so only a handful of renderers are needed
+  struct TileWork
+  {
+    uint32_t tile;
+    int spp;
+  };
+  std::vector<TileWork> work;
+  for (uint32_t tile = 0; tile < grid.numTiles(); tile++) {
+    const int needed =
+        std::min(requiredSamples(variance[tile], targetError), maxSpp)
+        - int(tileSamples[tile]);
+    if (needed <= 0)
+      continue;
+    int spp = passSpp;
+    while (spp < needed)
+      spp *= 2;
+    work.push_back({tile, spp});
+  }
+
+  // Tiles render concurrently in batches, one camera and frame per slot
+  std::vector<anari::Camera> tileCameras(batchSize);
+  std::vector<anari::Frame> tileFrames(batchSize);
+  std::vector<uint2> tileFrameSizes(batchSize, uint2(tileSize, tileSize));
+  for (size_t i = 0; i < batchSize; i++) {
+    tileCameras[i] = anari::newObject<anari::Camera>(device, "perspective");
+    tileFrames[i] = newFrame(device,
+        tileFrameSizes[i],
+        world,
+        rendererFor(passSpp),
+        tileCameras[i]);
+  }
+
+  size_t adaptiveSamples = 2 * size_t(passSpp) * numPixels;
+  for (size_t first = 0; first < work.size(); first += batchSize) {
+    const size_t count = std::min(batchSize, work.size() - first);
+
+    timer.reset();
+    for (size_t i = 0; i < count; i++) {
+      const TileWork &w = work[first + i];
+      uint32_t x0, y0, x1, y1;
+      grid.tileBounds(w.tile, x0, y0, x1, y1);
+      const uint2 size(x1 - x0, y1 - y0);
+      setPerspectiveCameraParameters(device,
+          tileCameras[i],
+          eye,
+          dir,
+          up,
+          fovy,
+          aspect,
+          tileImageRegion(region, grid, w.tile));
+      if (size.x != tileFrameSizes[i].x || size.y != tileFrameSizes[i].y) {
+        anari::setParameter(device, tileFrames[i], "size", size);
+        tileFrameSizes[i] = size;
+      }
+      anari::setParameter(
+          device, tileFrames[i], "renderer", rendererFor(w.spp));
+      anari::commitParameters(device, tileFrames[i]);
+      anari::render(device, tileFrames[i]);
+      adaptiveSamples += size_t(size.x) * size.y * w.spp;
+    }
+    for (size_t i = 0; i < count; i++)
+      anari::wait(device, tileFrames[i]);
+    tileRender.add(timer.elapsedMs());
+
+    timer.reset();
+    for (size_t i = 0; i < count; i++) {
+      const TileWork &w = work[first + i];
+      auto fb = anari::map<float4>(device, tileFrames[i], "channel.color");
+      accumulateTile(grid,
+          w.tile,
+          (const float *)fb.data,
+          tileSamples[w.tile],
+          w.spp,
+          accumulated.data());
+      anari::unmap(device, tileFrames[i], "channel.color");
+      tileSamples[w.tile] += w.spp;
+    }
+    accumulate.add(timer.elapsedMs());
+  }
+
+  const double adaptiveMs =
+      passes.sum() + estimate.sum() + tileRender.sum() + accumulate.sum();
+
+  // Predicted error: per-tile sqrt(variance / samples), pixel weighted
+  double predictedAdaptive = 0.0;
+  Stats sppPerTile;
+  for (uint32_t tile = 0; tile < grid.numTiles(); tile++) {
+    uint32_t x0, y0, x1, y1;
+    grid.tileBounds(tile, x0, y0, x1, y1);
+    predictedAdaptive +=
+        double(variance[tile]) / tileSamples[tile] * (x1 - x0) * (y1 - y0);
+    sppPerTile.add(tileSamples[tile]);
+  }
+  predictedAdaptive = std::sqrt(predictedAdaptive / numPixels);
+
+  // Report //
+
+  const size_t uniformSamples = size_t(uniformSpp) * numPixels;
+  printf("%ux%u, %u tiles of %u, passes of %d spp, target error %.5f\n",
+      imageSize.x,
+      imageSize.y,
+      grid.numTiles(),
+      tileSize,
+      passSpp,
+      targetError);
+  printf("  uniform %d spp:  %12zu samples %10.2fms  predicted error %.5f\n",
+      uniformSpp,
+      uniformSamples,
+      uniformMs,
+      std::sqrt(meanVariance / uniformSpp));
+  printf("  adaptive:        %12zu samples %10.2fms  predicted error %.5f\n",
+      adaptiveSamples,
+      adaptiveMs,
+      predictedAdaptive);
+  printf("  refined %zu of %u tiles in %zu batches\n",
+      work.size(),
+      grid.numTiles(),
+      tileRender.count());
+  passes.print("  initial passes");
+  estimate.print("  variance estimate");
+  tileRender.print("  tile batch render");
+  accumulate.print("  tile accumulate");
+  sppPerTile.print("  samples per pixel", "");
+  printf("  => %.2fx the samples, %.2fx the time of uniform sampling\n",
+      double(adaptiveSamples) / uniformSamples,
+      adaptiveMs / uniformMs);
+
+  ToneMapParams encode;
+  std::vector<uint32_t> uniformImage(numPixels), adaptiveImage(numPixels);
+  toneMapImage(encode,
+      uniform.data(),
+      uniformImage.data(),
+      imageSize.x,
+      imageSize.y);
+  toneMapImage(encode,
+      accumulated.data(),
+      adaptiveImage.data(),
+      imageSize.x,
+      imageSize.y);
+
+  if (referenceSpp > 0) {
+    std::vector<float> referenceColor;
+    renderFull(referenceSpp, referenceColor);
+    std::vector<uint32_t> reference(numPixels);
+    toneMapImage(encode,
+        referenceColor.data(),
+        reference.data(),
+        imageSize.x,
+        imageSize.y);
+    printf("  RMSE vs %d spp reference: uniform %.3f, adaptive %.3f\n",
+        referenceSpp,
+        rmseRGBA8(uniformImage, reference),
+        rmseRGBA8(adaptiveImage, reference));
+  }
+
+  stbi_flip_vertically_on_write(1);
+  stbi_write_png("adaptive.png",
+      imageSize.x,
+      imageSize.y,
+      4,
+      adaptiveImage.data(),
+      4 * imageSize.x);
+  printf("Output: adaptive.png\n");
+
+  for (size_t i = 0; i < batchSize; i++) {
+    anari::release(device, tileCameras[i]);
+    anari::release(device, tileFrames[i]);
+  }
+  for (auto &r : renderers)
+    anari::release(device, r.second);
+  anari::release(device, camera);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
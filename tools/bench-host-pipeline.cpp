@@ -0,0 +1,288 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Measures the host-side cost of the render loop (camera math, parameter
+// commits, render/wait, framebuffer mapping). Run it with the in-tree null
+// device to take rendering out of the picture:
+//
+//   ANARI_LIBRARY=offaxis bench-host-pipeline -n 10000
+//
+// With --matrix-layer, the device is wrapped in the in-tree "matrix" layer
+// (devices/MatrixCameraDevice.h) so Strategy 1 runs on any device, and the
+// layer's translation cost is reported.
+//
+// The eye follows a head tracker trace (--trace <file>, or a synthetic one,
+// see Tracker.h). With --tracked-screen (or --screen-trace <file>), the
+// screen moves like a handheld or rigid-body tracked display: its corners
+// are recomputed from the screen pose every frame, together with the eye.
+// Both traces are sampled at the wall-clock time of the frame, as a live
+// application would see them.
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Projection.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Tracker.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+static void benchStrategy(anari::Device device,
+    anari::Frame frame,
+    Strategy strategy,
+    float3 LL,
+    float3 LR,
+    float3 UR,
+    const std::vector<TrackerSample> &headTrace,
+    const std::vector<ScreenPoseSample> &screenPoses,
+    float2 screenSize,
+    int numFrames)
+{
+  Stats cameraMath, commit, renderWait, mapUnmap, total;
+
+  auto camera = newStrategyCamera(device, strategy);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  Timer clock;
+  for (int i = 0; i < numFrames; i++) {
+    const double time = clock.elapsedMs() * 1e-3;
+
+    Timer frameTimer;
+
+    // Camera math //
+
+    Timer timer;
+    const float3 e = trackerPositionAt(headTrace, time);
+    float3 sLL = LL, sLR = LR, sUR = UR;
+    if (!screenPoses.empty()) {
+      screenCorners(
+          screenPoseAt(screenPoses, time), screenSize, sLL, sLR, sUR);
+    }
+    float3 pos = e, dir, up;
+    float fovy = 0.f, aspect = 1.f;
+    float4 imgRegion;
+    mat4 proj, view;
+    if (strategy == Strategy::FixedFrame) {
+      offaxisStereoCamera(
+          sLL, sLR, sUR, e, dir, up, fovy, aspect, imgRegion);
+    } else {
+      offaxisStereoTransform(sLL, sLR, sUR, e, proj, view);
+      if (strategy == Strategy::MatricesToPerspective) {
+        offaxisStereoCameraFromTransform(inverse(proj),
+            inverse(view),
+            pos,
+            dir,
+            up,
+            fovy,
+            aspect,
+            imgRegion);
+      }
+    }
+    cameraMath.add(timer.elapsedMs());
+
+    // Parameter commits //
+
+    timer.reset();
+    if (strategy == Strategy::MatrixCamExtension) {
+      setMatrixCameraParameters(device, camera, proj, view);
+    } else {
+      setPerspectiveCameraParameters(
+          device, camera, pos, dir, up, fovy, aspect, imgRegion);
+    }
+    commit.add(timer.elapsedMs());
+
+    // Render //
+
+    timer.reset();
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    renderWait.add(timer.elapsedMs());
+
+    // Read back //
+
+    timer.reset();
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    volatile uint32_t sink = fb.data ? fb.data[0] : 0u;
+    (void)sink;
+    anari::unmap(device, frame, "channel.color");
+    mapUnmap.add(timer.elapsedMs());
+
+    total.add(frameTimer.elapsedMs());
+  }
+
+  anari::release(device, camera);
+
+  printf("%s, %d frames%s:\n",
+      strategyName(strategy),
+      numFrames,
+      screenPoses.empty() ? "" : ", tracked screen");
+  cameraMath.print("  camera math");
+  commit.print("  camera commit");
+  renderWait.print("  render + wait");
+  mapUnmap.print("  map + unmap");
+  total.print("  total");
+  const double fps = total.mean() > 0.0 ? 1000.0 / total.mean() : 0.0;
+  printf("  => %.1f frames/s\n", fps);
+}
+
+int main(int argc, char *argv[])
+{
+  int numFrames = 1000;
+  bool matrixLayer = false;
+  bool trackedScreen = false;
+  std::string traceFile;
+  std::string screenTraceFile;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--matrix-layer"))
+      matrixLayer = true;
+    else if (!std::strcmp(argv[i], "--tracked-screen"))
+      trackedScreen = true;
+    else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      traceFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--screen-trace") && i + 1 < argc)
+      screenTraceFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [-n frames] [--matrix-layer] [--trace file]"
+          " [--tracked-screen] [--screen-trace file] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  anari::Library layerLibrary = nullptr;
+  if (matrixLayer) {
+    layerLibrary = anari::loadLibrary("offaxis", statusFunc);
+    if (!layerLibrary) {
+      fprintf(stderr, "could not load the offaxis library\n");
+      return 1;
+    }
+    auto layer = anari::newDevice(layerLibrary, "matrix");
+    anari::setParameter(layer, layer, "wrappedDevice", device);
+    anari::commitParameters(layer, layer);
+    anari::release(device, device); // now owned by the layer
+    device = layer;
+  }
+
+  Timer timer;
+  auto world = newSampleWorld(device);
+  printf("scene setup took %fms\n", timer.elapsedMs());
+
+  auto renderer = newSampleRenderer(device);
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  uint2 imageSize = {800, 800};
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  std::vector<TrackerSample> headTrace;
+  if (!traceFile.empty()) {
+    if (!loadTrackerTrace(traceFile.c_str(), headTrace)) {
+      fprintf(stderr, "could not load tracker trace '%s'\n", traceFile.c_str());
+      return 1;
+    }
+  } else {
+    headTrace = syntheticTrackerTrace(eye, size_t(numFrames));
+  }
+
+  // Screen poses over time; the rest pose matches LL/LR/UR above
+  const float2 screenSize(3.f, 3.f);
+  std::vector<ScreenPoseSample> screenPoses;
+  if (!screenTraceFile.empty()) {
+    if (!loadScreenPoseTrace(screenTraceFile.c_str(), screenPoses)) {
+      fprintf(stderr,
+          "could not load screen pose trace '%s'\n",
+          screenTraceFile.c_str());
+      return 1;
+    }
+  } else if (trackedScreen) {
+    ScreenPose rest;
+    rest.position = float3(1.5f, 1.5f, 0.f);
+    screenPoses = syntheticScreenPoseTrace(rest, size_t(numFrames));
+  }
+
+  if (matrixLayer
+      || deviceHasExtension(
+          library, "default", "ANARI_VSNRAY_CAMERA_MATRIX")) {
+    benchStrategy(device,
+        frame,
+        Strategy::MatrixCamExtension,
+        LL,
+        LR,
+        UR,
+        headTrace,
+        screenPoses,
+        screenSize,
+        numFrames);
+  }
+  if (matrixLayer) {
+    uint64_t translations = 0, cacheHits = 0, translateNs = 0;
+    anari::getProperty(device, device, "matrix.translations", translations);
+    anari::getProperty(device, device, "matrix.cacheHits", cacheHits);
+    anari::getProperty(device, device, "matrix.translateNs", translateNs);
+    printf("  matrix layer: %llu translations (%.4fms each), %llu cached\n",
+        (unsigned long long)translations,
+        translations ? 1e-6 * translateNs / translations : 0.0,
+        (unsigned long long)cacheHits);
+  }
+  benchStrategy(device,
+      frame,
+      Strategy::FixedFrame,
+      LL,
+      LR,
+      UR,
+      headTrace,
+      screenPoses,
+      screenSize,
+      numFrames);
+  benchStrategy(device,
+      frame,
+      Strategy::MatricesToPerspective,
+      LL,
+      LR,
+      UR,
+      headTrace,
+      screenPoses,
+      screenSize,
+      numFrames);
+
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  if (layerLibrary)
+    anari::unloadLibrary(layerLibrary);
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Throughput of the compiled camera solvers (projection/) for every ISA
+// path this CPU supports, compared with the header-only Projection.h, and
+// their deviation from it. Prints the path selected at runtime:
+//
+//   bench-projection [--eyes 1000000] [-n 20]
+
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+// ours
+#include "OffaxisProjection.h"
+#include "Projection.h"
+#include "Timing.h"
+
+using namespace offaxis;
+
+static void printThroughput(const char *name, const Stats &s, size_t numEyes)
+{
+  printf("  %-22s %10.3fms %10.1f Meyes/s\n",
+      name,
+      s.mean(),
+      numEyes / (1e3 * std::max(1e-9, s.mean())));
+}
+
+int main(int argc, char *argv[])
+{
+  size_t numEyes = 1000000;
+  int numRuns = 20;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--eyes") && i + 1 < argc)
+      numEyes = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numRuns = std::max(1, std::atoi(argv[++i]));
+    else {
+      fprintf(stderr, "Usage: %s [--eyes n] [-n runs]\n", argv[0]);
+      return 1;
+    }
+  }
+
+  const float3 LL(0.f, 0.f, 0.f);
+  const float3 LR(3.f, 0.f, 0.f);
+  const float3 UR(3.f, 3.f, 0.f);
+  const ProjectionScreen screen = {
+      {LL.x, LL.y, LL.z}, {LR.x, LR.y, LR.z}, {UR.x, UR.y, UR.z}};
+
+  // Tracked eyes in front of the screen, including off-center ones
+  std::mt19937 rng;
+  rng.seed(0);
+  std::uniform_real_distribution<float> dist(-1.f, 1.f);
+  std::vector<float> eyes(3 * numEyes);
+  for (size_t i = 0; i < numEyes; i++) {
+    eyes[3 * i] = 1.5f + 2.f * dist(rng);
+    eyes[3 * i + 1] = 1.68f + 1.f * dist(rng);
+    eyes[3 * i + 2] = 1.5f + 0.75f * dist(rng);
+  }
+
+  printf("%zu eyes, selected path: %s (available:",
+      numEyes,
+      projectionIsaName(projectionIsa()));
+  for (int i = 0; i < int(ProjectionIsa::Count); i++) {
+    if (projectionIsaAvailable(ProjectionIsa(i)))
+      printf(" %s", projectionIsaName(ProjectionIsa(i)));
+  }
+  printf(")\n");
+
+  // Reference: Projection.h, one eye at a time //
+
+  std::vector<PerspectiveSolution> reference(numEyes);
+  std::vector<FrustumSolution> referenceFrustum(numEyes);
+  Stats headerPerspective, headerFrustum;
+  for (int r = 0; r < numRuns; r++) {
+    Timer timer;
+    for (size_t i = 0; i < numEyes; i++) {
+      const float3 eye(eyes[3 * i], eyes[3 * i + 1], eyes[3 * i + 2]);
+      float3 dir, up;
+      float fovy, aspect;
+      float4 region;
+      offaxisStereoCamera(LL, LR, UR, eye, dir, up, fovy, aspect, region);
+      PerspectiveSolution &s = reference[i];
+      std::memcpy(s.dir, &dir, sizeof(s.dir));
+      std::memcpy(s.up, &up, sizeof(s.up));
+      s.fovy = fovy;
+      s.aspect = aspect;
+      std::memcpy(s.imageRegion, &region, sizeof(s.imageRegion));
+    }
+    headerPerspective.add(timer.elapsedMs());
+
+    timer.reset();
+    for (size_t i = 0; i < numEyes; i++) {
+      const float3 eye(eyes[3 * i], eyes[3 * i + 1], eyes[3 * i + 2]);
+      mat4 proj, view;
+      offaxisStereoTransform(LL, LR, UR, eye, proj, view);
+      std::memcpy(referenceFrustum[i].proj, &proj, sizeof(proj));
+      std::memcpy(referenceFrustum[i].view, &view, sizeof(view));
+    }
+    headerFrustum.add(timer.elapsedMs());
+  }
+
+  // Scalar library solvers //
+
+  std::vector<PerspectiveSolution> perspective(numEyes);
+  std::vector<FrustumSolution> frustum(numEyes);
+  Stats scalarPerspective, scalarFrustum;
+  for (int r = 0; r < numRuns; r++) {
+    Timer timer;
+    for (size_t i = 0; i < numEyes; i++)
+      solvePerspective(screen, &eyes[3 * i], perspective[i]);
+    scalarPerspective.add(timer.elapsedMs());
+    timer.reset();
+    for (size_t i = 0; i < numEyes; i++)
+      solveFrustum(screen, &eyes[3 * i], frustum[i]);
+    scalarFrustum.add(timer.elapsedMs());
+  }
+
+  // Largest deviation from Projection.h //
+
+  auto perspectiveError = [&]() {
+    double e = 0.0;
+    for (size_t i = 0; i < numEyes; i++) {
+      const auto &a = perspective[i];
+      const auto &b = reference[i];
+      e = std::max(e, double(std::fabs(a.fovy - b.fovy)));
+      e = std::max(e, double(std::fabs(a.aspect - b.aspect) / b.aspect));
+      for (int c = 0; c < 4; c++) {
+        e = std::max(
+            e, double(std::fabs(a.imageRegion[c] - b.imageRegion[c])));
+      }
+    }
+    return e;
+  };
+  auto frustumError = [&]() {
+    double e = 0.0;
+    for (size_t i = 0; i < numEyes; i++) {
+      for (int c = 0; c < 16; c++) {
+        const float p = frustum[i].proj[c];
+        const float q = referenceFrustum[i].proj[c];
+        const float v = frustum[i].view[c];
+        const float w = referenceFrustum[i].view[c];
+        // relative for the large entries of the projection matrix
+        e = std::max(e, double(std::fabs(p - q) / std::max(1.f, std::fabs(q))));
+        e = std::max(e, double(std::fabs(v - w)));
+      }
+    }
+    return e;
+  };
+
+  printf("perspective (Strategy 2):\n");
+  printThroughput("Projection.h", headerPerspective, numEyes);
+  printThroughput("scalar", scalarPerspective, numEyes);
+  printf("  %-22s %10.3g\n", "  max. deviation", perspectiveError());
+
+  const ProjectionIsa selected = projectionIsa();
+  std::vector<double> frustumErrors;
+  std::vector<Stats> frustumStats;
+  for (int i = 0; i < int(ProjectionIsa::Count); i++) {
+    const ProjectionIsa isa = ProjectionIsa(i);
+    if (!setProjectionIsa(isa))
+      continue;
+    Stats s;
+    for (int r = 0; r < numRuns; r++) {
+      Timer timer;
+      solvePerspectiveBatch(
+          screen, eyes.data(), numEyes, perspective.data());
+      s.add(timer.elapsedMs());
+    }
+    const std::string name = std::string("batch ") + projectionIsaName(isa)
+        + (isa == selected ? " *" : "");
+    printThroughput(name.c_str(), s, numEyes);
+    printf("  %-22s %10.3g\n", "  max. deviation", perspectiveError());
+
+    Stats f;
+    for (int r = 0; r < numRuns; r++) {
+      Timer timer;
+      solveFrustumBatch(screen, eyes.data(), numEyes, frustum.data());
+      f.add(timer.elapsedMs());
+    }
+    frustumStats.push_back(f);
+    frustumErrors.push_back(frustumError());
+  }
+
+  // The scalar frustum results were overwritten by the batches
+  for (size_t i = 0; i < numEyes; i++)
+    solveFrustum(screen, &eyes[3 * i], frustum[i]);
+
+  printf("frustum (Strategies 1 and 3):\n");
+  printThroughput("Projection.h", headerFrustum, numEyes);
+  printThroughput("scalar", scalarFrustum, numEyes);
+  printf("  %-22s %10.3g\n", "  max. deviation", frustumError());
+  for (int i = 0, k = 0; i < int(ProjectionIsa::Count); i++) {
+    const ProjectionIsa isa = ProjectionIsa(i);
+    if (!projectionIsaAvailable(isa))
+      continue;
+    const std::string name = std::string("batch ") + projectionIsaName(isa)
+        + (isa == selected ? " *" : "");
+    printThroughput(name.c_str(), frustumStats[k], numEyes);
+    printf("  %-22s %10.3g\n", "  max. deviation", frustumErrors[k]);
+    k++;
+  }
+
+  setProjectionIsa(selected);
+  return 0;
+}
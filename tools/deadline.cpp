@@ -0,0 +1,251 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Replays a head tracker trace (Tracker.h) with a per-frame deadline
+// (Deadline.h): frames are polled with ANARI_NO_WAIT, and late ones are
+// discarded and either re-rendered with fewer samples or replaced by the
+// previous image. Reports deadline misses, discard latency and how long it
+// takes to get back to fresh full-quality images after a miss, next to
+// plain blocking waits. Without --deadline, the deadline is 'budget' times
+// the median frame time at full quality.
+//
+// The trace is replayed by its timestamps: frames start on the display's
+// refresh (--rate), and each shows the head where the trace has it at that
+// time, so slow frames skip samples like a live application would. With the
+// in-tree null device (ANARI_LIBRARY=offaxis), --null-sample-ms and
+// --null-jitter give frames a simulated render time, so misses and discards
+// happen without a real renderer:
+//
+//   deadline [--policy wait|previous|lower|all] [--deadline ms]
+//            [--budget 1.1] [--trace file] [-n samples] [--rate 60]
+//            [--null-sample-ms ms] [--null-jitter 0..1]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "Deadline.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Tracker.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+static void reportPolicy(const DeadlineRenderer &r,
+    const std::vector<DeadlineFrame> &frames)
+{
+  Stats discard, present, recovery;
+  size_t numMissed = 0, numStale = 0, longestStale = 0, openEpisodes = 0;
+  std::vector<size_t> perLevel(r.levels.size(), 0);
+
+  size_t staleRun = 0;
+  bool inEpisode = false;
+  size_t episodeStart = 0;
+  for (size_t i = 0; i < frames.size(); i++) {
+    const DeadlineFrame &f = frames[i];
+    perLevel[f.level]++;
+    if (f.missed) {
+      numMissed++;
+      if (r.policy != DeadlinePolicy::Wait)
+        discard.add(f.discardMs);
+    }
+    present.add(f.presentMs);
+
+    staleRun = f.stale ? staleRun + 1 : 0;
+    numStale += f.stale ? 1 : 0;
+    longestStale = std::max(longestStale, staleRun);
+
+    // A miss starts an episode that ends with the next fresh full-quality
+    // image that was ready in time
+    if (f.missed && !inEpisode) {
+      inEpisode = true;
+      episodeStart = i;
+    } else if (inEpisode && !f.missed && f.level == 0) {
+      recovery.add(double(i - episodeStart));
+      inEpisode = false;
+    }
+  }
+  openEpisodes = inEpisode ? 1 : 0;
+
+  printf("%s: %zu frames, deadline %.3fms\n",
+      deadlinePolicyName(r.policy),
+      frames.size(),
+      r.deadlineMs);
+  printf("  missed %zu (%.1f%%), stale images shown %zu (longest run %zu)\n",
+      numMissed,
+      frames.empty() ? 0.0 : 100.0 * numMissed / frames.size(),
+      numStale,
+      longestStale);
+  if (discard.count() > 0)
+    discard.print("  discard");
+  present.print("  image available");
+  if (recovery.count() > 0)
+    recovery.print("  frames to recover", "");
+  if (openEpisodes)
+    printf("  still recovering at the end of the trace\n");
+  printf("  frames per quality level:");
+  for (size_t l = 0; l < perLevel.size(); l++)
+    printf(" %dspp=%zu", r.levels[l], perLevel[l]);
+  printf("\n");
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<DeadlinePolicy> policies;
+  double deadlineMs = 0.0;
+  double budget = 1.1;
+  size_t numSamples = 300;
+  double rate = 60.0;
+  float nullSampleMs = 0.f;
+  float nullJitter = 0.f;
+  std::string traceFile;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    DeadlinePolicy p;
+    if (!std::strcmp(argv[i], "--policy") && i + 1 < argc) {
+      if (!std::strcmp(argv[++i], "all"))
+        policies.clear();
+      else if (parseDeadlinePolicy(argv[i], p))
+        policies.push_back(p);
+      else {
+        fprintf(stderr, "unknown policy '%s'\n", argv[i]);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--deadline") && i + 1 < argc)
+      deadlineMs = std::max(0.0, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--budget") && i + 1 < argc)
+      budget = std::max(0.01, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      traceFile = argv[++i];
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numSamples = size_t(std::max(2, std::atoi(argv[++i])));
+    else if (!std::strcmp(argv[i], "--rate") && i + 1 < argc)
+      rate = std::max(1.0, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--null-sample-ms") && i + 1 < argc)
+      nullSampleMs = std::max(0.f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--null-jitter") && i + 1 < argc)
+      nullJitter = std::max(0.f, std::min(float(std::atof(argv[++i])), 1.f));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--policy name|all] [--deadline ms] [--budget factor] "
+          "[--trace file] [-n samples] [--rate hz] [--null-sample-ms ms] "
+          "[--null-jitter 0..1] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (policies.empty()) {
+    for (int i = 0; i <= int(DeadlinePolicy::LowerQuality); i++)
+      policies.push_back(DeadlinePolicy(i));
+  }
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  std::vector<TrackerSample> trace;
+  if (!traceFile.empty()) {
+    if (!loadTrackerTrace(traceFile.c_str(), trace)) {
+      fprintf(stderr, "could not load tracker trace '%s'\n", traceFile.c_str());
+      return 1;
+    }
+  } else {
+    trace = syntheticTrackerTrace(eye, numSamples);
+  }
+  const double traceMs = 1e3 * (trace.back().time - trace.front().time);
+  const double refreshMs = 1e3 / rate;
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device, camera, LL, LR, UR, eye);
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  uint2 imageSize = {800, 800};
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  if (nullSampleMs > 0.f) {
+    anari::setParameter(device, frame, "null.sampleTime", nullSampleMs);
+    anari::setParameter(device, frame, "null.jitter", nullJitter);
+  }
+  anari::commitParameters(device, frame);
+
+  // Calibrate the deadline at full quality //
+
+  if (deadlineMs <= 0.0) {
+    Stats calibration;
+    for (int i = 0; i < 10; i++) {
+      Timer timer;
+      anari::render(device, frame);
+      anari::wait(device, frame);
+      calibration.add(timer.elapsedMs());
+    }
+    deadlineMs = budget * calibration.percentile(0.5);
+    printf("median frame time %.3fms, deadline %.3fms (x%.2f)\n\n",
+        calibration.percentile(0.5),
+        deadlineMs,
+        budget);
+  }
+
+  for (DeadlinePolicy policy : policies) {
+    DeadlineRenderer r;
+    r.device = device;
+    r.frame = frame;
+    r.renderer = renderer;
+    r.policy = policy;
+    r.deadlineMs = deadlineMs;
+    r.setLevel(0);
+
+    // Replay for the duration of the trace (at least one frame); every
+    // frame starts on the first refresh after the previous one was shown
+    std::vector<DeadlineFrame> frames;
+    Timer clock;
+    do {
+      const double nowMs = clock.elapsedMs();
+      setFixedFrameCameraParameters(
+          device, camera, LL, LR, UR, trackerPositionAt(trace, nowMs * 1e-3));
+      frames.push_back(r.renderFrame());
+
+      const double shownMs = clock.elapsedMs();
+      const double nextMs = refreshMs * std::ceil(shownMs / refreshMs);
+      std::this_thread::sleep_for(
+          std::chrono::duration<double, std::milli>(nextMs - shownMs));
+    } while (clock.elapsedMs() < traceMs);
+    reportPolicy(r, frames);
+    printf("\n");
+  }
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+  anari::unloadLibrary(library);
+
+  return 0;
+}
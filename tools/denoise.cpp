@@ -0,0 +1,255 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Renders the off-axis view at low sample counts and denoises it on the
+// host (Denoise.h), guided by the depth, normal and albedo channels when the
+// device provides them. Reports render and denoise times and the error
+// against a high sample count reference:
+//
+//   denoise [--spp 1,2,4] [--reference-spp 32] [--passes 5] [--no-guides]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Denoise.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "ToneMapping.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+struct Channels
+{
+  bool depth{false};
+  bool normal{false};
+  bool albedo{false};
+};
+
+// Rendered float color plus whatever guides were requested
+struct RenderResult
+{
+  std::vector<float> color, depth, normal, albedo;
+  double renderMs{0.0};
+};
+
+static RenderResult renderFrame(anari::Device device,
+    anari::World world,
+    anari::Renderer renderer,
+    anari::Camera camera,
+    uint2 size,
+    int spp,
+    Channels channels)
+{
+  RenderResult result;
+  const size_t numPixels = size_t(size.x) * size.y;
+
+  anari::setParameter(device, renderer, "pixelSamples", spp);
+  anari::commitParameters(device, renderer);
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", size);
+  anari::setParameter(device, frame, "channel.color", ANARI_FLOAT32_VEC4);
+  if (channels.depth)
+    anari::setParameter(device, frame, "channel.depth", ANARI_FLOAT32);
+  if (channels.normal)
+    anari::setParameter(device, frame, "channel.normal", ANARI_FLOAT32_VEC3);
+  if (channels.albedo)
+    anari::setParameter(device, frame, "channel.albedo", ANARI_FLOAT32_VEC3);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  Timer timer;
+  anari::render(device, frame);
+  anari::wait(device, frame);
+  result.renderMs = timer.elapsedMs();
+
+  auto copyChannel = [&](const char *name, int numComponents) {
+    std::vector<float> values;
+    auto fb = anari::map<float>(device, frame, name);
+    if (fb.data) {
+      values.assign(fb.data, fb.data + numPixels * numComponents);
+    }
+    anari::unmap(device, frame, name);
+    return values;
+  };
+
+  result.color = copyChannel("channel.color", 4);
+  if (channels.depth)
+    result.depth = copyChannel("channel.depth", 1);
+  if (channels.normal)
+    result.normal = copyChannel("channel.normal", 3);
+  if (channels.albedo)
+    result.albedo = copyChannel("channel.albedo", 3);
+
+  anari::release(device, frame);
+  return result;
+}
+
+static double psnr(double rmse)
+{
+  return rmse > 0.0 ? 20.0 * std::log10(255.0 / rmse) : INFINITY;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<int> sppList = {1, 2, 4};
+  int referenceSpp = 32;
+  DenoiseParams params;
+  bool useGuides = true;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--spp") && i + 1 < argc) {
+      sppList.clear();
+      for (char *s = std::strtok(argv[++i], ","); s; s = std::strtok(0, ","))
+        sppList.push_back(std::max(1, std::atoi(s)));
+    } else if (!std::strcmp(argv[i], "--reference-spp") && i + 1 < argc)
+      referenceSpp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--passes") && i + 1 < argc)
+      params.numPasses =
+          std::min(std::max(0, std::atoi(argv[++i])), maxDenoisePasses);
+    else if (!std::strcmp(argv[i], "--no-guides"))
+      useGuides = false;
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--spp n,n,...] [--reference-spp n] [--passes n] "
+          "[--no-guides] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  Channels channels;
+  if (useGuides) {
+    anari::Extensions extensions =
+        anari::extension::getInstanceExtensionStruct(device, device);
+    channels.depth = extensions.ANARI_KHR_FRAME_CHANNEL_DEPTH;
+    channels.normal = extensions.ANARI_KHR_FRAME_CHANNEL_NORMAL;
+    channels.albedo = extensions.ANARI_KHR_FRAME_CHANNEL_ALBEDO;
+  }
+  printf("guides: depth %s, normal %s, albedo %s\n",
+      channels.depth ? "yes" : "no",
+      channels.normal ? "yes" : "no",
+      channels.albedo ? "yes" : "no");
+
+  auto world = newSampleWorld(device);
+
+  // pixelSamples is set per frame by renderFrame
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  ToneMapParams encode; // sRGB only, for comparisons and output
+
+  // Reference //
+
+  auto reference = renderFrame(
+      device, world, renderer, camera, imageSize, referenceSpp, Channels{});
+  std::vector<uint32_t> referenceImage(numPixels);
+  toneMapImage(encode,
+      reference.color.data(),
+      referenceImage.data(),
+      imageSize.x,
+      imageSize.y);
+
+  printf("reference: %d spp in %fms\n", referenceSpp, reference.renderMs);
+  printf("%6s %12s %12s %10s %10s %10s %10s %10s\n",
+      "spp",
+      "render ms",
+      "denoise ms",
+      "raw RMSE",
+      "raw PSNR",
+      "dn RMSE",
+      "dn PSNR",
+      "speedup");
+
+  std::vector<float> denoised(numPixels * 4);
+  std::vector<uint32_t> raw(numPixels), image(numPixels);
+  stbi_flip_vertically_on_write(1);
+
+  for (int spp : sppList) {
+    auto frame = renderFrame(
+        device, world, renderer, camera, imageSize, spp, channels);
+
+    DenoiseGuides guides;
+    if (!frame.depth.empty())
+      guides.depth = frame.depth.data();
+    if (!frame.normal.empty())
+      guides.normal = frame.normal.data();
+    if (!frame.albedo.empty())
+      guides.albedo = frame.albedo.data();
+
+    Timer timer;
+    denoise(params,
+        guides,
+        frame.color.data(),
+        denoised.data(),
+        imageSize.x,
+        imageSize.y);
+    const double denoiseMs = timer.elapsedMs();
+
+    toneMapImage(
+        encode, frame.color.data(), raw.data(), imageSize.x, imageSize.y);
+    toneMapImage(
+        encode, denoised.data(), image.data(), imageSize.x, imageSize.y);
+
+    const double rawError = rmseRGBA8(raw, referenceImage);
+    const double error = rmseRGBA8(image, referenceImage);
+    printf("%6d %12.3f %12.3f %10.3f %10.2f %10.3f %10.2f %9.1fx\n",
+        spp,
+        frame.renderMs,
+        denoiseMs,
+        rawError,
+        psnr(rawError),
+        error,
+        psnr(error),
+        reference.renderMs / (frame.renderMs + denoiseMs));
+
+    const std::string fileName = "denoise-" + std::to_string(spp) + ".png";
+    stbi_write_png(fileName.c_str(),
+        imageSize.x,
+        imageSize.y,
+        4,
+        image.data(),
+        4 * imageSize.x);
+  }
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
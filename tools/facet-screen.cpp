@@ -0,0 +1,251 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Renders a screen made of planar facets (Screen.h) with one off-axis camera
+// and frame per facet, renders all facets concurrently and stitches them
+// into one image. Without --screen, a cylindrical wall is approximated by
+// increasing facet counts and each approximation is compared against a
+// finely faceted reference:
+//
+//   facet-screen [--facets 1,2,4,8,16] [--reference 64] [-o facets.png]
+//   facet-screen --screen wall.txt [-o facets.png]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Parallel.h"
+#include "Scene.h"
+#include "Screen.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+struct FacetTimings
+{
+  double cameraMs{0.0};
+  double commitMs{0.0};
+  double renderMs{0.0};
+  double stitchMs{0.0};
+};
+
+static FacetTimings renderScreen(anari::Device device,
+    anari::World world,
+    anari::Renderer renderer,
+    const FacetScreen &screen,
+    float3 eye,
+    std::vector<uint32_t> &image)
+{
+  FacetTimings timings;
+  const size_t numFacets = screen.facets.size();
+
+  std::vector<anari::Camera> cameras(numFacets);
+  std::vector<anari::Frame> frames(numFacets);
+  for (size_t i = 0; i < numFacets; i++) {
+    const ScreenFacet &f = screen.facets[i];
+    cameras[i] = anari::newObject<anari::Camera>(device, "perspective");
+    frames[i] = anari::newObject<anari::Frame>(device);
+    anari::setParameter(device, frames[i], "size", uint2(f.width, f.height));
+    anari::setParameter(
+        device, frames[i], "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+    anari::setParameter(device, frames[i], "world", world);
+    anari::setParameter(device, frames[i], "renderer", renderer);
+    anari::setParameter(device, frames[i], "camera", cameras[i]);
+    anari::commitParameters(device, frames[i]);
+  }
+
+  // Per-facet cameras, computed in one batch //
+
+  Timer timer;
+  std::vector<FacetCamera> params;
+  facetCameras(screen, eye, params);
+  timings.cameraMs = timer.elapsedMs();
+
+  timer.reset();
+  for (size_t i = 0; i < numFacets; i++) {
+    const FacetCamera &c = params[i];
+    setPerspectiveCameraParameters(device,
+        cameras[i],
+        eye,
+        c.dir,
+        c.up,
+        c.fovy,
+        c.aspect,
+        c.imageRegion);
+  }
+  timings.commitMs = timer.elapsedMs();
+
+  // Kick off all facets before waiting on any of them //
+
+  timer.reset();
+  for (auto frame : frames)
+    anari::render(device, frame);
+  for (auto frame : frames)
+    anari::wait(device, frame);
+  timings.renderMs = timer.elapsedMs();
+
+  // Stitch //
+
+  timer.reset();
+  image.resize(size_t(screen.imageSize.x) * screen.imageSize.y);
+  std::vector<const uint32_t *> pixels(numFacets);
+  for (size_t i = 0; i < numFacets; i++)
+    pixels[i] = anari::map<uint32_t>(device, frames[i], "channel.color").data;
+
+  parallelFor(numFacets, [&](size_t begin, size_t end) {
+    for (size_t i = begin; i < end; i++) {
+      const ScreenFacet &f = screen.facets[i];
+      for (uint32_t y = 0; y < f.height; y++) {
+        const uint32_t *src = pixels[i] + size_t(y) * f.width;
+        uint32_t *dst =
+            image.data() + size_t(f.y0 + y) * screen.imageSize.x + f.x0;
+        std::copy(src, src + f.width, dst);
+      }
+    }
+  });
+
+  for (size_t i = 0; i < numFacets; i++)
+    anari::unmap(device, frames[i], "channel.color");
+  timings.stitchMs = timer.elapsedMs();
+
+  for (size_t i = 0; i < numFacets; i++) {
+    anari::release(device, cameras[i]);
+    anari::release(device, frames[i]);
+  }
+
+  return timings;
+}
+
+static void writeImage(const std::string &fileName,
+    const FacetScreen &screen,
+    const std::vector<uint32_t> &image)
+{
+  stbi_flip_vertically_on_write(1);
+  stbi_write_png(fileName.c_str(),
+      screen.imageSize.x,
+      screen.imageSize.y,
+      4,
+      image.data(),
+      4 * screen.imageSize.x);
+  printf("Output: %s\n", fileName.c_str());
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<uint32_t> facetCounts = {1, 2, 4, 8, 16};
+  uint32_t referenceFacets = 64;
+  std::string screenFile;
+  std::string outFile = "facets.png";
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--facets") && i + 1 < argc) {
+      facetCounts.clear();
+      for (char *s = std::strtok(argv[++i], ","); s; s = std::strtok(0, ","))
+        facetCounts.push_back(std::max(1, std::atoi(s)));
+    } else if (!std::strcmp(argv[i], "--reference") && i + 1 < argc)
+      referenceFacets = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--screen") && i + 1 < argc)
+      screenFile = argv[++i];
+    else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      outFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--facets n,n,...] [--reference n] [--screen file] "
+          "[-o file.png] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  float3 eye(1.5f, 1.68f, 1.5f);
+  std::vector<uint32_t> image;
+
+  if (!screenFile.empty()) {
+    FacetScreen screen;
+    if (!loadFacetScreen(screenFile.c_str(), screen)) {
+      fprintf(stderr, "could not load screen '%s'\n", screenFile.c_str());
+      return 1;
+    }
+    auto t = renderScreen(device, world, renderer, screen, eye, image);
+    printf("%zu facets: cameras %fms, commit %fms, render %fms, "
+           "stitch %fms\n",
+        screen.facets.size(),
+        t.cameraMs,
+        t.commitMs,
+        t.renderMs,
+        t.stitchMs);
+    writeImage(outFile, screen, image);
+  } else {
+    // Quarter cylinder around the eye whose single-facet approximation is
+    // the planar screen used by the sample
+    const float3 center(1.5f, 0.f, 1.5f);
+    const float radius = 1.5f * std::sqrt(2.f);
+    const float arc = 1.5707963f; // 90 degrees
+    const float height = 3.f;
+    const uint32_t imageHeight = 800;
+
+    std::vector<uint32_t> reference;
+    auto refScreen = cylindricalScreen(
+        center, radius, arc, height, referenceFacets, imageHeight);
+    renderScreen(device, world, renderer, refScreen, eye, reference);
+
+    printf("cylinder r=%.3f, %ux%u stitched, reference %u facets\n",
+        radius,
+        refScreen.imageSize.x,
+        refScreen.imageSize.y,
+        referenceFacets);
+    printf("%8s %12s %10s %12s %12s %12s %12s\n",
+        "facets",
+        "max dev",
+        "RMSE",
+        "camera ms",
+        "commit ms",
+        "render ms",
+        "stitch ms");
+    for (uint32_t n : facetCounts) {
+      auto screen =
+          cylindricalScreen(center, radius, arc, height, n, imageHeight);
+      auto t = renderScreen(device, world, renderer, screen, eye, image);
+      printf("%8u %12.5f %10.3f %12.5f %12.4f %12.4f %12.4f\n",
+          n,
+          cylindricalFacetError(radius, arc, n),
+          rmseRGBA8(image, reference),
+          t.cameraMs,
+          t.commitMs,
+          t.renderMs,
+          t.stitchMs);
+    }
+    writeImage(outFile, refScreen, image); // all share the same image size
+  }
+
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,229 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Replays a head tracker trace (Tracker.h) through a frame cache keyed by
+// the quantized Strategy 2 camera (FrameCache.h): frames whose camera falls
+// into a cached cell are not rendered, the cached image is reused (or warped
+// to the new eye with --warp). Reports the fraction of skipped frames and
+// the device time saved; --validate renders skipped frames anyway to
+// measure the error of reusing images:
+//
+//   frame-cache [--trace head.txt] [--threshold 0.005] [--warp] [--validate]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "FrameCache.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Tracker.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+int main(int argc, char *argv[])
+{
+  std::string traceFile, writeTrace;
+  size_t numSamples = 600;
+  CameraQuantization steps;
+  size_t capacity = 4;
+  bool warp = false;
+  bool validate = false;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      traceFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc)
+      numSamples = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--write-trace") && i + 1 < argc)
+      writeTrace = argv[++i];
+    else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc)
+      steps.position = std::max(1e-6f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--capacity") && i + 1 < argc)
+      capacity = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--warp"))
+      warp = true;
+    else if (!std::strcmp(argv[i], "--validate"))
+      validate = true;
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--trace file | --samples n] [--write-trace file] "
+          "[--threshold m] [--capacity n] [--warp] [--validate] "
+          "[--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  // The remaining steps follow the position threshold: an eye moving by
+  // 'position' shifts the image region by about position / screen width
+  steps.region = steps.position / length(LR - LL);
+  steps.angle = steps.position / length(eye - LL);
+  steps.direction = steps.angle;
+
+  std::vector<TrackerSample> trace;
+  if (!traceFile.empty()) {
+    if (!loadTrackerTrace(traceFile.c_str(), trace)) {
+      fprintf(stderr, "could not load tracker trace '%s'\n", traceFile.c_str());
+      return 1;
+    }
+  } else {
+    trace = syntheticTrackerTrace(eye, numSamples);
+  }
+  if (!writeTrace.empty())
+    saveTrackerTrace(writeTrace.c_str(), trace);
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  if (warp) {
+    anari::Extensions extensions =
+        anari::extension::getInstanceExtensionStruct(device, device);
+    if (!extensions.ANARI_KHR_FRAME_CHANNEL_DEPTH) {
+      fprintf(stderr, "no depth channel, disabling --warp\n");
+      warp = false;
+    }
+  }
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  if (warp)
+    anari::setParameter(device, frame, "channel.depth", ANARI_FLOAT32);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  // Replay the trace //
+
+  FrameCache cache(capacity);
+  std::vector<uint32_t> display(numPixels);
+  Stats render, lookup, reuse, error;
+  size_t skipped = 0;
+
+  auto renderAt = [&](float3 e,
+                      float3 dir,
+                      float3 up,
+                      float fovy,
+                      float aspect,
+                      float4 region) {
+    setPerspectiveCameraParameters(
+        device, camera, e, dir, up, fovy, aspect, region);
+    Timer timer;
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    return timer.elapsedMs();
+  };
+
+  for (const auto &sample : trace) {
+    const float3 e = sample.position;
+    float3 dir, up;
+    float fovy, aspect;
+    float4 region;
+    offaxisStereoCamera(LL, LR, UR, e, dir, up, fovy, aspect, region);
+
+    Timer timer;
+    const CameraKey key =
+        quantizeCamera(steps, e, dir, up, fovy, aspect, region);
+    const CachedFrame *hit = cache.find(key);
+    lookup.add(timer.elapsedMs());
+
+    if (hit) {
+      skipped++;
+      timer.reset();
+      if (warp) {
+        mat4 proj, view;
+        offaxisStereoTransform(LL, LR, UR, e, proj, view);
+        warpCachedFrame(*hit, imageSize, e, proj, view, display.data());
+      } else {
+        std::copy(hit->color.begin(), hit->color.end(), display.begin());
+      }
+      reuse.add(timer.elapsedMs());
+
+      if (validate) {
+        renderAt(e, dir, up, fovy, aspect, region);
+        auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+        error.add(rmseRGBA8(display.data(), fb.data, numPixels));
+        anari::unmap(device, frame, "channel.color");
+      }
+      continue;
+    }
+
+    render.add(renderAt(e, dir, up, fovy, aspect, region));
+
+    CachedFrame &entry = cache.insert(key);
+    entry.eye = e;
+    offaxisStereoTransform(LL, LR, UR, e, entry.proj, entry.view);
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    entry.color.assign(fb.data, fb.data + numPixels);
+    anari::unmap(device, frame, "channel.color");
+    if (warp) {
+      auto depth = anari::map<float>(device, frame, "channel.depth");
+      entry.depth.assign(depth.data, depth.data + numPixels);
+      anari::unmap(device, frame, "channel.depth");
+    }
+    std::copy(entry.color.begin(), entry.color.end(), display.begin());
+  }
+
+  // Report //
+
+  const double duration = trace.size() > 1
+      ? trace.back().time - trace.front().time
+      : 0.0;
+  printf("%zu tracker samples over %.1fs, threshold %.4f, cache of %zu%s\n",
+      trace.size(),
+      duration,
+      steps.position,
+      capacity,
+      warp ? ", warping reused frames" : "");
+  printf("  rendered %zu, skipped %zu (%.1f%%)\n",
+      render.count(),
+      skipped,
+      100.0 * skipped / std::max<size_t>(1, trace.size()));
+  render.print("  render");
+  lookup.print("  cache lookup");
+  reuse.print(warp ? "  warp cached" : "  copy cached");
+  printf("  device time %.1fms, saved ~%.1fms vs rendering every sample\n",
+      render.sum(),
+      skipped * render.mean());
+  if (validate)
+    error.print("  reuse error (RMSE)", "");
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,352 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Builds a scene of n^3 copies of the sphere cluster, once through ANARI
+// instances of a single sphere group and once as flattened geometry of the
+// same primitive count (Scene.h), and compares build time, render time and
+// resident memory. Flattening is skipped above --flat-limit spheres, so
+// instancing alone can be pushed to billions of effective spheres:
+//
+//   instancing [--grid 10] [--spheres 10000] [--mode both|instanced|flat]
+//
+// Freed memory is often kept by the allocator, so on Linux each variant runs
+// on its own device in a child process and is measured from a clean heap.
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#ifdef __linux__
+// posix
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// Resident set size of this process (0 if unknown)
+static size_t residentBytes()
+{
+#ifdef __linux__
+  FILE *fp = fopen("/proc/self/statm", "r");
+  if (!fp)
+    return 0;
+  unsigned long size = 0, resident = 0;
+  const int n = fscanf(fp, "%lu %lu", &size, &resident);
+  fclose(fp);
+  return n == 2 ? size_t(resident) * size_t(sysconf(_SC_PAGESIZE)) : 0;
+#else
+  return 0;
+#endif
+}
+
+struct RunResult
+{
+  double buildMs{0.0};
+  double firstFrameMs{0.0};
+  Stats render;
+  size_t memory{0};
+  std::vector<uint32_t> image;
+};
+
+// Render 'world' (which gets a light added) and collect timings
+static void measure(anari::Device device,
+    anari::Frame frame,
+    anari::World world,
+    int numFrames,
+    RunResult &result)
+{
+  addSampleLight(device, world);
+
+  anari::setParameter(device, frame, "world", world);
+  anari::commitParameters(device, frame);
+
+  // Devices typically build their acceleration structures lazily
+  Timer timer;
+  anari::render(device, frame);
+  anari::wait(device, frame);
+  result.firstFrameMs = timer.elapsedMs();
+
+  for (int i = 0; i < numFrames; i++) {
+    timer.reset();
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    result.render.add(timer.elapsedMs());
+  }
+
+  auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+  result.image.assign(fb.data, fb.data + size_t(fb.width) * fb.height);
+  anari::unmap(device, frame, "channel.color");
+}
+
+// Build, render and measure one variant on a fresh device
+static bool runVariant(const std::string &libraryName,
+    bool flatten,
+    const SphereData &spheres,
+    const std::vector<mat4> &transforms,
+    uint2 imageSize,
+    int numFrames,
+    RunResult &result)
+{
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return false;
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+
+  const size_t before = residentBytes();
+  Timer timer;
+  auto world = flatten
+      ? newSphereWorld(device, flattenInstances(spheres, transforms))
+      : newInstancedSphereWorld(device, spheres, transforms);
+  result.buildMs = timer.elapsedMs();
+  measure(device, frame, world, numFrames, result);
+  const size_t after = residentBytes();
+  result.memory = after > before ? after - before : 0;
+
+  anari::release(device, world);
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return true;
+}
+
+#ifdef __linux__
+static bool transferAll(int fd, void *data, size_t size, bool send)
+{
+  char *p = (char *)data;
+  while (size > 0) {
+    const ssize_t n = send ? write(fd, p, size) : read(fd, p, size);
+    if (n < 0 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+// Send or receive a RunResult over a pipe
+static bool transferResult(int fd, RunResult &r, bool send)
+{
+  size_t numSamples = r.render.samples.size();
+  size_t numPixels = r.image.size();
+  if (!transferAll(fd, &r.buildMs, sizeof(r.buildMs), send)
+      || !transferAll(fd, &r.firstFrameMs, sizeof(r.firstFrameMs), send)
+      || !transferAll(fd, &r.memory, sizeof(r.memory), send)
+      || !transferAll(fd, &numSamples, sizeof(numSamples), send)
+      || !transferAll(fd, &numPixels, sizeof(numPixels), send))
+    return false;
+  if (!send) {
+    r.render.samples.resize(numSamples);
+    r.image.resize(numPixels);
+  }
+  return transferAll(
+             fd, r.render.samples.data(), numSamples * sizeof(double), send)
+      && transferAll(fd, r.image.data(), numPixels * sizeof(uint32_t), send);
+}
+#endif
+
+// Runs a variant in a child process where possible, so its resident memory
+// isn't masked by pages the allocator kept from the previous one
+static bool runIsolated(const std::string &libraryName,
+    bool flatten,
+    const SphereData &spheres,
+    const std::vector<mat4> &transforms,
+    uint2 imageSize,
+    int numFrames,
+    RunResult &result)
+{
+#ifdef __linux__
+  int fds[2];
+  if (pipe(fds)) {
+    perror("pipe");
+    return false;
+  }
+  fflush(stdout);
+  const pid_t pid = fork();
+  if (pid < 0) {
+    perror("fork");
+    close(fds[0]);
+    close(fds[1]);
+    return false;
+  }
+  if (pid == 0) {
+    close(fds[0]);
+    RunResult r;
+    const bool ok = runVariant(libraryName,
+                        flatten,
+                        spheres,
+                        transforms,
+                        imageSize,
+                        numFrames,
+                        r)
+        && transferResult(fds[1], r, true);
+    _exit(ok ? 0 : 1);
+  }
+  close(fds[1]);
+  const bool received = transferResult(fds[0], result, false);
+  close(fds[0]);
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+  }
+  return received && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#else
+  return runVariant(
+      libraryName, flatten, spheres, transforms, imageSize, numFrames, result);
+#endif
+}
+
+static void printResult(const char *name, const RunResult &r)
+{
+  printf("%s:\n", name);
+  printf("  %-22s %10.2fms\n", "host build + upload", r.buildMs);
+  printf("  %-22s %10.2fms\n", "first frame", r.firstFrameMs);
+  r.render.print("  render");
+  printf("  %-22s %10.1fMB\n", "resident memory", r.memory / 1048576.0);
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t gridSize = 10;
+  uint32_t numSpheres = 10000;
+  size_t flatLimit = 50000000;
+  int numFrames = 10;
+  bool runInstanced = true;
+  bool runFlat = true;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--grid") && i + 1 < argc)
+      gridSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--spheres") && i + 1 < argc)
+      numSpheres = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--flat-limit") && i + 1 < argc)
+      flatLimit = std::strtoull(argv[++i], nullptr, 10);
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--mode") && i + 1 < argc) {
+      const std::string mode = argv[++i];
+      runInstanced = mode == "both" || mode == "instanced";
+      runFlat = mode == "both" || mode == "flat";
+    } else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--grid n] [--spheres n] [--flat-limit n] [-n frames] "
+          "[--mode both|instanced|flat] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Flattened sphere indices are 32 bit
+  flatLimit = std::min<size_t>(flatLimit, UINT32_MAX);
+
+  const float3 pivot(1.5f, 1.5f, 0.f);
+  const SphereData spheres = generateSpheres(pivot, numSpheres);
+  const std::vector<mat4> transforms =
+      instanceGrid(pivot, pivot, 2.4f, gridSize);
+  const size_t totalSpheres = size_t(numSpheres) * transforms.size();
+
+  printf("%zu instances x %u spheres = %zu spheres\n",
+      transforms.size(),
+      numSpheres,
+      totalSpheres);
+
+  if (runFlat && totalSpheres > flatLimit) {
+    printf("skipping flattened geometry above %zu spheres\n", flatLimit);
+    runFlat = false;
+  }
+
+  const uint2 imageSize = {800, 800};
+
+  stbi_flip_vertically_on_write(1);
+
+  // Instanced //
+
+  RunResult instanced, flat;
+  if (runInstanced) {
+    if (!runIsolated(libraryName,
+            false,
+            spheres,
+            transforms,
+            imageSize,
+            numFrames,
+            instanced)) {
+      fprintf(stderr, "instanced run failed\n");
+      return 1;
+    }
+    printResult("instanced", instanced);
+    stbi_write_png("instanced.png",
+        imageSize.x,
+        imageSize.y,
+        4,
+        instanced.image.data(),
+        4 * imageSize.x);
+  }
+
+  // Flattened //
+
+  if (runFlat) {
+    if (!runIsolated(libraryName,
+            true,
+            spheres,
+            transforms,
+            imageSize,
+            numFrames,
+            flat)) {
+      fprintf(stderr, "flattened run failed\n");
+      return 1;
+    }
+    printResult("flattened", flat);
+    stbi_write_png("flat.png",
+        imageSize.x,
+        imageSize.y,
+        4,
+        flat.image.data(),
+        4 * imageSize.x);
+  }
+
+  if (runInstanced && runFlat) {
+    printf("instanced vs flattened: %.2fx render time, %.2fx memory, "
+           "image RMSE %.3f\n",
+        instanced.render.mean() / std::max(1e-6, flat.render.mean()),
+        double(instanced.memory) / std::max<size_t>(1, flat.memory),
+        rmseRGBA8(instanced.image, flat.image));
+  }
+
+  return 0;
+}
@@ -0,0 +1,220 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// View-dependent level of detail (LevelOfDetail.h) on a large sphere scene
+// (n^3 copies of the cluster, see Scene.h). For every sample of a head
+// tracker trace (Tracker.h), a cut through the octree is selected from the
+// tracked eye and uploaded, and compared against rendering the full detail
+// scene from the same eye; one run per pixel threshold:
+//
+//   lod [--grid 6] [--threshold 2,4,8] [--trace head.txt | --samples 60]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "LevelOfDetail.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Tracker.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+int main(int argc, char *argv[])
+{
+  uint32_t gridSize = 6;
+  uint32_t numSpheres = 10000;
+  std::vector<float> thresholds = {2.f, 4.f, 8.f};
+  std::string traceFile;
+  size_t numSamples = 60;
+  uint32_t leafSize = 32;
+  bool cull = true;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--grid") && i + 1 < argc)
+      gridSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--spheres") && i + 1 < argc)
+      numSpheres = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--threshold") && i + 1 < argc) {
+      thresholds.clear();
+      for (char *tok = std::strtok(argv[++i], ","); tok;
+           tok = std::strtok(nullptr, ","))
+        thresholds.push_back(std::max(0.f, float(std::atof(tok))));
+    } else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      traceFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--samples") && i + 1 < argc)
+      numSamples = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--leaf-size") && i + 1 < argc)
+      leafSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--no-cull"))
+      cull = false;
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--grid n] [--spheres n] [--threshold px,...] "
+          "[--trace file | --samples n] [--leaf-size n] [--no-cull] "
+          "[--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  std::vector<TrackerSample> trace;
+  if (!traceFile.empty()) {
+    if (!loadTrackerTrace(traceFile.c_str(), trace)) {
+      fprintf(stderr, "could not load tracker trace '%s'\n", traceFile.c_str());
+      return 1;
+    }
+  } else {
+    trace = syntheticTrackerTrace(eye, numSamples);
+  }
+
+  // Scene and octree //
+
+  const float3 pivot(1.5f, 1.5f, 0.f);
+  const SphereData full = flattenInstances(generateSpheres(pivot, numSpheres),
+      instanceGrid(pivot, pivot, 2.4f, gridSize));
+
+  Timer timer;
+  const LodTree tree = buildLodTree(full, leafSize);
+  printf("%zu spheres, octree of %zu nodes built in %.1fms\n",
+      full.positions.size(),
+      tree.nodes.size(),
+      timer.elapsedMs());
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto fullWorld = newSphereWorld(device, full);
+  addSampleLight(device, fullWorld);
+
+  anari::Geometry lodGeometry = nullptr;
+  SphereData cut;
+  selectLod(tree, LodParams(), LL, LR, UR, eye, 800, cut);
+  auto lodWorld =
+      newSurfaceWorld(device, newSphereSurface(device, cut, &lodGeometry));
+  addSampleLight(device, lodWorld);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  auto newFrame = [&](anari::World world) {
+    auto frame = anari::newObject<anari::Frame>(device);
+    anari::setParameter(device, frame, "size", imageSize);
+    anari::setParameter(
+        device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+    anari::setParameter(device, frame, "world", world);
+    anari::setParameter(device, frame, "renderer", renderer);
+    anari::setParameter(device, frame, "camera", camera);
+    anari::commitParameters(device, frame);
+    return frame;
+  };
+  auto fullFrame = newFrame(fullWorld);
+  auto lodFrame = newFrame(lodWorld);
+
+  auto renderFrame = [&](anari::Frame frame) {
+    Timer t;
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    return t.elapsedMs();
+  };
+
+  // Full detail reference, one image per tracker sample //
+
+  std::vector<std::vector<uint32_t>> reference(trace.size());
+  Stats fullRender;
+  renderFrame(fullFrame); // acceleration structure build
+  for (size_t i = 0; i < trace.size(); i++) {
+    setFixedFrameCameraParameters(
+        device, camera, LL, LR, UR, trace[i].position);
+    fullRender.add(renderFrame(fullFrame));
+    auto fb = anari::map<uint32_t>(device, fullFrame, "channel.color");
+    reference[i].assign(fb.data, fb.data + numPixels);
+    anari::unmap(device, fullFrame, "channel.color");
+  }
+
+  printf("%zu tracker samples, full detail:\n", trace.size());
+  fullRender.print("  render");
+
+  // LOD, per threshold //
+
+  for (float threshold : thresholds) {
+    LodParams params;
+    params.pixelThreshold = threshold;
+    params.cull = cull;
+
+    Stats select, upload, render, primitives, proxies, error;
+    for (size_t i = 0; i < trace.size(); i++) {
+      const float3 e = trace[i].position;
+
+      timer.reset();
+      const LodStats stats =
+          selectLod(tree, params, LL, LR, UR, e, imageSize.x, cut);
+      select.add(timer.elapsedMs());
+      primitives.add(double(stats.spheres + stats.proxies));
+      proxies.add(double(stats.proxies));
+
+      timer.reset();
+      setSphereArrays(device, lodGeometry, cut);
+      anari::commitParameters(device, lodGeometry);
+      upload.add(timer.elapsedMs());
+
+      setFixedFrameCameraParameters(device, camera, LL, LR, UR, e);
+      render.add(renderFrame(lodFrame));
+
+      auto fb = anari::map<uint32_t>(device, lodFrame, "channel.color");
+      error.add(rmseRGBA8(fb.data, reference[i].data(), numPixels));
+      anari::unmap(device, lodFrame, "channel.color");
+    }
+
+    printf("threshold %.1fpx%s:\n", threshold, cull ? ", culling" : "");
+    printf("  %-22s %10.0f of %zu (%.1f%%), %.0f proxies\n",
+        "primitives",
+        primitives.mean(),
+        full.positions.size(),
+        100.0 * primitives.mean() / std::max<size_t>(1, full.positions.size()),
+        proxies.mean());
+    select.print("  LOD selection");
+    upload.print("  upload");
+    render.print("  render");
+    error.print("  RMSE vs full detail", "");
+    printf("  => %.2fx full detail frame time (%.2fx incl. selection)\n",
+        render.mean() / std::max(1e-6, fullRender.mean()),
+        (select.mean() + upload.mean() + render.mean())
+            / std::max(1e-6, fullRender.mean()));
+  }
+
+  anari::release(device, lodGeometry);
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, fullWorld);
+  anari::release(device, lodWorld);
+  anari::release(device, fullFrame);
+  anari::release(device, lodFrame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
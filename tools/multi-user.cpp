@@ -0,0 +1,298 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Render loop for several tracked users in a CAVE with shutter multiplexing
+// (MultiUser.h): every display cycle renders users x 2 eyes x walls views on
+// one device. Each user follows a synthetic head tracker trace; the cameras
+// of all views are solved in one batch per wall. Reports per-user latency
+// (tracker sample to the user's last view being ready) for each schedule and
+// how throughput scales with the number of users:
+//
+//   multi-user [--users 1,2,4] [--walls 4] [--cycles 60]
+//              [--schedule serial|wall-major|user-major|all]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "MultiUser.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Tracker.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+struct CycleResult
+{
+  uint32_t numUsers{0};
+  ViewSchedule schedule{ViewSchedule::Serial};
+  size_t numViews{0};
+  Stats camera, commit, cycle;
+  std::vector<Stats> userLatency;
+
+  double viewsPerSecond() const
+  {
+    return cycle.mean() > 0.0 ? 1000.0 * numViews / cycle.mean() : 0.0;
+  }
+};
+
+static CycleResult runCycles(anari::Device device,
+    const std::vector<anari::Frame> &frames,
+    const std::vector<anari::Camera> &cameras,
+    const std::vector<CaveWall> &walls,
+    const std::vector<std::vector<TrackerSample>> &traces,
+    uint32_t numUsers,
+    float ipd,
+    ViewSchedule schedule,
+    int numCycles)
+{
+  CycleResult result;
+  result.numUsers = numUsers;
+  result.schedule = schedule;
+  result.userLatency.resize(numUsers);
+
+  MultiUserViews views;
+  std::vector<float3> heads(numUsers);
+  std::vector<uint32_t> order;
+  std::vector<double> readyMs;
+
+  // One extra cycle up front to warm up the device
+  for (int c = -1; c < numCycles; c++) {
+    const uint32_t cycle = uint32_t(c + 1);
+
+    // The cycle starts when the tracker samples arrive
+    Timer cycleTimer;
+    for (uint32_t u = 0; u < numUsers; u++)
+      heads[u] = traces[u][cycle % traces[u].size()].position;
+
+    // Cameras of all views //
+
+    Timer timer;
+    updateMultiUserViews(walls, heads.data(), numUsers, ipd, views);
+    const double cameraMs = timer.elapsedMs();
+
+    timer.reset();
+    for (size_t v = 0; v < views.numViews(); v++) {
+      const offaxis::PerspectiveSolution &s = views.cameras[v];
+      setPerspectiveCameraParameters(device,
+          cameras[v],
+          views.eyeOf(v),
+          float3(s.dir[0], s.dir[1], s.dir[2]),
+          float3(s.up[0], s.up[1], s.up[2]),
+          s.fovy,
+          s.aspect,
+          float4(s.imageRegion[0],
+              s.imageRegion[1],
+              s.imageRegion[2],
+              s.imageRegion[3]));
+    }
+    const double commitMs = timer.elapsedMs();
+
+    // Render //
+
+    viewOrder(views, schedule, cycle, order);
+    readyMs.assign(views.numViews(), 0.0);
+    if (schedule == ViewSchedule::Serial) {
+      for (uint32_t v : order) {
+        anari::render(device, frames[v]);
+        anari::wait(device, frames[v]);
+        readyMs[v] = cycleTimer.elapsedMs();
+      }
+    } else {
+      // Keep the device busy: everything in flight, then wait in the order
+      // the views were issued
+      for (uint32_t v : order)
+        anari::render(device, frames[v]);
+      for (uint32_t v : order) {
+        anari::wait(device, frames[v]);
+        readyMs[v] = cycleTimer.elapsedMs();
+      }
+    }
+    const double cycleMs = cycleTimer.elapsedMs();
+
+    if (c < 0)
+      continue;
+
+    result.camera.add(cameraMs);
+    result.commit.add(commitMs);
+    result.cycle.add(cycleMs);
+    std::vector<double> latency(numUsers, 0.0);
+    for (size_t v = 0; v < views.numViews(); v++) {
+      const uint32_t u = views.userOf(v);
+      latency[u] = std::max(latency[u], readyMs[v]);
+    }
+    for (uint32_t u = 0; u < numUsers; u++)
+      result.userLatency[u].add(latency[u]);
+  }
+
+  result.numViews = views.numViews();
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<uint32_t> userCounts = {1, 2, 4};
+  std::vector<ViewSchedule> schedules;
+  uint32_t numWalls = 4;
+  uint2 viewSize = {400, 400};
+  float ipd = 0.065f;
+  int numCycles = 60;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    ViewSchedule s;
+    if (!std::strcmp(argv[i], "--users") && i + 1 < argc) {
+      userCounts.clear();
+      for (char *t = std::strtok(argv[++i], ","); t; t = std::strtok(0, ","))
+        userCounts.push_back(std::max(1, std::atoi(t)));
+    } else if (!std::strcmp(argv[i], "--walls") && i + 1 < argc)
+      numWalls = std::min(5, std::max(1, std::atoi(argv[++i])));
+    else if (!std::strcmp(argv[i], "--schedule") && i + 1 < argc) {
+      if (!std::strcmp(argv[++i], "all"))
+        schedules.clear();
+      else if (parseViewSchedule(argv[i], s))
+        schedules.push_back(s);
+      else {
+        fprintf(stderr, "unknown schedule '%s'\n", argv[i]);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+      viewSize.x = std::max(1, std::atoi(argv[++i]));
+      viewSize.y = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--ipd") && i + 1 < argc)
+      ipd = float(std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--cycles") && i + 1 < argc)
+      numCycles = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--users n,n,...] [--walls n] [--schedule name|all] "
+          "[--size w h] [--ipd m] [--cycles n] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (schedules.empty()) {
+    for (int i = 0; i <= int(ViewSchedule::UserMajor); i++)
+      schedules.push_back(ViewSchedule(i));
+  }
+  const uint32_t maxUsers =
+      *std::max_element(userCounts.begin(), userCounts.end());
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  // One frame and camera per view, for the largest user count //
+
+  const std::vector<CaveWall> walls = caveWalls(3.f, numWalls);
+  const size_t maxViews = size_t(walls.size()) * maxUsers * 2;
+  std::vector<anari::Camera> cameras(maxViews);
+  std::vector<anari::Frame> frames(maxViews);
+  for (size_t v = 0; v < maxViews; v++) {
+    cameras[v] = anari::newObject<anari::Camera>(device, "perspective");
+    frames[v] = anari::newObject<anari::Frame>(device);
+    anari::setParameter(device, frames[v], "size", viewSize);
+    anari::setParameter(
+        device, frames[v], "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+    anari::setParameter(device, frames[v], "world", world);
+    anari::setParameter(device, frames[v], "renderer", renderer);
+    anari::setParameter(device, frames[v], "camera", cameras[v]);
+    anari::commitParameters(device, frames[v]);
+  }
+
+  // Users stand at different spots inside the CAVE
+  std::vector<std::vector<TrackerSample>> traces(maxUsers);
+  for (uint32_t u = 0; u < maxUsers; u++) {
+    const float x = 1.5f + 0.5f * (float(u) - 0.5f * (maxUsers - 1));
+    traces[u] = syntheticTrackerTrace(
+        float3(x, 1.68f, 1.5f), size_t(numCycles) + 1, 60.0, u);
+  }
+
+  printf("%zu walls, %ux%u pixels per view, %d cycles\n",
+      walls.size(),
+      viewSize.x,
+      viewSize.y,
+      numCycles);
+
+  std::vector<CycleResult> results;
+  for (uint32_t numUsers : userCounts) {
+    for (ViewSchedule schedule : schedules) {
+      CycleResult r = runCycles(device,
+          frames,
+          cameras,
+          walls,
+          traces,
+          numUsers,
+          ipd,
+          schedule,
+          numCycles);
+
+      printf("\n%u users x 2 eyes x %zu walls = %zu views, %s:\n",
+          numUsers,
+          walls.size(),
+          r.numViews,
+          viewScheduleName(schedule));
+      r.camera.print("  camera batch");
+      r.commit.print("  camera commits");
+      r.cycle.print("  cycle");
+      for (uint32_t u = 0; u < numUsers; u++) {
+        const std::string name = "  user " + std::to_string(u) + " latency";
+        r.userLatency[u].print(name.c_str());
+      }
+      results.push_back(std::move(r));
+    }
+  }
+
+  // Throughput scaling with the number of users //
+
+  printf("\n%-6s %-12s %8s %12s %10s %12s\n",
+      "users",
+      "schedule",
+      "views",
+      "cycle [ms]",
+      "views/s",
+      "scaling");
+  for (const auto &r : results) {
+    // Relative to the first user count with the same schedule
+    double base = 0.0;
+    for (const auto &b : results) {
+      if (b.schedule == r.schedule) {
+        base = b.viewsPerSecond();
+        break;
+      }
+    }
+    printf("%-6u %-12s %8zu %12.3f %10.1f %11.2fx\n",
+        r.numUsers,
+        viewScheduleName(r.schedule),
+        r.numViews,
+        r.cycle.mean(),
+        r.viewsPerSecond(),
+        base > 0.0 ? r.viewsPerSecond() / base : 0.0);
+  }
+
+  for (size_t v = 0; v < maxViews; v++) {
+    anari::release(device, cameras[v]);
+    anari::release(device, frames[v]);
+  }
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, device);
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,201 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Applies per-projector warp maps and edge-blend masks (Warp.h) to the
+// rendered off-axis image and reports the time per projector against a
+// frame budget. Warp maps are read from files, or generated for P projectors
+// placed side by side with overlapping, blended edges:
+//
+//   projector-warp [--maps a.oxwm,b.oxwm,...] [-n iterations] [--budget ms]
+//   projector-warp --projectors 3 --overlap 0.2 --write-maps wall
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "Warp.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+int main(int argc, char *argv[])
+{
+  std::vector<std::string> mapFiles;
+  uint32_t numProjectors = 3;
+  float overlap = 0.2f;
+  uint2 projectorSize = {1280, 800};
+  int numIterations = 100;
+  double budgetMs = 1000.0 / 60.0;
+  std::string writeMaps;
+  std::string outPrefix = "projector";
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--maps") && i + 1 < argc) {
+      for (char *s = std::strtok(argv[++i], ","); s; s = std::strtok(0, ","))
+        mapFiles.push_back(s);
+    } else if (!std::strcmp(argv[i], "--projectors") && i + 1 < argc)
+      numProjectors = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--overlap") && i + 1 < argc)
+      overlap = std::min(std::max(float(std::atof(argv[++i])), 0.f), 0.9f);
+    else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+      projectorSize.x = std::max(1, std::atoi(argv[++i]));
+      projectorSize.y = std::max(1, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numIterations = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--budget") && i + 1 < argc)
+      budgetMs = std::atof(argv[++i]);
+    else if (!std::strcmp(argv[i], "--write-maps") && i + 1 < argc)
+      writeMaps = argv[++i];
+    else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      outPrefix = argv[++i];
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--maps file,file,...] [--projectors n] [--overlap f] "
+          "[--size w h] [-n iterations] [--budget ms] [--write-maps prefix] "
+          "[-o prefix] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device and render the off-axis image once //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  uint2 imageSize = {800, 800};
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  anari::render(device, frame);
+  anari::wait(device, frame);
+
+  // Warp maps //
+
+  std::vector<WarpMap> maps;
+  if (!mapFiles.empty()) {
+    for (const auto &fileName : mapFiles) {
+      WarpMap map;
+      if (!loadWarpMap(fileName.c_str(), map)) {
+        fprintf(stderr, "could not load warp map '%s'\n", fileName.c_str());
+        return 1;
+      }
+      if (map.srcWidth != imageSize.x || map.srcHeight != imageSize.y) {
+        fprintf(stderr,
+            "warp map '%s' expects a %ux%u image\n",
+            fileName.c_str(),
+            map.srcWidth,
+            map.srcHeight);
+        return 1;
+      }
+      maps.push_back(std::move(map));
+    }
+  } else {
+    for (uint32_t p = 0; p < numProjectors; p++) {
+      maps.push_back(demoWarpMap(p,
+          numProjectors,
+          overlap,
+          projectorSize.x,
+          projectorSize.y,
+          imageSize.x,
+          imageSize.y));
+      if (!writeMaps.empty()) {
+        const std::string fileName =
+            writeMaps + "-" + std::to_string(p) + ".oxwm";
+        if (!saveWarpMap(fileName.c_str(), maps.back()))
+          fprintf(stderr, "could not write '%s'\n", fileName.c_str());
+      }
+    }
+  }
+
+  // Warp + blend per projector //
+
+  auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+
+  printf("%zu projectors, %d iterations, budget %.2fms, %u threads, %s\n",
+      maps.size(),
+      numIterations,
+      budgetMs,
+      numThreads(),
+      hostIsaName(hostIsa()));
+
+  Stats all;
+  for (size_t p = 0; p < maps.size(); p++) {
+    Timer timer;
+    const WarpTable table = buildWarpTable(maps[p]);
+    const double buildMs = timer.elapsedMs();
+
+    std::vector<uint32_t> out(size_t(table.width) * table.height);
+    Stats stats;
+    for (int i = 0; i < numIterations; i++) {
+      timer.reset();
+      warpAndBlend(table, fb.data, out.data());
+      stats.add(timer.elapsedMs());
+      all.add(stats.samples.back());
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "  projector %zu", p);
+    stats.print(name);
+    printf("    %ux%u, table build %.2fms, %.1f Mpixel/s, %s budget\n",
+        table.width,
+        table.height,
+        buildMs,
+        table.width * double(table.height) / (stats.mean() * 1000.0),
+        stats.percentile(0.95) <= budgetMs ? "within" : "EXCEEDS");
+
+    const std::string fileName = outPrefix + "-" + std::to_string(p) + ".png";
+    stbi_flip_vertically_on_write(1);
+    stbi_write_png(fileName.c_str(),
+        table.width,
+        table.height,
+        4,
+        out.data(),
+        4 * table.width);
+  }
+  printf("  all projectors, sequential: %.3fms per frame\n",
+      all.sum() / numIterations);
+
+  anari::unmap(device, frame, "channel.color");
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,459 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Replays a trace recorded with the "trace" layer device (see
+// devices/TraceDevice.h) on any ANARI device and reports the time spent in
+// each call, next to the time the call took on the recorded device:
+//
+//   anari-offaxis-sample --trace sample.trace
+//   ANARI_LIBRARY=visionaray replay-trace sample.trace --csv calls.csv
+
+// anari
+#include <anari/anari.h>
+// std
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "devices/DataTypes.h"
+#include "devices/TraceFormat.h"
+
+using namespace offaxis;
+using trace::Op;
+
+struct Replayer
+{
+  struct ArrayInfo
+  {
+    ANARIDataType elementType{ANARI_UNKNOWN};
+    uint64_t numItems{0};
+    void *mapped{nullptr};
+  };
+
+  ANARIDevice device{nullptr};
+  std::vector<ANARIObject> objects; // indexed by trace id
+  std::vector<ArrayInfo> arrays; // indexed by trace id
+  ANARIWaitMask lastWaitMask{ANARI_NO_WAIT}; // of the last FrameReady
+
+  ANARIObject handle(uint64_t id) const
+  {
+    if (id == 1)
+      return (ANARIObject)device;
+    return id < objects.size() ? objects[id] : nullptr;
+  }
+
+  // Ids are assigned densely in creation order, starting after the device
+  bool isNextId(uint64_t id) const
+  {
+    return id == std::max<uint64_t>(objects.size(), 2);
+  }
+
+  void setHandle(uint64_t id, ANARIObject o)
+  {
+    if (id >= objects.size()) {
+      objects.resize(id + 1, nullptr);
+      arrays.resize(id + 1);
+    }
+    objects[id] = o;
+  }
+
+  // Copy recorded array contents into mapped memory, translating ids;
+  // returns false if the contents don't match the array's size. Nothing is
+  // recorded for arrays the recorded device failed to map.
+  bool fill(const ArrayInfo &info, void *dst, const uint8_t *src, size_t size)
+  {
+    if (size == 0)
+      return true;
+    const size_t elementSize = isObjectType(info.elementType)
+        ? sizeof(uint64_t)
+        : sizeOfDataType(info.elementType);
+    if (!src || elementSize == 0 || size / elementSize != info.numItems
+        || size % elementSize != 0)
+      return false;
+    if (!dst)
+      return true;
+
+    if (!isObjectType(info.elementType)) {
+      std::memcpy(dst, src, size);
+      return true;
+    }
+    auto *handles = (ANARIObject *)dst;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) {
+      uint64_t id = 0;
+      std::memcpy(&id, src + i * sizeof(uint64_t), sizeof(uint64_t));
+      handles[i] = handle(id);
+    }
+    return true;
+  }
+
+  // n1 * n2 * n3, or false if that overflows
+  static bool numItems(uint64_t n1, uint64_t n2, uint64_t n3, uint64_t &n)
+  {
+    if ((n2 && n1 > UINT64_MAX / n2) || (n3 && n1 * n2 > UINT64_MAX / n3))
+      return false;
+    n = n1 * n2 * n3;
+    return true;
+  }
+
+  ANARIObject newObject(ANARIDataType type, const char *subtype)
+  {
+    switch (type) {
+    case ANARI_LIGHT:
+      return anariNewLight(device, subtype);
+    case ANARI_CAMERA:
+      return anariNewCamera(device, subtype);
+    case ANARI_GEOMETRY:
+      return anariNewGeometry(device, subtype);
+    case ANARI_SPATIAL_FIELD:
+      return anariNewSpatialField(device, subtype);
+    case ANARI_SURFACE:
+      return anariNewSurface(device);
+    case ANARI_VOLUME:
+      return anariNewVolume(device, subtype);
+    case ANARI_MATERIAL:
+      return anariNewMaterial(device, subtype);
+    case ANARI_SAMPLER:
+      return anariNewSampler(device, subtype);
+    case ANARI_GROUP:
+      return anariNewGroup(device);
+    case ANARI_INSTANCE:
+      return anariNewInstance(device, subtype);
+    case ANARI_WORLD:
+      return anariNewWorld(device);
+    case ANARI_RENDERER:
+      return anariNewRenderer(device, subtype);
+    case ANARI_FRAME:
+      return anariNewFrame(device);
+    default:
+      return nullptr;
+    }
+  }
+
+  // Executes one record; returns false on a malformed trace
+  bool step(trace::Reader &in, Op op)
+  {
+    switch (op) {
+    case Op::NewArray: {
+      const uint64_t id = in.varint();
+      const int dims = int(in.varint());
+      const auto type = ANARIDataType(in.varint());
+      const uint64_t n1 = in.varint();
+      const uint64_t n2 = in.varint();
+      const uint64_t n3 = in.varint();
+      const bool hasData = in.u8() != 0;
+      uint64_t n = 0;
+      if (in.failed || !isNextId(id) || !numItems(n1, n2, n3, n))
+        return false;
+      ANARIArray a = nullptr;
+      if (dims == 1)
+        a = anariNewArray1D(device, nullptr, nullptr, nullptr, type, n1);
+      else if (dims == 2)
+        a = anariNewArray2D(device, nullptr, nullptr, nullptr, type, n1, n2);
+      else
+        a = anariNewArray3D(
+            device, nullptr, nullptr, nullptr, type, n1, n2, n3);
+      setHandle(id, a);
+      arrays[id].elementType = type;
+      arrays[id].numItems = n;
+      if (hasData) {
+        // App-owned memory in the recording: upload via map/unmap instead
+        size_t size = 0;
+        const uint8_t *data = in.data(size);
+        if (in.failed)
+          return false;
+        void *mapped = a ? anariMapArray(device, a) : nullptr;
+        const bool filled = fill(arrays[id], mapped, data, size);
+        if (a)
+          anariUnmapArray(device, a);
+        if (!filled)
+          return false;
+      }
+      break;
+    }
+    case Op::MapArray: {
+      const uint64_t id = in.varint();
+      if (auto a = (ANARIArray)handle(id))
+        arrays[id].mapped = anariMapArray(device, a);
+      break;
+    }
+    case Op::UnmapArray: {
+      const uint64_t id = in.varint();
+      size_t size = 0;
+      const uint8_t *data = in.data(size);
+      if (in.failed)
+        return false;
+      if (auto a = (ANARIArray)handle(id)) {
+        const bool filled = fill(arrays[id], arrays[id].mapped, data, size);
+        anariUnmapArray(device, a);
+        arrays[id].mapped = nullptr;
+        if (!filled)
+          return false;
+      }
+      break;
+    }
+    case Op::NewObject: {
+      const uint64_t id = in.varint();
+      const auto type = ANARIDataType(in.varint());
+      const std::string subtype = in.string();
+      if (in.failed || !isNextId(id))
+        return false;
+      setHandle(id, newObject(type, subtype.c_str()));
+      break;
+    }
+    case Op::SetParameter: {
+      const ANARIObject o = handle(in.varint());
+      const std::string name = in.string();
+      const auto type = ANARIDataType(in.varint());
+      if (type == ANARI_STRING) {
+        const std::string str = in.string();
+        anariSetParameter(device, o, name.c_str(), type, str.c_str());
+      } else if (isObjectType(type)) {
+        const ANARIObject value = handle(in.varint());
+        anariSetParameter(device, o, name.c_str(), type, &value);
+      } else {
+        // The device reads sizeOfDataType(type) bytes
+        size_t size = 0;
+        const uint8_t *data = in.data(size);
+        if (in.failed || size == 0 || size != sizeOfDataType(type))
+          return false;
+        anariSetParameter(device, o, name.c_str(), type, data);
+      }
+      break;
+    }
+    case Op::UnsetParameter: {
+      const ANARIObject o = handle(in.varint());
+      const std::string name = in.string();
+      anariUnsetParameter(device, o, name.c_str());
+      break;
+    }
+    case Op::UnsetAllParameters:
+      anariUnsetAllParameters(device, handle(in.varint()));
+      break;
+    case Op::MapParameterArray: {
+      const uint64_t id = in.varint();
+      const std::string name = in.string();
+      const auto type = ANARIDataType(in.varint());
+      const int dims = int(in.varint());
+      const uint64_t n1 = in.varint();
+      const uint64_t n2 = in.varint();
+      const uint64_t n3 = in.varint();
+      uint64_t n = 0;
+      if (in.failed || !numItems(n1, n2, n3, n))
+        return false;
+      uint64_t stride = 0;
+      void *ptr = nullptr;
+      if (dims == 1)
+        ptr = anariMapParameterArray1D(
+            device, handle(id), name.c_str(), type, n1, &stride);
+      else if (dims == 2)
+        ptr = anariMapParameterArray2D(
+            device, handle(id), name.c_str(), type, n1, n2, &stride);
+      else
+        ptr = anariMapParameterArray3D(
+            device, handle(id), name.c_str(), type, n1, n2, n3, &stride);
+      pendingParamArray.elementType = type;
+      pendingParamArray.numItems = n;
+      pendingParamArray.mapped = ptr;
+      break;
+    }
+    case Op::UnmapParameterArray: {
+      const ANARIObject o = handle(in.varint());
+      const std::string name = in.string();
+      size_t size = 0;
+      const uint8_t *data = in.data(size);
+      if (in.failed)
+        return false;
+      const bool filled =
+          fill(pendingParamArray, pendingParamArray.mapped, data, size);
+      anariUnmapParameterArray(device, o, name.c_str());
+      pendingParamArray = ArrayInfo();
+      if (!filled)
+        return false;
+      break;
+    }
+    case Op::CommitParameters:
+      anariCommitParameters(device, handle(in.varint()));
+      break;
+    case Op::Release:
+      anariRelease(device, handle(in.varint()));
+      break;
+    case Op::Retain:
+      anariRetain(device, handle(in.varint()));
+      break;
+    case Op::RenderFrame:
+      anariRenderFrame(device, (ANARIFrame)handle(in.varint()));
+      break;
+    case Op::FrameReady: {
+      const auto frame = (ANARIFrame)handle(in.varint());
+      const auto mask = ANARIWaitMask(in.varint());
+      anariFrameReady(device, frame, mask);
+      lastWaitMask = mask;
+      break;
+    }
+    case Op::DiscardFrame:
+      anariDiscardFrame(device, (ANARIFrame)handle(in.varint()));
+      break;
+    case Op::MapFrame: {
+      const auto frame = (ANARIFrame)handle(in.varint());
+      const std::string channel = in.string();
+      uint32_t width = 0, height = 0;
+      ANARIDataType type = ANARI_UNKNOWN;
+      anariMapFrame(device, frame, channel.c_str(), &width, &height, &type);
+      break;
+    }
+    case Op::UnmapFrame: {
+      const auto frame = (ANARIFrame)handle(in.varint());
+      const std::string channel = in.string();
+      anariUnmapFrame(device, frame, channel.c_str());
+      break;
+    }
+    case Op::GetProperty: {
+      const ANARIObject o = handle(in.varint());
+      const std::string name = in.string();
+      const auto type = ANARIDataType(in.varint());
+      const uint64_t size = in.varint();
+      const auto mask = ANARIWaitMask(in.varint());
+      std::vector<uint8_t> mem(size);
+      anariGetProperty(device, o, name.c_str(), type, mem.data(), size, mask);
+      break;
+    }
+    default:
+      return false;
+    }
+    return !in.failed;
+  }
+
+  ArrayInfo pendingParamArray;
+};
+
+int main(int argc, char *argv[])
+{
+  std::string traceFile, csvFile;
+  std::string libraryName = "environment";
+  std::string deviceName = "default";
+  bool validArgs = true;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--csv") && i + 1 < argc)
+      csvFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else if (!std::strcmp(argv[i], "--device") && i + 1 < argc)
+      deviceName = argv[++i];
+    else if (traceFile.empty() && argv[i][0] != '-')
+      traceFile = argv[i];
+    else
+      validArgs = false;
+  }
+
+  if (!validArgs || traceFile.empty()) {
+    fprintf(stderr,
+        "Usage: %s <file.trace> [--library name] [--device subtype]"
+        " [--csv calls.csv]\n",
+        argv[0]);
+    return 1;
+  }
+
+  trace::Reader in;
+  if (!in.open(traceFile)) {
+    fprintf(stderr, "could not read trace '%s'\n", traceFile.c_str());
+    return 1;
+  }
+
+  auto library = anariLoadLibrary(libraryName.c_str(), statusFunc, nullptr);
+  if (!library) {
+    fprintf(stderr, "could not load ANARI library '%s'\n", libraryName.c_str());
+    return 1;
+  }
+
+  Replayer replayer;
+  replayer.device = anariNewDevice(library, deviceName.c_str());
+
+  FILE *csv = csvFile.empty() ? nullptr : std::fopen(csvFile.c_str(), "w");
+  if (csv)
+    fprintf(csv, "index,call,recorded_us,replayed_us\n");
+
+  const size_t numOps = size_t(Op::Count);
+  std::vector<Stats> replayed(numOps);
+  std::vector<double> recordedTotal(numOps, 0.0);
+  Stats frames; // renderFrame + blocking frameReady
+  double frameStart = -1.0;
+
+  Timer total;
+  size_t index = 0;
+  while (!in.atEnd()) {
+    const Op op = Op(in.u8());
+    const double recordedUs = in.varint() * 1e-3;
+
+    Timer timer;
+    if (!replayer.step(in, op)) {
+      fprintf(stderr,
+          "malformed trace at record %zu (%s)\n",
+          index,
+          trace::opName(op));
+      break;
+    }
+    const double ms = timer.elapsedMs();
+
+    replayed[size_t(op)].add(ms);
+    recordedTotal[size_t(op)] += recordedUs * 1e-3;
+
+    if (op == Op::RenderFrame)
+      frameStart = total.elapsedMs() - ms;
+    else if (op == Op::FrameReady && frameStart >= 0.0
+        && replayer.lastWaitMask == ANARI_WAIT) {
+      // ANARI_NO_WAIT polls don't end the frame
+      frames.add(total.elapsedMs() - frameStart);
+      frameStart = -1.0;
+    }
+
+    if (csv) {
+      fprintf(csv,
+          "%zu,%s,%.3f,%.3f\n",
+          index,
+          trace::opName(op),
+          recordedUs,
+          ms * 1e3);
+    }
+    index++;
+  }
+  const double totalMs = total.elapsedMs();
+
+  printf("replayed %zu calls in %fms\n\n", index, totalMs);
+  printf("%-20s %8s %14s %14s %12s %12s\n",
+      "call",
+      "count",
+      "replayed [ms]",
+      "recorded [ms]",
+      "avg [us]",
+      "max [us]");
+  for (size_t i = 1; i < numOps; i++) {
+    const auto &s = replayed[i];
+    if (s.count() == 0)
+      continue;
+    printf("%-20s %8zu %14.3f %14.3f %12.3f %12.3f\n",
+        trace::opName(Op(i)),
+        s.count(),
+        s.sum(),
+        recordedTotal[i],
+        s.mean() * 1e3,
+        s.max() * 1e3);
+  }
+  if (frames.count() > 0) {
+    printf("\n");
+    frames.print("frame (render..ready)");
+  }
+
+  if (csv)
+    std::fclose(csv);
+
+  anariRelease(replayer.device, replayer.device);
+  anariUnloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,238 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Writes the test scene as a float32 and as a quantized16 scene cache
+// (SceneCache.h), and reports file sizes, load time, decode throughput of
+// the SIMD and scalar decoders, the positional error introduced, and the
+// difference of the rendered images:
+//
+//   scene-cache [--spheres 10000000] [--block 4096] [-o scene]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Scene.h"
+#include "SceneCache.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+static size_t fileSize(const char *fileName)
+{
+  FILE *fp = fopen(fileName, "rb");
+  if (!fp)
+    return 0;
+  fseek(fp, 0, SEEK_END);
+  const long size = ftell(fp);
+  fclose(fp);
+  return size > 0 ? size_t(size) : 0;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t numSpheres = 10000000;
+  uint32_t blockSize = 4096;
+  int numRuns = 5;
+  bool render = true;
+  std::string prefix = "scene";
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--spheres") && i + 1 < argc)
+      numSpheres = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--block") && i + 1 < argc)
+      blockSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numRuns = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      prefix = argv[++i];
+    else if (!std::strcmp(argv[i], "--no-render"))
+      render = false;
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--spheres n] [--block n] [-n runs] [-o prefix] "
+          "[--no-render] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  const std::string floatFile = prefix + ".float32.oxsc";
+  const std::string quantizedFile = prefix + ".quantized16.oxsc";
+
+  // Write both encodings //
+
+  SceneCache original;
+  original.spheres = generateSpheres(float3(1.5f, 1.5f, 0.f), numSpheres);
+
+  Timer timer;
+  SceneCache quantized;
+  quantized.encoding = SceneEncoding::Quantized16;
+  quantized.quantized = quantizeSpheres(original.spheres, blockSize);
+  const double quantizeMs = timer.elapsedMs();
+
+  if (!saveSceneCache(floatFile.c_str(), original)
+      || !saveSceneCache(quantizedFile.c_str(), quantized)) {
+    fprintf(stderr, "could not write scene caches '%s.*'\n", prefix.c_str());
+    return 1;
+  }
+
+  const size_t floatBytes = fileSize(floatFile.c_str());
+  const size_t quantizedBytes = fileSize(quantizedFile.c_str());
+  printf("%u spheres, blocks of %u, quantized in %.1fms\n",
+      numSpheres,
+      blockSize,
+      quantizeMs);
+  printf("  %-22s %10.1fMB\n", "float32", floatBytes / 1048576.0);
+  printf("  %-22s %10.1fMB (%.1f%% smaller)\n",
+      "quantized16",
+      quantizedBytes / 1048576.0,
+      100.0 * (1.0 - double(quantizedBytes) / std::max<size_t>(1, floatBytes)));
+
+  // Load (mostly from the page cache) //
+
+  SceneCache floatCache, quantizedCache;
+  Stats floatLoad, quantizedLoad;
+  for (int i = 0; i < numRuns; i++) {
+    timer.reset();
+    bool ok = loadSceneCache(floatFile.c_str(), floatCache);
+    floatLoad.add(timer.elapsedMs());
+    timer.reset();
+    ok = loadSceneCache(quantizedFile.c_str(), quantizedCache) && ok;
+    quantizedLoad.add(timer.elapsedMs());
+    if (!ok) {
+      fprintf(stderr, "could not read scene caches '%s.*'\n", prefix.c_str());
+      return 1;
+    }
+  }
+  printf("load:\n");
+  floatLoad.print("  float32");
+  quantizedLoad.print("  quantized16");
+
+  // Decode throughput //
+
+  const auto &q = quantizedCache.quantized;
+  std::vector<float3> positions(q.size());
+  std::vector<float> attributes(q.size());
+  Stats simdDecode, scalarDecode;
+  for (int i = 0; i < numRuns; i++) {
+    timer.reset();
+    decodeQuantizedSpheres(q, positions.data(), attributes.data(), false);
+    scalarDecode.add(timer.elapsedMs());
+    timer.reset();
+    decodeQuantizedSpheres(q, positions.data(), attributes.data(), true);
+    simdDecode.add(timer.elapsedMs());
+  }
+  const double outputGB =
+      q.size() * (sizeof(float3) + sizeof(float)) / 1073741824.0;
+  printf("decode (%u threads):\n", numThreads());
+  simdDecode.print("  SIMD");
+  scalarDecode.print("  scalar");
+  printf("  => %.1f vs %.1f Mspheres/s, %.2f vs %.2f GB/s written\n",
+      q.size() / (1e3 * std::max(1e-6, simdDecode.mean())),
+      q.size() / (1e3 * std::max(1e-6, scalarDecode.mean())),
+      outputGB / (1e-3 * std::max(1e-6, simdDecode.mean())),
+      outputGB / (1e-3 * std::max(1e-6, scalarDecode.mean())));
+
+  // Error, per primitive //
+
+  // Quantized sphere i is the i-th primitive along the Morton curve
+  const auto &s = floatCache.spheres;
+  const std::vector<uint32_t> order = spatialOrder(s);
+  double maxError = 0.0, sumSquared = 0.0, maxAttributeError = 0.0;
+  for (size_t i = 0; i < order.size(); i++) {
+    const double e = length(positions[i] - s.positions[order[i]]);
+    maxError = std::max(maxError, e);
+    sumSquared += e * e;
+    maxAttributeError = std::max(maxAttributeError,
+        double(std::fabs(attributes[i] - s.distances[order[i]])));
+  }
+  const double rmsError = std::sqrt(sumSquared / std::max<size_t>(1, q.size()));
+  printf("positional error:\n");
+  printf("  %-22s %10.3g (%.3f%% of the radius)\n",
+      "max",
+      maxError,
+      100.0 * maxError / s.radius);
+  printf("  %-22s %10.3g (%.3f%% of the radius)\n",
+      "rms",
+      rmsError,
+      100.0 * rmsError / s.radius);
+  printf("  %-22s %10.3g\n", "max attribute error", maxAttributeError);
+
+  if (!render)
+    return 0;
+
+  // Upload and render both //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  uint2 imageSize = {800, 800};
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+
+  auto renderCache = [&](const SceneCache &cache,
+                         std::vector<uint32_t> &image) {
+    Timer t;
+    auto world = newCachedSphereWorld(device, cache);
+    const double uploadMs = t.elapsedMs();
+
+    addSampleLight(device, world);
+
+    anari::setParameter(device, frame, "world", world);
+    anari::commitParameters(device, frame);
+    anari::render(device, frame);
+    anari::wait(device, frame);
+
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    image.assign(fb.data, fb.data + size_t(fb.width) * fb.height);
+    anari::unmap(device, frame, "channel.color");
+
+    anari::unsetParameter(device, frame, "world");
+    anari::commitParameters(device, frame);
+    anari::release(device, world);
+    return uploadMs;
+  };
+
+  std::vector<uint32_t> floatImage, quantizedImage;
+  printf("upload:\n");
+  printf("  %-22s %10.2fms\n", "float32", renderCache(floatCache, floatImage));
+  printf("  %-22s %10.2fms (incl. decode)\n",
+      "quantized16",
+      renderCache(quantizedCache, quantizedImage));
+  printf("image RMSE quantized16 vs float32: %.3f\n",
+      rmseRGBA8(floatImage, quantizedImage));
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
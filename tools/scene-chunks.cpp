@@ -0,0 +1,249 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Writes a time series of the test scene (the sphere cluster expanding
+// over time) as a chunked, compressed scene file (SceneChunks.h), then
+// plays it back, decompressing every step in parallel straight into the
+// mapped arrays of the sphere geometry. Reports compression ratio, load
+// throughput and the peak memory of loading compared with the final array
+// size:
+//
+//   scene-chunks [--spheres 10000000] [--steps 8] [--chunk 65536]
+//                [--encoding float32|quantized16] [-o particles.oxck]
+//   scene-chunks --read particles.oxck
+//
+// Use --read in a fresh process for peak memory numbers that are not
+// dominated by writing.
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// posix
+#include <sys/resource.h>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Scene.h"
+#include "SceneChunks.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// Peak resident set size of this process so far
+static size_t peakResidentBytes()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0)
+    return 0;
+#ifdef __APPLE__
+  return size_t(usage.ru_maxrss);
+#else
+  return size_t(usage.ru_maxrss) * 1024;
+#endif
+}
+
+static bool writeTimeSeries(const char *fileName,
+    uint32_t numSpheres,
+    uint32_t numSteps,
+    uint32_t chunkSize,
+    SceneEncoding encoding)
+{
+  const float3 pivot(1.5f, 1.5f, 0.f);
+  const SphereData base = generateSpheres(pivot, numSpheres);
+
+  ChunkedSceneWriter writer;
+  if (!writer.open(fileName, encoding, chunkSize, numSpheres, base.radius))
+    return false;
+
+  SphereData spheres = base;
+  Stats write;
+  for (uint32_t t = 0; t < numSteps; t++) {
+    const float scale = 1.f + 0.05f * t;
+    for (size_t i = 0; i < spheres.positions.size(); i++)
+      spheres.positions[i] = pivot + (base.positions[i] - pivot) * scale;
+
+    Timer timer;
+    if (!writer.writeStep(spheres))
+      return false;
+    write.add(timer.elapsedMs());
+  }
+
+  if (!writer.close())
+    return false;
+  const uint64_t fileBytes = writer.offset;
+
+  // Positions and attributes of every step, the index array once, as the
+  // file stores it
+  const double rawBytes =
+      double(numSpheres) * numSteps * (sizeof(float3) + sizeof(float))
+      + double(numSpheres) * sizeof(uint32_t);
+  printf("wrote %u steps of %u spheres to '%s'\n",
+      numSteps,
+      numSpheres,
+      fileName);
+  printf("  %-22s %10.1fMB (%.2fx smaller than the arrays)\n",
+      "file",
+      fileBytes / 1048576.0,
+      rawBytes / std::max<uint64_t>(1, fileBytes));
+  write.print("  compress + write");
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  uint32_t numSpheres = 10000000;
+  uint32_t numSteps = 8;
+  uint32_t chunkSize = 65536;
+  SceneEncoding encoding = SceneEncoding::Float32;
+  std::string fileName = "particles.oxck";
+  bool write = true;
+  bool render = true;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--spheres") && i + 1 < argc)
+      numSpheres = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--steps") && i + 1 < argc)
+      numSteps = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--chunk") && i + 1 < argc)
+      chunkSize = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--encoding") && i + 1 < argc) {
+      const std::string name = argv[++i];
+      encoding = name == "quantized16" ? SceneEncoding::Quantized16
+                                       : SceneEncoding::Float32;
+    } else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      fileName = argv[++i];
+    else if (!std::strcmp(argv[i], "--read") && i + 1 < argc) {
+      fileName = argv[++i];
+      write = false;
+    } else if (!std::strcmp(argv[i], "--no-render"))
+      render = false;
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--spheres n] [--steps n] [--chunk n] "
+          "[--encoding float32|quantized16] [-o file | --read file] "
+          "[--no-render] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  if (write
+      && !writeTimeSeries(
+          fileName.c_str(), numSpheres, numSteps, chunkSize, encoding)) {
+    fprintf(stderr, "could not write '%s'\n", fileName.c_str());
+    return 1;
+  }
+
+  // Playback //
+
+  ChunkedSceneReader reader;
+  if (!reader.open(fileName.c_str())) {
+    fprintf(stderr, "could not read '%s'\n", fileName.c_str());
+    return 1;
+  }
+  const double arrayBytes = double(reader.numSpheres)
+      * (sizeof(float3) + sizeof(float) + sizeof(uint32_t));
+  printf("'%s': %u steps of %llu spheres, %s, chunks of %u\n",
+      fileName.c_str(),
+      reader.numSteps,
+      (unsigned long long)reader.numSpheres,
+      reader.encoding == SceneEncoding::Quantized16 ? "quantized16"
+                                                    : "float32",
+      reader.chunkSize);
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  // First step: peak memory while loading it versus what it ends up as
+  Stats load;
+  uint64_t compressedBytes = 0, rawBytes = 0;
+  const size_t peakBefore = peakResidentBytes();
+  anari::Geometry geometry = nullptr;
+  Timer loadTimer;
+  auto world = newChunkedSphereWorld(device, reader, 0, &geometry);
+  load.add(loadTimer.elapsedMs());
+  const size_t peakAfter = peakResidentBytes();
+  if (!world) {
+    fprintf(stderr, "could not read step 0 of '%s'\n", fileName.c_str());
+    anari::release(device, device);
+    anari::unloadLibrary(library);
+    return 1;
+  }
+  reader.stepBytes(0, compressedBytes, rawBytes);
+
+  addSampleLight(device, world);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  uint2 imageSize = {800, 800};
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  Stats frameTime;
+  for (uint32_t t = 0; t < reader.numSteps; t++) {
+    if (t > 0) {
+      Timer timer;
+      if (!setChunkedSphereArrays(device, geometry, reader, t))
+        fprintf(stderr, "could not read step %u\n", t);
+      anari::commitParameters(device, geometry);
+      load.add(timer.elapsedMs());
+
+      uint64_t c, r;
+      reader.stepBytes(t, c, r);
+      compressedBytes += c;
+      rawBytes += r;
+    }
+
+    if (render) {
+      Timer timer;
+      anari::render(device, frame);
+      anari::wait(device, frame);
+      frameTime.add(timer.elapsedMs());
+    }
+  }
+
+  printf("playback (%u threads):\n", numThreads());
+  load.print("  load step");
+  if (render)
+    frameTime.print("  render");
+  const double loadSeconds = std::max(1e-9, load.sum() * 1e-3);
+  printf("  => %.0fMB/s read, %.0fMB/s decompressed\n",
+      compressedBytes / 1048576.0 / loadSeconds,
+      rawBytes / 1048576.0 / loadSeconds);
+  printf("  %-22s %10.1fMB\n", "final arrays", arrayBytes / 1048576.0);
+  printf("  %-22s %10.1fMB\n",
+      "peak growth on load",
+      (peakAfter > peakBefore ? peakAfter - peakBefore : 0) / 1048576.0);
+
+  anari::release(device, geometry);
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
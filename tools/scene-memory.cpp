@@ -0,0 +1,262 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Page fault and build cost of very large sphere scenes (SceneMemory.h).
+// The baseline generates into std::vectors, which are zeroed page by page
+// by the main thread, and copies them into device-owned arrays. The other
+// runs generate into application-owned mappings backed by base, transparent
+// huge or explicit huge pages, first touched by workers pinned per NUMA
+// node, and share them with the device:
+//
+//   scene-memory [--spheres 100000000] [--pages base,thp,hugetlb] [--no-pin]
+//
+// Explicit huge pages have to be reserved first, e.g. for 100M spheres:
+//
+//   sysctl vm.nr_hugepages=1000
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Parallel.h"
+#include "Scene.h"
+#include "SceneMemory.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// AnonHugePages of this process, i.e., memory backed by transparent huge
+// pages (0 if unknown)
+static size_t transparentHugeBytes()
+{
+  FILE *fp = fopen("/proc/self/smaps_rollup", "r");
+  if (!fp)
+    return 0;
+  char line[256];
+  size_t kb = 0;
+  while (fgets(line, sizeof(line), fp)) {
+    if (!std::strncmp(line, "AnonHugePages:", 14)) {
+      kb = std::strtoull(line + 14, nullptr, 10);
+      break;
+    }
+  }
+  fclose(fp);
+  return kb * 1024;
+}
+
+struct Phase
+{
+  double ms{0.0};
+  PageFaults faults;
+};
+
+// Times 'func' and counts the page faults it causes
+template <typename Func>
+static Phase measurePhase(Func &&func)
+{
+  Phase phase;
+  const PageFaults before = pageFaults();
+  Timer timer;
+  func();
+  phase.ms = timer.elapsedMs();
+  const PageFaults after = pageFaults();
+  phase.faults.minor = after.minor - before.minor;
+  phase.faults.major = after.major - before.major;
+  return phase;
+}
+
+static void printPhase(const char *name, const Phase &p)
+{
+  printf("  %-22s %10.2fms %12ld minor %6ld major faults\n",
+      name,
+      p.ms,
+      p.faults.minor,
+      p.faults.major);
+}
+
+int main(int argc, char *argv[])
+{
+  size_t numSpheres = 100000000;
+  std::vector<PageMode> pageModes = {
+      PageMode::Base, PageMode::Transparent, PageMode::Explicit};
+  bool pinned = true;
+  bool runVector = true;
+  bool render = true;
+  int numFrames = 3;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--spheres") && i + 1 < argc)
+      numSpheres = std::max<size_t>(1, std::strtoull(argv[++i], nullptr, 10));
+    else if (!std::strcmp(argv[i], "--pages") && i + 1 < argc) {
+      pageModes.clear();
+      for (char *tok = std::strtok(argv[++i], ","); tok;
+           tok = std::strtok(nullptr, ",")) {
+        PageMode mode;
+        if (!parsePageMode(tok, mode)) {
+          fprintf(stderr, "unknown page mode '%s'\n", tok);
+          return 1;
+        }
+        pageModes.push_back(mode);
+      }
+    } else if (!std::strcmp(argv[i], "--no-pin"))
+      pinned = false;
+    else if (!std::strcmp(argv[i], "--no-vector"))
+      runVector = false;
+    else if (!std::strcmp(argv[i], "--no-render"))
+      render = false;
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--spheres n] [--pages base,thp,hugetlb] [--no-pin] "
+          "[--no-vector] [--no-render] [-n frames] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  if (numSpheres > maxSceneSpheres) {
+    fprintf(stderr, "at most %zu spheres are supported\n", maxSceneSpheres);
+    return 1;
+  }
+
+  const auto &nodes = numaNodes();
+  printf("%zu spheres (%.1fMB), %u threads on %zu NUMA node(s)\n",
+      numSpheres,
+      numSpheres * (sizeof(float3) + sizeof(float) + sizeof(uint32_t))
+          / 1048576.0,
+      numThreads(),
+      nodes.size());
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  uint2 imageSize = {800, 800};
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+
+  const float3 pos(1.5f, 1.5f, 0.f);
+
+  // Build world and light, render, report; consumes the world
+  auto finish = [&](const char *name,
+                    const Phase &generate,
+                    size_t hugeBytes,
+                    anari::World world,
+                    const Phase &commit) {
+    addSampleLight(device, world);
+
+    Phase firstFrame;
+    Stats frames;
+    if (render) {
+      anari::setParameter(device, frame, "world", world);
+      anari::commitParameters(device, frame);
+      // Devices typically build their acceleration structures lazily
+      firstFrame = measurePhase([&] {
+        anari::render(device, frame);
+        anari::wait(device, frame);
+      });
+      for (int i = 0; i < numFrames; i++) {
+        Timer timer;
+        anari::render(device, frame);
+        anari::wait(device, frame);
+        frames.add(timer.elapsedMs());
+      }
+      anari::unsetParameter(device, frame, "world");
+      anari::commitParameters(device, frame);
+    }
+    anari::release(device, world);
+
+    printf("%s:\n", name);
+    printPhase("generate", generate);
+    printPhase("world build + commit", commit);
+    if (render) {
+      printPhase("first frame", firstFrame);
+      frames.print("  render");
+    }
+    printf("  %-22s %10.1fMB\n", "transparent huge", hugeBytes / 1048576.0);
+    printf("  %-22s %10.2fms\n",
+        "=> build total",
+        generate.ms + commit.ms + firstFrame.ms);
+  };
+
+  // Baseline: std::vector + device-owned copy //
+
+  if (runVector) {
+    SphereData spheres;
+    const Phase generate = measurePhase([&] {
+      spheres.positions.resize(numSpheres);
+      spheres.distances.resize(numSpheres);
+      spheres.indices.resize(numSpheres);
+      parallelFor(numSphereBlocks(numSpheres), [&](size_t begin, size_t end) {
+        fillSphereBlocks(pos,
+            numSpheres,
+            begin,
+            end,
+            spheres.positions.data(),
+            spheres.distances.data(),
+            spheres.indices.data());
+      });
+    });
+    const size_t hugeBytes = transparentHugeBytes();
+    anari::World world = nullptr;
+    const Phase commit =
+        measurePhase([&] { world = newSphereWorld(device, spheres); });
+    spheres = SphereData();
+    finish("std::vector, copied", generate, hugeBytes, world, commit);
+  }
+
+  // Application-owned arrays //
+
+  for (PageMode mode : pageModes) {
+    SceneArrays arrays;
+    bool ok = false;
+    const Phase generate = measurePhase([&] {
+      ok = generateSceneArrays(pos, numSpheres, mode, pinned, arrays);
+    });
+    if (!ok) {
+      fprintf(stderr, "%s: allocation failed\n", pageModeName(mode));
+      continue;
+    }
+    const size_t hugeBytes = transparentHugeBytes();
+    const std::string name = std::string(pageModeName(arrays.positions->mode))
+        + " pages, shared" + (pinned ? ", NUMA first touch" : "");
+    anari::World world = nullptr;
+    const Phase commit =
+        measurePhase([&] { world = newSharedSphereWorld(device, arrays); });
+    finish(name.c_str(), generate, hugeBytes, world, commit);
+  }
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
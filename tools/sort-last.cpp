@@ -0,0 +1,456 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Sort-last rendering on one machine: the spheres of the test scene are
+// partitioned across K worker processes which each render the same off-axis
+// view (Strategy 2) with color and depth channels. The partial images are
+// then depth-composited, either by binary-swap exchange between the workers
+// or by the host process:
+//
+//   sort-last -k 4 [--host-compositing] [-o sortlast.png]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// posix
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <unistd.h>
+// std
+#include <algorithm>
+#include <cerrno>
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Compositing.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// ========================================================
+// Barrier between the host and its workers, built on one
+//  pipe pair per worker: workers report arrival, the host
+//  releases them. After fork() every process closes the
+//  ends it does not use, so a worker that dies shows up
+//  as end-of-file on its pipe to the host, and a host
+//  that dies as end-of-file on the workers' pipes.
+// ========================================================
+struct ProcessBarrier
+{
+  ~ProcessBarrier()
+  {
+    closeAll();
+  }
+
+  bool init(int numWorkers)
+  {
+    fds.assign(4 * numWorkers, -1);
+    for (int i = 0; i < numWorkers; i++) {
+      if (pipe(&fds[4 * i + toHostRead]) != 0
+          || pipe(&fds[4 * i + toWorkerRead]) != 0)
+        return false;
+    }
+    return true;
+  }
+
+  // In worker 'rank' after fork(): keep its own two ends only
+  void attachWorker(int rank)
+  {
+    for (size_t i = 0; i < fds.size(); i++) {
+      const bool own = int(i / 4) == rank
+          && (i % 4 == toHostWrite || i % 4 == toWorkerRead);
+      if (!own)
+        closeFd(i);
+    }
+  }
+
+  // In the host once all workers were forked
+  void attachHost()
+  {
+    for (size_t i = 0; i < fds.size(); i++) {
+      if (i % 4 == toHostWrite || i % 4 == toWorkerRead)
+        closeFd(i);
+    }
+  }
+
+  // Worker side: arrive and wait for the host to release; exits when the
+  // host went away
+  void arriveAndWait(int rank)
+  {
+    char c = char(rank);
+    if (!transfer(fds[4 * rank + toHostWrite], &c, true)
+        || !transfer(fds[4 * rank + toWorkerRead], &c, false))
+      _exit(1);
+  }
+
+  // Host side: wait until all workers arrived; false when one of them
+  // exited or the pipe failed
+  bool waitAll(int numWorkers)
+  {
+    char c;
+    for (int i = 0; i < numWorkers; i++) {
+      if (!transfer(fds[4 * i + toHostRead], &c, false))
+        return false;
+    }
+    return true;
+  }
+
+  bool releaseAll(int numWorkers)
+  {
+    char c = 1;
+    for (int i = 0; i < numWorkers; i++) {
+      if (!transfer(fds[4 * i + toWorkerWrite], &c, true))
+        return false;
+    }
+    return true;
+  }
+
+  // Host side on failure: the remaining workers see end-of-file and exit
+  void closeAll()
+  {
+    for (size_t i = 0; i < fds.size(); i++)
+      closeFd(i);
+  }
+
+ private:
+  enum : size_t
+  {
+    toHostRead,
+    toHostWrite,
+    toWorkerRead,
+    toWorkerWrite
+  };
+
+  // One byte; end-of-file and errors other than EINTR are failures
+  static bool transfer(int fd, char *c, bool write)
+  {
+    for (;;) {
+      const ssize_t n = write ? ::write(fd, c, 1) : ::read(fd, c, 1);
+      if (n == 1)
+        return true;
+      if (n < 0 && errno == EINTR)
+        continue;
+      return false;
+    }
+  }
+
+  void closeFd(size_t i)
+  {
+    if (fds[i] >= 0)
+      close(fds[i]);
+    fds[i] = -1;
+  }
+
+  std::vector<int> fds; // per worker, indexed as in the enum above
+};
+
+// Waits for all workers and reports the ones that did not exit cleanly;
+// returns whether all did
+static bool reapWorkers(const std::vector<pid_t> &workers)
+{
+  bool ok = true;
+  for (size_t i = 0; i < workers.size(); i++) {
+    int status = 0;
+    if (waitpid(workers[i], &status, 0) != workers[i]) {
+      fprintf(stderr, "worker %zu: waitpid failed\n", i);
+      ok = false;
+    } else if (WIFSIGNALED(status)) {
+      fprintf(stderr,
+          "worker %zu: killed by signal %d\n",
+          i,
+          WTERMSIG(status));
+      ok = false;
+    } else if (WIFEXITED(status) && WEXITSTATUS(status) != 0) {
+      fprintf(stderr,
+          "worker %zu: exited with status %d\n",
+          i,
+          WEXITSTATUS(status));
+      ok = false;
+    }
+  }
+  return ok;
+}
+
+struct WorkerStats
+{
+  size_t numSpheres;
+  double renderMs;
+  double compositeMs;
+};
+
+static const uint2 imageSize = {800, 800};
+
+static bool runWorker(int rank,
+    int numWorkers,
+    bool binarySwap,
+    std::vector<DepthLayer> &layers,
+    WorkerStats *stats,
+    ProcessBarrier &barrier)
+{
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  // Setup ANARI device and this worker's part of the scene //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice("environment", library);
+  if (!device)
+    return false;
+
+  auto spheres = partitionSpheres(
+      generateSpheres(float3(1.5f, 1.5f, 0.f)), rank, numWorkers);
+  auto world = newSphereWorld(device, spheres);
+  stats[rank].numSpheres = spheres.positions.size();
+
+  addSampleLight(device, world);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "channel.depth", ANARI_FLOAT32);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  // Render and publish color + depth to shared memory //
+
+  Timer timer;
+  anari::render(device, frame);
+  anari::wait(device, frame);
+  stats[rank].renderMs = timer.elapsedMs();
+
+  // A device without the depth channel, or one that renders a different
+  //  size, can't be composited; failing here makes the host abort the run
+  bool mapped = true;
+  auto color = anari::map<uint32_t>(device, frame, "channel.color");
+  if (color.data && size_t(color.width) * color.height == numPixels) {
+    std::memcpy(layers[rank].color, color.data, numPixels * sizeof(uint32_t));
+  } else {
+    fprintf(stderr, "worker %d: could not map channel.color\n", rank);
+    mapped = false;
+  }
+  anari::unmap(device, frame, "channel.color");
+  auto depth = anari::map<float>(device, frame, "channel.depth");
+  if (depth.data && size_t(depth.width) * depth.height == numPixels) {
+    std::memcpy(layers[rank].depth, depth.data, numPixels * sizeof(float));
+  } else {
+    fprintf(stderr, "worker %d: could not map channel.depth\n", rank);
+    mapped = false;
+  }
+  anari::unmap(device, frame, "channel.depth");
+
+  if (!mapped) {
+    anari::release(device, camera);
+    anari::release(device, renderer);
+    anari::release(device, world);
+    anari::release(device, frame);
+    anari::release(device, device);
+    anari::unloadLibrary(library);
+    return false;
+  }
+
+  barrier.arriveAndWait(rank);
+
+  // Binary-swap exchange //
+
+  if (binarySwap) {
+    const int P = binarySwapNumRanks(numWorkers);
+    timer.reset();
+    if (rank < numWorkers - P) {
+      const auto &extra = layers[rank + P];
+      depthCompositeRange(layers[rank].color,
+          layers[rank].depth,
+          extra.color,
+          extra.depth,
+          0,
+          numPixels);
+    }
+    barrier.arriveAndWait(rank);
+
+    for (int round = 0; round < binarySwapNumRounds(numWorkers); round++) {
+      if (rank < P)
+        binarySwapRound(layers, rank, round, numPixels);
+      barrier.arriveAndWait(rank);
+    }
+    stats[rank].compositeMs = timer.elapsedMs();
+  }
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+  anari::unloadLibrary(library);
+  return true;
+}
+
+int main(int argc, char *argv[])
+{
+  int numWorkers = 4;
+  bool binarySwap = true;
+  std::string outFile = "sortlast.png";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-k") && i + 1 < argc)
+      numWorkers = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--host-compositing"))
+      binarySwap = false;
+    else if (!std::strcmp(argv[i], "-o") && i + 1 < argc)
+      outFile = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [-k workers] [--host-compositing] [-o file.png]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  // Shared memory for all layers plus stats, mapped before forking //
+
+  const size_t layerBytes = numPixels * (sizeof(uint32_t) + sizeof(float));
+  const size_t sharedBytes =
+      numWorkers * layerBytes + numWorkers * sizeof(WorkerStats);
+  auto *shared = (uint8_t *)mmap(nullptr,
+      sharedBytes,
+      PROT_READ | PROT_WRITE,
+      MAP_SHARED | MAP_ANONYMOUS,
+      -1,
+      0);
+  if (shared == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+
+  std::vector<DepthLayer> layers(numWorkers);
+  for (int i = 0; i < numWorkers; i++) {
+    uint8_t *base = shared + i * layerBytes;
+    layers[i].color = (uint32_t *)base;
+    layers[i].depth = (float *)(base + numPixels * sizeof(uint32_t));
+  }
+  auto *stats = (WorkerStats *)(shared + numWorkers * layerBytes);
+
+  // A worker that went away must not kill the host when it is released
+  signal(SIGPIPE, SIG_IGN);
+
+  ProcessBarrier barrier;
+  if (!barrier.init(numWorkers)) {
+    perror("pipe");
+    return 1;
+  }
+
+  std::vector<pid_t> workers;
+  for (int rank = 0; rank < numWorkers; rank++) {
+    pid_t pid = fork();
+    if (pid == 0) {
+      barrier.attachWorker(rank);
+      const bool ok =
+          runWorker(rank, numWorkers, binarySwap, layers, stats, barrier);
+      _exit(ok ? 0 : 1);
+    } else if (pid < 0) {
+      perror("fork");
+      barrier.closeAll();
+      reapWorkers(workers);
+      return 1;
+    }
+    workers.push_back(pid);
+  }
+  barrier.attachHost();
+
+  // Drive the barriers and composite //
+
+  Timer total;
+  bool ok = barrier.waitAll(numWorkers);
+  const double renderDoneMs = total.elapsedMs();
+
+  std::vector<uint32_t> image(numPixels);
+  std::vector<float> imageDepth(numPixels);
+  DepthLayer out{image.data(), imageDepth.data()};
+
+  Timer timer;
+  if (ok && binarySwap) {
+    // Fold, then one step per round
+    for (int step = 0; ok && step <= binarySwapNumRounds(numWorkers); step++)
+      ok = barrier.releaseAll(numWorkers) && barrier.waitAll(numWorkers);
+    const double exchangeMs = timer.elapsedMs();
+
+    // Gather the final pieces
+    timer.reset();
+    const int P = binarySwapNumRanks(numWorkers);
+    const int rounds = binarySwapNumRounds(numWorkers);
+    for (int rank = 0; ok && rank < P; rank++) {
+      size_t begin, end;
+      binarySwapRange(rank, rounds, numPixels, begin, end);
+      std::copy(layers[rank].color + begin,
+          layers[rank].color + end,
+          image.begin() + begin);
+    }
+    if (ok) {
+      printf("binary-swap exchange: %fms (%d rounds), gather: %fms\n",
+          exchangeMs,
+          rounds,
+          timer.elapsedMs());
+    }
+  } else if (ok) {
+    depthCompositeLayers(layers, out, numPixels);
+    printf("host compositing of %d layers (%u threads, %s): %fms\n",
+        numWorkers,
+        numThreads(),
+        hostIsaName(hostIsa()),
+        timer.elapsedMs());
+  }
+  if (ok)
+    ok = barrier.releaseAll(numWorkers);
+  else
+    barrier.closeAll();
+
+  if (!reapWorkers(workers) || !ok) {
+    fprintf(stderr, "a worker failed, no image written\n");
+    munmap(shared, sharedBytes);
+    return 1;
+  }
+
+  for (int i = 0; i < numWorkers; i++) {
+    printf("worker %d: rendered %zu spheres in %fms",
+        i,
+        stats[i].numSpheres,
+        stats[i].renderMs);
+    if (binarySwap)
+      printf(", compositing %fms", stats[i].compositeMs);
+    printf("\n");
+  }
+  printf("all workers done after %fms, total %fms\n",
+      renderDoneMs,
+      total.elapsedMs());
+
+  stbi_flip_vertically_on_write(1);
+  stbi_write_png(outFile.c_str(),
+      imageSize.x,
+      imageSize.y,
+      4,
+      image.data(),
+      4 * imageSize.x);
+  printf("Output: %s\n", outFile.c_str());
+
+  munmap(shared, sharedBytes);
+
+  return 0;
+}
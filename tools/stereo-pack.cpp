@@ -0,0 +1,181 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Renders both eyes of a tracked viewer with Strategy 2 and packs them into
+// the stereo layouts in Stereo.h. Each eye is rendered at the resolution it
+// occupies in the packed image, and packing reads straight from the mapped
+// frames; the time of the alternative (copy both eyes out, then pack) is
+// reported for comparison:
+//
+//   stereo-pack [--format sbs|tb|rows|columns|anaglyph|all] [--size w h]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Scene.h"
+#include "Stereo.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+static anari::Frame newEyeFrame(anari::Device device,
+    anari::World world,
+    anari::Renderer renderer,
+    anari::Camera camera,
+    uint2 size)
+{
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", size);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+  return frame;
+}
+
+int main(int argc, char *argv[])
+{
+  std::vector<StereoFormat> formats;
+  uint2 outSize = {1600, 800};
+  float ipd = 0.065f;
+  int numIterations = 100;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    StereoFormat f;
+    if (!std::strcmp(argv[i], "--format") && i + 1 < argc) {
+      if (!std::strcmp(argv[++i], "all"))
+        formats.clear();
+      else if (parseStereoFormat(argv[i], f))
+        formats.push_back(f);
+      else {
+        fprintf(stderr, "unknown stereo format '%s'\n", argv[i]);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--size") && i + 2 < argc) {
+      outSize.x = std::max(2, std::atoi(argv[++i]));
+      outSize.y = std::max(2, std::atoi(argv[++i]));
+    } else if (!std::strcmp(argv[i], "--ipd") && i + 1 < argc)
+      ipd = float(std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numIterations = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--format name|all] [--size w h] [--ipd m] "
+          "[-n iterations] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (formats.empty()) {
+    for (int i = 0; i <= int(StereoFormat::Anaglyph); i++)
+      formats.push_back(StereoFormat(i));
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 head(1.5f, 1.68f, 1.5f);
+
+  float3 leftEye, rightEye;
+  stereoEyes(LL, LR, head, ipd, leftEye, rightEye);
+
+  auto leftCamera = newStrategyCamera(device, Strategy::FixedFrame);
+  auto rightCamera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device, leftCamera, LL, LR, UR, leftEye);
+  setFixedFrameCameraParameters(device, rightCamera, LL, LR, UR, rightEye);
+
+  for (StereoFormat format : formats) {
+    const uint2 eyeSize = stereoEyeSize(format, outSize);
+    const uint2 packedSize = stereoPackedSize(format, eyeSize);
+    const size_t eyePixels = size_t(eyeSize.x) * eyeSize.y;
+
+    auto left = newEyeFrame(device, world, renderer, leftCamera, eyeSize);
+    auto right = newEyeFrame(device, world, renderer, rightCamera, eyeSize);
+
+    Timer timer;
+    anari::render(device, left);
+    anari::render(device, right);
+    anari::wait(device, left);
+    anari::wait(device, right);
+    const double renderMs = timer.elapsedMs();
+
+    std::vector<uint32_t> packed(size_t(packedSize.x) * packedSize.y);
+    std::vector<uint32_t> leftCopy(eyePixels), rightCopy(eyePixels);
+    Stats direct, copyThenPack;
+
+    auto l = anari::map<uint32_t>(device, left, "channel.color");
+    auto r = anari::map<uint32_t>(device, right, "channel.color");
+    for (int i = 0; i < numIterations; i++) {
+      timer.reset();
+      packStereo(format, l.data, r.data, eyeSize, packed.data());
+      direct.add(timer.elapsedMs());
+
+      timer.reset();
+      std::memcpy(leftCopy.data(), l.data, eyePixels * sizeof(uint32_t));
+      std::memcpy(rightCopy.data(), r.data, eyePixels * sizeof(uint32_t));
+      packStereo(
+          format, leftCopy.data(), rightCopy.data(), eyeSize, packed.data());
+      copyThenPack.add(timer.elapsedMs());
+    }
+    anari::unmap(device, left, "channel.color");
+    anari::unmap(device, right, "channel.color");
+
+    printf("%s: eyes %ux%u, packed %ux%u, render both eyes %fms\n",
+        stereoFormatName(format),
+        eyeSize.x,
+        eyeSize.y,
+        packedSize.x,
+        packedSize.y,
+        renderMs);
+    direct.print("  pack from frames");
+    copyThenPack.print("  copy, then pack");
+
+    const std::string fileName =
+        std::string("stereo-") + stereoFormatName(format) + ".png";
+    stbi_flip_vertically_on_write(1);
+    stbi_write_png(fileName.c_str(),
+        packedSize.x,
+        packedSize.y,
+        4,
+        packed.data(),
+        4 * packedSize.x);
+    printf("  Output: %s\n", fileName.c_str());
+
+    anari::release(device, left);
+    anari::release(device, right);
+  }
+
+  anari::release(device, leftCamera);
+  anari::release(device, rightCamera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,303 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Streams rendered frames to a thin client over TCP: each mapped color
+// buffer is split into tiles, tiles changed since the previous frame are
+// delta-encoded and LZ-compressed (Streaming.h), and sent to a client on
+// the loopback interface which decodes them into its own framebuffer and
+// acknowledges every frame. Reports bandwidth and the latency added by
+// encoding, transfer and decoding while the tracked eye moves:
+//
+//   stream-frames -n 300 [--tile 64] [--library name]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// posix
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "Scene.h"
+#include "Streaming.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// ========================================================
+// Blocking socket helpers
+// ========================================================
+
+static bool sendAll(int fd, const void *data, size_t size)
+{
+  const uint8_t *p = (const uint8_t *)data;
+  while (size > 0) {
+    const ssize_t n = send(fd, p, size, 0);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+static bool recvAll(int fd, void *data, size_t size)
+{
+  uint8_t *p = (uint8_t *)data;
+  while (size > 0) {
+    const ssize_t n = recv(fd, p, size, 0);
+    if (n <= 0)
+      return false;
+    p += n;
+    size -= size_t(n);
+  }
+  return true;
+}
+
+static void setNoDelay(int fd)
+{
+  int one = 1;
+  setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// ========================================================
+// Thin client: applies received deltas and acks each frame
+// ========================================================
+
+struct Client
+{
+  void run(uint16_t port)
+  {
+    const int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      perror("client connect");
+      if (fd >= 0)
+        close(fd);
+      failed = true;
+      return;
+    }
+    setNoDelay(fd);
+
+    std::vector<uint8_t> msg;
+    for (;;) {
+      uint32_t size = 0;
+      if (!recvAll(fd, &size, sizeof(size)) || size == 0)
+        break;
+      msg.resize(size);
+      if (!recvAll(fd, msg.data(), size))
+        break;
+
+      Timer timer;
+      uint32_t frameID = 0;
+      if (!decodeFrameDelta(
+              msg.data(), size, fb.data(), width, height, frameID)) {
+        failed = true;
+        break;
+      }
+      decode.add(timer.elapsedMs());
+
+      if (!sendAll(fd, &frameID, sizeof(frameID)))
+        break;
+    }
+    close(fd);
+  }
+
+  uint32_t width{0}, height{0};
+  std::vector<uint32_t> fb;
+  Stats decode;
+  bool failed{false};
+};
+
+int main(int argc, char *argv[])
+{
+  int numFrames = 300;
+  uint32_t tileSize = 64;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::atoi(argv[++i]);
+    else if (!std::strcmp(argv[i], "--tile") && i + 1 < argc)
+      tileSize = std::max(8, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [-n frames] [--tile size] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  uint2 imageSize = {800, 800};
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  // Start the server and connect the loopback client //
+
+  const int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_port = 0; // ephemeral
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  socklen_t addrLen = sizeof(addr);
+  if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0
+      || listen(listenFd, 1) != 0
+      || getsockname(listenFd, (sockaddr *)&addr, &addrLen) != 0) {
+    perror("server socket");
+    return 1;
+  }
+
+  Client client;
+  client.width = imageSize.x;
+  client.height = imageSize.y;
+  client.fb.resize(size_t(imageSize.x) * imageSize.y, 0u);
+  std::thread clientThread([&] { client.run(ntohs(addr.sin_port)); });
+
+  const int fd = accept(listenFd, nullptr, nullptr);
+  if (fd < 0) {
+    perror("accept");
+    // Resets a pending connection, so the client returns
+    close(listenFd);
+    clientThread.join();
+    return 1;
+  }
+  setNoDelay(fd);
+
+  // Stream frames under a moving eye //
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  // The client rejects tiles larger than the image
+  tileSize = std::min(tileSize, std::max(imageSize.x, imageSize.y));
+  TileGrid grid(imageSize.x, imageSize.y, tileSize);
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+  std::vector<uint32_t> prev(numPixels, 0u); // the client starts out black
+  std::vector<uint8_t> msg;
+
+  Stats encode, transfer, added, frameMs, kbPerFrame, tilesPerFrame;
+  size_t totalBytes = 0;
+  bool ok = true;
+
+  Timer streamTimer;
+  for (int i = 0; i < numFrames && ok; i++) {
+    const float t = i * 0.05f;
+    const float3 e =
+        eye + float3(0.2f * std::sin(t), 0.1f * std::cos(0.7f * t), 0.f);
+
+    Timer frameTimer;
+    setStrategyCameraParameters(
+        device, camera, Strategy::FixedFrame, LL, LR, UR, e);
+    anari::render(device, frame);
+    anari::wait(device, frame);
+
+    auto fb = anari::map<uint32_t>(device, frame, "channel.color");
+    if (!fb.data || fb.width != imageSize.x || fb.height != imageSize.y) {
+      fprintf(stderr, "could not map channel.color\n");
+      anari::unmap(device, frame, "channel.color");
+      ok = false;
+      break;
+    }
+
+    Timer timer;
+    const uint32_t numTiles =
+        encodeFrameDelta(grid, uint32_t(i), fb.data, prev.data(), msg);
+    const double encodeMs = timer.elapsedMs();
+    std::copy(fb.data, fb.data + numPixels, prev.begin());
+    anari::unmap(device, frame, "channel.color");
+
+    timer.reset();
+    uint32_t size = uint32_t(msg.size()), ack = ~0u;
+    ok = sendAll(fd, &size, sizeof(size)) && sendAll(fd, msg.data(), size)
+        && recvAll(fd, &ack, sizeof(ack)) && ack == uint32_t(i);
+    const double transferMs = timer.elapsedMs();
+
+    encode.add(encodeMs);
+    transfer.add(transferMs);
+    added.add(encodeMs + transferMs);
+    frameMs.add(frameTimer.elapsedMs());
+    kbPerFrame.add((sizeof(size) + msg.size()) / 1024.0);
+    tilesPerFrame.add(numTiles);
+    totalBytes += sizeof(size) + msg.size();
+  }
+  const double streamSeconds = streamTimer.elapsedMs() / 1000.0;
+
+  const uint32_t done = 0;
+  sendAll(fd, &done, sizeof(done));
+  clientThread.join();
+  close(fd);
+  close(listenFd);
+
+  // Report //
+
+  if (!ok || client.failed)
+    fprintf(stderr, "streaming failed after %zu frames\n", encode.count());
+
+  const bool match = client.fb == prev;
+  const double rawKB = numPixels * sizeof(uint32_t) / 1024.0;
+  printf("%zu frames, %ux%u, %ux%u tiles (%u per frame)\n",
+      encode.count(),
+      imageSize.x,
+      imageSize.y,
+      tileSize,
+      tileSize,
+      grid.numTiles());
+  tilesPerFrame.print("  tiles sent", "");
+  kbPerFrame.print("  KB per frame", "KB");
+  printf("  raw frame %.1fKB, compression ratio %.1f:1\n",
+      rawKB,
+      kbPerFrame.mean() > 0.0 ? rawKB / kbPerFrame.mean() : 0.0);
+  printf("  bandwidth %.2f MB/s at %.1f frames/s\n",
+      totalBytes / (1024.0 * 1024.0) / streamSeconds,
+      frameMs.mean() > 0.0 ? 1000.0 / frameMs.mean() : 0.0);
+  encode.print("  encode");
+  transfer.print("  send + decode + ack");
+  client.decode.print("  client decode");
+  added.print("  added latency");
+  frameMs.print("  frame total");
+  printf("  client framebuffer %s\n", match ? "matches" : "DIFFERS");
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return match && ok && !client.failed ? 0 : 1;
+}
@@ -0,0 +1,220 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Renders low sample count frames while the tracked eye moves and
+// accumulates them over time, reprojecting the history with the previous
+// and current off-axis matrices (TemporalAccumulation.h). Every few frames
+// the result is compared against a high sample count render from the same
+// eye position:
+//
+//   temporal [-n frames] [--spp 1] [--reference-spp 32] [--check-every 10]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Scene.h"
+#include "Strategies.h"
+#include "TemporalAccumulation.h"
+#include "Timing.h"
+#include "ToneMapping.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+int main(int argc, char *argv[])
+{
+  int numFrames = 60;
+  int spp = 1;
+  int referenceSpp = 32;
+  int checkEvery = 10;
+  TemporalParams params;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--spp") && i + 1 < argc)
+      spp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--reference-spp") && i + 1 < argc)
+      referenceSpp = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--check-every") && i + 1 < argc)
+      checkEvery = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--max-history") && i + 1 < argc)
+      params.maxHistory = std::max(1.f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [-n frames] [--spp n] [--reference-spp n] "
+          "[--check-every n] [--max-history n] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  anari::Extensions extensions =
+      anari::extension::getInstanceExtensionStruct(device, device);
+  if (!extensions.ANARI_KHR_FRAME_CHANNEL_DEPTH) {
+    fprintf(stderr, "device does not support ANARI_KHR_FRAME_CHANNEL_DEPTH\n");
+    return 1;
+  }
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device, spp);
+  auto referenceRenderer = newSampleRenderer(device, referenceSpp);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_FLOAT32_VEC4);
+  anari::setParameter(device, frame, "channel.depth", ANARI_FLOAT32);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+  anari::setParameter(device, frame, "camera", camera);
+  anari::commitParameters(device, frame);
+
+  auto referenceFrame = anari::newObject<anari::Frame>(device);
+  anari::setParameter(device, referenceFrame, "size", imageSize);
+  anari::setParameter(
+      device, referenceFrame, "channel.color", ANARI_FLOAT32_VEC4);
+  anari::setParameter(device, referenceFrame, "world", world);
+  anari::setParameter(device, referenceFrame, "renderer", referenceRenderer);
+  anari::setParameter(device, referenceFrame, "camera", camera);
+  anari::commitParameters(device, referenceFrame);
+
+  // Render loop under a moving eye //
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  float3 eye(1.5f, 1.68f, 1.5f);
+
+  TemporalHistory history;
+  std::vector<float> accumulated(numPixels * 4);
+  std::vector<uint32_t> raw(numPixels), image(numPixels), reference(numPixels);
+  ToneMapParams encode;
+
+  Stats render, accumulate, rejected, referenceRender;
+
+  printf("%6s %10s %12s %12s\n", "frame", "rejected", "raw RMSE", "acc RMSE");
+  for (int i = 0; i < numFrames; i++) {
+    const float t = i * 0.05f;
+    const float3 e =
+        eye + float3(0.2f * std::sin(t), 0.1f * std::cos(0.7f * t), 0.f);
+
+    mat4 proj, view;
+    offaxisStereoTransform(LL, LR, UR, e, proj, view);
+    setFixedFrameCameraParameters(device, camera, LL, LR, UR, e);
+
+    Timer timer;
+    anari::render(device, frame);
+    anari::wait(device, frame);
+    render.add(timer.elapsedMs());
+
+    auto color = anari::map<float4>(device, frame, "channel.color");
+    auto depth = anari::map<float>(device, frame, "channel.depth");
+
+    timer.reset();
+    const float rejectedFraction = temporalAccumulate(history,
+        params,
+        (const float *)color.data,
+        depth.data,
+        imageSize,
+        e,
+        proj,
+        view,
+        accumulated.data());
+    accumulate.add(timer.elapsedMs());
+    rejected.add(100.0 * rejectedFraction);
+
+    const bool check = (i + 1) % checkEvery == 0 || i + 1 == numFrames;
+    if (check) {
+      toneMapImage(encode,
+          (const float *)color.data,
+          raw.data(),
+          imageSize.x,
+          imageSize.y);
+    }
+
+    anari::unmap(device, frame, "channel.color");
+    anari::unmap(device, frame, "channel.depth");
+
+    if (check) {
+      timer.reset();
+      anari::render(device, referenceFrame);
+      anari::wait(device, referenceFrame);
+      referenceRender.add(timer.elapsedMs());
+
+      auto ref = anari::map<float4>(device, referenceFrame, "channel.color");
+      toneMapImage(encode,
+          (const float *)ref.data,
+          reference.data(),
+          imageSize.x,
+          imageSize.y);
+      anari::unmap(device, referenceFrame, "channel.color");
+
+      toneMapImage(encode,
+          accumulated.data(),
+          image.data(),
+          imageSize.x,
+          imageSize.y);
+      printf("%6d %9.2f%% %12.3f %12.3f\n",
+          i,
+          100.0 * rejectedFraction,
+          rmseRGBA8(raw, reference),
+          rmseRGBA8(image, reference));
+    }
+  }
+
+  printf("%d frames at %d spp, reference %d spp:\n",
+      numFrames,
+      spp,
+      referenceSpp);
+  render.print("  render");
+  accumulate.print("  accumulate");
+  rejected.print("  rejected history", "%");
+  referenceRender.print("  reference render");
+  printf("  => %.1fx cheaper per frame than the reference\n",
+      referenceRender.mean() / (render.mean() + accumulate.mean()));
+
+  stbi_flip_vertically_on_write(1);
+  stbi_write_png("temporal.png",
+      imageSize.x,
+      imageSize.y,
+      4,
+      image.data(),
+      4 * imageSize.x);
+  printf("Output: temporal.png\n");
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, referenceRenderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, referenceFrame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
@@ -0,0 +1,231 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Renders the off-axis view into an ANARI_FLOAT32_VEC4 color channel and
+// applies exposure, tone mapping and sRGB encoding on the host
+// (ToneMapping.h), compared against the device's own 8-bit sRGB output.
+// Several exposures can be applied to the same HDR frame, e.g. to match the
+// brightness of neighboring walls without re-rendering:
+//
+//   tonemap [--op none|reinhard|aces] [--exposure 1.0,1.2,...] [-n iters]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// stb_image
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include "stb_image_write.h"
+// ours
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "ToneMapping.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// Max and mean absolute difference of the RGB channels in 8-bit units
+static void compareImages(const std::vector<uint32_t> &a,
+    const std::vector<uint32_t> &b,
+    int &maxDiff,
+    double &meanDiff)
+{
+  maxDiff = 0;
+  double sum = 0.0;
+  for (size_t i = 0; i < a.size(); i++) {
+    for (int c = 0; c < 3; c++) {
+      const int d = std::abs(
+          int((a[i] >> (8 * c)) & 0xff) - int((b[i] >> (8 * c)) & 0xff));
+      maxDiff = std::max(maxDiff, d);
+      sum += d;
+    }
+  }
+  meanDiff = a.empty() ? 0.0 : sum / (3.0 * a.size());
+}
+
+int main(int argc, char *argv[])
+{
+  ToneMapOperator op = ToneMapOperator::Aces;
+  std::vector<float> exposures;
+  int numIterations = 100;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--op") && i + 1 < argc) {
+      const char *name = argv[++i];
+      bool found = false;
+      for (int o = 0; o <= int(ToneMapOperator::Aces) && !found; o++) {
+        if (!std::strcmp(name, toneMapOperatorName(ToneMapOperator(o)))) {
+          op = ToneMapOperator(o);
+          found = true;
+        }
+      }
+      if (!found) {
+        fprintf(stderr, "unknown tone mapping operator '%s'\n", name);
+        return 1;
+      }
+    } else if (!std::strcmp(argv[i], "--exposure") && i + 1 < argc) {
+      for (char *s = std::strtok(argv[++i], ","); s; s = std::strtok(0, ","))
+        exposures.push_back(float(std::atof(s)));
+    } else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numIterations = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--op none|reinhard|aces] [--exposure e,e,...] "
+          "[-n iterations] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+  if (exposures.empty())
+    exposures.push_back(1.f);
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto camera = newStrategyCamera(device, Strategy::FixedFrame);
+  setFixedFrameCameraParameters(device,
+      camera,
+      float3(0.f, 0.f, 0.f),
+      float3(3.f, 0.f, 0.f),
+      float3(3.f, 3.f, 0.f),
+      float3(1.5f, 1.68f, 1.5f));
+
+  uint2 imageSize = {800, 800};
+  const size_t numPixels = size_t(imageSize.x) * imageSize.y;
+
+  auto newFrame = [&](ANARIDataType colorType) {
+    auto frame = anari::newObject<anari::Frame>(device);
+    anari::setParameter(device, frame, "size", imageSize);
+    anari::setParameter(device, frame, "channel.color", colorType);
+    anari::setParameter(device, frame, "world", world);
+    anari::setParameter(device, frame, "renderer", renderer);
+    anari::setParameter(device, frame, "camera", camera);
+    anari::commitParameters(device, frame);
+    return frame;
+  };
+
+  // Device-side 8-bit output //
+
+  auto ldrFrame = newFrame(ANARI_UFIXED8_RGBA_SRGB);
+  Timer timer;
+  anari::render(device, ldrFrame);
+  anari::wait(device, ldrFrame);
+  const double ldrRenderMs = timer.elapsedMs();
+
+  timer.reset();
+  std::vector<uint32_t> deviceImage(numPixels);
+  {
+    auto fb = anari::map<uint32_t>(device, ldrFrame, "channel.color");
+    std::copy(fb.data, fb.data + numPixels, deviceImage.begin());
+    anari::unmap(device, ldrFrame, "channel.color");
+  }
+  const double ldrMapMs = timer.elapsedMs();
+
+  // Float output, tone mapped on the host //
+
+  auto hdrFrame = newFrame(ANARI_FLOAT32_VEC4);
+  timer.reset();
+  anari::render(device, hdrFrame);
+  anari::wait(device, hdrFrame);
+  const double hdrRenderMs = timer.elapsedMs();
+
+  timer.reset();
+  auto hdr = anari::map<float4>(device, hdrFrame, "channel.color");
+  const float *pixels = (const float *)hdr.data;
+  const double hdrMapMs = timer.elapsedMs();
+
+  printf("device 8-bit:  render %fms, map + copy %fms\n",
+      ldrRenderMs,
+      ldrMapMs);
+  printf("device float:  render %fms, map %fms (%u threads on host, %s)\n",
+      hdrRenderMs,
+      hdrMapMs,
+      numThreads(),
+      hostIsaName(hostIsa()));
+
+  // Exact encoding without tone mapping should reproduce the device output
+  std::vector<uint32_t> exact(numPixels), image(numPixels);
+  ToneMapParams params;
+  params.encode = SrgbEncode::Exact;
+  toneMapImage(params, pixels, exact.data(), imageSize.x, imageSize.y);
+  int maxDiff;
+  double meanDiff;
+  compareImages(exact, deviceImage, maxDiff, meanDiff);
+  printf("host exact sRGB vs device 8-bit: max diff %d, mean diff %.4f\n",
+      maxDiff,
+      meanDiff);
+
+  // Encoding variants //
+
+  params.op = op;
+  params.exposure = exposures[0];
+  params.encode = SrgbEncode::Exact;
+  toneMapImage(params, pixels, exact.data(), imageSize.x, imageSize.y);
+
+  printf("tone mapping '%s', exposure %.3f, %d iterations:\n",
+      toneMapOperatorName(op),
+      exposures[0],
+      numIterations);
+  for (int e = 0; e <= int(SrgbEncode::Polynomial); e++) {
+    params.encode = SrgbEncode(e);
+    Stats stats;
+    for (int i = 0; i < numIterations; i++) {
+      timer.reset();
+      toneMapImage(params, pixels, image.data(), imageSize.x, imageSize.y);
+      stats.add(timer.elapsedMs());
+    }
+    compareImages(image, exact, maxDiff, meanDiff);
+
+    char name[64];
+    snprintf(name, sizeof(name), "  %s", srgbEncodeName(params.encode));
+    stats.print(name);
+    printf("    vs exact: max diff %d, mean diff %.4f; %.1f Mpixel/s\n",
+        maxDiff,
+        meanDiff,
+        numPixels / (stats.mean() * 1000.0));
+  }
+
+  // Per-wall exposures from the same HDR frame //
+
+  params.encode = SrgbEncode::Polynomial;
+  stbi_flip_vertically_on_write(1);
+  for (size_t i = 0; i < exposures.size(); i++) {
+    params.exposure = exposures[i];
+    toneMapImage(params, pixels, image.data(), imageSize.x, imageSize.y);
+    const std::string fileName = "tonemap-" + std::to_string(i) + ".png";
+    stbi_write_png(fileName.c_str(),
+        imageSize.x,
+        imageSize.y,
+        4,
+        image.data(),
+        4 * imageSize.x);
+    printf("Output: %s (exposure %.3f)\n", fileName.c_str(), exposures[i]);
+  }
+
+  anari::unmap(device, hdrFrame, "channel.color");
+
+  anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, ldrFrame);
+  anari::release(device, hdrFrame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}
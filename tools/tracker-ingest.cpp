@@ -0,0 +1,344 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Stress test for tracker ingestion (TrackerInput.h): a writer publishes
+// head positions at tracker rates (or as fast as it can) while reader
+// threads fetch the latest pose, the recent history and a prediction at
+// render rate (or as fast as they can). Reports the readers' latency and how
+// old the pose they got was, for the seqlock mailbox and a mutex-protected
+// one under the same load, and end to end through a loopback UDP socket:
+//
+//   tracker-ingest [--rate 1000] [--render-rate 120] [--readers 2]
+//                  [--seconds 3] [--trace file]
+
+// posix
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// std
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// ours
+#include "Timing.h"
+#include "Tracker.h"
+#include "TrackerInput.h"
+
+using Clock = std::chrono::steady_clock;
+
+// Baseline: the same interface behind a mutex
+struct MutexMailbox
+{
+  void publish(const TrackerSample &s)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    value = s;
+    valid = true;
+  }
+
+  bool tryRead(TrackerSample &s) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    s = value;
+    return valid;
+  }
+
+  mutable std::mutex mutex;
+  TrackerSample value;
+  bool valid{false};
+};
+
+struct MutexRing
+{
+  static constexpr size_t size = TrackerReceiver::historySize;
+
+  void push(const TrackerSample &s)
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    samples[count++ % size] = s;
+  }
+
+  size_t recent(TrackerSample *out, size_t maxCount) const
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    const size_t n = std::min({maxCount, size_t(count), size});
+    for (size_t i = 0; i < n; i++)
+      out[i] = samples[(count - n + i) % size];
+    return n;
+  }
+
+  mutable std::mutex mutex;
+  TrackerSample samples[size];
+  uint64_t count{0};
+};
+
+// Keeps memory bounded when readers run flat out
+static constexpr size_t maxRecordedReads = 1 << 20;
+
+struct ReaderStats
+{
+  Stats latencyUs; // latest + history + prediction
+  Stats ageMs; // how old the latest pose was when read
+  uint64_t numReads{0};
+  uint64_t numMisses{0}; // no pose (yet, or writes kept interfering)
+};
+
+// Render-thread stand-in: reads at 'readRate' Hz (0: flat out) until
+// 'done' and records how long the read path took
+template <typename ReadLatest, typename ReadRecent>
+static void readerLoop(ReadLatest readLatest,
+    ReadRecent readRecent,
+    double readRate,
+    const std::atomic<bool> &done,
+    ReaderStats &stats)
+{
+  constexpr size_t historyLength = 8;
+  TrackerSample history[historyLength];
+  auto next = Clock::now();
+  while (!done) {
+    Timer timer;
+    TrackerSample s;
+    const bool ok = readLatest(s);
+    const size_t n = readRecent(history, historyLength);
+    volatile float sink =
+        predictPosition(history, n, trackerClock() + 1.0 / 120).x;
+    (void)sink;
+    const double us = timer.elapsedMs() * 1e3;
+
+    stats.numReads++;
+    if (!ok)
+      stats.numMisses++;
+    else if (stats.latencyUs.count() < maxRecordedReads) {
+      stats.latencyUs.add(us);
+      stats.ageMs.add((trackerClock() - s.time) * 1e3);
+    }
+
+    if (readRate > 0.0) {
+      next += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / readRate));
+      std::this_thread::sleep_until(next);
+    }
+  }
+}
+
+static void printReaders(const std::vector<ReaderStats> &readers)
+{
+  for (size_t i = 0; i < readers.size(); i++) {
+    const auto &r = readers[i];
+    printf("  reader %zu: %llu reads, %llu without a pose\n",
+        i,
+        (unsigned long long)r.numReads,
+        (unsigned long long)r.numMisses);
+    r.latencyUs.print("    read path", "us");
+    r.ageMs.print("    pose age");
+  }
+}
+
+// Writer at 'rate' Hz (0: flat out) cycling through 'trace', with the
+// publish time as sample time
+template <typename Publish>
+static uint64_t writerLoop(Publish publish,
+    const std::vector<TrackerSample> &trace,
+    double rate,
+    const std::atomic<bool> &done)
+{
+  uint64_t count = 0;
+  auto next = Clock::now();
+  while (!done) {
+    TrackerSample s = trace[count % trace.size()];
+    s.time = trackerClock();
+    publish(s);
+    count++;
+    if (rate > 0.0) {
+      next += std::chrono::duration_cast<Clock::duration>(
+          std::chrono::duration<double>(1.0 / rate));
+      std::this_thread::sleep_until(next);
+    }
+  }
+  return count;
+}
+
+template <typename Mailbox, typename Ring>
+static void stressMailbox(const char *name,
+    const std::vector<TrackerSample> &trace,
+    double rate,
+    double readRate,
+    int numReaders,
+    double seconds)
+{
+  Mailbox mailbox;
+  Ring ring;
+  std::atomic<bool> done{false};
+  std::vector<ReaderStats> readers(numReaders);
+
+  uint64_t numPublished = 0;
+  std::thread writer([&] {
+    numPublished = writerLoop(
+        [&](const TrackerSample &s) {
+          mailbox.publish(s);
+          ring.push(s);
+        },
+        trace,
+        rate,
+        done);
+  });
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numReaders; i++) {
+    threads.emplace_back([&, i] {
+      readerLoop(
+          [&](TrackerSample &s) {
+            return mailbox.tryRead(s) || ring.recent(&s, 1) == 1;
+          },
+          [&](TrackerSample *out, size_t n) { return ring.recent(out, n); },
+          readRate,
+          done,
+          readers[i]);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  done = true;
+  writer.join();
+  for (auto &t : threads)
+    t.join();
+
+  printf("%s: %.0f poses/s published\n", name, numPublished / seconds);
+  printReaders(readers);
+}
+
+// Sends "time x y z" datagrams to the receiver on the loopback interface
+static uint64_t udpSender(uint16_t port,
+    const std::vector<TrackerSample> &trace,
+    double rate,
+    const std::atomic<bool> &done)
+{
+  const int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  if (fd < 0)
+    return 0;
+  sockaddr_in addr = {};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+
+  const uint64_t count = writerLoop(
+      [&](const TrackerSample &s) {
+        char buf[128];
+        const int n = snprintf(buf,
+            sizeof(buf),
+            "%.6f %.6f %.6f %.6f\n",
+            s.time,
+            s.position.x,
+            s.position.y,
+            s.position.z);
+        sendto(fd, buf, size_t(n), 0, (sockaddr *)&addr, sizeof(addr));
+      },
+      trace,
+      rate,
+      done);
+  close(fd);
+  return count;
+}
+
+int main(int argc, char *argv[])
+{
+  double rate = 1000.0;
+  double readRate = 120.0;
+  int numReaders = 2;
+  double seconds = 3.0;
+  std::string traceFile;
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--rate") && i + 1 < argc)
+      rate = std::max(0.0, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--render-rate") && i + 1 < argc)
+      readRate = std::max(0.0, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--readers") && i + 1 < argc)
+      numReaders = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--seconds") && i + 1 < argc)
+      seconds = std::max(0.1, std::atof(argv[++i]));
+    else if (!std::strcmp(argv[i], "--trace") && i + 1 < argc)
+      traceFile = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--rate hz] [--render-rate hz] [--readers n] "
+          "[--seconds s] [--trace file]\n"
+          "  a rate of 0 runs the writer or the readers flat out\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  std::vector<TrackerSample> trace;
+  if (!traceFile.empty()) {
+    if (!loadTrackerTrace(traceFile.c_str(), trace)) {
+      fprintf(stderr, "could not load tracker trace '%s'\n", traceFile.c_str());
+      return 1;
+    }
+  } else {
+    trace = syntheticTrackerTrace(float3(1.5f, 1.68f, 1.5f), 10000, 1000.0);
+  }
+
+  printf("writer at %s, %d readers at %s, %.1fs per run\n\n",
+      rate > 0.0 ? (std::to_string(int(rate)) + " Hz").c_str() : "full speed",
+      numReaders,
+      readRate > 0.0 ? (std::to_string(int(readRate)) + " Hz").c_str()
+                     : "full speed",
+      seconds);
+
+  stressMailbox<SeqlockMailbox<TrackerSample>,
+      SeqlockRing<TrackerSample, TrackerReceiver::historySize>>(
+      "seqlock", trace, rate, readRate, numReaders, seconds);
+  printf("\n");
+  stressMailbox<MutexMailbox, MutexRing>(
+      "mutex", trace, rate, readRate, numReaders, seconds);
+  printf("\n");
+
+  // End to end: background receiver thread on a loopback UDP socket //
+
+  TrackerReceiver receiver;
+  if (!receiver.listenUdp(0)) {
+    perror("udp receiver");
+    return 1;
+  }
+  std::atomic<bool> done{false};
+  std::vector<ReaderStats> readers(numReaders);
+  uint64_t numSent = 0;
+  std::thread sender(
+      [&] { numSent = udpSender(receiver.boundPort, trace, rate, done); });
+  std::vector<std::thread> threads;
+  for (int i = 0; i < numReaders; i++) {
+    threads.emplace_back([&, i] {
+      readerLoop([&](TrackerSample &s) { return receiver.latest(s); },
+          [&](TrackerSample *out, size_t n) {
+            return receiver.recent(out, n);
+          },
+          readRate,
+          done,
+          readers[i]);
+    });
+  }
+
+  std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+  done = true;
+  sender.join();
+  for (auto &t : threads)
+    t.join();
+  receiver.stop();
+
+  printf("udp (port %u): %llu sent, %llu received, %llu malformed\n",
+      unsigned(receiver.boundPort),
+      (unsigned long long)numSent,
+      (unsigned long long)receiver.numReceived(),
+      (unsigned long long)receiver.numMalformed.load());
+  printReaders(readers);
+
+  return 0;
+}
@@ -0,0 +1,211 @@
+// Copyright 2023 Stefan Zellmann and Jefferson Amstutz
+// SPDX-License-Identifier: Apache-2.0
+
+// Sweeps the eye across the screen and beyond its edges and measures the
+// frame time of each strategy against the symmetric-frustum enlargement of
+// Strategy 2 (frustumEnlargement in Projection.h). A device that only traces
+// the imageRegion renders in constant time, one that traces the whole
+// widened frustum slows down with the enlargement. A linear fit of frame
+// time over enlargement summarizes this per strategy; --csv writes the
+// sweep for plotting:
+//
+//   wasted-rays [--steps 13] [--beyond 1.0] [--diagonal] [--csv file]
+
+// anari_cpp
+#include <anari/anari_cpp.hpp>
+// std
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+// ours
+#include "Projection.h"
+#include "Scene.h"
+#include "Strategies.h"
+#include "Timing.h"
+#include "anari-helpers.h"
+#include "tool-helpers.h"
+
+// Least squares fit of y = a + b * x
+static void linearFit(const std::vector<double> &x,
+    const std::vector<double> &y,
+    double &a,
+    double &b)
+{
+  const size_t n = x.size();
+  double sx = 0.0, sy = 0.0, sxx = 0.0, sxy = 0.0;
+  for (size_t i = 0; i < n; i++) {
+    sx += x[i];
+    sy += y[i];
+    sxx += x[i] * x[i];
+    sxy += x[i] * y[i];
+  }
+  const double det = n * sxx - sx * sx;
+  b = det != 0.0 ? (n * sxy - sx * sy) / det : 0.0;
+  a = n ? (sy - b * sx) / n : 0.0;
+}
+
+int main(int argc, char *argv[])
+{
+  int numSteps = 13;
+  int numFrames = 10;
+  float beyond = 1.f;
+  float distance = 1.5f;
+  bool diagonal = false;
+  std::string csvFile;
+  std::string libraryName = "environment";
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "--steps") && i + 1 < argc)
+      numSteps = std::max(2, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+      numFrames = std::max(1, std::atoi(argv[++i]));
+    else if (!std::strcmp(argv[i], "--beyond") && i + 1 < argc)
+      beyond = std::max(0.f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--distance") && i + 1 < argc)
+      distance = std::max(0.01f, float(std::atof(argv[++i])));
+    else if (!std::strcmp(argv[i], "--diagonal"))
+      diagonal = true;
+    else if (!std::strcmp(argv[i], "--csv") && i + 1 < argc)
+      csvFile = argv[++i];
+    else if (!std::strcmp(argv[i], "--library") && i + 1 < argc)
+      libraryName = argv[++i];
+    else {
+      fprintf(stderr,
+          "Usage: %s [--steps n] [-n frames] [--beyond widths] "
+          "[--distance d] [--diagonal] [--csv file] [--library name]\n",
+          argv[0]);
+      return 1;
+    }
+  }
+
+  // Setup ANARI device //
+
+  anari::Library library = nullptr;
+  auto device = newToolDevice(libraryName, library);
+  if (!device)
+    return 1;
+
+  auto world = newSampleWorld(device);
+
+  auto renderer = newSampleRenderer(device);
+
+  auto frame = anari::newObject<anari::Frame>(device);
+  uint2 imageSize = {800, 800};
+  anari::setParameter(device, frame, "size", imageSize);
+  anari::setParameter(device, frame, "channel.color", ANARI_UFIXED8_RGBA_SRGB);
+  anari::setParameter(device, frame, "world", world);
+  anari::setParameter(device, frame, "renderer", renderer);
+
+  std::vector<Strategy> strategies;
+  if (deviceHasExtension(library, "default", "ANARI_VSNRAY_CAMERA_MATRIX"))
+    strategies.push_back(Strategy::MatrixCamExtension);
+  strategies.push_back(Strategy::FixedFrame);
+  strategies.push_back(Strategy::MatricesToPerspective);
+
+  std::vector<anari::Camera> cameras;
+  for (Strategy s : strategies)
+    cameras.push_back(newStrategyCamera(device, s));
+
+  // Sweep //
+
+  float3 LL(0.f, 0.f, 0.f);
+  float3 LR(3.f, 0.f, 0.f);
+  float3 UR(3.f, 3.f, 0.f);
+  const float width = length(LR - LL);
+  const float height = length(UR - LR);
+
+  FILE *csv = csvFile.empty() ? nullptr : fopen(csvFile.c_str(), "w");
+  if (!csvFile.empty() && !csv)
+    fprintf(stderr, "could not open '%s' for writing\n", csvFile.c_str());
+  if (csv) {
+    fprintf(csv, "eye_x,eye_y,enlargement");
+    for (Strategy s : strategies)
+      fprintf(csv, ",strategy%d_ms", int(s));
+    fprintf(csv, "\n");
+  }
+
+  printf("%8s %8s %12s", "eye x", "eye y", "enlargement");
+  for (Strategy s : strategies)
+    printf("   strategy %d", int(s));
+  printf("\n");
+
+  std::vector<double> enlargements;
+  std::vector<std::vector<double>> times(strategies.size());
+
+  for (int step = 0; step < numSteps; step++) {
+    // From 'beyond' screen widths left of the screen to as far right of it
+    const float u = -beyond + (1.f + 2.f * beyond) * step / (numSteps - 1);
+    float3 eye(u * width, 0.56f * height, distance);
+    if (diagonal)
+      eye.y = u * height;
+
+    float3 dir, up;
+    float fovy, aspect;
+    float4 region;
+    offaxisStereoCamera(LL, LR, UR, eye, dir, up, fovy, aspect, region);
+    const float enlargement = frustumEnlargement(region);
+    enlargements.push_back(enlargement);
+
+    printf("%8.2f %8.2f %12.2f", eye.x, eye.y, enlargement);
+    if (csv)
+      fprintf(csv, "%f,%f,%f", eye.x, eye.y, enlargement);
+
+    for (size_t i = 0; i < strategies.size(); i++) {
+      setStrategyCameraParameters(
+          device, cameras[i], strategies[i], LL, LR, UR, eye);
+      anari::setParameter(device, frame, "camera", cameras[i]);
+      anari::commitParameters(device, frame);
+
+      // One warm-up frame after the camera change
+      anari::render(device, frame);
+      anari::wait(device, frame);
+
+      Stats render;
+      for (int f = 0; f < numFrames; f++) {
+        Timer timer;
+        anari::render(device, frame);
+        anari::wait(device, frame);
+        render.add(timer.elapsedMs());
+      }
+      times[i].push_back(render.mean());
+      printf(" %10.2fms", render.mean());
+      if (csv)
+        fprintf(csv, ",%f", render.mean());
+    }
+    printf("\n");
+    if (csv)
+      fprintf(csv, "\n");
+  }
+
+  if (csv) {
+    fclose(csv);
+    printf("Output: %s\n", csvFile.c_str());
+  }
+
+  // Summary: relative slope of frame time over enlargement; ~0 means only
+  // the visible region is traced, ~1 means the whole frustum is
+  printf("frame time ~ a + b * enlargement:\n");
+  for (size_t i = 0; i < strategies.size(); i++) {
+    double a, b;
+    linearFit(enlargements, times[i], a, b);
+    const double relative = a + b != 0.0 ? b / (a + b) : 0.0;
+    printf("  %-40s a %8.2fms  b %8.2fms  (%.0f%% of the cost scales)\n",
+        strategyName(strategies[i]),
+        a,
+        b,
+        100.0 * relative);
+  }
+
+  for (auto camera : cameras)
+    anari::release(device, camera);
+  anari::release(device, renderer);
+  anari::release(device, world);
+  anari::release(device, frame);
+  anari::release(device, device);
+
+  anari::unloadLibrary(library);
+
+  return 0;
+}